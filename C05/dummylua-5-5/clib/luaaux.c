@@ -123,7 +123,7 @@ typedef struct CallS {
 
 static int f_call(lua_State* L, void* ud) {
     CallS* c = cast(CallS*, ud);
-    luaD_call(L, c->func, c->nresult);
+    luaD_callnoyield(L, c->func, c->nresult);
     return LUA_OK;
 }
 
@@ -36,12 +36,16 @@ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
 
 #if defined(LLONG_MAX) 
 #define LUA_INTEGER long long
+#define LUA_MAXINTEGER LLONG_MAX
+#define LUA_MININTEGER LLONG_MIN
 #define LUA_NUMBER double
 
 #define LUA_INTEGER_FORMAT "%lld"
 #define LUA_NUMBER_FORMAT "%.14g"
 #else
 #define LUA_INTEGER int 
+#define LUA_MAXINTEGER INT_MAX
+#define LUA_MININTEGER INT_MIN
 #define LUA_NUMBER float 
 
 #define LUA_INTEGER_FORMAT "%d"
@@ -61,6 +65,7 @@ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
 #define LUA_ERRRUN 3 
 #define LUA_ERRLEXER 4
 #define LUA_ERRPARSER 5
+#define LUA_YIELD 6 // not an error, the coroutine is suspended
 
 #define cast(t, exp) ((t)(exp))
 #define savestack(L, o) ((o) - (L)->stack)
@@ -87,7 +92,7 @@ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
 #define LUA_MINSTACK 20
 #define LUA_STACKSIZE (2 * LUA_MINSTACK)
 #define LUA_EXTRASTACK 5
-#define LUA_MAXSTACK 15000
+#define LUA_MAXSTACK 1000000
 #define LUA_ERRORSTACK 200
 #define LUA_MULRET -1
 #define LUA_MAXCALLS 200
@@ -126,6 +131,10 @@ typedef ptrdiff_t   l_mem;
 
 typedef LUA_UNSIGNED lua_Unsigned;
 
+// wrap-around conversions between signed and unsigned integers
+#define l_castS2U(i) ((lua_Unsigned)(i))
+#define l_castU2S(i) ((lua_Integer)(i))
+
 // vm
 typedef int Instruction;
 
@@ -6,6 +6,7 @@
 #include "../vm/luado.h"
 #include "luatable.h"
 #include "luadebug.h"
+#include "../vm/luavm.h"
 
 #define MAX_NUMBER_STR_SIZE 64
 
@@ -149,6 +150,35 @@ static int luaB_getmetatable(struct lua_State* L) {
 	return 1;
 }
 
+// select('#', ...) returns the number of extra arguments, select(n, ...) returns
+// all of them from the n-th one on, negative n counts from the end
+static int luaB_select(struct lua_State* L) {
+	int n = lua_gettop(L);
+	TValue* o = index2addr(L, 1);
+	if ((ttisshrstr(o) || ttislngstr(o)) && *getstr(gco2ts(gcvalue(o))) == '#') {
+		lua_pushinteger(L, n - 1);
+		return 1;
+	}
+
+	lua_Integer i = 0;
+	if (!luaV_tointeger(L, o, &i)) {
+		luaG_runerror(L, "%s", "select:number expected");
+	}
+
+	if (i < 0) {
+		i = n + i;
+	}
+	else if (i > n) {
+		i = n;
+	}
+
+	if (i < 1) {
+		luaG_runerror(L, "%s", "select:index out of range");
+	}
+
+	return n - cast(int, i); // the values are already on the top of the stack
+}
+
 static int luaB_collectgarbage(struct lua_State* L) {
 	luaC_fullgc(L);
 	return 0;
@@ -161,6 +191,7 @@ const lua_Reg base_reg[] = {
 	{ "pairs", luaB_pairs },
 	{ "setmetatable", luaB_setmetatable },
 	{ "getmetatable", luaB_getmetatable },
+	{ "select", luaB_select },
 	{ "collectgarbage", luaB_collectgarbage },
 	{ NULL, NULL },
 };
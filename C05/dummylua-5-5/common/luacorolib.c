@@ -0,0 +1,164 @@
+#include "luacorolib.h"
+#include "../clib/luaaux.h"
+#include "../vm/luagc.h"
+#include "../vm/luado.h"
+#include "luadebug.h"
+
+static struct lua_State* getco(struct lua_State* L) {
+	TValue* o = index2addr(L, 1);
+	if (!ttisthread(o)) {
+		luaG_runerror(L, "%s", "coroutine expected");
+	}
+	return thvalue(o);
+}
+
+// move narg arguments to co and resume it. The results are moved back and
+// their number returned, or the error is on the top of L and -1 returned
+static int auxresume(struct lua_State* L, struct lua_State* co, int narg) {
+	if (!lua_checkstack(co, narg)) {
+		lua_pushstring(L, "too many arguments to resume");
+		return -1;
+	}
+
+	if (co->status == LUA_OK && co->ci == &co->base_ci && lua_gettop(co) == 0) {
+		lua_pushstring(L, "cannot resume dead coroutine");
+		return -1;
+	}
+
+	lua_xmove(L, co, narg);
+	int status = lua_resume(co, L, narg);
+	if (status == LUA_OK || status == LUA_YIELD) {
+		int nres = lua_gettop(co);
+		if (!lua_checkstack(L, nres + 1)) {
+			lua_settop(co, -nres);
+			lua_pushstring(L, "too many results to resume");
+			return -1;
+		}
+		lua_xmove(co, L, nres);
+		return nres;
+	}
+	else {
+		lua_xmove(co, L, 1); // the error
+		return -1;
+	}
+}
+
+static int luaB_cocreate(struct lua_State* L) {
+	if (!lua_tofunction(L, 1)) {
+		luaG_runerror(L, "%s", "coroutine.create:function expected");
+	}
+
+	struct lua_State* NL = lua_newthread(L);
+	lua_pushvalue(L, 1);
+	lua_xmove(L, NL, 1); // the body is the first value on the new stack
+	return 1;
+}
+
+// true and what the coroutine yielded or returned, or false and the error
+static int luaB_coresume(struct lua_State* L) {
+	struct lua_State* co = getco(L);
+	int r = auxresume(L, co, lua_gettop(L) - 1);
+
+	TValue b;
+	if (r < 0) {
+		setbvalue(&b, false);
+		lua_insert(L, -1, &b);
+		return 2;
+	}
+
+	setbvalue(&b, true);
+	if (r > 0) {
+		lua_insert(L, -r, &b);
+	}
+	else {
+		setobj(L->top, &b);
+		increase_top(L);
+	}
+	return r + 1;
+}
+
+static int luaB_auxwrap(struct lua_State* L) {
+	struct lua_State* co = thvalue(index2addr(L, lua_upvalueindex(1)));
+	int r = auxresume(L, co, lua_gettop(L));
+	if (r < 0) {
+		luaD_throw(L, LUA_ERRRUN); // pass the error of the coroutine on
+	}
+	return r;
+}
+
+static int luaB_cowrap(struct lua_State* L) {
+	luaB_cocreate(L);
+	lua_pushCclosure(L, luaB_auxwrap, 1);
+	return 1;
+}
+
+static int luaB_yield(struct lua_State* L) {
+	return lua_yield(L, lua_gettop(L));
+}
+
+static int luaB_costatus(struct lua_State* L) {
+	struct lua_State* co = getco(L);
+	if (L == co) {
+		lua_pushstring(L, "running");
+		return 1;
+	}
+
+	switch (co->status) {
+	case LUA_YIELD: {
+		lua_pushstring(L, "suspended");
+	} break;
+	case LUA_OK: {
+		if (co->ci != &co->base_ci) { // it has resumed another coroutine
+			lua_pushstring(L, "normal");
+		}
+		else if (lua_gettop(co) == 0) {
+			lua_pushstring(L, "dead");
+		}
+		else {
+			lua_pushstring(L, "suspended"); // not started yet
+		}
+	} break;
+	default: { // it has raised an error
+		lua_pushstring(L, "dead");
+	} break;
+	}
+
+	return 1;
+}
+
+static int luaB_isyieldable(struct lua_State* L) {
+	lua_pushboolean(L, L->nny == 0);
+	return 1;
+}
+
+static int luaB_corunning(struct lua_State* L) {
+	setgco(L->top, obj2gco(L));
+	increase_top(L);
+	lua_pushboolean(L, L == G(L)->mainthread);
+	return 2;
+}
+
+static const lua_Reg co_reg[] = {
+	{ "create", luaB_cocreate },
+	{ "resume", luaB_coresume },
+	{ "running", luaB_corunning },
+	{ "status", luaB_costatus },
+	{ "wrap", luaB_cowrap },
+	{ "yield", luaB_yield },
+	{ "isyieldable", luaB_isyieldable },
+	{ NULL, NULL },
+};
+
+int luaB_opencoroutine(struct lua_State* L) {
+	lua_createtable(L);
+
+	for (int i = 0; i < (sizeof(co_reg) / sizeof(co_reg[0])); i++) {
+		if (co_reg[i].name && co_reg[i].func) {
+			lua_pushstring(L, co_reg[i].name);
+			lua_pushCclosure(L, co_reg[i].func, 0);
+			lua_settable(L, -3);
+		}
+	}
+
+	return 1;
+}
@@ -0,0 +1,8 @@
+#ifndef luacorolib_h
+#define luacorolib_h
+
+#include "luastate.h"
+
+int luaB_opencoroutine(struct lua_State* L);
+
+#endif
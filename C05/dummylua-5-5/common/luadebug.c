@@ -6,6 +6,9 @@
 #include "luastate.h"
 #include "../vm/luaopcodes.h"
 
+#define LEVELS1 10	// size of the first part of the traceback
+#define LEVELS2 11	// size of the second part of the traceback
+
 static TString* getfuncname(struct lua_State* L, struct CallInfo* ci) {
 	TString* ts;
 	if (!ci) {
@@ -19,7 +22,7 @@ static TString* getfuncname(struct lua_State* L, struct CallInfo* ci) {
 		Instruction i = cl->p->code[pc];
 		if (GET_OPCODE(i) == OP_CALL) {
 			int narg = GET_ARG_B(i);
-			switch (GET_OPCODE(cl->p->code[pc - narg])) {
+			switch (luaP_genericop(GET_OPCODE(cl->p->code[pc - narg]))) {
 			case OP_MOVE: {
 				int arg_b = GET_ARG_B(cl->p->code[pc - narg]);
 				ts = cl->p->locvars[arg_b].varname;
@@ -58,14 +61,35 @@ void luaG_runerror(struct lua_State* L, const char* fmt, ...) {
 	luaO_pushfvstring(L, fmt, argp);
 	va_end(argp);
 
+	// deep recursion can leave a huge number of frames, only the innermost
+	// LEVELS1 and the outermost LEVELS2 ones are reported
+	int nlevels = 0;
+	for (struct CallInfo* ci = L->ci; ci != &L->base_ci; ci = ci->previous) {
+		if (ci->callstatus & CIST_LUA) {
+			nlevels++;
+		}
+	}
+
+	int level = 0;
 	for (struct CallInfo* ci = L->ci; ci != &L->base_ci; ci = ci->previous) {
 		if (ci->callstatus & CIST_LUA) {
 			n++;
 
+			level++;
+			if (level > LEVELS1 && level <= nlevels - LEVELS2) {
+				if (level == LEVELS1 + 1) {
+					luaO_pushfstring(L, "\t ...\n");
+					luaO_concat(L, L->top - 2, L->top - 1, L->top - 2);
+					L->top--;
+				}
+				continue;
+			}
+
 			struct LClosure* cl = gco2lclosure(gcvalue(ci->func));
 			struct Proto* p = cl->p;
 
-			TString* ts = getfuncname(L, ci->previous);
+			// the caller of a reused frame is gone, so its name can not be recovered
+			TString* ts = (ci->callstatus & CIST_TAIL) ? luaS_newliteral(L, "(...tail calls...)") : getfuncname(L, ci->previous);
 			luaO_pushfstring(L, "\t %s line:%d in %s\n", getstr(p->source), p->line[ci->l.savedpc - p->code - 1], getstr(ts));
 
 			luaO_concat(L, L->top - 2, L->top - 1, L->top - 2);
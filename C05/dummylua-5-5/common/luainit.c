@@ -21,10 +21,12 @@ SOFTWARE.*/
 #include "../clib/luaaux.h"
 #include "luabase.h"
 #include "lualoadlib.h"
+#include "luacorolib.h"
 
 const lua_Reg reg[] = {
 	{ "_G", luaB_openbase },
 	{ "package", luaB_openpackage },
+	{ "coroutine", luaB_opencoroutine },
 	{ NULL, NULL },
 };
 
@@ -25,7 +25,7 @@ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
 #include "../vm/luado.h"
 #include "luadebug.h"
 
-#define arithint(op, v1, v2) (v1->value_.i = (v1->value_.i op v2->value_.i))
+#define arithint(op, v1, v2) (v1->value_.i = l_castU2S(l_castS2U(v1->value_.i) op l_castS2U(v2->value_.i)))
 #define arithnum(op, v1, v2) (v1->value_.n = (v1->value_.n op v2->value_.n))
 
 const TValue luaO_nilobject_ = { {NULL}, LUA_TNIL };
@@ -39,15 +39,40 @@ int luaO_ceillog2(lua_Integer value) {
     return -1;
 }
 
+// a size hint of OP_NEWTABLE only has 9 bits, so it is stored as
+// (1xxx) * 2 ^ (eeeee - 1) when eeeee != 0, and as xxx otherwise
+int luaO_int2fb(unsigned int x) {
+	int e = 0;
+	if (x < 8) return x;
+	while (x >= (8 << 4)) {
+		x = (x + 0xf) >> 4;
+		e += 4;
+	}
+	while (x >= (8 << 1)) {
+		x = (x + 1) >> 1;
+		e++;
+	}
+	return ((e + 1) << 3) | (cast(int, x) - 8);
+}
+
+int luaO_fb2int(int x) {
+	return (x < 8) ? x : ((x & 7) + 8) << ((x >> 3) - 1);
+}
+
 static void intarith(struct lua_State* L, int op, TValue* v1, TValue* v2) {
 	switch (op) {
 	case LUA_OPT_BAND:	arithint(&, v1, v2); break;
 	case LUA_OPT_BOR:	arithint(|, v1, v2); break;
 	case LUA_OPT_BXOR:	arithint(^, v1, v2); break;
 	case LUA_OPT_BNOT:	v1->value_.i = ~v1->value_.i; break;
-	case LUA_OPT_IDIV:  arithint(/, v1, v2); break;
-	case LUA_OPT_SHL:	arithint(<<, v1, v2); break;
-	case LUA_OPT_SHR:	arithint(>>, v1, v2); break;
+	case LUA_OPT_SHL:	v1->value_.i = luaV_shiftl(v1->value_.i, v2->value_.i); break;
+	case LUA_OPT_SHR:	v1->value_.i = luaV_shiftl(v1->value_.i, -v2->value_.i); break;
+	case LUA_OPT_UMN:	v1->value_.i = l_castU2S(0u - l_castS2U(v1->value_.i)); break;
+	case LUA_OPT_ADD:	arithint(+, v1, v2); break;
+	case LUA_OPT_SUB:	arithint(-, v1, v2); break;
+	case LUA_OPT_MUL:	arithint(*, v1, v2); break;
+	case LUA_OPT_IDIV:  v1->value_.i = luaV_div(L, v1->value_.i, v2->value_.i); break;
+	case LUA_OPT_MOD:	v1->value_.i = luaV_mod(L, v1->value_.i, v2->value_.i); break;
 	default:luaG_runerror(L, "intarith:unknow int op %c \n", cast(char, op)); break;
 	}
 }
@@ -59,27 +84,43 @@ static void numarith(struct lua_State* L, int op, TValue* v1, TValue* v2) {
 	case LUA_OPT_ADD: arithnum(+, v1, v2); break;
 	case LUA_OPT_SUB: arithnum(-, v1, v2); break;
 	case LUA_OPT_MUL: arithnum(*, v1, v2); break;
-	case LUA_OPT_MOD: v1->value_.n = fmod(v1->value_.n, v2->value_.n); break;
+	case LUA_OPT_IDIV: v1->value_.n = floor(v1->value_.n / v2->value_.n); break;
+	case LUA_OPT_MOD: {
+		lua_Number m = fmod(v1->value_.n, v2->value_.n);
+		if (m * v2->value_.n < 0) { // the result takes the sign of the divisor
+			m += v2->value_.n;
+		}
+		v1->value_.n = m;
+	} break;
 	case LUA_OPT_POW: v1->value_.n = pow(v1->value_.n, v2->value_.n); break;
 	default:luaG_runerror(L, "intarith:unknow int op %c \n", cast(char, op)); break;
 	}
 }
 
+// bitwise operators always work on integers, '/' and '^' always on floats,
+// the other ones keep the integer subtype when both operands are integers
 int luaO_arith(struct lua_State* L, int op, TValue* v1, TValue* v2) {
 	switch (op) {
 	case LUA_OPT_BAND: case LUA_OPT_BOR: case LUA_OPT_BXOR: case LUA_OPT_BNOT:
-	case LUA_OPT_IDIV: case LUA_OPT_SHL: case LUA_OPT_SHR: {
+	case LUA_OPT_SHL: case LUA_OPT_SHR: {
 		lua_Integer i1, i2;
 		if (!luaV_tointeger(L, v1, &i1) || !luaV_tointeger(L, v2, &i2))
 			return 0;
 
 		setivalue(v1, i1);
-		setivalue(v2, i2);
+		TValue iv2;
+		setivalue(&iv2, i2);
 
-		intarith(L, op, v1, v2);
+		intarith(L, op, v1, &iv2);
 	} return 1;
-	case LUA_OPT_UMN: case LUA_OPT_DIV: case LUA_OPT_ADD: case LUA_OPT_SUB:
-	case LUA_OPT_MUL: case LUA_OPT_POW: case LUA_OPT_MOD: {
+	case LUA_OPT_UMN: case LUA_OPT_ADD: case LUA_OPT_SUB: case LUA_OPT_MUL:
+	case LUA_OPT_IDIV: case LUA_OPT_MOD: {
+		if (ttisinteger(v1) && ttisinteger(v2)) {
+			intarith(L, op, v1, v2);
+			return 1;
+		}
+	} // fall through, at least one of them is not an integer
+	case LUA_OPT_DIV: case LUA_OPT_POW: {
 		lua_Number n1, n2;
 		if (!luaV_tonumber(L, v1, &n1) || !luaV_tonumber(L, v2, &n2)) {
 			return 0;
@@ -99,31 +140,56 @@ int luaO_arith(struct lua_State* L, int op, TValue* v1, TValue* v2) {
 	return 0;
 }
 
-int luaO_concat(struct lua_State* L, TValue* arg1, TValue* arg2, TValue* target) {
-	if (!ttisshrstr(arg1) && !ttislngstr(arg1)) {
-		return 0;
+// the number in obj becomes the string tostring gives for it
+void luaO_tostr(struct lua_State* L, TValue* obj) {
+	char buff[MAXNUMBER2STR];
+	int len;
+	if (ttisinteger(obj)) {
+		len = l_sprintf(buff, sizeof(buff), LUA_INTEGER_FORMAT, obj->value_.i);
 	}
+	else {
+		len = l_sprintf(buff, sizeof(buff), LUA_NUMBER_FORMAT, obj->value_.n);
+	}
+	setgco(obj, obj2gco(luaS_newlstr(L, buff, len)));
+}
 
-	if (!ttisshrstr(arg2) && !ttislngstr(arg2)) {
-		return 0;
+// the n strings from first on joined into one. The total length is known
+// before anything is copied, so a long result is written straight into its
+// TString, a short one goes through a buffer on the C stack to be interned
+TString* luaO_strjoin(struct lua_State* L, const TValue* first, int n) {
+	size_t l = 0;
+	for (int i = 0; i < n; i++) {
+		TString* s = gco2ts(gcvalue(first + i));
+		l += tsslen(s);
+	}
+
+	char buff[MAXSHORTSTR];
+	TString* ts = NULL;
+	char* p = buff;
+	if (l > MAXSHORTSTR) {
+		ts = luaS_createlngstrobj(L, l);
+		p = getstr(ts);
 	}
 
-	TString* o1 = gco2ts(gcvalue(arg1));
-	TString* o2 = gco2ts(gcvalue(arg2));
+	for (int i = 0; i < n; i++) {
+		TString* s = gco2ts(gcvalue(first + i));
+		size_t sl = tsslen(s);
+		memcpy(p, getstr(s), sl);
+		p += sl;
+	}
 
-	char* s1 = getstr(o1);
-	char* s2 = getstr(o2);
-	int s1_sz = strlen(s1);
-	int s2_sz = strlen(s2);
+	return ts ? ts : luaS_newlstr(L, buff, l);
+}
 
-	char* new_s = (char*)malloc(s1_sz + s2_sz + 1);
-	memcpy(new_s, s1, s1_sz);
-	memcpy(new_s + s1_sz, s2, s2_sz);
-	new_s[s1_sz + s2_sz] = '\0';
-	TString* ts = luaS_new(L, new_s, s1_sz + s2_sz + 1);
-	free(new_s);
+int luaO_concat(struct lua_State* L, TValue* arg1, TValue* arg2, TValue* target) {
+	if (novariant(arg1) != LUA_TSTRING || novariant(arg2) != LUA_TSTRING) {
+		return 0;
+	}
 
-	setgco(target, obj2gco(ts));
+	TValue pair[2];
+	setobj(&pair[0], arg1);
+	setobj(&pair[1], arg2);
+	setgco(target, obj2gco(luaO_strjoin(L, pair, 2)));
 
 	return 1;
 }
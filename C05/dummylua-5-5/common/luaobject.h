@@ -57,6 +57,7 @@ typedef void* (*lua_Alloc)(void* ud, void* ptr, size_t osize, size_t nsize);
 
 #define luaO_nilobject (&luaO_nilobject_)
 #define MAXSHORTSTR 40
+#define MAXNUMBER2STR 64 // a number printed by tostring fits in here
 #define MAXUPVAL 255
 #define MAXLOCALVAR 200
 
@@ -84,6 +85,7 @@ typedef void* (*lua_Alloc)(void* ud, void* ptr, size_t osize, size_t nsize);
 #define ttislcf(o) ((o)->tt_ == LUA_TLCF)
 #define ttisboolean(o) (novariant(o) == LUA_TBOOLEAN)
 #define ttisnil(o) ((o)->tt_ == LUA_TNIL)
+#define ttisthread(o) ((o)->tt_ == LUA_TTHREAD)
 
 #define l_false(o) (ttisnil(o) || ttisboolean(o) && (o)->value_.b == 0)
 #define is_lua(o) ((o)->tt_ == LUA_TLCL)
@@ -148,7 +150,7 @@ typedef struct Node {
     TValue value;
 } Node;
 
-const Node dummynode_;
+extern Node dummynode_; // empty hash part shared by all tables, defined in luatable.c
 
 struct Table {
     CommonHeader;
@@ -159,9 +161,22 @@ struct Table {
     Node* lastfree;
     struct GCObject* gclist;
 	struct Table* metatable;
+	lu_byte flags;  // 1 << e means that metamethod e is absent when this table is a metatable, see luatm.h
+	lu_byte inchain; // a cached __index lookup went through this table, see luaV_finishget
+	unsigned int lenhint; // border found by the last luaH_getn, tried first next time
 };
 
 // compiler and vm structs
+
+// inline cache of a table access with a constant short string key, one per
+// instruction. It remembers where the key was found the last time, and is
+// only trusted while the table still uses the same node array and the node
+// at slot still holds the key
+typedef struct ICache {
+    Node* node;
+    unsigned int slot;
+} ICache;
+
 typedef struct LocVar {
     TString* varname;
     int startpc;
@@ -174,6 +189,10 @@ typedef struct Upvaldesc {
     TString* name;
 } Upvaldesc;
 
+// a function compiled ahead of time by luatoc, see vm/luaaot.h
+struct CallInfo;
+typedef const Instruction* (*lua_AOTFunction)(struct lua_State* L, struct CallInfo* ci, const Instruction* pc);
+
 typedef struct Proto {
     CommonHeader;
 	int* line;
@@ -193,6 +212,15 @@ typedef struct Proto {
     TString* source;
     struct GCObject* gclist;
 	int maxstacksize;
+	ICache* cache;      // inline caches, indexed like code
+	int sizecache;
+	struct JitCode* jit; // native code, see luajit.c
+	int hotcount;       // calls and loop iterations left before the jit compiles it
+	struct JitLoop* loops; // hot counters and traces of the loop back edges, indexed like code
+	int sizeloops;
+	int ndeopt;         // how many quickened instructions fell back to their generic form
+	lu_byte noquicken;  // too many fallbacks, stop specializing this function
+	lua_AOTFunction aot; // runs the function instead of the interpreter, NULL if it was parsed at runtime
 } Proto;
 
 typedef struct LClosure {
@@ -227,8 +255,12 @@ typedef struct Udata {
 			(o)->tt_ = (u)->ttuv_; (o)->value_ = (u)->user_
 
 int luaO_ceillog2(lua_Integer value);
+int luaO_int2fb(unsigned int x); // encode x as a "floating point byte" (eeeeexxx), rounding up
+int luaO_fb2int(int x);
 int luaO_arith(struct lua_State* L, int op, TValue* v1, TValue* v2); // the result will store in v1
 int luaO_concat(struct lua_State* L, TValue* arg1, TValue* arg2, TValue* target);
+TString* luaO_strjoin(struct lua_State* L, const TValue* first, int n); // all n values must be strings
+void luaO_tostr(struct lua_State* L, TValue* obj); // obj must be a number
 TString* luaO_pushfstring(struct lua_State* L, const char* fmt, ...);
 TString* luaO_pushfvstring(struct lua_State* L, const char* fmt, va_list argp);
 
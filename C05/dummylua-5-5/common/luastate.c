@@ -29,6 +29,8 @@ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
 #include "luadebug.h"
 #include "luaobject.h"
 #include "luatm.h"
+#include "../vm/luajit.h"
+#include "../vm/luado.h"
 
 typedef struct LX {
     lu_byte extra_[LUA_EXTRASPACE];
@@ -41,20 +43,15 @@ typedef struct LG {
 } LG;
 
 static void stack_init(struct lua_State* L) {
-    L->stack = (StkId)luaM_realloc(L, NULL, 0, LUA_STACKSIZE * sizeof(TValue));
-    L->stack_size = LUA_STACKSIZE;
-    L->stack_last = L->stack + LUA_STACKSIZE - LUA_EXTRASTACK;
+    L->stack = NULL;
+    L->stack_size = 0;
+    luaD_reallocstack(L, LUA_STACKSIZE);
     L->previous = NULL;
     L->status = LUA_OK;
     L->errorjmp = NULL;
     L->top = L->stack;
     L->errorfunc = 0;
 	L->openupval = NULL;
-
-    int i;
-    for (i = 0; i < L->stack_size; i++) {
-        setnilvalue(L->stack + i);
-    }
     L->top++;
 
     L->ci = &L->base_ci;
@@ -136,9 +133,25 @@ struct lua_State* lua_newstate(lua_Alloc alloc, void* ud) {
     g->seed = makeseed(L);
 	g->gcfinnum = 0;
 
+	g->jitmode = LUAJ_METHOD;
+	g->recording = 0;
+	g->inlining = 1;
+	g->tracestate = NULL;
+	g->chainepoch = 1;
+	for (int i = 0; i < INDEXCACHE_SIZE; i++) {
+		g->indexcache[i].mt = NULL;
+		g->indexcache[i].key = NULL;
+		setnilvalue(&g->indexcache[i].value);
+		g->indexcache[i].epoch = 0;
+	}
+
     L->marked = luaC_white(g);
     L->gclist = NULL;
-	L->nny = 0;
+	L->nny = 1; // the main thread can not yield
+	L->ncalls = 0;
+	L->twups = L;
+	g->twups = NULL;
+	g->quickening = 1;
 
     stack_init(L);
     luaS_init(L);
@@ -151,10 +164,17 @@ struct lua_State* lua_newstate(lua_Alloc alloc, void* ud) {
 
 #define fromstate(L) (cast(LX*, cast(lu_byte*, (L)) - offsetof(LX, l)))
 
-static void free_stack(struct lua_State* L) {
-    luaM_free(L, L->stack, sizeof(TValue));
-    L->stack = L->stack_last = L->top = NULL;
-    L->stack_size = 0;
+static void free_ci(struct lua_State* L, struct lua_State* L1) {
+    struct CallInfo* base_ci = &L1->base_ci;
+    struct CallInfo* ci = base_ci->next;
+
+    while(ci) {
+        struct CallInfo* block = ci;
+        ci = block[CI_BLOCKSIZE - 1].next;
+        luaM_free(L, block, CI_BLOCKSIZE * sizeof(struct CallInfo));
+    }
+    base_ci->next = NULL;
+    L1->nci = 0;
 }
 
 void lua_close(struct lua_State* L) {
@@ -162,20 +182,90 @@ void lua_close(struct lua_State* L) {
     struct lua_State* L1 = g->mainthread; // only mainthread can be close
 
     luaC_freeallobjects(L);
+    luaJ_close(L);
     
-    struct CallInfo* base_ci = &L1->base_ci;
-    struct CallInfo* ci = base_ci->next;
+    free_ci(L, L1);
+    luaD_freestack(L1);    
+    (*g->frealloc)(g->ud, fromstate(L1), sizeof(LG), 0);
+}
 
-    while(ci) {
-        struct CallInfo* next = ci->next;
-        struct CallInfo* free_ci = ci;
+// a coroutine shares the global state of L. Its stack starts as small as the
+// one of the main thread and grows on demand
+struct lua_State* lua_newthread(struct lua_State* L) {
+    struct global_State* g = G(L);
+    luaC_checkgc(L);
+
+    LX* lx = cast(LX*, luaM_realloc(L, NULL, 0, sizeof(LX)));
+    struct lua_State* L1 = &lx->l;
+    L1->marked = luaC_white(g);
+    L1->tt_ = LUA_TTHREAD;
+    L1->next = g->allgc;
+    g->allgc = obj2gco(L1);
+    setgco(L->top, obj2gco(L1));
+    increase_top(L);
 
-        luaM_free(L, free_ci, sizeof(struct CallInfo));
-        ci = next;
+    G(L1) = g;
+    L1->nci = 0;
+    L1->nny = 1; // lua_resume allows it to yield
+    L1->ncalls = 0;
+    L1->gclist = NULL;
+    L1->twups = L1;
+    L1->openupval = NULL;
+    L1->stack = NULL;
+    L1->base_ci.next = NULL;
+    stack_init(L1);
+
+    return L1;
+}
+
+// called by the collector. Upvalues still open on the stack of L1 are closed
+// so the closures sharing them keep working
+void luaE_freethread(struct lua_State* L, struct lua_State* L1) {
+    UpVal* upval = L1->openupval;
+    while (upval) {
+        UpVal* current = upval;
+        upval = upval->u.open.next;
+
+        if (current->refcount <= 0) {
+            luaM_free(L, current, sizeof(UpVal));
+        }
+        else {
+            setobj(&current->u.value, current->v);
+            current->v = &current->u.value;
+        }
     }
+    L1->openupval = NULL;
 
-    free_stack(L1);    
-    (*g->frealloc)(g->ud, fromstate(L1), sizeof(LG), 0);
+    free_ci(L, L1);
+    luaD_freestack(L1);
+    luaM_free(L, fromstate(L1), sizeof(LX));
+}
+
+int lua_checkstack(struct lua_State* L, int n) {
+    if (L->stack_last - L->top <= n) {
+        int inuse = cast(int, L->top - L->stack) + LUA_EXTRASTACK;
+        if (inuse > LUA_MAXSTACK - n) {
+            return 0;
+        }
+        luaD_growstack(L, n);
+    }
+
+    if (L->ci->top < L->top + n) {
+        L->ci->top = L->top + n;
+    }
+    return 1;
+}
+
+void lua_xmove(struct lua_State* from, struct lua_State* to, int n) {
+    if (from == to) {
+        return;
+    }
+
+    from->top -= n;
+    for (int i = 0; i < n; i++) {
+        setobj(to->top, from->top + i);
+        increase_top(to);
+    }
 }
 
 void setivalue(StkId target, lua_Integer integer) {
@@ -454,6 +544,7 @@ int lua_setmetatable(struct lua_State* L, int idx) {
 	case LUA_TTABLE: {
 		struct Table* t = gco2tbl(gcvalue(obj));
 		t->metatable = mt;
+		G(L)->chainepoch++; // a cached __index chain may go through t
 
 		TValue o;
 		setgco(&o, obj2gco(mt));
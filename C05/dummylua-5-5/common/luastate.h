@@ -36,6 +36,9 @@ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
 #define STRCACHE_M 53
 #define STRCACHE_N 2
 
+// size for the __index chain cache, must be a power of 2
+#define INDEXCACHE_SIZE 256
+
 #define LUA_MAINTHREADIDX 0
 #define LUA_GLOBALTBLIDX 1
 #define LUA_REGISTRYINDEX (-LUA_MAXSTACK - 1)
@@ -43,6 +46,21 @@ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
 
 typedef TValue* StkId;
 
+// the result of looking up key through the __index tables reachable from
+// metatable mt. It is valid while epoch is equal to global_State.chainepoch
+typedef struct IndexCache {
+    struct Table* mt;
+    TString* key;
+    TValue value;
+    unsigned int epoch;
+} IndexCache;
+
+// CallInfos past base_ci are allocated CI_BLOCKSIZE at a time as one
+// contiguous block, and their next/previous links are set up once when the
+// block is created. The blocks never move, so a CallInfo pointer stays valid
+// while its frame is alive
+#define CI_BLOCKSIZE 32
+
 struct CallInfo {
     StkId func;
     StkId top;
@@ -74,6 +92,8 @@ typedef struct lua_State {
     int ncalls;
     struct GCObject* gclist;
 	struct UpVal* openupval;
+	struct lua_State* twups;    // next thread with open upvalues, itself when it is not in the list
+	ptrdiff_t yieldfunc;        // where the function of the c frame that yielded was, see lua_yield
 } lua_State;
 
 // only for short string
@@ -118,6 +138,14 @@ typedef struct global_State {
     int GCstepmul;
 	struct Table* mt[LUA_NUMS];
 	TString* tmnames[TM_TOTAL];
+	IndexCache indexcache[INDEXCACHE_SIZE];
+	unsigned int chainepoch;        // changes whenever a table in a cached __index chain is modified
+	lu_byte jitmode;                // LUAJ_OFF, LUAJ_METHOD or LUAJ_TRACE, when built with the jit
+	lu_byte recording;              // the tracing jit is recording a loop, see luaJ_record
+	lu_byte inlining;               // the compiler inlines small local functions, see luaK_setinline
+	struct TraceState* tracestate;  // recorder and trace cache of the tracing jit
+	struct lua_State* twups;        // threads with open upvalues, see remarkupvals
+	lu_byte quickening;             // instructions specialize themselves on their operand types, see luaV_setquicken
 } global_State;
 
 // GCUnion
@@ -133,6 +161,13 @@ union GCUnion {
 
 struct lua_State* lua_newstate(lua_Alloc alloc, void* ud);
 void lua_close(struct lua_State* L);
+struct lua_State* lua_newthread(struct lua_State* L);  // create a coroutine and push it onto the stack
+void luaE_freethread(struct lua_State* L, struct lua_State* L1);
+
+int lua_resume(struct lua_State* L, struct lua_State* from, int nargs); // start or continue L with the nargs values on its top
+int lua_yield(struct lua_State* L, int nresults);  // only as 'return lua_yield(L, n)' in a c function
+int lua_checkstack(struct lua_State* L, int n);     // make room for n more values, 0 if it can not
+void lua_xmove(struct lua_State* from, struct lua_State* to, int n); // pop n values from 'from' and push them onto 'to'
 
 void setivalue(StkId target, lua_Integer integer);
 void setfvalue(StkId target, lua_CFunction f);
@@ -84,7 +84,9 @@ static struct TString* createstrobj(struct lua_State* L, const char* str, int ta
 
     struct GCObject* o = luaC_newobj(L, tag, total_size);
     struct TString* ts = gco2ts(o);
-    memcpy(getstr(ts), str, l * sizeof(char));
+    if (str) {
+        memcpy(getstr(ts), str, l * sizeof(char));
+    }
     getstr(ts)[l] = '\0';
     ts->extra = 0;
 
@@ -214,6 +216,11 @@ struct TString* luaS_createlongstr(struct lua_State* L, const char* str, size_t
     return createstrobj(L, str, LUA_LNGSTR, l, G(L)->seed);
 }
 
+// a long string of length l, the caller writes its contents
+struct TString* luaS_createlngstrobj(struct lua_State* L, size_t l) {
+    return createstrobj(L, NULL, LUA_LNGSTR, l, G(L)->seed);
+}
+
 Udata* luaS_newuserdata(struct lua_State* L, int size) {
 	struct GCObject* gco = luaC_newobj(L, LUA_TUSERDATA, sizeof(Udata) + size);
 	Udata* u = gco2u(gco);
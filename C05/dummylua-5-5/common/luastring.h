@@ -26,6 +26,7 @@ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
 
 #define sizelstring(l) (sizeof(TString) + (l + 1) * sizeof(char))
 #define getstr(ts) (ts->data)
+#define tsslen(ts) ((ts)->tt_ == LUA_SHRSTR ? (ts)->shrlen : (ts)->u.lnglen)
 #define luaS_newliteral(L, s) luaS_newlstr(L, s, strlen(s))
 
 void luaS_init(struct lua_State* L);
@@ -41,6 +42,7 @@ int luaS_eqlngstr(struct lua_State* L, struct TString* a, struct TString* b);
 unsigned int luaS_hash(struct lua_State* L, const char* str, unsigned int l, unsigned int h);
 unsigned int luaS_hashlongstr(struct lua_State* L, struct TString* ts);
 struct TString* luaS_createlongstr(struct lua_State* L, const char* str, size_t l);
+struct TString* luaS_createlngstrobj(struct lua_State* L, size_t l);
 
 Udata* luaS_newuserdata(struct lua_State* L, int size);
 
@@ -29,6 +29,21 @@ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
 
 #define MAXASIZE (1u << MAXABITS)
 
+Node dummynode_;
+
+static int l_floattointeger(lua_Number n, lua_Integer* p) {
+    if (floor(n) != n) {
+        return 0;
+    }
+
+    if (n >= -(lua_Number)LUA_MININTEGER || n < (lua_Number)LUA_MININTEGER) {
+        return 0;
+    }
+
+    *p = (lua_Integer)n;
+    return 1;
+}
+
 static int l_hashfloat(lua_Number n) {
     int i = 0;
     lua_Integer ni = 0;
@@ -124,6 +139,9 @@ struct Table* luaH_new(struct lua_State* L) {
     t->lastfree = NULL;
     t->gclist = NULL;
 	t->metatable = NULL;
+	t->flags = maskflags; // no fields, so no metamethods
+	t->inchain = 0;
+	t->lenhint = 0;
     
     setnodesize(L, t, 0);
     return t;
@@ -143,7 +161,7 @@ void luaH_free(struct lua_State* L, struct Table* t) {
 
 const TValue* luaH_getint(struct lua_State* L, struct Table* t, lua_Integer key) {
     // 1 <= key <= arraysize
-    if (cast(unsigned int, key) - 1 < t->arraysize) {
+    if (l_castS2U(key) - 1u < t->arraysize) {
         return cast(const TValue*, &t->array[key - 1]);        
     }
     else {
@@ -203,6 +221,28 @@ const TValue* luaH_getshrstr(struct lua_State* L, struct Table* t, struct TStrin
     return luaO_nilobject;
 }
 
+const TValue* luaH_getshrstrcache(struct lua_State* L, struct Table* t, struct TString* key, ICache* c) {
+    lua_assert(key->tt_ == LUA_SHRSTR);
+    struct Node* n = hashstr(key, t);
+    for (;;) {
+        TKey* k = &n->key;
+        if (ttisshrstr(&k->tvk) && luaS_eqshrstr(L, gco2ts(gcvalue(&k->tvk)), key)) {
+            c->node = t->node;
+            c->slot = cast(unsigned int, n - t->node);
+            return getval(n);
+        }
+        else {
+            int next = k->nk.next;
+            if (next == 0) {
+                break;
+            }
+            n += next;
+        }
+    }
+
+    return luaO_nilobject;
+}
+
 const TValue* luaH_getstr(struct lua_State* L, struct Table* t, struct TString* key) {
     if (key->tt_ == LUA_SHRSTR) {
         return luaH_getshrstr(L, t, key);
@@ -218,7 +258,13 @@ const TValue* luaH_get(struct lua_State* L, struct Table* t, const TValue* key)
     switch(key->tt_) {
         case LUA_TNIL:   return luaO_nilobject;
         case LUA_NUMINT: return luaH_getint(L, t, key->value_.i); 
-        case LUA_NUMFLT: return luaH_getint(L, t, l_hashfloat(key->value_.n));
+        case LUA_NUMFLT: {
+            lua_Integer k;
+            if (l_floattointeger(key->value_.n, &k)) { // 2.0 and 2 are the same key
+                return luaH_getint(L, t, k);
+            }
+            return getgeneric(L, t, key);
+        }
         case LUA_SHRSTR: return luaH_getshrstr(L, t, gco2ts(gcvalue(key)));
         case LUA_LNGSTR: return luaH_getstr(L, t, gco2ts(gcvalue(key)));
         default:{
@@ -229,6 +275,8 @@ const TValue* luaH_get(struct lua_State* L, struct Table* t, const TValue* key)
 
 TValue* luaH_set(struct lua_State* L, struct Table* t, const TValue* key) {
     const TValue* p = luaH_get(L, t, key);
+    invalidateTMcache(t); // the caller may fill a nil field
+    luaH_chainwrite(L, t);
     if (p != luaO_nilobject) {
         return cast(TValue*, p); 
     }
@@ -295,6 +343,26 @@ int luaH_resize(struct lua_State* L, struct Table* t, unsigned int asize, unsign
     return LUA_OK;
 }
 
+void luaH_setlist(struct lua_State* L, struct Table* t, unsigned int first, const TValue* src, int n) {
+    if (n <= 0) {
+        return;
+    }
+
+    unsigned int last = first + n;
+    if (last < first || last > MAXASIZE) {
+        luaG_runerror(L, "%s", "table overflow");
+    }
+    if (last > t->arraysize) {
+        luaH_resize(L, t, last, isdummy(t) ? 0 : twoto(t->lsizenode));
+    }
+
+    // stack slots and array slots are both TValue, the whole batch is one copy
+    memcpy(&t->array[first], src, n * sizeof(TValue));
+    for (int i = 0; i < n && isblack(t); i++) {
+        luaC_barrierback(L, t, &src[i]);
+    }
+}
+
 static Node* getlastfree(struct Table* t) {
     if (t->lastfree == NULL) {
         return NULL;
@@ -394,6 +462,8 @@ TValue* luaH_newkey(struct lua_State* L, struct Table* t, const TValue* key) {
     if (ttisnil(key)) {
 		luaG_runerror(L, "%s", "table key is nil");
     }
+    invalidateTMcache(t);
+    luaH_chainwrite(L, t);
 
     TValue k;
     if (ttisfloat(key)) {
@@ -401,9 +471,11 @@ TValue* luaH_newkey(struct lua_State* L, struct Table* t, const TValue* key) {
 			luaG_runerror(L, "%s", "table key is NAN");
         }
 
-        k.value_.i = l_hashfloat(key->value_.n);
-        k.tt_ = LUA_NUMINT;
-        key = &k;
+        lua_Integer ik;
+        if (l_floattointeger(key->value_.n, &ik)) { // float keys with an integral value are stored as integers
+            setivalue(&k, ik);
+            key = &k;
+        }
     }
 
     Node* main_node = mainposition(L, t, key);
@@ -514,15 +586,83 @@ int luaH_next(struct lua_State* L, struct Table* t, TValue* key) {
     return -1;
 }
 
-int luaH_getn(struct lua_State* L, struct Table* t) {
-    int n = 0;
-    for (int i = 0; i < (int)t->arraysize; i++) {
-        if (!ttisnil(&t->array[i])) {
-            n ++;
+// find a border in array[i .. j - 1] by binary search, where i == 0 or
+// t[i] is not nil, and t[j] is nil
+static unsigned int binsearch(const TValue* array, unsigned int i, unsigned int j) {
+    while (j - i > 1u) {
+        unsigned int m = (i + j) / 2;
+        if (ttisnil(&array[m - 1])) {
+            j = m;
+        }
+        else {
+            i = m;
+        }
+    }
+    return i;
+}
+
+// t[j] is not nil (or j is 0), look for a nil key by doubling j, and then
+// narrow the range down by binary search
+static unsigned int hash_search(struct lua_State* L, struct Table* t, unsigned int j) {
+    unsigned int i;
+    if (j == 0) j++;
+    do {
+        i = j;
+        if (j <= (unsigned int)INT_MAX / 2) {
+            j *= 2;
+        }
+        else {
+            j = INT_MAX;
+            if (ttisnil(luaH_getint(L, t, j))) {
+                break;
+            }
+            return j;
+        }
+    } while (!ttisnil(luaH_getint(L, t, j)));
+
+    while (j - i > 1u) {
+        unsigned int m = (i + j) / 2;
+        if (ttisnil(luaH_getint(L, t, m))) {
+            j = m;
         }
         else {
-            return n;
+            i = m;
+        }
+    }
+    return i;
+}
+
+// return a border of table t, that is an index n where t[n] is not nil and
+// t[n + 1] is nil (or 0 if t[1] is nil). The border found last time is kept
+// in t->lenhint, appending and removing at the end of a sequence only move it
+// by one, so it is checked before searching
+int luaH_getn(struct lua_State* L, struct Table* t) {
+    unsigned int limit = t->arraysize;
+    if (limit > 0 && ttisnil(&t->array[limit - 1])) {
+        unsigned int hint = t->lenhint;
+        if (hint < limit) {
+            if (hint == 0 || !ttisnil(&t->array[hint - 1])) {
+                if (ttisnil(&t->array[hint])) {
+                    return hint;
+                }
+                if (ttisnil(&t->array[hint + 1])) { // hint + 1 < limit, since array[limit - 1] is nil
+                    t->lenhint = hint + 1;
+                    return hint + 1;
+                }
+            }
+            else if (hint >= 2 && !ttisnil(&t->array[hint - 2])) {
+                t->lenhint = hint - 1;
+                return hint - 1;
+            }
         }
+        t->lenhint = binsearch(t->array, 0, limit);
+        return t->lenhint;
+    }
+
+    // the array part is full (or empty), so the border may be in the hash part
+    if (isdummy(t) || ttisnil(luaH_getint(L, t, (lua_Integer)limit + 1))) {
+        t->lenhint = limit;
+        return limit;
     }
-    return n;
+    return hash_search(L, t, limit);
 }
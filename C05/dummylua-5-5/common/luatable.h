@@ -34,6 +34,10 @@ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
 #define hashboolean(key, t) getnode(t, lmod(key, twoto(t->lsizenode)))
 #define hashpointer(p, t) getnode(t, lmod(point2uint(p), twoto(t->lsizenode)))
 
+// every write into a table that a cached __index lookup went through
+// invalidates all the cached lookups, see luaV_finishget
+#define luaH_chainwrite(L, t) ((t)->inchain ? cast(void, G(L)->chainepoch++) : cast(void, 0))
+
 struct Table* luaH_new(struct lua_State* L);
 void luaH_free(struct lua_State* L, struct Table* t);
 // if luaH_getint return luaO_nilobject, that means key is not exist
@@ -43,10 +47,20 @@ int luaH_setint(struct lua_State* L, struct Table* t, int key, const TValue* val
 const TValue* luaH_getshrstr(struct lua_State* L, struct Table* t, struct TString* key);
 const TValue* luaH_getstr(struct lua_State* L, struct Table* t, struct TString* key);
 
+// lookup of a short string key through an inline cache, the cache is refilled
+// when the key is found somewhere else in the hash part
+#define luaH_cachehit(t, c, key) ((t)->node == (c)->node && (c)->slot < cast(unsigned int, twoto((t)->lsizenode)) && \
+    ttisshrstr(getkey(getnode(t, (c)->slot))) && gcvalue(getkey(getnode(t, (c)->slot))) == obj2gco(key))
+#define luaH_getshrstrcached(L, t, key, c) \
+    (luaH_cachehit(t, c, key) ? cast(const TValue*, getval(getnode(t, (c)->slot))) : luaH_getshrstrcache(L, t, key, c))
+const TValue* luaH_getshrstrcache(struct lua_State* L, struct Table* t, struct TString* key, ICache* c);
+
 const TValue* luaH_get(struct lua_State* L, struct Table* t, const TValue* key);
 TValue* luaH_set(struct lua_State* L, struct Table* t, const TValue* key);
 
 int luaH_resize(struct lua_State* L, struct Table* t, unsigned int asize, unsigned int hsize);
+// store src[0 .. n - 1] into t[first + 1 .. first + n], growing the array part if needed
+void luaH_setlist(struct lua_State* L, struct Table* t, unsigned int first, const TValue* src, int n);
 TValue* luaH_newkey(struct lua_State* L, struct Table* t, const TValue* key);
 
 // 传入一个key，获得下一个key的key值和对应的value值，并且入栈
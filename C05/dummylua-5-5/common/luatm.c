@@ -7,9 +7,9 @@
 #include "../vm/luado.h"
 
 static const char* s_tm[] = {
-	"__lt", "__gt", "__le", "__ge", "__eq", "__concat",
+	"__index", "__newindex", "__gc", "__mode", "__eq",
+	"__lt", "__gt", "__le", "__ge", "__concat",
 	"__add", "__sub", "__mul", "__div", "__idiv", "__pow", "__band", "__bor", "__xor", "__shl", "__shr", "__mod",
-	"__index", "__newindex", "__gc", "__mode"
 };
 
 void luaT_init(struct lua_State* L) {
@@ -39,47 +39,35 @@ void luaT_trycallbinTM(struct lua_State* L, TValue* lhs, TValue* rhs, TMS tms) {
 	setobj(func + 2, rhs);
 	L->top += 3;
 
-	int ret = 0;
-	if (is_lua(func)) {
-		ret = luaD_call(L, func, 1);
-	}
-	else {
-		ret = luaD_callnoyield(L, func, 1);
-	}
+	// the instruction that needs the result can not be finished after a
+	// yield, so a metamethod can not yield
+	int ret = luaD_callnoyield(L, func, 1);
 
 	if (ret != LUA_OK)
 		luaG_runerror(L, "fail to call meta method %s", G(L)->tmnames[tms]);
 }
 
-TValue* luaT_gettmbyobj(struct lua_State* L, TValue* o, TMS event) {
-	switch (novariant(o)) {
-	case LUA_TTABLE: {
-		if (hvalue(o)->metatable == NULL) {
-			return NULL;
-		}
-
-		TValue* tm = (TValue*)luaH_getstr(L, hvalue(o)->metatable, luaS_newliteral(L, s_tm[(int)event]));
-		return ttisnil(tm) ? NULL : tm;
-	} break;
-	case LUA_TUSERDATA: {
-		if (uvalue(o)->metatable == NULL) {
-			return NULL;
-		}
-
-		TValue* tm = (TValue*)luaH_getstr(L, uvalue(o)->metatable, luaS_newliteral(L, s_tm[(int)event]));
-		return ttisnil(tm) ? NULL : tm;
-	} break;
-	default: {
-		if (!G(L)->mt[novariant(o)]) {
-			return NULL;
+// the names are interned once in luaT_init, a lookup never creates a string
+TValue* luaT_gettm(struct lua_State* L, struct Table* events, TMS event) {
+	TValue* tm = (TValue*)luaH_getshrstr(L, events, G(L)->tmnames[event]);
+	if (ttisnil(tm)) {
+		if (event <= TM_FAST) {
+			events->flags |= cast(lu_byte, 1u << event); // remember that it is absent
 		}
+		return NULL;
+	}
+	return tm;
+}
 
-		TValue* tm = (TValue*)luaH_getstr(L, G(L)->mt[novariant(o)], luaS_newliteral(L, s_tm[(int)event]));
-		return ttisnil(tm) ? NULL : tm;
-	} break;
+TValue* luaT_gettmbyobj(struct lua_State* L, TValue* o, TMS event) {
+	struct Table* mt;
+	switch (novariant(o)) {
+	case LUA_TTABLE: mt = hvalue(o)->metatable; break;
+	case LUA_TUSERDATA: mt = uvalue(o)->metatable; break;
+	default: mt = G(L)->mt[novariant(o)]; break;
 	}
 
-	return NULL;
+	return fasttm(L, mt, event);
 }
 
 void luaT_callTM(struct lua_State* L, TValue* f, TValue* p1, TValue* p2, TValue* p3, int hasres) {
@@ -96,12 +84,7 @@ void luaT_callTM(struct lua_State* L, TValue* f, TValue* p1, TValue* p2, TValue*
 		L->top++;
 	}
 
-	if (is_lua(func)) {
-		luaD_call(L, func, hasres);
-	}
-	else {
-		luaD_callnoyield(L, func, hasres);
-	}
+	luaD_callnoyield(L, func, hasres);
 
 	if (hasres) {
 		p3 = restorestack(L, result);
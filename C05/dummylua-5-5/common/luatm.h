@@ -3,12 +3,19 @@
 
 #include "luaobject.h"
 
+// the events up to TM_EQ are the ones looked up most, so they have an absence
+// bit in Table.flags. Keep s_tm in luatm.c in the same order
 typedef enum {
+	TM_INDEX,
+	TM_NEWINDEX,
+	TM_GC,
+	TM_MODE,
+	TM_EQ,
+
 	TM_LT,
 	TM_GT,
 	TM_LE,
 	TM_GE,
-	TM_EQ,
 	TM_CONCAT,
 
 	TM_ADD,
@@ -24,18 +31,22 @@ typedef enum {
 	TM_SHR,
 	TM_MOD,
 
-	TM_INDEX,
-	TM_NEWINDEX,
+	TM_TOTAL
+}TMS;
 
-	TM_GC,
+#define TM_FAST TM_EQ
+#define maskflags cast(lu_byte, ~(~0u << (TM_FAST + 1)))
 
-	TM_MODE,
+// any write that may turn a nil field of t into a non nil one must clear the flags
+#define invalidateTMcache(t) ((t)->flags = 0)
 
-	TM_TOTAL
-}TMS;
+// metamethod e of metatable et, or NULL. An absent fast metamethod costs a bit test
+#define fasttm(L, et, e) ((et) == NULL ? NULL : \
+	((et)->flags & (1u << (e))) ? NULL : luaT_gettm(L, et, e))
 
 void luaT_init(struct lua_State* L);
 void luaT_trycallbinTM(struct lua_State* L, TValue* lhs, TValue* rhs, TMS tm);
+TValue* luaT_gettm(struct lua_State* L, struct Table* events, TMS tm);
 TValue* luaT_gettmbyobj(struct lua_State* L, TValue* o, TMS tm);
 void luaT_callTM(struct lua_State* L, TValue* f, TValue* p1, TValue* p2, TValue* p3, int hasres);
 
@@ -8,6 +8,8 @@
 #include "../vm/luaopcodes.h"
 #include "../common/luastring.h"
 #include "../vm/luado.h"
+#include "../vm/luafunc.h"
+#include <string.h>
 
 #define MAININDEX 255
 #define hasjump(e) (e->t != e->f)
@@ -25,7 +27,8 @@ static int addk(FuncState* fs, TValue* v) {
 	TValue* idx = luaH_set(ls->L, ls->h, v);
 	if (!ttisnil(idx)) {
 		int k = (int)idx->value_.i;
-		if (k < fs->nk && luaV_eqobject(ls->L, &p->k[k], v)) {
+		// 1 and 1.0 share a key of ls->h, the tag tells them apart
+		if (k < fs->nk && p->k[k].tt_ == v->tt_ && luaV_eqobject(ls->L, &p->k[k], v)) {
 			return k;
 		}
 	}
@@ -74,7 +77,7 @@ static int validop(FuncState* fs, const TValue* v1, const TValue* v2, int op) {
 		if (!ttisinteger(v1) || !ttisinteger(v2))
 			return 0;
 
-		if (op == LUA_OPT_IDIV && v2->value_.i == 0) {
+		if ((op == LUA_OPT_IDIV || op == LUA_OPT_MOD) && v2->value_.i == 0) {
 			return 0;
 		}
 	} return 1;
@@ -113,6 +116,104 @@ static int constfolding(FuncState* fs, int op, expdesc* e1, expdesc* e2) {
 	return 1;
 }
 
+// the value of an expression that is a constant and carries no jumps
+int luaK_exp2const(FuncState* fs, const expdesc* e, TValue* v) {
+	if (hasjump(e)) {
+		return 0;
+	}
+
+	switch (e->k) {
+	case VNIL: setnilvalue(v); return 1;
+	case VTRUE: case VFALSE: setbvalue(v, e->k == VTRUE); return 1;
+	case VINT: setivalue(v, e->u.i); return 1;
+	case VFLT: setfltvalue(v, e->u.r); return 1;
+	case VK: setobj(v, &fs->p->k[e->u.info]); return 1;
+	default: return 0;
+	}
+}
+
+// comparisons of two constants. Only numbers are ordered here, the other
+// types go to the metamethods at runtime. 'a > b' and 'a >= b' are computed
+// the way the vm does, as 'not (a <= b)' and 'not (a < b)'
+static int foldcompare(FuncState* fs, int op, expdesc* e1, expdesc* e2) {
+	TValue v1, v2;
+	if (!luaK_exp2const(fs, e1, &v1) || !luaK_exp2const(fs, e2, &v2)) {
+		return 0;
+	}
+
+	int res;
+	if (op == BINOPR_EQ || op == BINOPR_NOTEQ) {
+		res = luaV_eqobject(fs->ls->L, &v1, &v2) == (op == BINOPR_EQ);
+	}
+	else {
+		if (!tonumeral(e1, NULL) || !tonumeral(e2, NULL)) {
+			return 0;
+		}
+
+		int lt, le;
+		if (ttisinteger(&v1) && ttisinteger(&v2)) {
+			lt = v1.value_.i < v2.value_.i;
+			le = v1.value_.i <= v2.value_.i;
+		}
+		else {
+			lua_Number n1, n2;
+			luaV_tonumber(fs->ls->L, &v1, &n1);
+			luaV_tonumber(fs->ls->L, &v2, &n2);
+			lt = n1 < n2;
+			le = n1 <= n2;
+		}
+
+		switch (op) {
+		case BINOPR_LESS: res = lt; break;
+		case BINOPR_LESSEQ: res = le; break;
+		case BINOPR_GREATER: res = !le; break;
+		default: res = !lt; break;
+		}
+	}
+
+	e1->k = res ? VTRUE : VFALSE;
+	return 1;
+}
+
+// "a" .. "b" is "ab", as long as the result is a short string. luaK_infix
+// has already loaded e1 into the top register, the load is taken back if it
+// is still the last instruction and no jump lands right after it
+static int foldconcat(FuncState* fs, expdesc* e1, expdesc* e2) {
+	Proto* p = fs->p;
+	if (e2->k != VK || hasjump(e2) || !ttisshrstr(&p->k[e2->u.info])) {
+		return 0;
+	}
+
+	if (fs->pc == 0 || fs->last_target >= fs->pc || fs->jpc != NO_JUMP) {
+		return 0;
+	}
+
+	Instruction i = p->code[fs->pc - 1];
+	if (GET_OPCODE(i) != OP_LOADK || GET_ARG_A(i) != e1->u.info || e1->u.info != fs->freereg - 1 
+		|| !ttisshrstr(&p->k[GET_ARG_Bx(i)])) {
+		return 0;
+	}
+
+	TValue v;
+	TString* s1 = gco2ts(gcvalue(&p->k[GET_ARG_Bx(i)]));
+	TString* s2 = gco2ts(gcvalue(&p->k[e2->u.info]));
+	int l1 = s1->shrlen, l2 = s2->shrlen;
+	if (l1 + l2 > MAXSHORTSTR) {
+		return 0;
+	}
+
+	char buff[MAXSHORTSTR];
+	memcpy(buff, getstr(s1), l1);
+	memcpy(buff + l1, getstr(s2), l2);
+	setgco(&v, obj2gco(luaS_newlstr(fs->ls->L, buff, l1 + l2)));
+
+	fs->pc--;
+	fs->freereg--;
+	e1->k = VK;
+	e1->u.info = addk(fs, &v);
+	return 1;
+}
+
 static void codeunexpval(FuncState* fs, int op, expdesc* e) {
 	luaK_exp2anyreg(fs, e);
 	freeexp(fs, e);
@@ -137,14 +238,10 @@ static void codeunexpval(FuncState* fs, int op, expdesc* e) {
 }
 
 static void codenot(FuncState* fs, expdesc* e) {
-	switch (e->k) {
-	case VFALSE: case VNIL: {
-		e->k = VTRUE;
-	} return;
-	case VTRUE: case VINT: case VFLT: {
-		e->k = VFALSE;
-	} return;
-	default:break;
+	TValue v;
+	if (luaK_exp2const(fs, e, &v)) {
+		e->k = l_false(&v) ? VTRUE : VFALSE;
+		return;
 	}
 
 	discharge2anyreg(fs, e);
@@ -169,7 +266,7 @@ static void codebinexp(FuncState* fs, int op, expdesc* e1, expdesc* e2) {
 
 void luaK_prefix(FuncState* fs, int op, expdesc* e) {
 	expdesc ef;
-	ef.k = VINT; ef.u.info = 0; ef.t = ef.f = NO_JUMP;
+	ef.k = VINT; ef.u.i = 0; ef.t = ef.f = NO_JUMP;
 
 	switch (op) {
 	case UNOPR_MINUS: case UNOPR_BNOT: {
@@ -196,14 +293,7 @@ void luaK_infix(FuncState* fs, int op, expdesc* e) {
 		luaK_goiffalse(fs, e);
 	} break;
 	case BINOPR_CONCAT: {
-		if (e->k != VCALL) {
-			luaK_exp2nextreg(fs, e);
-		}
-		else {
-			e->k = VNONRELOC;
-			e->u.info = fs->freereg;
-			luaK_reserveregs(fs, 1);
-		}
+		luaK_exp2nextreg(fs, e);
 	} break;
 	case BINOPR_ADD: case BINOPR_SUB: case BINOPR_MUL: case BINOPR_DIV:
 	case BINOPR_IDIV: case BINOPR_MOD: case BINOPR_POW: case BINOPR_BAND:
@@ -214,7 +304,10 @@ void luaK_infix(FuncState* fs, int op, expdesc* e) {
 	} break;
 	case BINOPR_LESS: case BINOPR_GREATER: case BINOPR_LESSEQ: case BINOPR_GREATEQ:
 	case BINOPR_EQ: case BINOPR_NOTEQ: {
-		luaK_exp2RK(fs, e);
+		TValue v;
+		if (!luaK_exp2const(fs, e, &v)) { // a constant waits, the other side may be one too
+			luaK_exp2RK(fs, e);
+		}
 	} break;
 	default: {
 		luaO_pushfstring(fs->ls->L, "luaK_infix:unknow binopr:%d \n", op);
@@ -243,7 +336,7 @@ static void codecmp(FuncState* fs, int op, expdesc* e1, expdesc* e2) {
 		luaK_codeABC(fs, OP_LT, 1, e1->u.info, e2->u.info);
 	} break;
 	case BINOPR_GREATEQ: {
-		luaK_codeABC(fs, OP_LE, 0, e1->u.info, e2->u.info);
+		luaK_codeABC(fs, OP_LT, 0, e1->u.info, e2->u.info);
 	} break;
 	case BINOPR_LESSEQ: {
 		luaK_codeABC(fs, OP_LE, 1, e1->u.info, e2->u.info);
@@ -266,20 +359,26 @@ void luaK_posfix(FuncState* fs, int op, expdesc* e1, expdesc* e2) {
 		*e1 = *e2;
 	} break;
 	case BINOPR_CONCAT: {
-		if (e2->k != VCALL) {
-			luaK_exp2nextreg(fs, e2);
+		if (foldconcat(fs, e1, e2)) {
+			break;
+		}
+		// a .. b .. c is right associative, when e2 is the CONCAT of b .. c
+		// right above e1 it grows to take e1 in, so the whole chain is one
+		// instruction over consecutive registers
+		luaK_exp2val(fs, e2);
+		if (e2->k == VRELOCATE && GET_OPCODE(get_instruction(fs, e2)) == OP_CONCAT &&
+			GET_ARG_B(get_instruction(fs, e2)) == e1->u.info + 1) {
+			freeexp(fs, e1);
+			SET_ARG_B(get_instruction(fs, e2), e1->u.info);
+			e1->u.info = e2->u.info;
 		}
 		else {
-			e2->k = VNONRELOC;
-			e2->u.info = fs->freereg;
-			luaK_reserveregs(fs, 1);
+			luaK_exp2nextreg(fs, e2);
+			freeexp(fs, e2);
+			freeexp(fs, e1);
+			e1->u.info = luaK_codeABC(fs, OP_CONCAT, 0, e1->u.info, e2->u.info);
 		}
-
-		fs->freereg -= 2;
-		luaK_codeABC(fs, OP_CONCAT, fs->freereg, e1->u.info, e2->u.info);
-		luaK_reserveregs(fs, 1);
-		e1->k = VNONRELOC;
-		e1->u.info = fs->freereg - 1;
+		e1->k = VRELOCATE;
 	} break;
 	case BINOPR_ADD: case BINOPR_SUB: case BINOPR_MUL: case BINOPR_DIV:
 	case BINOPR_IDIV: case BINOPR_MOD: case BINOPR_POW: case BINOPR_BAND:
@@ -290,7 +389,9 @@ void luaK_posfix(FuncState* fs, int op, expdesc* e1, expdesc* e2) {
 	} break;
 	case BINOPR_LESS: case BINOPR_GREATER: case BINOPR_LESSEQ: case BINOPR_GREATEQ:
 	case BINOPR_EQ: case BINOPR_NOTEQ: {
-		codecmp(fs, op, e1, e2);
+		if (!foldcompare(fs, op, e1, e2)) {
+			codecmp(fs, op, e1, e2);
+		}
 	} break;
 	default: {
 		luaO_pushfstring(fs->ls->L, "luaK_posfix:unknow binopr:%d \n", op);
@@ -299,14 +400,31 @@ void luaK_posfix(FuncState* fs, int op, expdesc* e1, expdesc* e2) {
 	}
 }
 
+// a call expression returns one value by default (C = 2), this changes the
+// number of results it (or a '...' expression) produces; nret can be LUA_MULRET
 void luaK_setreturns(FuncState* fs, expdesc* e, int nret) {
-	lua_assert(e->k == VCALL);
 	Instruction* i = &get_instruction(fs, e);
-	SET_ARG_C(*i, (nret + 1));
+	if (e->k == VCALL) {
+		SET_ARG_C(*i, (nret + 1));
+	}
+	else {
+		lua_assert(e->k == VVARARG);
+		SET_ARG_B(*i, (nret + 1));
+		SET_ARG_A(*i, fs->freereg);
+		luaK_reserveregs(fs, 1);
+	}
 }
 
+// the single result of a call is left in its base register
 void luaK_setoneret(FuncState* fs, expdesc* e) {
-
+	if (e->k == VCALL) {
+		e->k = VNONRELOC;
+		e->u.info = GET_ARG_A(get_instruction(fs, e));
+	}
+	else if (e->k == VVARARG) {
+		SET_ARG_B(get_instruction(fs, e), 2);
+		e->k = VRELOCATE;
+	}
 }
 
 void luaK_storevar(FuncState* fs, expdesc* var, expdesc* ex) {
@@ -543,7 +661,6 @@ void luaK_nil(FuncState* fs, int from, int to) {
 
 static void dischargejpc(FuncState* fs) {
 	patchlistaux(fs, fs->jpc, fs->pc, NO_REG, fs->pc);
-	fs->last_target = fs->pc;
 	fs->jpc = NO_JUMP;
 }
 
@@ -600,9 +717,8 @@ void luaK_dischargevars(FuncState* fs, expdesc* e) {
 
 		e->k = VRELOCATE;
 	} break;
-	case VCALL: {
-		e->k = VNONRELOC;
-		e->u.info = GET_ARG_A(get_instruction(fs, e));
+	case VCALL: case VVARARG: {
+		luaK_setoneret(fs, e);
 	} break;
 	default:break;
 	}
@@ -635,8 +751,12 @@ void luaK_reserveregs(FuncState* fs, int n) {
 void luaK_setlist(FuncState* fs, int base, int nelemts, int tostore) {
 	int c = (nelemts - 1) / LFIELD_PER_FLUSH + 1;
 	int b = tostore == LUA_MULRET ? 0 : tostore;
-	if (c <= MAXARG_Bx)
+	if (c <= MAXARG_C)
 		luaK_codeABC(fs, OP_SETLIST, base, b, c);
+	else if (c <= MAXARG_Bx) {
+		luaK_codeABC(fs, OP_SETLIST, base, b, 0);
+		luaK_codeABx(fs, OP_EXTRAARG, 0, c);
+	}
 	else
 		luaX_syntaxerror(fs->ls->L, fs->ls, "constructor is too long");
 	fs->freereg = base + 1;
@@ -673,6 +793,7 @@ static void discharge2reg(FuncState* fs, expdesc* e, int reg) {
 }
 
 static void discharge2anyreg(FuncState* fs, expdesc* e) {
+	luaK_dischargevars(fs, e);
 	if (e->k != VNONRELOC) {
 		luaK_reserveregs(fs, 1);
 		discharge2reg(fs, e, fs->freereg - 1);
@@ -706,6 +827,13 @@ static int patchtestreg(FuncState* fs, int pc, int reg) {
 }
 
 static void patchlistaux(FuncState* fs, int list, int dtarget, int reg, int vtarget) {
+	if (list != NO_JUMP) {
+		int target = dtarget > vtarget ? dtarget : vtarget;
+		if (target > fs->last_target) {
+			fs->last_target = target;
+		}
+	}
+
 	while (list != NO_JUMP) {
 		int next = get_next_jmp(fs, list);
 
@@ -780,4 +908,1208 @@ void luaK_exp2anyregup(FuncState* fs, expdesc* e) {
 	if (e->k != VUPVAL) {
 		luaK_exp2anyreg(fs, e);
 	}
-}
\ No newline at end of file
+}
+
+// the final pass over the code of a function, see luaK_finish. A RegSet is a
+// set of registers, there are at most MAXARG_A + 1 of them
+#define REGSET_WORDS ((MAXARG_A + 1) / 64)
+
+typedef struct RegSet {
+	unsigned long long w[REGSET_WORDS];
+} RegSet;
+
+#define regset_has(s, r) (((s)->w[(r) >> 6] >> ((r) & 63)) & 1)
+#define regset_add(s, r) ((s)->w[(r) >> 6] |= 1ull << ((r) & 63))
+
+static void regset_range(RegSet* s, int from, int to) {
+	for (int r = from; r <= to && r <= MAXARG_A; r++) {
+		regset_add(s, r);
+	}
+}
+
+static void regset_rk(RegSet* s, int rk) {
+	if (!ISK(rk)) {
+		regset_add(s, rk);
+	}
+}
+
+// the registers instruction i reads and the ones it always writes. When the
+// exact set is unknown, like the arguments of a call that takes everything
+// up to the top of the stack, use gets bigger and def smaller, so a register
+// is never taken for dead while it is not
+static void regsuse(Instruction i, RegSet* use, RegSet* def) {
+	int a = GET_ARG_A(i);
+	int b = GET_ARG_B(i);
+	int c = GET_ARG_C(i);
+	memset(use, 0, sizeof(RegSet));
+	memset(def, 0, sizeof(RegSet));
+
+	switch (luaP_genericop(GET_OPCODE(i))) {
+	case OP_MOVE: case OP_UNM: case OP_LEN: case OP_BNOT: case OP_NOT:
+		regset_add(use, b); regset_add(def, a);
+		break;
+	case OP_LOADK: case OP_GETUPVAL: case OP_LOADBOOL: case OP_NEWTABLE: case OP_CLOSURE:
+		regset_add(def, a);
+		break;
+	case OP_LOADNIL:
+		regset_range(def, a, a + b);
+		break;
+	case OP_CALL:
+		regset_range(use, a, b ? a + b - 1 : MAXARG_A);
+		regset_range(def, a, a + c - 2); // with C == 0 nothing is sure to be written
+		break;
+	case OP_TAILCALL:
+		regset_range(use, a, MAXARG_A);
+		break;
+	case OP_RETURN:
+		regset_range(use, a, b ? a + b - 2 : MAXARG_A);
+		break;
+	case OP_VARARG:
+		regset_range(def, a, a + b - 2);
+		break;
+	case OP_GETTABUP:
+		regset_rk(use, c); regset_add(def, a);
+		break;
+	case OP_GETTABLE:
+		regset_add(use, b); regset_rk(use, c); regset_add(def, a);
+		break;
+	case OP_SELF:
+		regset_add(use, b); regset_rk(use, c); regset_range(def, a, a + 1);
+		break;
+	case OP_TEST: case OP_SETUPVAL:
+		regset_add(use, a);
+		break;
+	case OP_TESTSET: // R(A) is only written when the test passes
+		regset_add(use, b);
+		break;
+	case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV: case OP_IDIV: case OP_MOD: case OP_POW:
+	case OP_BAND: case OP_BOR: case OP_BXOR: case OP_SHL: case OP_SHR:
+		regset_rk(use, b); regset_rk(use, c); regset_add(def, a);
+		break;
+	case OP_CONCAT:
+		regset_range(use, b, c); regset_add(def, a);
+		break;
+	case OP_EQ: case OP_LT: case OP_LE: case OP_SETTABUP:
+		regset_rk(use, b); regset_rk(use, c);
+		break;
+	case OP_SETTABLE:
+		regset_add(use, a); regset_rk(use, b); regset_rk(use, c);
+		break;
+	case OP_SETLIST:
+		regset_range(use, a, b ? a + b : MAXARG_A);
+		break;
+	case OP_FORPREP: case OP_FORLOOP: // the loop variable is only set when the loop goes on
+		regset_range(use, a, a + 2);
+		break;
+	case OP_TFORCALL:
+		regset_range(use, a, a + 2); regset_range(def, a + 3, a + 2 + c);
+		break;
+	case OP_TFORLOOP:
+		regset_add(use, a + 1);
+		break;
+	default: break;
+	}
+}
+
+// the instruction after a test, or after OP_LOADBOOL with C set, is the one
+// they skip, so it has to stay where it is
+static int skippable(Proto* p, int pc) {
+	if (pc == 0) {
+		return 0;
+	}
+
+	Instruction prev = p->code[pc - 1];
+	return testTMode(prev) || (GET_OPCODE(prev) == OP_LOADBOOL && GET_ARG_C(prev));
+}
+
+// where the control goes after pc, returns the number of successors
+static int successors(Proto* p, int pc, int* succ) {
+	Instruction i = p->code[pc];
+	int n = 0;
+	switch (luaP_genericop(GET_OPCODE(i))) {
+	case OP_JUMP:
+		succ[n++] = pc + 1 + GET_ARG_sBx(i);
+		break;
+	case OP_LOADBOOL:
+		succ[n++] = GET_ARG_C(i) ? pc + 2 : pc + 1;
+		break;
+	case OP_TEST: case OP_TESTSET: case OP_EQ: case OP_LT: case OP_LE:
+		succ[n++] = pc + 1;
+		succ[n++] = pc + 2;
+		break;
+	case OP_FORPREP:
+		succ[n++] = pc + 1;
+		succ[n++] = pc + 2 + GET_ARG_sBx(i);
+		break;
+	case OP_FORLOOP: case OP_TFORLOOP:
+		succ[n++] = pc + 1;
+		succ[n++] = pc + 1 + GET_ARG_sBx(i);
+		break;
+	case OP_RETURN:
+		break;
+	default:
+		succ[n++] = pc + 1;
+		break;
+	}
+	return n;
+}
+
+// locals that a nested function captures can change whenever anything is
+// called, the pass leaves them alone
+static void capturedregs(Proto* p, int np, RegSet* captured) {
+	memset(captured, 0, sizeof(RegSet));
+	for (int j = 0; j < np; j++) {
+		Proto* f = p->p[j];
+		for (int u = 1; u < f->sizeupvalues; u++) {
+			if (f->upvalues[u].name && f->upvalues[u].in_stack) {
+				regset_add(captured, f->upvalues[u].idx);
+			}
+		}
+	}
+}
+
+// liveout[pc] is the set of registers that may still be read after pc.
+// Removed instructions just pass the control on
+static void liveness(struct lua_State* L, Proto* p, int n, const char* removed, RegSet* liveout) {
+	RegSet* livein = luaM_newvector(L, n, RegSet);
+	memset(livein, 0, sizeof(RegSet) * n);
+	memset(liveout, 0, sizeof(RegSet) * n);
+
+	int changed = 1;
+	while (changed) {
+		changed = 0;
+		for (int pc = n - 1; pc >= 0; pc--) {
+			int succ[2];
+			int ns = 1;
+			succ[0] = pc + 1;
+			if (!removed[pc]) {
+				ns = successors(p, pc, succ);
+			}
+
+			RegSet out;
+			memset(&out, 0, sizeof(RegSet));
+			for (int s = 0; s < ns; s++) {
+				if (succ[s] >= 0 && succ[s] < n) {
+					for (int w = 0; w < REGSET_WORDS; w++) {
+						out.w[w] |= livein[succ[s]].w[w];
+					}
+				}
+			}
+
+			RegSet use, def, in;
+			if (removed[pc]) {
+				memset(&use, 0, sizeof(RegSet));
+				memset(&def, 0, sizeof(RegSet));
+			}
+			else {
+				regsuse(p->code[pc], &use, &def);
+			}
+			for (int w = 0; w < REGSET_WORDS; w++) {
+				in.w[w] = use.w[w] | (out.w[w] & ~def.w[w]);
+				if (in.w[w] != livein[pc].w[w]) {
+					changed = 1;
+				}
+			}
+			livein[pc] = in;
+			liveout[pc] = out;
+		}
+	}
+
+	luaM_free(L, livein, sizeof(RegSet) * n);
+}
+
+// can "op t ...; MOVE x t" become "op x ...", when t is dead after the move.
+// Only the instructions that read their operands before they write R(A), or
+// that do not read registers at all
+static int retargetable(Instruction i, int x) {
+	int b = GET_ARG_B(i);
+	int c = GET_ARG_C(i);
+	switch (luaP_genericop(GET_OPCODE(i))) {
+	case OP_MOVE: case OP_LOADK: case OP_GETUPVAL: case OP_NEWTABLE: case OP_CLOSURE:
+	case OP_UNM: case OP_LEN: case OP_BNOT: case OP_NOT:
+	case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV: case OP_IDIV: case OP_MOD: case OP_POW:
+	case OP_BAND: case OP_BOR: case OP_BXOR: case OP_SHL: case OP_SHR:
+		return 1;
+	case OP_LOADNIL:
+		return b == 0;
+	case OP_LOADBOOL:
+		return c == 0;
+	case OP_GETTABUP:
+		return c != x;
+	case OP_GETTABLE:
+		return b != x && c != x;
+	case OP_CONCAT:
+		return x < b || x > c;
+	default:
+		return 0;
+	}
+}
+
+// "MOVE t x; op ... t ..." becomes "op ... x ...", returns 0 if op reads t
+// in a way that can not be rewritten. The caller checks that t is dead after op
+static int forwardreg(Instruction* i, int t, int x) {
+	int op = luaP_genericop(GET_OPCODE(*i));
+	int a = GET_ARG_A(*i);
+	int b = GET_ARG_B(*i);
+	int c = GET_ARG_C(*i);
+	int rb = 0, rc = 0; // which of B and C are register operands
+	switch (op) {
+	case OP_MOVE: case OP_UNM: case OP_LEN: case OP_BNOT: case OP_NOT:
+		rb = 1;
+		break;
+	case OP_GETTABUP:
+		rc = !ISK(c);
+		break;
+	case OP_GETTABLE: case OP_SELF:
+		if (a == x || (op == OP_SELF && a + 1 == x)) {
+			return 0;
+		}
+		rb = 1; rc = !ISK(c);
+		break;
+	case OP_CONCAT: // the operands must stay consecutive
+		return 0;
+	case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV: case OP_IDIV: case OP_MOD: case OP_POW:
+	case OP_BAND: case OP_BOR: case OP_BXOR: case OP_SHL: case OP_SHR:
+	case OP_EQ: case OP_LT: case OP_LE: case OP_SETTABUP:
+		rb = !ISK(b); rc = !ISK(c);
+		break;
+	case OP_SETTABLE:
+		if (a == t) {
+			return 0;
+		}
+		rb = !ISK(b); rc = !ISK(c);
+		break;
+	default:
+		return 0;
+	}
+
+	// R(A) is only read by the ones that do not write it
+	if (a == t && (op == OP_EQ || op == OP_LT || op == OP_LE || op == OP_SETTABUP)) {
+		return 0;
+	}
+
+	if (!(rb && b == t) && !(rc && c == t)) {
+		return 0;
+	}
+
+	if (rb && b == t) {
+		SET_ARG_B(*i, x);
+	}
+	if (rc && c == t) {
+		SET_ARG_C(*i, x);
+	}
+	return 1;
+}
+
+// no side effects besides writing R(A), so it can go if R(A) is not read
+static int purestore(Instruction i) {
+	switch (GET_OPCODE(i)) {
+	case OP_MOVE: case OP_LOADK: case OP_GETUPVAL: case OP_NEWTABLE: case OP_NOT:
+		return 1;
+	case OP_LOADNIL:
+		return GET_ARG_B(i) == 0;
+	case OP_LOADBOOL:
+		return GET_ARG_C(i) == 0;
+	default:
+		return 0;
+	}
+}
+
+static int jumptarget(Proto* p, int pc) {
+	Instruction i = p->code[pc];
+	switch (GET_OPCODE(i)) {
+	case OP_JUMP: case OP_FORLOOP: case OP_TFORLOOP: return pc + 1 + GET_ARG_sBx(i);
+	case OP_FORPREP: return pc + 1 + GET_ARG_sBx(i); // its OP_FORLOOP
+	default: return -1;
+	}
+}
+
+// Inlining. A local function that calls nothing and runs straight through
+// to its return is copied into the calls made through its local, when the
+// local holds that closure on every path to the call, and into the calls
+// made from nested functions through an upvalue bound to it, when nothing
+// else ever assigns the local. The body runs in the registers above the
+// function slot of the call, which nothing else uses at that point
+
+// the registers i may write, even if it does not always do so
+static void maydefs(Instruction i, RegSet* def) {
+	RegSet use;
+	int a = GET_ARG_A(i);
+	regsuse(i, &use, def);
+
+	switch (luaP_genericop(GET_OPCODE(i))) {
+	case OP_CALL:
+		if (GET_ARG_C(i) == 0) {
+			regset_range(def, a, MAXARG_A);
+		}
+		break;
+	case OP_VARARG:
+		if (GET_ARG_B(i) == 0) {
+			regset_range(def, a, MAXARG_A);
+		}
+		break;
+	case OP_TESTSET: case OP_FORPREP: case OP_TFORLOOP:
+		regset_add(def, a);
+		break;
+	case OP_CONCAT: // the operands are scratch
+		regset_range(def, GET_ARG_B(i), GET_ARG_C(i));
+		break;
+	case OP_FORLOOP:
+		regset_add(def, a); regset_add(def, a + 3);
+		break;
+	default: break;
+	}
+}
+
+// istarget[pc] is set when pc can be reached from somewhere else than pc - 1
+static void marktargets(Proto* p, int n, const char* removed, char* istarget) {
+	memset(istarget, 0, n);
+	for (int pc = 0; pc < n; pc++) {
+		if (removed && removed[pc]) {
+			continue;
+		}
+
+		Instruction i = p->code[pc];
+		int target = jumptarget(p, pc);
+		if (target >= 0 && target < n) {
+			istarget[target] = 1;
+		}
+		if ((testTMode(i) || (GET_OPCODE(i) == OP_LOADBOOL && GET_ARG_C(i))) && pc + 2 < n) {
+			istarget[pc + 2] = 1;
+		}
+		if (GET_OPCODE(i) == OP_FORPREP && target + 1 < n) {
+			istarget[target + 1] = 1;
+		}
+	}
+}
+
+// does f, or a function nested in it, assign its upvalue u
+static int upvalwritten(Proto* f, int u) {
+	for (int pc = 0; pc < f->sizecode; pc++) {
+		Instruction i = f->code[pc];
+		if (GET_OPCODE(i) == OP_SETUPVAL && GET_ARG_B(i) == u) {
+			return 1;
+		}
+	}
+
+	// a nested function gets the upvalue of the same index, see luaV_pushclosure
+	for (int j = 0; j < f->sizep; j++) {
+		Proto* g = f->p[j];
+		if (g && u < g->sizeupvalues && g->upvalues[u].name && !g->upvalues[u].in_stack && upvalwritten(g, u)) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// small, a fixed number of parameters, at most one result, and no branches,
+// calls or closures before the return
+static int inlinable(Proto* f) {
+	int n = f->sizecode;
+	if (f->is_vararg || n < 1 || n - 1 > LUAK_INLINESIZE) {
+		return 0;
+	}
+
+	Instruction ret = f->code[n - 1];
+	if (GET_OPCODE(ret) != OP_RETURN || GET_ARG_B(ret) < 1 || GET_ARG_B(ret) > 2) {
+		return 0;
+	}
+
+	for (int pc = 0; pc < n - 1; pc++) {
+		Instruction i = f->code[pc];
+		switch (GET_OPCODE(i)) {
+		case OP_MOVE: case OP_LOADK: case OP_GETUPVAL: case OP_GETTABUP: case OP_GETTABLE: case OP_SELF:
+		case OP_UNM: case OP_LEN: case OP_BNOT: case OP_NOT: case OP_LOADNIL: case OP_NEWTABLE:
+		case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV: case OP_IDIV: case OP_MOD: case OP_POW:
+		case OP_BAND: case OP_BOR: case OP_BXOR: case OP_SHL: case OP_SHR: case OP_CONCAT:
+		case OP_SETTABUP: case OP_SETTABLE:
+			break;
+		case OP_LOADBOOL:
+			if (GET_ARG_C(i)) {
+				return 0;
+			}
+			break;
+		case OP_SETLIST:
+			if (GET_ARG_B(i) == 0 || GET_ARG_C(i) == 0) {
+				return 0;
+			}
+			break;
+		default:
+			return 0;
+		}
+	}
+	return 1;
+}
+
+// the local functions calls can be inlined to
+typedef struct KnownFuncs {
+	Proto* reg[MAXARG_A + 1]; // the function register r always holds, for the nested functions
+	int* rd[MAXARG_A + 1];    // see reachingclosure, for the function being finished itself
+	int n;                    // the length of its code
+} KnownFuncs;
+
+// does a function nested in p assign the local in register r
+static int localwritten(Proto* p, int np, int r) {
+	for (int j = 0; j < np; j++) {
+		Proto* c = p->p[j];
+		for (int u = 1; u < c->sizeupvalues; u++) {
+			Upvaldesc* up = &c->upvalues[u];
+			if (up->name && up->in_stack && up->idx == r && upvalwritten(c, u)) {
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
+
+// rd[pc] is the OP_CLOSURE of an inlinable function that register r got
+// its value from when the control gets to pc, the same one on every path
+// there. -1 if pc is not reached, -2 if r may hold something else
+static void reachingclosure(Proto* p, int np, int n, int r, int* rd) {
+	for (int pc = 0; pc < n; pc++) {
+		rd[pc] = -1;
+	}
+	rd[0] = -2;
+
+	int changed = 1;
+	while (changed) {
+		changed = 0;
+		for (int pc = 0; pc < n; pc++) {
+			if (rd[pc] == -1) {
+				continue;
+			}
+
+			Instruction i = p->code[pc];
+			int out = rd[pc];
+			RegSet def;
+			maydefs(i, &def);
+			if (regset_has(&def, r)) {
+				int bx = GET_ARG_Bx(i);
+				out = (GET_OPCODE(i) == OP_CLOSURE && bx < np && inlinable(p->p[bx])) ? pc : -2;
+			}
+
+			int succ[2];
+			int ns = successors(p, pc, succ);
+			for (int s = 0; s < ns; s++) {
+				int to = succ[s];
+				if (to < 0 || to >= n || rd[to] == out || rd[to] == -2) {
+					continue;
+				}
+				rd[to] = rd[to] == -1 ? out : -2;
+				changed = 1;
+			}
+		}
+	}
+}
+
+// returns how many registers may hold an inlinable function
+static int knownfuncs(FuncState* fs, KnownFuncs* known) {
+	struct lua_State* L = fs->ls->L;
+	Proto* p = fs->p;
+	int n = fs->pc;
+	int ndef[MAXARG_A + 1];
+	int lastdef[MAXARG_A + 1];
+	char closure[MAXARG_A + 1]; // an inlinable function is created into the register
+	memset(ndef, 0, sizeof(ndef));
+	memset(lastdef, -1, sizeof(lastdef));
+	memset(closure, 0, sizeof(closure));
+
+	for (int r = 0; r < p->nparam && r <= MAXARG_A; r++) {
+		ndef[r] = 1; // set by the caller
+	}
+
+	for (int pc = 0; pc < n; pc++) {
+		Instruction i = p->code[pc];
+		RegSet def;
+		maydefs(i, &def);
+		for (int r = 0; r <= MAXARG_A; r++) {
+			if (regset_has(&def, r)) {
+				ndef[r]++;
+				lastdef[r] = pc;
+			}
+		}
+
+		int bx = GET_ARG_Bx(i);
+		if (GET_OPCODE(i) == OP_CLOSURE && bx < fs->np && inlinable(p->p[bx])) {
+			closure[GET_ARG_A(i)] = 1;
+		}
+	}
+
+	int count = 0;
+	known->n = n;
+	for (int r = 0; r <= MAXARG_A; r++) {
+		known->reg[r] = NULL;
+		known->rd[r] = NULL;
+		if (!closure[r] || localwritten(p, fs->np, r)) {
+			continue;
+		}
+
+		count++;
+		known->rd[r] = luaM_newvector(L, n, int);
+		reachingclosure(p, fs->np, n, r, known->rd[r]);
+
+		// a nested function may run at any time, the register can only
+		// ever have been written by the closure
+		if (ndef[r] == 1 && GET_OPCODE(p->code[lastdef[r]]) == OP_CLOSURE) {
+			known->reg[r] = p->p[GET_ARG_Bx(p->code[lastdef[r]])];
+		}
+	}
+	return count;
+}
+
+static void freeknown(struct lua_State* L, KnownFuncs* known) {
+	for (int r = 0; r <= MAXARG_A; r++) {
+		if (known->rd[r]) {
+			luaM_free(L, known->rd[r], sizeof(int) * known->n);
+			known->rd[r] = NULL;
+		}
+	}
+}
+
+// a function the known functions are inlined into
+typedef struct InlineTarget {
+	Proto* q;
+	int nk;         // the number of constants of q
+	int* origin;    // origin[j] is the register the upvalue j of q is bound to in the function
+	                // being finished, or -1. NULL when q is that function
+	int child;      // q is nested right in the function being finished
+} InlineTarget;
+
+// the index of constant v in the target, added if it is not there yet
+static int protok(struct lua_State* L, InlineTarget* t, TValue* v) {
+	Proto* q = t->q;
+	for (int j = 0; j < t->nk; j++) {
+		if (q->k[j].tt_ == v->tt_ && luaV_eqobject(L, &q->k[j], v)) {
+			return j;
+		}
+	}
+
+	if (t->nk >= q->sizek) {
+		luaM_reallocvector(L, q->k, q->sizek, (t->nk + 1), TValue);
+		q->sizek = t->nk + 1;
+	}
+	setobj(&q->k[t->nk], v);
+	return t->nk++;
+}
+
+// an RK operand of f as an operand of the target, -1 if the constant index
+// does not fit
+static int maprk(struct lua_State* L, InlineTarget* t, Proto* f, int rk, int base) {
+	if (!ISK(rk)) {
+		return rk + base;
+	}
+
+	int k = protok(L, t, &f->k[rk - BITRK]);
+	return k <= MAININDEXRK ? RKMASK(k) : -1;
+}
+
+// how the target sees the upvalue u of f, a function nested in the one being
+// finished: as its upvalue *upv, or as its register *reg when the target is
+// the function being finished. A function nested right in it gets a new
+// upvalue if it does not have one bound to the same local yet
+static int mapupval(struct lua_State* L, InlineTarget* t, Proto* f, int u, int* upv, int* reg) {
+	*upv = -1;
+	*reg = -1;
+	if (u == 0) { // _ENV is the upvalue 0 of every function
+		*upv = 0;
+		return 1;
+	}
+
+	if (u >= f->sizeupvalues || !f->upvalues[u].name) {
+		return 0;
+	}
+
+	Upvaldesc* up = &f->upvalues[u];
+	if (t->origin == NULL) {
+		if (up->in_stack) {
+			*reg = up->idx;
+		}
+		else {
+			*upv = u;
+		}
+		return 1;
+	}
+
+	if (!up->in_stack) {
+		return 0;
+	}
+
+	Proto* q = t->q;
+	for (int j = 1; j < q->sizeupvalues; j++) {
+		if (t->origin[j] == up->idx) {
+			*upv = j;
+			return 1;
+		}
+	}
+
+	if (!t->child || q->sizeupvalues >= MAXUPVAL) {
+		return 0;
+	}
+
+	int j = q->sizeupvalues;
+	luaM_reallocvector(L, q->upvalues, q->sizeupvalues, (j + 1), Upvaldesc);
+	q->sizeupvalues = j + 1;
+	q->upvalues[j].in_stack = 1;
+	q->upvalues[j].idx = up->idx;
+	q->upvalues[j].name = up->name;
+	t->origin[j] = up->idx;
+	*upv = j;
+	return 1;
+}
+
+// copies the code of f before its return into out, with the registers moved
+// up by base, and the constants and upvalues the ones the target sees.
+// Returns the number of instructions, or -1 if one of them does not fit
+static int inlinebody(struct lua_State* L, InlineTarget* t, Proto* f, int base, Instruction* out) {
+	int n = f->sizecode - 1;
+	for (int pc = 0; pc < n; pc++) {
+		Instruction i = f->code[pc];
+		int a = GET_ARG_A(i) + base;
+		int b = GET_ARG_B(i);
+		int c = GET_ARG_C(i);
+		int upv, reg;
+		switch (GET_OPCODE(i)) {
+		case OP_MOVE: case OP_UNM: case OP_LEN: case OP_BNOT: case OP_NOT: {
+			b += base;
+			SET_ARG_B(i, b);
+		} break;
+		case OP_LOADK: {
+			int k = protok(L, t, &f->k[GET_ARG_Bx(i)]);
+			if (k > MAXARG_Bx) {
+				return -1;
+			}
+			SET_ARG_Bx(i, k);
+		} break;
+		case OP_GETUPVAL: {
+			if (!mapupval(L, t, f, b, &upv, &reg)) {
+				return -1;
+			}
+			if (reg >= 0) {
+				SET_OPCODE(i, OP_MOVE);
+				SET_ARG_B(i, reg);
+			}
+			else {
+				SET_ARG_B(i, upv);
+			}
+		} break;
+		case OP_GETTABUP: {
+			c = maprk(L, t, f, c, base);
+			if (c < 0 || !mapupval(L, t, f, b, &upv, &reg)) {
+				return -1;
+			}
+			if (reg >= 0) {
+				SET_OPCODE(i, OP_GETTABLE);
+				SET_ARG_B(i, reg);
+			}
+			else {
+				SET_ARG_B(i, upv);
+			}
+			SET_ARG_C(i, c);
+		} break;
+		case OP_SETTABUP: {
+			b = maprk(L, t, f, b, base);
+			c = maprk(L, t, f, c, base);
+			if (b < 0 || c < 0 || !mapupval(L, t, f, GET_ARG_A(i), &upv, &reg)) {
+				return -1;
+			}
+			if (reg >= 0) {
+				SET_OPCODE(i, OP_SETTABLE);
+				a = reg;
+			}
+			else {
+				a = upv;
+			}
+			SET_ARG_B(i, b);
+			SET_ARG_C(i, c);
+		} break;
+		case OP_GETTABLE: case OP_SELF: {
+			b += base;
+			c = maprk(L, t, f, c, base);
+			if (c < 0) {
+				return -1;
+			}
+			SET_ARG_B(i, b);
+			SET_ARG_C(i, c);
+		} break;
+		case OP_CONCAT: {
+			b += base;
+			c += base;
+			SET_ARG_B(i, b);
+			SET_ARG_C(i, c);
+		} break;
+		case OP_SETTABLE:
+		case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV: case OP_IDIV: case OP_MOD: case OP_POW:
+		case OP_BAND: case OP_BOR: case OP_BXOR: case OP_SHL: case OP_SHR: {
+			b = maprk(L, t, f, b, base);
+			c = maprk(L, t, f, c, base);
+			if (b < 0 || c < 0) {
+				return -1;
+			}
+			SET_ARG_B(i, b);
+			SET_ARG_C(i, c);
+		} break;
+		default: break; // only R(A) is a register
+		}
+		SET_ARG_A(i, a);
+		out[pc] = i;
+	}
+	return n;
+}
+
+// the known function the call at pc goes to. The function slot has to be
+// loaded from its local, or from an upvalue bound to it, and nothing in
+// between may branch, be branched into or write the slot
+static Proto* callee(InlineTarget* t, int pc, KnownFuncs* known, const char* istarget) {
+	Proto* q = t->q;
+	int r = GET_ARG_A(q->code[pc]);
+	for (int j = pc - 1; j >= 0; j--) {
+		Instruction i = q->code[j];
+		if (istarget[j + 1] || testTMode(i) || jumptarget(q, j) >= 0 ||
+			(GET_OPCODE(i) == OP_LOADBOOL && GET_ARG_C(i))) {
+			return NULL;
+		}
+
+		RegSet def;
+		maydefs(i, &def);
+		if (!regset_has(&def, r)) {
+			continue;
+		}
+
+		int b = GET_ARG_B(i);
+		if (GET_OPCODE(i) == OP_MOVE && t->origin == NULL) {
+			int d = known->rd[b] ? known->rd[b][j] : -1;
+			return d >= 0 ? q->p[GET_ARG_Bx(q->code[d])] : NULL;
+		}
+		if (GET_OPCODE(i) == OP_GETUPVAL && t->origin != NULL && b < q->sizeupvalues && t->origin[b] >= 0) {
+			return known->reg[t->origin[b]];
+		}
+		return NULL;
+	}
+	return NULL;
+}
+
+// a call that returns all its results is followed by the instruction that
+// takes them, up to the top of the stack. Once the call is inlined nothing
+// sets the top, so that instruction gets an exact count instead. Returns it,
+// or -1 if it can not have one
+static int fixconsumer(Instruction i, int top) {
+	int a = GET_ARG_A(i);
+	int b;
+	if (GET_ARG_B(i) != 0) {
+		return -1;
+	}
+
+	switch (GET_OPCODE(i)) {
+	case OP_CALL: case OP_TAILCALL: b = top - a; break;
+	case OP_RETURN: b = top - a + 1; break;
+	case OP_SETLIST: b = top - a - 1; break;
+	default: return -1;
+	}
+
+	if (b < 1) {
+		return -1;
+	}
+	SET_ARG_B(i, b);
+	return i;
+}
+
+// replaces the calls of the target, whose code is n instructions long, to
+// the known functions by their bodies. Returns the new length of the code
+static int inlinecalls(struct lua_State* L, InlineTarget* t, int n, KnownFuncs* known) {
+	Proto* q = t->q;
+	char* istarget = luaM_newvector(L, n, char);
+	marktargets(q, n, NULL, istarget);
+
+	int* len = luaM_newvector(L, n, int); // how many instructions pc becomes
+	int* at = luaM_newvector(L, n, int);  // where the code that replaces pc is in buf, -1 if it stays
+	Instruction* buf = NULL;
+	int sizebuf = 0;
+	int nbuf = 0;
+	for (int pc = 0; pc < n; pc++) {
+		len[pc] = 1;
+		at[pc] = -1;
+	}
+
+	for (int pc = 0; pc < n; pc++) {
+		Instruction i = q->code[pc];
+		int op = GET_OPCODE(i);
+		int r = GET_ARG_A(i);
+		int b = GET_ARG_B(i);
+		int c = GET_ARG_C(i);
+		if ((op != OP_CALL && op != OP_TAILCALL) || b == 0 || (op == OP_CALL && c > 2) || skippable(q, pc)) {
+			continue;
+		}
+
+		Proto* f = callee(t, pc, known, istarget);
+		if (f == NULL || f->nparam != b - 1 || r + 1 + f->maxstacksize > MAXARG_A) {
+			continue;
+		}
+
+		Instruction ret = f->code[f->sizecode - 1];
+		int nret = GET_ARG_B(ret) - 1;
+		int consumer = -1;
+		if (op == OP_CALL && c == 0) {
+			if (pc + 1 >= n || istarget[pc + 1] || (consumer = fixconsumer(q->code[pc + 1], r + nret)) == -1) {
+				continue;
+			}
+		}
+		if (op == OP_TAILCALL && (pc + 1 >= n || istarget[pc + 1] || GET_OPCODE(q->code[pc + 1]) != OP_RETURN)) {
+			continue;
+		}
+
+		while (nbuf + LUAK_INLINESIZE + 1 >= sizebuf) {
+			luaM_growvector(L, buf, nbuf + LUAK_INLINESIZE + 1, sizebuf, Instruction, INT_MAX);
+		}
+		int m = inlinebody(L, t, f, r + 1, &buf[nbuf]);
+		if (m < 0) {
+			continue;
+		}
+
+		// the result goes to the function slot, or is returned right away
+		int res = r + 1 + GET_ARG_A(ret);
+		if (op == OP_TAILCALL) {
+			buf[nbuf + m++] = nret == 1 ? (2 << POS_B) | (res << POS_A) | OP_RETURN : (1 << POS_B) | (r << POS_A) | OP_RETURN;
+		}
+		else if (nret == 1 && c != 1) {
+			buf[nbuf + m++] = (res << POS_B) | (r << POS_A) | OP_MOVE;
+		}
+		else if (nret == 0 && c == 2) {
+			buf[nbuf + m++] = (r << POS_A) | OP_LOADNIL;
+		}
+
+		if (consumer != -1) {
+			q->code[pc + 1] = consumer;
+		}
+		if (op == OP_TAILCALL) {
+			len[pc + 1] = 0; // the OP_RETURN after it, which the inlined code does instead
+		}
+		if (q->maxstacksize < r + 1 + f->maxstacksize) {
+			q->maxstacksize = r + 1 + f->maxstacksize;
+		}
+		at[pc] = nbuf;
+		len[pc] = m;
+		nbuf += m;
+	}
+
+	int* newpc = luaM_newvector(L, (n + 1), int);
+	int newn = 0;
+	for (int pc = 0; pc < n; pc++) {
+		newpc[pc] = newn;
+		newn += len[pc];
+	}
+	newpc[n] = newn;
+
+	if (nbuf > 0 || newn != n) {
+		Instruction* code = luaM_newvector(L, newn, Instruction);
+		int* line = luaM_newvector(L, newn, int);
+		for (int pc = 0; pc < n; pc++) {
+			for (int j = 0; j < len[pc]; j++) {
+				line[newpc[pc] + j] = q->line[pc];
+			}
+
+			if (at[pc] >= 0) {
+				memcpy(&code[newpc[pc]], &buf[at[pc]], sizeof(Instruction) * len[pc]);
+				continue;
+			}
+			if (len[pc] == 0) {
+				continue;
+			}
+
+			Instruction i = q->code[pc];
+			int target = jumptarget(q, pc);
+			if (target >= 0) {
+				SET_ARG_sBx(i, newpc[target] - newpc[pc] - 1);
+			}
+			code[newpc[pc]] = i;
+		}
+
+		for (int j = 0; j < q->sizelocvar; j++) {
+			LocVar* var = &q->locvars[j];
+			if (var->varname && var->startpc >= 0 && var->startpc <= n) {
+				var->startpc = newpc[var->startpc];
+			}
+			if (var->varname && var->endpc >= 0 && var->endpc <= n) {
+				var->endpc = newpc[var->endpc];
+			}
+		}
+
+		luaM_free(L, q->code, sizeof(Instruction) * q->sizecode);
+		luaM_free(L, q->line, sizeof(int) * q->sizeline);
+		q->code = code;
+		q->line = line;
+		q->sizecode = newn;
+		q->sizeline = newn;
+	}
+
+	luaM_free(L, newpc, sizeof(int) * (n + 1));
+	if (buf) {
+		luaM_free(L, buf, sizeof(Instruction) * sizebuf);
+	}
+	luaM_free(L, at, sizeof(int) * n);
+	luaM_free(L, len, sizeof(int) * n);
+	luaM_free(L, istarget, n);
+	return newn;
+}
+
+// inlines the known functions into q, a function nested in the one being
+// finished, and into the functions nested in q. origin is as in InlineTarget
+// and has room for MAXUPVAL + 1 entries
+static void inlinenested(struct lua_State* L, Proto* q, KnownFuncs* known, int* origin, int child) {
+	int reaches = 0;
+	for (int j = 1; j < q->sizeupvalues; j++) {
+		reaches = reaches || (origin[j] >= 0 && known->reg[origin[j]]);
+	}
+	if (!reaches) {
+		return;
+	}
+
+	InlineTarget t;
+	t.q = q;
+	t.nk = q->sizek;
+	t.origin = origin;
+	t.child = child;
+	int n = q->sizecode;
+	if (inlinecalls(L, &t, n, known) != n) {
+		// the inline caches are indexed like the code
+		if (q->cache) {
+			luaM_free(L, q->cache, sizeof(ICache) * q->sizecache);
+			q->cache = NULL;
+			q->sizecache = 0;
+		}
+		luaF_initcache(L, q);
+	}
+
+	int gorigin[MAXUPVAL + 1];
+	for (int j = 0; j < q->sizep; j++) {
+		Proto* g = q->p[j];
+		if (g == NULL) {
+			continue;
+		}
+
+		for (int u = 0; u < g->sizeupvalues; u++) {
+			Upvaldesc* up = &g->upvalues[u];
+			gorigin[u] = (u > 0 && u < q->sizeupvalues && up->name && !up->in_stack) ? origin[u] : -1;
+		}
+		inlinenested(L, g, known, gorigin, 0);
+	}
+}
+
+static void inlinelocals(FuncState* fs) {
+	struct lua_State* L = fs->ls->L;
+	Proto* p = fs->p;
+	KnownFuncs known;
+	if (knownfuncs(fs, &known) == 0) {
+		return;
+	}
+
+	int origin[MAXUPVAL + 1];
+	for (int j = 0; j < fs->np; j++) {
+		Proto* c = p->p[j];
+		for (int u = 0; u < c->sizeupvalues; u++) {
+			Upvaldesc* up = &c->upvalues[u];
+			origin[u] = (u > 0 && up->name && up->in_stack) ? up->idx : -1;
+		}
+		inlinenested(L, c, &known, origin, 1);
+	}
+
+	// a nested function whose only calls were inlined can be inlined now
+	freeknown(L, &known);
+	if (knownfuncs(fs, &known) == 0) {
+		return;
+	}
+
+	InlineTarget t;
+	t.q = p;
+	t.nk = fs->nk;
+	t.origin = NULL;
+	t.child = 0;
+	fs->pc = inlinecalls(L, &t, fs->pc, &known);
+	fs->nk = t.nk;
+	freeknown(L, &known);
+}
+
+void luaK_setinline(struct lua_State* L, int enable) {
+	G(L)->inlining = cast(lu_byte, enable ? 1 : 0);
+}
+
+// The code generator works one expression at a time, so it leaves jumps to
+// jumps, values computed into a temporary and then moved into a local, moves
+// of a value into a temporary just to be read by the next instruction, and
+// a second OP_RETURN at the end of most functions. This pass runs once the
+// function is complete: it threads the jumps, merges such moves into the
+// instructions next to them, and drops dead stores, jumps to the next
+// instruction and unreachable code. The remaining instructions keep their
+// line, and the pc ranges of the locals are moved along with them
+void luaK_finish(FuncState* fs) {
+	struct lua_State* L = fs->ls->L;
+	Proto* p = fs->p;
+	int n = fs->pc;
+	if (n == 0) {
+		return;
+	}
+
+	if (G(L)->inlining) {
+		inlinelocals(fs);
+		n = fs->pc;
+	}
+
+	// thread jump chains, every jump goes straight to where the chain ends
+	for (int pc = 0; pc < n; pc++) {
+		Instruction* i = &p->code[pc];
+		if (GET_OPCODE(*i) != OP_JUMP) {
+			continue;
+		}
+
+		int target = pc + 1 + GET_ARG_sBx(*i);
+		int steps = 0;
+		while (target >= 0 && target < n && GET_OPCODE(p->code[target]) == OP_JUMP && steps++ < n) {
+			int next = target + 1 + GET_ARG_sBx(p->code[target]);
+			if (next == target) {
+				break;
+			}
+			target = next;
+		}
+		SET_ARG_sBx(*i, target - pc - 1);
+	}
+
+	char* removed = luaM_newvector(L, n, char);
+	char* istarget = luaM_newvector(L, n, char);
+	memset(removed, 0, n);
+	memset(istarget, 0, n);
+
+	// what can be reached from the entry, everything else is removed
+	int* work = luaM_newvector(L, n, int);
+	int nwork = 0;
+	char* reached = istarget; // reused for the jump targets below
+	reached[0] = 1;
+	work[nwork++] = 0;
+	while (nwork > 0) {
+		int pc = work[--nwork];
+		int succ[2];
+		int ns = successors(p, pc, succ);
+		for (int s = 0; s < ns; s++) {
+			if (succ[s] >= 0 && succ[s] < n && !reached[succ[s]]) {
+				reached[succ[s]] = 1;
+				work[nwork++] = succ[s];
+			}
+		}
+	}
+	for (int pc = 0; pc < n; pc++) {
+		removed[pc] = !reached[pc];
+	}
+	luaM_free(L, work, sizeof(int) * n);
+
+	marktargets(p, n, removed, istarget);
+
+	// jumps to the next instruction and moves of a register to itself do nothing
+	for (int pc = 0; pc < n; pc++) {
+		Instruction i = p->code[pc];
+		if (removed[pc] || skippable(p, pc)) {
+			continue;
+		}
+
+		if ((GET_OPCODE(i) == OP_JUMP && GET_ARG_sBx(i) == 0) ||
+			(GET_OPCODE(i) == OP_MOVE && GET_ARG_A(i) == GET_ARG_B(i))) {
+			removed[pc] = 1;
+		}
+	}
+
+	RegSet captured;
+	capturedregs(p, fs->np, &captured);
+	RegSet* liveout = luaM_newvector(L, n, RegSet);
+	liveness(L, p, n, removed, liveout);
+
+	for (int pc = 0; pc < n; pc++) {
+		if (removed[pc]) {
+			continue;
+		}
+
+		Instruction* i = &p->code[pc];
+		int next = pc + 1;
+		if (next < n && !removed[next] && GET_OPCODE(p->code[next]) == OP_MOVE && !istarget[next] && !skippable(p, next)) {
+			// op t ...; MOVE x t => op x ...
+			Instruction* mv = &p->code[next];
+			int x = GET_ARG_A(*mv);
+			int t = GET_ARG_B(*mv);
+			if (GET_ARG_A(*i) == t && t != x && !regset_has(&captured, t) && !regset_has(&captured, x) &&
+				!regset_has(&liveout[next], t) && !skippable(p, pc) && retargetable(*i, x)) {
+				SET_ARG_A(*i, x);
+				removed[next] = 1;
+				continue;
+			}
+		}
+
+		if (GET_OPCODE(*i) == OP_MOVE && next < n && !removed[next] && !istarget[next] && !skippable(p, pc)) {
+			// MOVE t x; op ... t ... => op ... x ...
+			int t = GET_ARG_A(*i);
+			int x = GET_ARG_B(*i);
+			Instruction* use = &p->code[next];
+			RegSet u, d;
+			regsuse(*use, &u, &d);
+			if (t != x && !regset_has(&captured, t) && !regset_has(&captured, x) &&
+				(!regset_has(&liveout[next], t) || regset_has(&d, t))) {
+				Instruction saved = *use;
+				if (forwardreg(use, t, x)) {
+					regsuse(*use, &u, &d);
+					if (regset_has(&u, t)) { // still reads t somewhere else
+						*use = saved;
+					}
+					else {
+						removed[pc] = 1;
+						continue;
+					}
+				}
+			}
+		}
+
+		// a store nobody reads
+		if (purestore(*i) && !skippable(p, pc) && !regset_has(&captured, GET_ARG_A(*i)) &&
+			!regset_has(&liveout[pc], GET_ARG_A(*i))) {
+			removed[pc] = 1;
+		}
+	}
+	luaM_free(L, liveout, sizeof(RegSet) * n);
+
+	// compact, newpc[pc] is where pc goes, or the next kept instruction if it
+	// was removed
+	int* newpc = luaM_newvector(L, (n + 1), int);
+	int kept = 0;
+	for (int pc = 0; pc < n; pc++) {
+		newpc[pc] = kept;
+		if (!removed[pc]) {
+			kept++;
+		}
+	}
+	newpc[n] = kept;
+
+	for (int pc = 0; pc < n; pc++) {
+		if (removed[pc]) {
+			continue;
+		}
+
+		Instruction i = p->code[pc];
+		int target = jumptarget(p, pc);
+		if (target >= 0) {
+			SET_ARG_sBx(i, newpc[target] - newpc[pc] - 1);
+		}
+		p->code[newpc[pc]] = i;
+		p->line[newpc[pc]] = p->line[pc];
+	}
+
+	// the ranges of the locals that are still open are not set yet, and the
+	// ones of the blocks already left are past fs->nlocvars
+	for (int j = 0; j < p->sizelocvar; j++) {
+		LocVar* var = &p->locvars[j];
+		if (var->varname && var->startpc >= 0 && var->startpc <= n) {
+			var->startpc = newpc[var->startpc];
+		}
+		if (var->varname && var->endpc >= 0 && var->endpc <= n) {
+			var->endpc = newpc[var->endpc];
+		}
+	}
+
+	fs->pc = kept;
+	luaM_free(L, newpc, sizeof(int) * (n + 1));
+	luaM_free(L, removed, n);
+	luaM_free(L, istarget, n);
+}
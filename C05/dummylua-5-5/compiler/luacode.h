@@ -5,11 +5,16 @@
 #include "lualexer.h"
 #include "luaparser.h"
 
-#define get_instruction(fs, e) (fs->p->code[e->u.info])
+#define get_instruction(fs, e) ((fs)->p->code[(e)->u.info])
 #define NO_JUMP -1
 #define NO_REG -1
 
 #define luaK_codeAsBx(fs, c, a, sbx) luaK_codeABx(fs, c, a, (sbx) + LUA_IBIAS)
+#define luaK_setmultret(fs, e) luaK_setreturns(fs, e, LUA_MULRET)
+
+// the longest body, not counting its return, of a local function that
+// luaK_finish copies into the calls to it
+#define LUAK_INLINESIZE 8
 
 /*
 ** Ensures final expression result is either in a register or it is
@@ -17,6 +22,7 @@
 */
 void luaK_exp2val(FuncState* fs, expdesc* e);  
 int luaK_exp2RK(FuncState* fs, expdesc* e);   // discharge expression to constant table or specific register
+int luaK_exp2const(FuncState* fs, const expdesc* e, TValue* v); // the value of a constant expression without jumps
 int luaK_stringK(FuncState* fs, TString* key); // generate an expression to index constant in constants vector
 int luaK_nilK(FuncState* fs);
 int luaK_floatK(FuncState* fs, lua_Number r);
@@ -49,6 +55,9 @@ void luaK_nil(FuncState* fs, int from, int to);
 int luaK_codeABC(FuncState* fs, int opcode, int a, int b, int c);
 int luaK_codeABx(FuncState* fs, int opcode, int a, int bx);
 
+void luaK_finish(FuncState* fs); // optimize the code of a function once it is complete
+void luaK_setinline(struct lua_State* L, int enable); // inlining of local functions is on by default, turn it off to debug the plain calls
+
 void luaK_dischargevars(FuncState* fs, expdesc* e);
 int luaK_exp2nextreg(FuncState* fs, expdesc* e);    // discharge expression to next register 
 int luaK_exp2anyreg(FuncState* fs, expdesc* e); 
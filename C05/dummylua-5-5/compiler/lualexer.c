@@ -233,6 +233,10 @@ static int llex(LexState* ls, Seminfo* seminfo) {
 		}
 		case '/': {
 			next(ls);
+			if (ls->current == '/') { // floor division
+				next(ls);
+				return TK_IDIV;
+			}
 			return '/';
 		}
 		case '~': {
@@ -431,6 +435,9 @@ void luaX_syntaxerror(struct lua_State* L, LexState* ls, const char* error_text)
 		case TK_SHR: {
 			luaO_pushfstring(L, "%s\n", ">>");
 		} break;
+		case TK_IDIV: {
+			luaO_pushfstring(L, "%s\n", "//");
+		} break;
 		case TK_MOD: {
 			luaO_pushfstring(L, "%s\n", "%%");
 		} break;
@@ -63,6 +63,7 @@ enum RESERVED {
 	TK_LESSEQUAL,
 	TK_SHL,
 	TK_SHR,
+	TK_IDIV,
 	TK_MOD,
 	TK_DOT,
 	TK_VARARG,
@@ -27,7 +27,7 @@ static void funcbody(struct lua_State* L, LexState* ls, expdesc* e, int is_metho
 #define eqstr(a, b) ((a) == (b))
 #define vkisvar(v) (v->k >= VLOCAL && v->k <= VINDEXED)
 #define check_condition(ls, c, s) if(!(c)) luaX_syntaxerror(ls->L, ls, s)
-#define hasmulret(v) ((v)->k == VCALL)
+#define hasmulret(v) ((v)->k == VCALL || (v)->k == VVARARG)
 
 static void init_exp(expdesc* e, expkind k, int i) {
 	e->k = k;
@@ -67,6 +67,7 @@ static void open_func(LexState* ls, FuncState* fs) {
 	fs->nups = 0;
 	fs->prev = ls->fs;
 	fs->jpc = NO_JUMP;
+	fs->last_target = 0;
 	ls->fs = fs;
 	ls->lookahead.token = TK_EOS;
 	
@@ -82,7 +83,7 @@ static bool test_token(struct lua_State* L, LexState* ls, int token) {
 
 static LocVar* getlocalvar(FuncState* fs, int n) {
 	LexState* ls = fs->ls;
-	int idx = ls->dyd->actvar.arr[fs->firstlocal + n];
+	int idx = ls->dyd->actvar.arr[fs->firstlocal + n].idx;
 	lua_assert(idx < fs->nlocvars);
 	return &fs->p->locvars[idx];
 }
@@ -119,7 +120,13 @@ static int singlevaraux(FuncState* fs, expdesc* e, TString* n) {
 
 	int reg = searchvar(fs, n);
 	if (reg >= 0) {
-		init_exp(e, VLOCAL, reg);
+		int vidx = fs->firstlocal + reg;
+		if (fs->ls->dyd->actvar.arr[vidx].isconst) {
+			init_exp(e, VCONST, vidx); // inner functions take the value, not an upvalue
+		}
+		else {
+			init_exp(e, VLOCAL, reg);
+		}
 	}
 	else { 
 		// can not find it in local variables, then try upvalues
@@ -128,7 +135,7 @@ static int singlevaraux(FuncState* fs, expdesc* e, TString* n) {
 		// try to find in parent function
 		if (reg < 0) {
 			singlevaraux(fs->prev, e, n);
-			if (e->k != VVOID) {
+			if (e->k != VVOID && e->k != VCONST) {
 				reg = newupvalues(fs, e, n);
 				init_exp(e, VUPVAL, reg);
 			}
@@ -141,11 +148,24 @@ static void codestring(FuncState* fs, TString* n, expdesc* e) {
 	init_exp(e, VK, luaK_stringK(fs, n));
 }
 
+static void const2exp(FuncState* fs, TValue* v, expdesc* e) {
+	switch (v->tt_) {
+	case LUA_TNIL: init_exp(e, VNIL, 0); break;
+	case LUA_TBOOLEAN: init_exp(e, v->value_.b ? VTRUE : VFALSE, 0); break;
+	case LUA_NUMINT: init_exp(e, VINT, 0); e->u.i = v->value_.i; break;
+	case LUA_NUMFLT: init_exp(e, VFLT, 0); e->u.r = v->value_.n; break;
+	default: codestring(fs, gco2ts(gcvalue(v)), e); break;
+	}
+}
+
 // First, search local variable, if it is not exist, then it will try to search it's upvalues
 // if it also not exist, then try to search it in _ENV
 static void singlevar(FuncState* fs, expdesc* e, TString* n) {
 	singlevaraux(fs, e, n);
-	if (e->k == VVOID) { // variable is in global
+	if (e->k == VCONST) {
+		const2exp(fs, &fs->ls->dyd->actvar.arr[e->u.info].k, e);
+	}
+	else if (e->k == VVOID) { // variable is in global
 		expdesc k;
 		init_exp(&k, VVOID, 0);
 
@@ -255,12 +275,13 @@ static void lastlistfield(FuncState* fs, struct ConsControl* cc) {
 		return;
 
 	if (hasmulret(&cc->v)) {
+		luaK_setmultret(fs, &cc->v);
+		luaK_setlist(fs, cc->t->u.info, cc->na, LUA_MULRET);
 		cc->na--;
-		luaK_setlist(fs, cc->t->u.info, LUA_MULRET, cc->na);
 	}
 	else {
 		if (cc->v.k != VVOID) luaK_exp2nextreg(fs, &cc->v);
-		luaK_setlist(fs, cc->t->u.info, cc->tostore, cc->na);
+		luaK_setlist(fs, cc->t->u.info, cc->na, cc->tostore);
 	}
 }
 
@@ -283,8 +304,10 @@ static void constructor(struct lua_State* L, FuncState* fs, expdesc* t) {
 	checknext(L, fs->ls, '}');
 	lastlistfield(fs, &cc);
 
-	SET_ARG_B(fs->p->code[pc], cc.na);
-	SET_ARG_C(fs->p->code[pc], cc.nh);
+	int na = luaO_int2fb(cc.na);
+	int nh = luaO_int2fb(cc.nh);
+	SET_ARG_B(fs->p->code[pc], na);
+	SET_ARG_C(fs->p->code[pc], nh);
 }
 
 static void simpleexp(FuncState* fs, expdesc* e) {
@@ -316,6 +339,11 @@ static void simpleexp(FuncState* fs, expdesc* e) {
 		init_exp(e, VNIL, 0);
 		luaX_next(fs->ls->L, fs->ls);
 	} break;
+	case TK_VARARG: {
+		check_condition(ls, fs->p->is_vararg, "cannot use '...' outside a vararg function");
+		init_exp(e, VVARARG, luaK_codeABC(fs, OP_VARARG, 0, 1, 0));
+		luaX_next(fs->ls->L, fs->ls);
+	} break;
 	case '{': {
 		constructor(fs->ls->L, fs, e);
 	} break;
@@ -345,6 +373,7 @@ static BinOpr getbinopr(LexState* ls) {
 	case '-': return BINOPR_SUB;
 	case '*': return BINOPR_MUL;
 	case '/': return BINOPR_DIV;
+	case TK_IDIV: return BINOPR_IDIV;
 	case TK_MOD: return BINOPR_MOD;
 	case '^': return BINOPR_POW;
 	case '&': return BINOPR_BAND;
@@ -379,6 +408,30 @@ static const struct {
 	{2,2}, {1,1},			   // 'and' and 'or'
 };
 
+// 1 if the condition e always holds, 0 if it never does and -1 if that is
+// only known at runtime
+static int condvalue(FuncState* fs, expdesc* e) {
+	TValue v;
+	if (!luaK_exp2const(fs, e, &v)) {
+		return -1;
+	}
+	return !l_false(&v);
+}
+
+// the code from pc on can never run, take it back. Jumps pending on fs->jpc
+// were patched to pc by the first instruction of it, so they stay valid, the
+// breaks inside it are forgotten
+static void dropcode(FuncState* fs, int pc, int nlabel) {
+	if (fs->pc > pc) {
+		fs->pc = pc;
+		fs->jpc = NO_JUMP;
+		if (fs->last_target > pc) {
+			fs->last_target = pc;
+		}
+	}
+	fs->ls->dyd->labellist.n = nlabel;
+}
+
 static int subexpr(FuncState* fs, expdesc* e, int limit) {
 	LexState* ls = fs->ls;
 	int unopr = getunopr(ls);
@@ -396,9 +449,22 @@ static int subexpr(FuncState* fs, expdesc* e, int limit) {
 		init_exp(&e2, VVOID, 0);
 
 		luaX_next(ls->L, ls);
-		luaK_infix(fs, binopr, e);
-		int nextop = subexpr(fs, &e2, priority[binopr].right);
-		luaK_posfix(fs, binopr, e, &e2);
+		int nextop;
+		int v = condvalue(fs, e);
+		if ((binopr == BINOPR_AND && v == 0) || (binopr == BINOPR_OR && v == 1)) {
+			// 'false and x' or 'true or x', x is never evaluated
+			int pc = fs->pc;
+			int nlabel = ls->dyd->labellist.n;
+			int reg = fs->freereg;
+			nextop = subexpr(fs, &e2, priority[binopr].right);
+			dropcode(fs, pc, nlabel);
+			fs->freereg = reg;
+		}
+		else {
+			luaK_infix(fs, binopr, e);
+			nextop = subexpr(fs, &e2, priority[binopr].right);
+			luaK_posfix(fs, binopr, e, &e2);
+		}
 
 		binopr = nextop;
 	}
@@ -462,15 +528,23 @@ static void funcargs(FuncState* fs, expdesc* e) {
 		narg = explist(fs, &args);
 	}
 
-	if (args.k != VVOID) {
-		luaK_exp2nextreg(fs, &args);
-	}
-
 	lua_assert(e->k == VNONRELOC);
 	int base = e->u.info;
-	int nparams = fs->freereg - (base + 1);
-	init_exp(e, VCALL, luaK_codeABC(fs, OP_CALL, base, nparams + 1, 0));
-	fs->freereg = base;
+	int nparams;
+	if (hasmulret(&args)) {
+		luaK_setmultret(fs, &args); // the last argument is a call, pass all its results
+		nparams = LUA_MULRET;
+	}
+	else {
+		if (args.k != VVOID) {
+			luaK_exp2nextreg(fs, &args);
+		}
+		nparams = fs->freereg - (base + 1);
+	}
+
+	// one result by default, the caller adjusts it with luaK_setreturns
+	init_exp(e, VCALL, luaK_codeABC(fs, OP_CALL, base, nparams + 1, 2));
+	fs->freereg = base + 1;
 
 	checknext(fs->ls->L, fs->ls, ')');
 }
@@ -549,11 +623,11 @@ static void suffixedexp(struct lua_State* L, LexState* ls, FuncState* fs, expdes
 static void adjust_assign(FuncState* fs, int nvars, int nexps, expdesc* e) {
 	int extra = nvars - nexps;
 
-	if (e->k == VCALL) {
+	if (hasmulret(e)) {
 		extra++;
 		if (extra < 0) extra = 0;
 		luaK_setreturns(fs, e, extra);
-		if (extra >= 1) luaK_reserveregs(fs, extra);
+		if (extra > 1) luaK_reserveregs(fs, extra - 1); // the call itself holds the first one
 	}
 	else {
 		if (e->k != VVOID) luaK_exp2nextreg(fs, e);
@@ -597,10 +671,18 @@ static void assignment(FuncState* fs, LH_assign* v, int nvars) {
 	luaK_storevar(fs, &v->v, &e);
 }
 
-static void cond(struct lua_State* L, LexState* ls, FuncState* fs, expdesc* e) {
+static int cond(struct lua_State* L, LexState* ls, FuncState* fs, expdesc* e) {
 	explist(fs, e);
 	if (e->k == VNIL) e->k = VFALSE;
-	luaK_goiftrue(fs, e);
+
+	int v = condvalue(fs, e);
+	if (v == 0) {
+		e->f = luaK_jump(fs, e);
+	}
+	else {
+		luaK_goiftrue(fs, e);
+	}
+	return v;
 }
 
 static void enterblock(struct lua_State* L, LexState* ls, BlockCnt* bl, int is_loop) {
@@ -652,52 +734,50 @@ static void block(struct lua_State* L, LexState* ls, FuncState* fs, int is_loop)
 	leaveblock(L, ls);
 }
 
-static int test_then_part(struct lua_State* L, LexState* ls, expdesc* e, int* escapelist) {
-	FuncState* fs = ls->fs;
-
-	int is_elseif_follow = 0;
-	checknext(L, ls, TK_THEN);
-
-	BlockCnt bl;
-	enterblock(L, ls, &bl, 0);
-	statlist(L, ls, fs);
-	leaveblock(L, ls);
-
-	*escapelist = luaK_jump(fs, e);
-	if (ls->t.token == TK_ELSEIF) {
-		is_elseif_follow = ls->t.token;
-		luaX_next(L, ls);
-	}
-
-	return is_elseif_follow;
-}
-
+// a branch whose condition is a constant is decided at compile time: the
+// ones that can never run are parsed and dropped, and once a branch always
+// runs every branch after it is dead
 static void ifstat(struct lua_State* L, LexState* ls, FuncState* fs) {
-	luaX_next(L, ls); // skip if
-
-	expdesc e;
-	init_exp(&e, VVOID, 0);
-	cond(L, ls, fs, &e);  // cond part
-	lua_assert(e.f != NO_JUMP);
-	int condjmp = e.f;
-	e.f = NO_JUMP;
 	int escapelist = NO_JUMP;
+	int taken = 0;	// an earlier branch always runs
+	int token;
 
-	int is_elseif_follow = test_then_part(L, ls, &e, &escapelist);
-	while (is_elseif_follow) {
-		luaK_patchtohere(fs, condjmp);
-		cond(L, ls, fs, &e);
-		condjmp = e.f;
+	do {
+		luaX_next(L, ls); // skip if or elseif
+		int pc = fs->pc;
+		int nlabel = ls->dyd->labellist.n;
 
-		int escape = NO_JUMP;
-		is_elseif_follow = test_then_part(L, ls, &e, &escape);
-		luaK_concat(fs, &escapelist, escape);
-	}
+		expdesc e;
+		init_exp(&e, VVOID, 0);
+		int v = cond(L, ls, fs, &e);
+		int condjmp = e.f;
+
+		checknext(L, ls, TK_THEN);
+		block(L, ls, fs, 0);
+		token = ls->t.token;
 
-	luaK_patchtohere(fs, condjmp);
-	if (ls->t.token == TK_ELSE) {
+		if (taken || v == 0) {
+			dropcode(fs, pc, nlabel);
+		}
+		else if (v == 1) {
+			taken = 1;
+		}
+		else {
+			if (token == TK_ELSEIF || token == TK_ELSE) {
+				luaK_concat(fs, &escapelist, luaK_jump(fs, NULL));
+			}
+			luaK_patchtohere(fs, condjmp);
+		}
+	} while (token == TK_ELSEIF);
+
+	if (token == TK_ELSE) {
 		luaX_next(L, ls);
+		int pc = fs->pc;
+		int nlabel = ls->dyd->labellist.n;
 		block(L, ls, fs, 0);
+		if (taken) {
+			dropcode(fs, pc, nlabel);
+		}
 	}
 
 	luaK_patchtohere(fs, escapelist);
@@ -718,8 +798,10 @@ static void new_localvar(struct lua_State* L, LexState* ls, TString* varname) {
 	}
 	fs->p->locvars[fs->nlocvars].varname = varname;
 	
-	luaM_growvector(L, ls->dyd->actvar.arr, ls->dyd->actvar.n + 1, ls->dyd->actvar.size, short, INT_MAX);
-	ls->dyd->actvar.arr[ls->dyd->actvar.n++] = fs->nlocvars;
+	luaM_growvector(L, ls->dyd->actvar.arr, ls->dyd->actvar.n + 1, ls->dyd->actvar.size, Vardesc, INT_MAX);
+	Vardesc* var = &ls->dyd->actvar.arr[ls->dyd->actvar.n++];
+	var->idx = fs->nlocvars;
+	var->isconst = 0;
 
 	fs->nlocvars++;
 }
@@ -740,9 +822,25 @@ static void removevars(struct lua_State* L, LexState* ls) {
 	}
 }
 
+// local name <const> = exp, the value of exp must be known at compile time.
+// The variable still gets its register, but every use of it is replaced by
+// the value, so the code guarded by a constant flag can be folded away
+static int getattrib(struct lua_State* L, LexState* ls) {
+	if (!testnext(ls, '<')) {
+		return 0;
+	}
+
+	check(L, ls, TK_NAME);
+	check_condition(ls, eqstr(ls->t.seminfo.s, luaS_newliteral(L, "const")), "unknown attribute");
+	luaX_next(L, ls);
+	checknext(L, ls, '>');
+	return 1;
+}
+
 static void localstat(struct lua_State* L, LexState* ls, FuncState* fs) {
 	// restore local vars
 	int nvars = 0;
+	int isconst = 0;
 	do {
 		nvars++;
 
@@ -750,33 +848,45 @@ static void localstat(struct lua_State* L, LexState* ls, FuncState* fs) {
 		check(L, ls, TK_NAME);
 		new_localvar(L, ls, ls->t.seminfo.s);
 		luaX_next(L, ls);
+		isconst |= getattrib(L, ls);
 	} while (ls->t.token == ',');
+	check_condition(ls, !isconst || nvars == 1, "a <const> local must be declared alone");
 	
+	TValue k;
 	if (ls->t.token == '=') {
 		luaX_next(L, ls);
 
 		expdesc e;
 		init_exp(&e, VVOID, 0);
 		int nexps = explist(fs, &e);
+		check_condition(ls, !isconst || (nexps == 1 && luaK_exp2const(fs, &e, &k)), 
+			"a <const> local needs a constant value");
 
 		adjust_assign(fs, nvars, nexps, &e);
 	}
 	else {
+		setnilvalue(&k);
 		luaK_nil(fs, fs->freereg, fs->freereg + nvars);
 		luaK_reserveregs(fs, nvars);
 	}
 
 	adjustlocalvars(L, ls, fs, nvars);
+	if (isconst) {
+		Vardesc* var = &ls->dyd->actvar.arr[ls->dyd->actvar.n - 1];
+		var->isconst = 1;
+		setobj(&var->k, &k);
+	}
 }
 
 static void whilestat(struct lua_State* L, LexState* ls, FuncState* fs) {
 	luaX_next(L, ls); // skip TK_WHILE
 	
 	int whileinit = fs->pc;
+	int nlabel = ls->dyd->labellist.n;
 
 	expdesc e;
 	init_exp(&e, VVOID, 0);
-	cond(L, ls, fs, &e);
+	int v = cond(L, ls, fs, &e);
 	int condjmp = e.f;
 	e.f = NO_JUMP;
 
@@ -789,7 +899,12 @@ static void whilestat(struct lua_State* L, LexState* ls, FuncState* fs) {
 	leaveblock(L, ls);	
 	checknext(L, ls, TK_END);
 
-	luaK_patchtohere(fs, condjmp);
+	if (v == 0) { // while false: the loop never runs
+		dropcode(fs, whileinit, nlabel);
+	}
+	else {
+		luaK_patchtohere(fs, condjmp);
+	}
 }
 
 static void forbody(struct lua_State* L, LexState* ls, FuncState* fs, int is_num) {
@@ -841,12 +956,12 @@ static void fornum(struct lua_State* L, LexState* ls, FuncState* fs, TString* va
 		luaK_exp2nextreg(fs, &e);
 	}
 	else { 
-		init_exp(&e, VINT, 1);
+		init_exp(&e, VINT, 0);
+		e.u.i = 1; // info only covers part of the union
 		luaK_exp2nextreg(fs, &e);
 	}
 
-	luaK_codeABC(fs, OP_MOVE, fs->freereg, fs->freereg - 3, 0);
-	luaK_reserveregs(fs, 1);
+	luaK_reserveregs(fs, 1); // the loop variable, OP_FORPREP initializes it
 
 	check(L, ls, TK_DO);
 	forbody(L, ls, fs, 1);
@@ -869,7 +984,7 @@ static void forlist(struct lua_State* L, LexState* ls, FuncState* fs, TString* v
 	expr(fs, &e);
 	lua_assert(e.k == VCALL);
 	SET_ARG_C(get_instruction(fs, (&e)), 4);
-	luaK_reserveregs(fs, 5);
+	luaK_reserveregs(fs, 4);
 
 	check(L, ls, TK_DO);
 	forbody(L, ls, fs, 0);
@@ -944,6 +1059,13 @@ static void funcbody(struct lua_State* L, LexState* ls, expdesc* e, int is_metho
 	}
 
 	while (ls->t.token != ')') {
+		if (ls->t.token == TK_VARARG) { // '...' must be the last parameter
+			new_fs.p->is_vararg = 1;
+			luaX_next(L, ls);
+			check(L, ls, ')');
+			break;
+		}
+
 		nvars++;
 		check(L, ls, TK_NAME);
 		new_localvar(L, ls, ls->t.seminfo.s);
@@ -1023,6 +1145,7 @@ static void funcstat(struct lua_State* L, LexState* ls, FuncState* fs) {
 
 	expdesc e2;
 	init_exp(&e2, VVOID, 0);
+	check_condition(ls, vkisvar((&e)), "not var");
 	funcbody(L, ls, &e2, is_method);
 	luaK_storevar(fs, &e, &e2);
 }
@@ -1053,44 +1176,37 @@ static void exprstat(struct lua_State* L, LexState* ls, FuncState* fs) {
 	}
 	else {
 		check_condition(ls, lh.v.k == VCALL, "exp type error");
+		SET_ARG_C(get_instruction(fs, (&lh.v)), 1); // call statement uses no results
 	}
 }
 
 static void retstat(struct lua_State* L, LexState* ls, FuncState* fs) {
 	luaX_next(L, ls); // skip TK_RETURN
 
-	int first_result = fs->freereg;
-	int nexp = 1;
+	int first = fs->nactvars;
+	int nret = 0;
 	expdesc e;
 	init_exp(&e, VVOID, 0);
-	if (!block_follow(L, ls)) {
-		expr(fs, &e);
-
-		for (;;) {
-			if (test_token(fs->ls->L, fs->ls, ',')) {
-				luaX_next(fs->ls->L, fs->ls);
-				if (e.k == VCALL) {
-					luaK_dischargevars(fs, &e);
-					luaK_reserveregs(fs, 1);
-				}
-				else {
-					luaK_exp2nextreg(fs, &e);
-				}
-
-				expr(fs, &e);
-				nexp++;
-			}
-			else if (test_token(fs->ls->L, fs->ls, ';')) {
-				luaX_next(fs->ls->L, fs->ls);
-				break;
-			}
-			else {
-				break;
+	if (!block_follow(L, ls) && ls->t.token != ';') {
+		nret = explist(fs, &e);
+		if (hasmulret(&e)) {
+			luaK_setmultret(fs, &e);
+			if (e.k == VCALL && nret == 1) { // tail call
+				SET_OPCODE(get_instruction(fs, &e), OP_TAILCALL);
+				lua_assert(GET_ARG_A(get_instruction(fs, &e)) == fs->nactvars);
 			}
+			nret = LUA_MULRET;
+		}
+		else if (nret == 1) {
+			first = luaK_exp2anyreg(fs, &e);
+		}
+		else {
+			luaK_exp2nextreg(fs, &e);
+			lua_assert(nret == fs->freereg - first);
 		}
 	}
-	if (e.k != VVOID && e.k != VCALL) luaK_exp2nextreg(fs, &e);
-	luaK_ret(fs, first_result, e.k == VCALL ? LUA_MULRET:nexp);
+	testnext(ls, ';');
+	luaK_ret(fs, first, nret);
 }
 
 static void statement(struct lua_State* L, LexState* ls, FuncState* fs) {
@@ -1166,6 +1282,18 @@ static void statlist(struct lua_State* L, LexState* ls, FuncState* fs) {
 
 static void close_func(struct lua_State* L, FuncState* fs) {
 	luaK_ret(fs, 0, 0);
+	luaK_finish(fs);
+
+	// drop the unused tails of the code and constant vectors, so sizecode is the number
+	// of instructions and sizek the number of constants
+	Proto* p = fs->p;
+	luaM_reallocvector(L, p->code, p->sizecode, fs->pc, Instruction);
+	p->sizecode = fs->pc;
+	luaM_reallocvector(L, p->line, p->sizeline, fs->pc, int);
+	p->sizeline = fs->pc;
+	luaM_reallocvector(L, p->k, p->sizek, fs->nk, TValue);
+	p->sizek = fs->nk;
+	luaF_initcache(L, p);
 
 	LexState* ls = fs->ls;
 	ls->fs = fs->prev;
@@ -1177,6 +1305,7 @@ static void mainfunc(struct lua_State* L, LexState* ls, FuncState* fs) {
 
 	BlockCnt bl;
 	open_func(ls, fs);
+	fs->p->is_vararg = 1; // main chunk receives the arguments of the loader
 	newupvalues(fs, &e, fs->ls->env);
 
 	luaX_next(L, ls);
@@ -1226,6 +1355,9 @@ static void test_lexer(struct lua_State* L, LexState* ls) {
 			case TK_SHR: {
 				printf("TK_SHR >> \n");
 			} break;
+			case TK_IDIV: {
+				printf("TK_IDIV // \n");
+			} break;
 			case TK_MOD: {
 				printf("TK_MOD %% \n");
 			} break;
@@ -69,6 +69,7 @@ typedef enum expkind {
 	VTRUE,			// expression is true value
 	VFALSE,			// expression is false value
 	VCALL,			// expression is a function call, info field of struct expdesc is represent instruction pc
+	VVARARG,		// expression is '...', info field of struct expdesc is represent instruction pc
 
 	VLOCAL,			// expression is a local value, info field of struct expdesc is represent the pos of the stack
 	VUPVAL,			// expression is a upvalue, ind is in use
@@ -78,6 +79,7 @@ typedef enum expkind {
 	VJMP,
 	VRELOCATE,		// expression can put result in any register, info field represents the instruction pc
 	VNONRELOC,		// expression has result in a register, info field represents the pos of the stack
+	VCONST,			// a <const> local whose value is known at compile time, info is its index in Dyndata.actvar
 } expkind;
 
 typedef struct expdesc {
@@ -116,9 +118,16 @@ typedef struct Labellist {
 	int size;
 } Labellist;
 
+// an active local variable, a <const> one keeps its compile time value
+typedef struct Vardesc {
+	short idx;			// index of the variable in Proto.locvars
+	lu_byte isconst;	// k holds the value of the variable
+	TValue k;
+} Vardesc;
+
 typedef struct Dyndata {
 	struct {
-		short* arr;
+		Vardesc* arr;
 		int n;
 		int size;
 	} actvar;
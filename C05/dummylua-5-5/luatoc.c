@@ -0,0 +1,392 @@
+/* Copyright (c) 2018 Manistein,https://manistein.github.io/blog/  
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.*/
+
+// luatoc translates a lua file into c, see vm/luaaot.h
+//
+//   luatoc input.lua output.c [modname]
+//
+// output.c defines luaopen_<modname>, modname defaults to the name of the
+// input file. Build it into a shared library that require finds, or link it
+// into the host and call the function like any other luaopen_ function, it
+// runs the main function of the file and returns its result
+
+#include "clib/luaaux.h"
+#include "vm/luaopcodes.h"
+#include "common/luastring.h"
+#include "common/luamem.h"
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+// the macro of luaaot.h that implements each opcode, in the order of enum OpCode
+static const char* opnames[] = {
+	"MOVE", "LOADK", "GETUPVAL", "CALL", "TAILCALL", "RETURN", "GETTABUP", "GETTABLE",
+	"SELF", "TEST", "TESTSET", "JUMP", "UNM", "LEN", "BNOT", "NOT",
+	"ADD", "SUB", "MUL", "DIV", "IDIV", "MOD", "POW", "BAND",
+	"BOR", "BXOR", "SHL", "SHR", "CONCAT", "EQ", "LT", "LE",
+	"LOADBOOL", "LOADNIL", "SETUPVAL", "SETTABUP", "NEWTABLE", "SETLIST", "SETTABLE", "FORPREP",
+	"FORLOOP", "TFORCALL", "TFORLOOP", "CLOSURE", "VARARG",
+	"EXTRAARG",
+};
+
+static void emitstring(FILE* out, const char* s, size_t len) {
+	fputc('"', out);
+	for (size_t i = 0; i < len; i++) {
+		unsigned char c = (unsigned char)s[i];
+		if (c == '"' || c == '\\' || c == '?') {
+			fprintf(out, "\\%c", c);
+		}
+		else if (isprint(c)) {
+			fputc(c, out);
+		}
+		else {
+			fprintf(out, "\\%03o", c);
+		}
+	}
+	fputc('"', out);
+}
+
+static void emitnumber(FILE* out, lua_Number n) {
+	if (n != n) {
+		fprintf(out, "NAN");
+	}
+	else if (n == HUGE_VAL || n == -HUGE_VAL) {
+		fprintf(out, n > 0 ? "HUGE_VAL" : "-HUGE_VAL");
+	}
+	else {
+		fprintf(out, "%a", (double)n);
+	}
+}
+
+static void emitinteger(FILE* out, lua_Integer i) {
+	if (i == LUA_MININTEGER) {
+		fprintf(out, "LUA_MININTEGER");
+	}
+	else {
+		fprintf(out, LUA_INTEGER_FORMAT, i);
+	}
+}
+
+// which instructions need a label: jump targets, and the instructions after
+// a call, where the function is entered again
+static void marklabels(Proto* p, char* label, char* entry) {
+	entry[0] = label[0] = 1;
+	for (int n = 0; n < p->sizecode; n++) {
+		Instruction i = p->code[n];
+		int target = -1;
+		switch (luaP_genericop(GET_OPCODE(i))) {
+		case OP_TEST: case OP_TESTSET: case OP_EQ: case OP_LT: case OP_LE:
+			target = n + 2;
+			break;
+		case OP_LOADBOOL:
+			if (GET_ARG_C(i)) {
+				target = n + 2;
+			}
+			break;
+		case OP_JUMP: case OP_FORLOOP: case OP_TFORLOOP:
+			target = n + 1 + GET_ARG_sBx(i);
+			break;
+		case OP_FORPREP:
+			target = n + 2 + GET_ARG_sBx(i);
+			break;
+		case OP_CALL: case OP_TFORCALL:
+			target = n + 1;
+			if (target < p->sizecode) {
+				entry[target] = 1;
+			}
+			break;
+		default: break;
+		}
+
+		if (target >= 0 && target < p->sizecode) {
+			label[target] = 1;
+		}
+	}
+}
+
+static void emitinstruction(FILE* out, Proto* p, int n) {
+	Instruction i = p->code[n];
+	int op = luaP_genericop(GET_OPCODE(i));
+	int a = GET_ARG_A(i);
+	int b = GET_ARG_B(i);
+	int c = GET_ARG_C(i);
+	int bx = GET_ARG_Bx(i);
+	int sbx = GET_ARG_sBx(i);
+	const char* name = opnames[op];
+
+	switch (op) {
+	case OP_TAILCALL: case OP_RETURN:
+		fprintf(out, "aot_interpret(%d);", n);
+		break;
+	case OP_LOADK: case OP_CLOSURE:
+		fprintf(out, "aot_OP_%s(%d, %d, %d);", name, n, a, bx);
+		break;
+	case OP_MOVE: case OP_GETUPVAL: case OP_UNM: case OP_LEN: case OP_BNOT: case OP_NOT:
+	case OP_LOADNIL: case OP_SETUPVAL: case OP_VARARG:
+		fprintf(out, "aot_OP_%s(%d, %d, %d);", name, n, a, b);
+		break;
+	case OP_LOADBOOL:
+		fprintf(out, "aot_OP_%s(%d, %d, %d);", name, n, a, b);
+		if (c) {
+			fprintf(out, " goto l%d;", n + 2);
+		}
+		break;
+	case OP_TEST:
+		fprintf(out, "aot_OP_%s(%d, %d, %d, l%d);", name, n, a, c, n + 2);
+		break;
+	case OP_TESTSET: case OP_EQ: case OP_LT: case OP_LE:
+		fprintf(out, "aot_OP_%s(%d, %d, %d, %d, l%d);", name, n, a, b, c, n + 2);
+		break;
+	case OP_JUMP:
+		fprintf(out, "aot_OP_%s(%d, l%d);", name, n, n + 1 + sbx);
+		break;
+	case OP_FORPREP:
+		fprintf(out, "aot_OP_%s(%d, %d, l%d);", name, n, a, n + 2 + sbx);
+		break;
+	case OP_FORLOOP: case OP_TFORLOOP:
+		fprintf(out, "aot_OP_%s(%d, %d, l%d);", name, n, a, n + 1 + sbx);
+		break;
+	case OP_TFORCALL:
+		fprintf(out, "aot_OP_%s(%d, %d, %d);", name, n, a, c);
+		break;
+	case OP_SETLIST:
+		if (c == 0) {
+			c = GET_ARG_Bx(p->code[n + 1]);
+		}
+		fprintf(out, "aot_OP_%s(%d, %d, %d, %d);", name, n, a, b, c);
+		break;
+	case OP_EXTRAARG:
+		fprintf(out, "aot_OP_%s(%d);", name, n);
+		break;
+	default:
+		fprintf(out, "aot_OP_%s(%d, %d, %d, %d);", name, n, a, b, c);
+		break;
+	}
+}
+
+static void emitfunction(FILE* out, lua_State* L, Proto* p, int id) {
+	char* label = luaM_realloc(L, NULL, 0, p->sizecode);
+	char* entry = luaM_realloc(L, NULL, 0, p->sizecode);
+	memset(label, 0, p->sizecode);
+	memset(entry, 0, p->sizecode);
+	marklabels(p, label, entry);
+
+	fprintf(out, "static const Instruction* aot_%d(struct lua_State* L, struct CallInfo* ci, const Instruction* pc) {\n", id);
+	fprintf(out, "\taot_prologue();\n");
+	fprintf(out, "\tswitch (pc - code) {\n");
+	for (int n = 0; n < p->sizecode; n++) {
+		if (entry[n]) {
+			fprintf(out, "\tcase %d: goto l%d;\n", n, n);
+		}
+	}
+	fprintf(out, "\tdefault: return pc;\n\t}\n\n");
+
+	for (int n = 0; n < p->sizecode; n++) {
+		if (label[n]) {
+			fprintf(out, "l%d:\n", n);
+		}
+		fprintf(out, "\t");
+		emitinstruction(out, p, n);
+		fprintf(out, "\n");
+	}
+	fprintf(out, "}\n\n");
+
+	luaM_free(L, label, p->sizecode);
+	luaM_free(L, entry, p->sizecode);
+}
+
+// children first, so the parent can point at their AOTProto
+static int emitproto(FILE* out, lua_State* L, Proto* p, int* nproto) {
+	int id = (*nproto)++;
+	int* children = luaM_realloc(L, NULL, 0, sizeof(int) * (p->sizep + 1));
+	for (int j = 0; j < p->sizep; j++) {
+		children[j] = p->p[j] ? emitproto(out, L, p->p[j], nproto) : -1;
+	}
+
+	fprintf(out, "// <%s:%d>\n", getstr(p->source), p->sizeline > 0 ? p->line[0] : 0);
+	fprintf(out, "static const Instruction code_%d[] = {", id);
+	for (int n = 0; n < p->sizecode; n++) {
+		fprintf(out, "%s%d,", n % 8 ? " " : "\n\t", (int)p->code[n]);
+	}
+	fprintf(out, "\n};\n");
+
+	fprintf(out, "static const int line_%d[] = {", id);
+	for (int n = 0; n < p->sizecode; n++) {
+		fprintf(out, "%s%d,", n % 16 ? " " : "\n\t", n < p->sizeline ? p->line[n] : 0);
+	}
+	fprintf(out, "\n};\n");
+
+	if (p->sizek > 0) {
+		fprintf(out, "static const AOTConst k_%d[] = {\n", id);
+		for (int j = 0; j < p->sizek; j++) {
+			TValue* o = &p->k[j];
+			fprintf(out, "\t{ %d, ", o->tt_);
+			if (ttisinteger(o)) {
+				emitinteger(out, o->value_.i);
+				fprintf(out, ", 0, NULL, 0 },\n");
+			}
+			else if (ttisfloat(o)) {
+				fprintf(out, "0, ");
+				emitnumber(out, o->value_.n);
+				fprintf(out, ", NULL, 0 },\n");
+			}
+			else if (ttisshrstr(o) || ttislngstr(o)) {
+				TString* ts = gco2ts(gcvalue(o));
+				size_t len = ttisshrstr(o) ? ts->shrlen : ts->u.lnglen;
+				fprintf(out, "0, 0, ");
+				emitstring(out, getstr(ts), len);
+				fprintf(out, ", %d },\n", (int)len);
+			}
+			else {
+				fprintf(out, "%d, 0, NULL, 0 },\n", ttisboolean(o) ? o->value_.b : 0);
+			}
+		}
+		fprintf(out, "};\n");
+	}
+
+	if (p->sizeupvalues > 0) {
+		fprintf(out, "static const AOTUpval upvalues_%d[] = {\n", id);
+		for (int j = 0; j < p->sizeupvalues; j++) {
+			Upvaldesc* up = &p->upvalues[j];
+			fprintf(out, "\t{ %d, %d, ", up->in_stack, up->idx);
+			if (up->name) {
+				emitstring(out, getstr(up->name), strlen(getstr(up->name)));
+			}
+			else {
+				fprintf(out, "NULL");
+			}
+			fprintf(out, " },\n");
+		}
+		fprintf(out, "};\n");
+	}
+
+	if (p->sizelocvar > 0) {
+		fprintf(out, "static const char* const locvars_%d[] = {\n", id);
+		for (int j = 0; j < p->sizelocvar; j++) {
+			fprintf(out, "\t");
+			if (p->locvars[j].varname) {
+				emitstring(out, getstr(p->locvars[j].varname), strlen(getstr(p->locvars[j].varname)));
+			}
+			else {
+				fprintf(out, "NULL");
+			}
+			fprintf(out, ",\n");
+		}
+		fprintf(out, "};\n");
+	}
+
+	if (p->sizep > 0) {
+		fprintf(out, "static const AOTProto* const p_%d[] = {\n", id);
+		for (int j = 0; j < p->sizep; j++) {
+			if (children[j] >= 0) {
+				fprintf(out, "\t&proto_%d,\n", children[j]);
+			}
+			else {
+				fprintf(out, "\tNULL,\n");
+			}
+		}
+		fprintf(out, "};\n");
+	}
+	fprintf(out, "\n");
+
+	emitfunction(out, L, p, id);
+
+	fprintf(out, "static const AOTProto proto_%d = {\n", id);
+	fprintf(out, "\taot_%d, code_%d, line_%d, %d,\n", id, id, id, p->sizecode);
+	if (p->sizek > 0) fprintf(out, "\tk_%d, %d,\n", id, p->sizek); else fprintf(out, "\tNULL, 0,\n");
+	if (p->sizeupvalues > 0) fprintf(out, "\tupvalues_%d, %d,\n", id, p->sizeupvalues); else fprintf(out, "\tNULL, 0,\n");
+	if (p->sizelocvar > 0) fprintf(out, "\tlocvars_%d, %d,\n", id, p->sizelocvar); else fprintf(out, "\tNULL, 0,\n");
+	if (p->sizep > 0) fprintf(out, "\tp_%d, %d,\n", id, p->sizep); else fprintf(out, "\tNULL, 0,\n");
+	fprintf(out, "\t%d, %d, %d,\n};\n\n", p->nparam, p->is_vararg, p->maxstacksize);
+
+	luaM_free(L, children, sizeof(int) * (p->sizep + 1));
+	return id;
+}
+
+// the base name of the input file, with anything that is not valid in a c
+// identifier turned into '_'
+static void modname(const char* filename, char* buff, size_t size) {
+	const char* s = filename;
+	for (const char* c = filename; *c; c++) {
+		if (*c == '/' || *c == '\\') {
+			s = c + 1;
+		}
+	}
+
+	size_t len = strlen(s);
+	const char* dot = strrchr(s, '.');
+	if (dot) {
+		len = dot - s;
+	}
+
+	size_t j = 0;
+	for (; j < len && j < size - 1; j++) {
+		buff[j] = isalnum((unsigned char)s[j]) ? s[j] : '_';
+	}
+	buff[j] = '\0';
+}
+
+int main(int argc, char** argv) {
+	if (argc < 3) {
+		fprintf(stderr, "usage: %s input.lua output.c [modname]\n", argv[0]);
+		return 1;
+	}
+
+	char name[256];
+	if (argc > 3) {
+		// like require, which looks for luaopen_a_b for module "a.b"
+		snprintf(name, sizeof(name), "%s", argv[3]);
+		for (char* c = name; *c; c++) {
+			if (!isalnum((unsigned char)*c)) *c = '_';
+		}
+	}
+	else {
+		modname(argv[1], name, sizeof(name));
+	}
+
+	struct lua_State* L = luaL_newstate();
+	if (luaL_loadfile(L, argv[1]) != LUA_OK) {
+		fprintf(stderr, "luatoc: cannot load %s\n", argv[1]);
+		luaL_close(L);
+		return 1;
+	}
+
+	FILE* out = fopen(argv[2], "w");
+	if (out == NULL) {
+		fprintf(stderr, "luatoc: cannot open %s\n", argv[2]);
+		luaL_close(L);
+		return 1;
+	}
+
+	LClosure* cl = gco2lclosure(gcvalue(L->top - 1));
+	fprintf(out, "// generated by luatoc from %s, do not edit\n\n", argv[1]);
+	fprintf(out, "#include \"luaaot.h\"\n#include <math.h>\n\n");
+	int nproto = 0;
+	emitproto(out, L, cl->p, &nproto);
+	fprintf(out, "LUA_API int luaopen_%s(struct lua_State* L) {\n", name);
+	fprintf(out, "\treturn luaA_open(L, &proto_0, ");
+	emitstring(out, argv[1], strlen(argv[1]));
+	fprintf(out, ");\n}\n");
+	fclose(out);
+
+	luaL_pop(L);
+	luaL_close(L);
+	return 0;
+}
@@ -1,9 +1,76 @@
 #include "test/p13_test.h"
+#include "test/p14_test.h"
+#include "test/p15_test.h"
+#include "test/p16_test.h"
+#include "test/p17_test.h"
+#include "test/p18_test.h"
+#include "test/p19_test.h"
+#include "test/p20_test.h"
+#include "test/p21_test.h"
+#include "test/p22_test.h"
+#include "test/p23_test.h"
+#include "test/p24_test.h"
+#include "test/p25_test.h"
+#include "test/p26_test.h"
+#include "test/p27_test.h"
+#include "test/p28_test.h"
+#include "test/p29_test.h"
+#include "test/p30_test.h"
+#include "test/p31_test.h"
+#include "test/p32_test.h"
+#include "test/p33_test.h"
+#include "test/p34_test.h"
+#include "test/p35_test.h"
+#include "test/p36_test.h"
+#include "test/p37_test.h"
+#include <string.h>
 #ifdef _WINDOWS_PLATFORM_
 #include <process.h>
 #endif
 
+// the script tests that report failures, 'dummylua <name>' runs one of them,
+// see add_test in CMakeLists.txt
+static const struct {
+	const char* name;
+	int (*test_main)();
+} tests[] = {
+	{ "p14", p14_test_main },
+	{ "p15", p15_test_main },
+	{ "p16", p16_test_main },
+	{ "p17", p17_test_main },
+	{ "p18", p18_test_main },
+	{ "p19", p19_test_main },
+	{ "p20", p20_test_main },
+	{ "p21", p21_test_main },
+	{ "p22", p22_test_main },
+	{ "p23", p23_test_main },
+	{ "p24", p24_test_main },
+	{ "p25", p25_test_main },
+	{ "p26", p26_test_main },
+	{ "p27", p27_test_main },
+	{ "p28", p28_test_main },
+	{ "p29", p29_test_main },
+	{ "p30", p30_test_main },
+	{ "p31", p31_test_main },
+	{ "p32", p32_test_main },
+	{ "p33", p33_test_main },
+	{ "p34", p34_test_main },
+	{ "p35", p35_test_main },
+	{ "p36", p36_test_main },
+	{ "p37", p37_test_main },
+};
+
 int main(int argc, char** argv) {
+	if (argc > 1) {
+		for (int i = 0; i < (int)(sizeof(tests) / sizeof(tests[0])); i++) {
+			if (strcmp(argv[1], tests[i].name) == 0) {
+				return tests[i].test_main() == 0 ? 0 : 1;
+			}
+		}
+		printf("unknown test %s\n", argv[1]);
+		return 1;
+	}
+
 	p13_test_main();
 
 #ifdef _WINDOWS_PLATFORM_
@@ -0,0 +1,37 @@
+-- the 'not' operator, it always produces a boolean and only nil and false are falsy
+local zero = 0
+local one = 1
+local half = 0.5
+local t = {}
+local f = function() end
+
+expect(not nil == true, "not nil")
+expect(not false == true, "not false")
+expect(not true == false, "not true")
+
+-- numbers are true, even 0, so 'not 0' is false and not 1 like it used to be
+expect(not zero == false, "not 0")
+expect(not one == false, "not 1")
+expect(not half == false, "not 0.5")
+expect(not not zero == true, "not not 0")
+
+expect(not "" == false, "not of a string")
+expect(not t == false, "not of a table")
+expect(not f == false, "not of a lua function")
+expect(not print == false, "not of a c function")
+
+-- the result is a real boolean, it can be compared and stored
+local r = not zero
+expect(r == false, "stored result")
+local s = tostring(not nil)
+expect(s == "true", "tostring(not nil)")
+s = tostring(not zero)
+expect(s == "false", "tostring(not 0)")
+
+local n = 0
+for i = 1, 10 do
+	if not (i > 5) then
+		n = n + 1
+	end
+end
+expect(n == 5, "not in a loop condition")
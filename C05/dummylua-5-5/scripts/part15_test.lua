@@ -0,0 +1,73 @@
+-- quickened opcodes, the script runs with quickening on and off and has to give
+-- the same results both times, see p15_test.c
+local function sum(n)
+	local s = 0
+	for i = 1, n do
+		s = s + i * 2 - 1
+	end
+	return s
+end
+expect(sum(100) == 10000, "integer add, sub and mul")
+
+local function fsum(n)
+	local s = 0.5
+	for i = 1, n do
+		s = s * 1.0 + 0.25
+	end
+	return s
+end
+expect(fsum(8) == 2.5, "float add and mul")
+
+local function count(a, b)
+	local n = 0
+	for i = 1, 20 do
+		if a < i then n = n + 1 end
+		if i <= b then n = n + 1 end
+	end
+	return n
+end
+expect(count(10, 5) == 15, "integer lt and le")
+expect(count(10.5, 5.5) == 15, "float lt and le")
+
+local arr = {}
+for i = 1, 16 do arr[i] = i * i end
+local function sumarr(t)
+	local s = 0
+	for i = 1, 16 do s = s + t[i] end
+	return s
+end
+expect(sumarr(arr) == 1496, "integer keys")
+
+local point = { x = 3, y = 4 }
+local function norm2(p)
+	return p.x * p.x + p.y * p.y
+end
+for i = 1, 10 do norm2(point) end
+expect(norm2(point) == 25, "constant string keys")
+
+-- the same instructions see other operand types once they are specialized, a
+-- failed guard goes back to the generic opcode and has to get the same result
+local function add(a, b) return a + b end
+for i = 1, 10 do add(i, i) end
+expect(add(1, 2) == 3, "add integers")
+expect(add(1.5, 2) == 3.5, "add after the integer guard fails")
+
+local mt = { __add = function(a, b) return "added" end, __lt = function(a, b) return true end }
+local obj = setmetatable({}, mt)
+expect(add(obj, 1) == "added", "__add after the guard fails")
+
+local function lt(a, b) return a < b end
+for i = 1, 10 do lt(i, 20) end
+expect(lt(obj, obj) == true, "__lt after the guard fails")
+
+local function get(t, k) return t[k] end
+for i = 1, 10 do get(arr, i) end
+expect(get(point, "x") == 3, "string key after the integer key guard fails")
+expect(get(arr, 4) == 16, "integer key again")
+expect(norm2({ y = 1, x = 2 }) == 5, "constant key in another table")
+
+-- a function whose instructions keep flipping stops being specialized
+local vals = { 1, 1.5, 2, 2.5 }
+local s = 0
+for i = 1, 200 do s = add(s, vals[i % 4 + 1]) end
+expect(s == 350, "flipping operand types")
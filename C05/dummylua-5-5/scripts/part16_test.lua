@@ -0,0 +1,137 @@
+-- the method jit, every function below is called often enough to get compiled
+-- and is checked again once it runs as native code. p16_test.c runs the script
+-- with the jit on and off, JIT tells whether functions are expected to compile
+local HOT = 100
+
+local function warm(f, a, b, c)
+	for i = 1, HOT do f(a, b, c) end
+	expect(compiled(f) == JIT, "compiled when the jit is on, interpreted when it is off")
+end
+
+-- OP_MOVE and OP_LOADK
+local function movek(a)
+	local b = a
+	local c = 10
+	local d = 2.5
+	local e = "k"
+	return b, c, d, e
+end
+warm(movek, 1)
+local b, c, d, e = movek(7)
+expect(b == 7 and c == 10 and d == 2.5 and e == "k", "move and loadk")
+
+-- OP_ADD, OP_SUB, OP_MUL, OP_DIV and OP_UNM on integers and floats
+local function arith(a, b)
+	return a + b, a - b, a * b, a / b
+end
+warm(arith, 6, 3)
+local s, d2, m, q = arith(6, 3)
+expect(s == 9 and d2 == 3 and m == 18 and q == 2.0, "integer arithmetic")
+s, d2, m, q = arith(1.5, 0.5)
+expect(s == 2.0 and d2 == 1.0 and m == 0.75 and q == 3.0, "float arithmetic")
+s, d2, m, q = arith(3, 0.5)
+expect(s == 3.5 and d2 == 2.5 and m == 1.5 and q == 6.0, "mixed arithmetic")
+
+local function neg(a) return -a end
+warm(neg, 1)
+expect(neg(6) == -6 and neg(-1.5) == 1.5, "unm")
+
+-- OP_EQ, OP_LT and OP_LE with both outcomes, OP_LOADBOOL and OP_NOT
+local function compare(a, b)
+	return a == b, a < b, a <= b, not (a < b)
+end
+warm(compare, 1, 2)
+local eq, lt, le, nlt = compare(1, 2)
+expect(eq == false and lt == true and le == true and nlt == false, "compare 1, 2")
+eq, lt, le, nlt = compare(2, 2)
+expect(eq == true and lt == false and le == true and nlt == true, "compare 2, 2")
+eq, lt, le, nlt = compare(3, 2)
+expect(eq == false and lt == false and le == false and nlt == true, "compare 3, 2")
+eq, lt, le, nlt = compare(1.5, 2.5)
+expect(eq == false and lt == true and le == true and nlt == false, "compare floats")
+
+-- OP_TEST and OP_TESTSET
+local function logic(a, b)
+	local x = a or b
+	local y = a and b
+	if a then
+		return x, y, 1
+	end
+	return x, y, 0
+end
+warm(logic, 1, 2)
+local x, y, t = logic(1, 2)
+expect(x == 1 and y == 2 and t == 1, "logic on numbers")
+x, y, t = logic(nil, 2)
+expect(x == 2 and y == nil and t == 0, "logic on nil")
+x, y, t = logic(false, 3)
+expect(x == 3 and y == false and t == 0, "logic on false")
+
+-- OP_GETTABLE, OP_SETTABLE and OP_FORLOOP on the array part
+local function scale(arr, n, k)
+	local total = 0
+	for i = 1, n do
+		arr[i] = arr[i] * k
+		total = total + arr[i]
+	end
+	return total
+end
+local arr = {}
+for i = 1, 10 do arr[i] = 1 end
+warm(function() for i = 1, 10 do arr[i] = 1 end return scale(arr, 10, 1) end)
+expect(compiled(scale) == JIT, "a loop makes its function hot")
+expect(scale(arr, 10, 2) == 20, "integer loop over the array part")
+expect(arr[10] == 2, "settable stored the result")
+
+local function fsum(from, to, step)
+	local s = 0
+	for v = from, to, step do s = s + v end
+	return s
+end
+warm(fsum, 1, 10, 1)
+expect(fsum(0.5, 2.5, 0.5) == 7.5, "float loop")
+expect(fsum(10, 1, -3) == 22, "negative step")
+
+-- a failed type guard leaves the native code for the interpreter, which has to
+-- produce the same results, metamethods included
+local mt = {
+	__add = function(a, b) return "add" end,
+	__sub = function(a, b) return "sub" end,
+	__mul = function(a, b) return "mul" end,
+	__div = function(a, b) return "div" end,
+	__lt = function(a, b) return true end,
+	__le = function(a, b) return false end,
+}
+local obj = setmetatable({}, mt)
+s, d2, m, q = arith(obj, 1)
+expect(s == "add" and d2 == "sub" and m == "mul" and q == "div", "arithmetic guards fall back to the metamethods")
+eq, lt, le = compare(obj, obj)
+expect(eq == true and lt == true and le == false, "compare guard falls back to the metamethods")
+
+local words = { "a", "b" }
+local function get(t, k) return t[k] end
+warm(get, arr, 1)
+expect(get(arr, 3) == 2, "array get")
+expect(get({ x = 5 }, "x") == 5, "string key leaves the native code")
+expect(get(arr, 11) == nil, "key out of the array part")
+expect(get(words, 2) == "b", "non number values")
+
+local function set(t, k, v) t[k] = v end
+warm(set, arr, 1, 2)
+set(arr, 1, "one")
+expect(arr[1] == "one", "storing a string leaves the native code")
+set(arr, 12, 3)
+expect(arr[12] == 3, "storing outside the array part")
+local rec = {}
+set(rec, "name", 1)
+expect(rec.name == 1, "string key store")
+
+-- switching the jit off keeps the compiled code, but the interpreter runs it
+setjitmode(0)
+for i = 1, 10 do arr[i] = i end
+expect(scale(arr, 10, 3) == 165, "interpreted loop")
+s, d2, m, q = arith(6, 3)
+expect(s == 9 and d2 == 3 and m == 18 and q == 2.0, "interpreted arithmetic")
+local function cold(a) return a + 1 end
+for i = 1, HOT do cold(i) end
+expect(compiled(cold) == false, "nothing compiles with the jit off")
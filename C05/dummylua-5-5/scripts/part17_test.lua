@@ -0,0 +1,102 @@
+-- the tracing jit, p17_test.c runs the script in trace mode, tracestats()
+-- returns the counters of luaJ_dumptraces and JIT tells whether loops get
+-- traced at all
+local function delta(before, after, field)
+	return after[field] - before[field]
+end
+
+-- a numeric for loop becomes one trace that runs nearly all its iterations
+local st = tracestats()
+local s = 0
+for i = 1, 1000 do
+	s = s + i
+end
+local st2 = tracestats()
+expect(s == 500500, "numeric for")
+if JIT then
+	expect(delta(st, st2, "traces") == 1, "numeric for is traced")
+	expect(delta(st, st2, "aborts") == 0, "numeric for does not abort")
+	expect(st2.entries > 0, "the trace is entered")
+	expect(st2.sideexits == 0, "no side exits on a stable loop")
+end
+
+-- a generic for over a c iterator: the trace runs the loop body and hands the
+-- call of the iterator to the interpreter at OP_TFORCALL
+local arr = {}
+for i = 1, 500 do arr[i] = i * 2 end
+st = tracestats()
+s = 0
+for i, v in ipairs(arr) do
+	s = s + v
+end
+st2 = tracestats()
+expect(s == 250500, "ipairs loop")
+if JIT then
+	expect(delta(st, st2, "traces") == 1, "ipairs loop is traced")
+	expect(delta(st, st2, "aborts") == 0, "ipairs loop does not abort")
+	expect(delta(st, st2, "blacklisted") == 0, "ipairs loop is not blacklisted")
+	expect(delta(st, st2, "entries") > 400, "the ipairs trace runs the iterations")
+	expect(delta(st, st2, "sideexits") == 0, "returning to the iterator call is no side exit")
+end
+
+-- a lua iterator, its frame is never recorded since the trace ends at the call
+local function range(n)
+	return function(_, i)
+		if i < n then return i + 1, i end
+		return nil
+	end, nil, 0
+end
+st = tracestats()
+s = 0
+for i, prev in range(300) do
+	s = s + i - prev
+end
+st2 = tracestats()
+expect(s == 300, "lua iterator loop")
+if JIT then
+	expect(delta(st, st2, "traces") == 1, "lua iterator loop is traced")
+	expect(delta(st, st2, "aborts") == 0, "lua iterator loop does not abort")
+end
+
+-- the trace of a generic for guards the types of its body, a change of types
+-- leaves the trace and gives the same result
+local mixed = {}
+for i = 1, 300 do mixed[i] = i end
+for i = 151, 300 do mixed[i] = 0.5 end
+s = 0
+for i, v in ipairs(mixed) do
+	s = s + v
+end
+expect(s == 11325 + 75.0, "ipairs over changing types")
+
+-- a loop that calls a function has no template for the call, the recordings
+-- abort until the loop is blacklisted
+st = tracestats()
+local n = 0
+local k = 0
+while k < 2000 do
+	k = k + 1
+	n = select(1, n) + 1
+end
+st2 = tracestats()
+expect(n == 2000, "loop with a call")
+if JIT then
+	expect(delta(st, st2, "aborts") > 0, "calls abort the recording")
+	expect(delta(st, st2, "blacklisted") == 1, "the loop is blacklisted")
+	expect(delta(st, st2, "traces") == 0, "no trace for the loop with a call")
+end
+
+-- a nested generic for does not end the trace of the outer loop
+st = tracestats()
+s = 0
+for j = 1, 300 do
+	for i, v in ipairs({ 1, 2 }) do
+		s = s + v
+	end
+end
+expect(s == 900, "nested generic for")
+
+if not JIT then
+	st = tracestats()
+	expect(st.traces == 0 and st.recorded == 0, "nothing is traced without the jit")
+end
@@ -0,0 +1,121 @@
+-- ahead of time compilation, luatoc translates this file into c and the test
+-- compares what the translation prints with what the interpreter prints, see
+-- test/aotdiff.cmake. the script only prints values that do not depend on
+-- addresses
+print(1 + 2, 3 * 4, 7 // 2, 7 % 3, -7 // 2, -7 % 3, 2 ^ 10, 10 / 4)
+print(1.5 + 2, 2 * 0.25, 1 - 0.5, -(3), -(2.5))
+local big = 9007199254740993
+print(big + 0, big == 9007199254740993)
+
+-- calls, recursion, tail calls and varargs
+local function fib(n) if n < 2 then return n end return fib(n - 1) + fib(n - 2) end
+print(fib(20))
+local function deep(n) if n == 0 then return 0 end return 1 + deep(n - 1) end
+print(deep(5000))
+local function tail(n) if n == 0 then return "done" end return tail(n - 1) end
+print(tail(100000))
+local function va(...) return select('#', ...), select(2, ...) end
+print(va(1, nil, 3))
+local function va2(a, ...) local t = { ... } return a, #t, ... end
+print(va2(1, 2, 3, 4))
+local function nothing(a) end
+print(nothing(1))
+print((nothing(1)))
+
+-- loops
+local s = 0
+for i = 1, 10 do s = s + i end
+print(s)
+for i = 10, 1, -3 do s = i end
+print(s)
+for i = 1.0, 2.0, 0.5 do print(i) end
+for i = 1, 0 do print("never") end
+local i = 0
+repeat i = i + 1 if i == 4 then break end until false
+print(i)
+local k = 0
+while true do
+	k = k + 1
+	if k > 2 then break end
+end
+print(k)
+
+-- tables
+local t = {}
+for j = 1, 100 do t[#t + 1] = j end
+print(#t, t[100])
+t[50] = nil
+print(t[49], t[50], t[51])
+local rec = { x = 1, y = "two", [3] = 3.5 }
+print(rec.x, rec.y, rec[3])
+rec.x = rec.x + 10
+print(rec.x)
+local sum = 0
+for j, v in ipairs({ 4, 5, 6 }) do sum = sum + j * v end
+print(sum)
+
+-- strings and logic
+local a, b, c, d = "a", "b", 1, 2.5
+print(a .. b .. c .. d, "x" .. 1 .. "y")
+print(1 == 1, 1 ~= 2, 2 < 1, 3 >= 3, 3 > 3, 2 <= 2, "a" == "a", nil == false)
+print(not nil, not "s", not 0, not false)
+print(false and 1, true or 1, nil or 5, 1 and 2, false or nil)
+local r = (a == "a") and "big" or "small"
+print(r)
+
+-- closures and upvalues
+local x = 10
+local function getx() return x end
+print(getx())
+x = 20
+print(getx())
+local function counter()
+	local n = 0
+	return function() n = n + 1 return n end
+end
+local c1 = counter()
+local c2 = counter()
+print(c1(), c1(), c2(), c1())
+for j = 1, 3 do
+	local z = j * 10
+	local function gz() return z end
+	print(gz())
+end
+local function setg(v) G_V = v end
+setg(42)
+print(G_V)
+
+-- metatables and the __index chain
+local Base = {}
+Base.__index = Base
+function Base.hello() return "base" end
+local Derived = setmetatable({}, Base)
+Derived.__index = Derived
+local o = setmetatable({}, Derived)
+print(o.hello())
+function Derived.hello() return "derived" end
+print(o.hello())
+Derived.hello = nil
+print(o.hello())
+local vec = setmetatable({}, { __add = function(p, q) return "added" end })
+print(vec + 1)
+
+-- generic for with a lua iterator
+local function range(n)
+	return function(_, j)
+		if j < n then return j + 1, j * j end
+		return nil
+	end, nil, 0
+end
+for j, sq in range(4) do print(j, sq) end
+
+-- coroutines
+local co = coroutine.create(function(p)
+	local q = coroutine.yield(p + 1)
+	return q * 2
+end)
+print(coroutine.resume(co, 1))
+print(coroutine.resume(co, 5))
+print(coroutine.status(co))
+
+expect(fib(10) == 55, "fib")
@@ -0,0 +1,184 @@
+-- the peephole pass of luaK_finish threads jumps, merges moves into the
+-- instructions next to them and drops dead code. the results below have to be
+-- the ones of the plain code, and the lines of the remaining instructions
+-- have to stay where they were
+
+-- and/or chains, as values and as conditions, for every combination of truthy
+-- and falsy operands
+local vals = { false, 1, 0, "s" }
+local n = 0
+for ia = 1, 5 do
+	for ib = 1, 5 do
+		for ic = 1, 5 do
+			local a = vals[ia]
+			local b = vals[ib]
+			local c = vals[ic]
+
+			local v1
+			if a then v1 = b else v1 = a end
+			if not v1 then v1 = c end
+			expect((a and b or c) == v1, "a and b or c")
+
+			local v2
+			if a then v2 = a else v2 = b end
+			if v2 then v2 = c end
+			expect(((a or b) and c) == v2, "(a or b) and c")
+
+			local v3 = false
+			if a then
+				if b or c then v3 = true end
+			elseif c then
+				v3 = true
+			end
+			local got = false
+			if a and (b or c) or not a and c then got = true end
+			expect(got == v3, "a and (b or c) or not a and c as a condition")
+
+			local v4 = true
+			if a and b and c then v4 = false end
+			expect((not (a and b and c)) == v4, "not (a and b and c)")
+
+			n = n + 1
+		end
+	end
+end
+expect(n == 125, "all combinations")
+
+-- a chain whose jumps go to other jumps
+local function classify(x)
+	if x == nil then
+		return "nil"
+	elseif x == false then
+		return "false"
+	elseif x == 0 then
+		return "zero"
+	elseif x and x ~= 1 then
+		return "other"
+	else
+		return "one"
+	end
+end
+expect(classify(nil) == "nil" and classify(false) == "false" and classify(0) == "zero", "else if chain")
+expect(classify(1) == "one" and classify(2) == "other", "else if chain with and")
+
+-- assignments, a result computed into a temporary and moved into the local
+local a, b = 3, 4
+local c = a + b
+local d = c
+d = d * 2
+expect(c == 7 and d == 14, "move into a local")
+a, b = b, a
+expect(a == 4 and b == 3, "swap")
+local x, y, z = 1, 2, 3
+x, y, z = z, x, y
+expect(x == 3 and y == 1 and z == 2, "rotate")
+x = x
+expect(x == 3, "self assignment")
+local dead = 1
+dead = 2
+dead = dead + 1
+expect(dead == 3, "overwritten store")
+local t = { a + 1, b + 1 }
+local u = t[1] + t[2]
+t[1] = u
+expect(t[1] == 9 and t[2] == 4, "table stores")
+local function pass(...) return ... end
+local p1, p2 = pass(a, b)
+expect(p1 == 4 and p2 == 3, "call results into locals")
+local e = a > b
+expect(e == true, "comparison result into a local")
+local f = not e
+expect(f == false, "not into a local")
+
+-- loops with breaks out of nested loops and conditions at the end
+local count = 0
+for i = 1, 10 do
+	for j = 1, 10 do
+		if j > i then break end
+		count = count + 1
+	end
+end
+expect(count == 55, "nested for with break")
+
+local i = 0
+local s = 0
+while true do
+	i = i + 1
+	if i % 2 == 0 then
+		s = s + i
+	elseif i > 9 then
+		break
+	end
+end
+expect(i == 11 and s == 30, "while true with break")
+
+local k = 0
+repeat
+	local done = k > 4
+	k = k + 1
+until done
+expect(k == 6, "repeat with a local in the condition")
+
+local w = 10
+while w > 0 and w ~= 3 do w = w - 1 end
+expect(w == 3, "while with an and condition")
+
+local hits = 0
+for q = 1, 20 do
+	if q < 5 or q > 15 then
+		hits = hits + 1
+	end
+end
+expect(hits == 9, "or in a loop condition")
+
+local function early(limit)
+	for q = 1, 100 do
+		if q == limit then return q end
+	end
+	return -1
+end
+expect(early(7) == 7 and early(200) == -1, "return out of a loop")
+
+-- unreachable code after a return is dropped, the code after it still runs
+local function unreachable(v)
+	do return v + 1 end
+	return v + 2
+end
+expect(unreachable(1) == 2, "code after return")
+
+-- the lines of the remaining instructions
+local here = line()
+expect(here == 150, "line of a call")
+local l1 = line(); local l2 = line()
+expect(l1 == 152 and l2 == 152, "two calls on one line")
+local l3 =
+	line()
+expect(l3 == 155, "call on the line after the assignment")
+
+-- an instruction gets the line of the token after its expression, so the
+-- statements that fail below do not end their line
+local function fails(v)
+	local r = v + 1; local q = r
+	return q
+end
+local ok, msg = try(fails, nil)
+expect(ok == false, "runtime error")
+expect(errline(msg) == 161, "line of an error in a merged move")
+
+local function fails2(v)
+	if v then
+		local m = v and v.field; return m
+	end
+end
+ok, msg = try(fails2, 5)
+expect(ok == false and errline(msg) == 170, "line of an error in an and chain")
+
+local function fails3()
+	local acc = 0
+	for q = 1, 3 do
+		acc = acc + q
+	end
+	acc = acc + nil; return acc
+end
+ok, msg = try(fails3)
+expect(ok == false and errline(msg) == 181, "line of an error after a loop")
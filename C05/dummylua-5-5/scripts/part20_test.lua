@@ -0,0 +1,106 @@
+-- the inliner of luaK_finish, p20_test.c runs the script with luaK_setinline
+-- on and off. INLINE tells which, and ncalls(f) counts the calls left in f
+local function inlined(f, n, what)
+	if INLINE then
+		expect(ncalls(f) == n, what .. " is inlined")
+	else
+		expect(ncalls(f) > n, what .. " is a call without the inliner")
+	end
+end
+
+local function add(a, b) return a + b end
+local function sq(a) return a * a end
+
+-- callees that read upvalues, the inlined code has to see later assignments
+local x = 10
+local function getx() return x end
+local function user()
+	return getx() + sq(3)
+end
+expect(user() == 19, "upvalue read by an inlined callee")
+x = 1
+expect(user() == 10, "the inlined callee sees the new value")
+inlined(user, 0, "a callee reading an upvalue")
+
+local scale = { k = 3 }
+local function scaled(v) return v * scale.k end
+local function usescale(v) return scaled(v) + 1 end
+expect(usescale(2) == 7, "callee indexing an upvalue table")
+scale.k = 5
+expect(usescale(2) == 11, "the inlined callee sees the table change")
+
+-- callees inlined into nested closures
+local function outer()
+	local y = 3
+	local function gy() return y end
+	local function inc(a) return a + 1 end
+	local function inner() return gy() + inc(y) end
+	y = 4
+	return inner
+end
+expect(outer()() == 9, "inlined into a nested closure")
+inlined(outer(), 0, "calls in a nested closure")
+
+local function maker(i)
+	local z = i * 10
+	local function mul(a, b) return a * b end
+	return function() return mul(z, i) + z end
+end
+local fs = {}
+for i = 1, 3 do fs[i] = maker(i) end
+expect(fs[1]() == 20 and fs[2]() == 60 and fs[3]() == 120, "inlined into closures of separate calls")
+inlined(fs[2], 0, "calls in closures of separate calls")
+
+
+-- tail calls and consumers of all the results of a call
+local function tc(a) return sq(a) end
+expect(tc(7) == 49, "tail call")
+inlined(tc, 0, "a tail call")
+
+local function wrap(a) return add(a, 1) end
+expect(wrap(5) == 6, "tail call with two arguments")
+
+local function two(a) return a, sq(a) end
+local p, q = two(4)
+expect(p == 4 and q == 16, "the last value of a return")
+inlined(two, 0, "a call whose results are returned")
+
+local function list(a) return { a, sq(a) } end
+local t = list(3)
+expect(#t == 2 and t[1] == 3 and t[2] == 9, "the last value of a table constructor")
+
+local function pass(...) return select('#', ...), ... end
+local function multi(a) return pass(a, sq(a)) end
+local nm, m1, m2 = multi(5)
+expect(nm == 2 and m1 == 5 and m2 == 25, "the last argument of a call")
+
+local function nothing(a) end
+local function usenothing(a) return nothing(a) end
+expect(usenothing(1) == nil, "a callee without results")
+expect(select('#', usenothing(1)) == 0, "no results at all")
+expect(select('#', (nothing(1))) == 1, "one nil in parentheses")
+
+-- calls that are never inlined
+local function branchy(a) if a then return 1 end return 2 end
+local function usebranchy(a) return branchy(a) + 1 end
+expect(usebranchy(true) == 2 and usebranchy(false) == 3, "a callee with a branch")
+expect(ncalls(usebranchy) == 1, "a callee with a branch is called")
+
+local function va(...) return ... end
+local function useva(a) return va(a) end
+expect(useva(3) == 3, "a vararg callee")
+expect(ncalls(useva) == 1, "a vararg callee is called")
+
+local changing = function(a) return a + 1 end
+local function usechanging(a) return changing(a) end
+expect(usechanging(1) == 2, "before the local changes")
+changing = function(a) return a + 100 end
+expect(usechanging(1) == 101, "a local that is assigned again is called")
+expect(ncalls(usechanging) == 1, "a local that is assigned again stays a call")
+
+local written = function() return 1 end
+local function setwritten() written = function() return 2 end end
+local function usewritten() return written() end
+setwritten()
+expect(usewritten() == 2, "a local written by a closure")
+expect(ncalls(usewritten) == 1, "a local written by a closure stays a call")
@@ -0,0 +1,95 @@
+-- constant folding, <const> locals and dropped branches. count(f, op) tells
+-- how many instructions of f have the opcode op
+
+-- comparisons of two constants are folded to true and false
+local function cmps()
+	return 1 < 2, 2 < 1, 2 <= 2, 3 <= 2, 3 > 2, 2 > 3, 3 >= 3, 2 >= 3,
+		1 == 1, 1 == 2, "a" == "a", "a" ~= "b", 1.5 < 2, 2 == 2.0, nil == false
+end
+local r = { cmps() }
+expect(r[1] == true and r[2] == false, "folded <")
+expect(r[3] == true and r[4] == false, "folded <=")
+expect(r[5] == true and r[6] == false, "folded >")
+expect(r[7] == true and r[8] == false, "folded >=")
+expect(r[9] == true and r[10] == false, "folded == on numbers")
+expect(r[11] == true and r[12] == true, "folded == and ~= on strings")
+expect(r[13] == true and r[14] == true, "folded float comparisons")
+expect(r[15] == false, "folded nil == false")
+expect(count(cmps, "EQ") == 0 and count(cmps, "LT") == 0 and count(cmps, "LE") == 0, "no comparison is left")
+
+local function folds()
+	return "a" .. "b" .. "c", not "s", not nil, 2 * 3 + 1
+end
+local s, ns, nn, ar = folds()
+expect(s == "abc" and ns == false and nn == true and ar == 7, "folded concat, not and arithmetic")
+expect(count(folds, "CONCAT") == 0 and count(folds, "NOT") == 0, "no concat or not is left")
+
+-- '>=' and '>' on registers, '>=' used to compile like '>'
+local function ge(a, b) return a >= b end
+local function gt(a, b) return a > b end
+local function gek(a) return a >= 0 end
+local function gtk(a) return a > 0 end
+local function kge(a) return 0 >= a end
+expect(ge(3, 3) == true and ge(4, 3) == true and ge(2, 3) == false, ">= on registers")
+expect(gt(3, 3) == false and gt(4, 3) == true and gt(2, 3) == false, "> on registers")
+expect(gek(0) == true and gek(1) == true and gek(-1) == false, ">= a constant")
+expect(gtk(0) == false and gtk(1) == true and gtk(-1) == false, "> a constant")
+expect(kge(0) == true and kge(1) == false and kge(-1) == true, "constant >= a register")
+expect(ge(2.5, 2.5) == true and ge(2.5, 3) == false, ">= on floats")
+local n = 0
+for i = -5, 5 do
+	if i >= 0 then n = n + 1 end
+end
+expect(n == 6, ">= in a condition")
+
+-- <const> locals are replaced by their values, nested functions included
+local N <const> = 3
+local NAME <const> = "name"
+local DEBUG <const> = false
+local plain = 3
+local function usesconst(x) return x * N end
+local function usesplain(x) return x * plain end
+expect(usesconst(2) == 6 and usesplain(2) == 6, "const and plain local")
+expect(count(usesconst, "GETUPVAL") == 0, "a const is no upvalue")
+expect(count(usesplain, "GETUPVAL") == 1, "a plain local is an upvalue")
+local function deeper()
+	return function(x) return x .. NAME end
+end
+expect(deeper()("a") == "aname", "a const two functions down")
+expect(count(deeper(), "GETUPVAL") == 0, "a const two functions down is no upvalue")
+local function sizes() return N * N, N == 3, NAME .. "s" end
+local sq, eq3, names = sizes()
+expect(sq == 9 and eq3 == true and names == "names", "consts fold with other constants")
+expect(count(sizes, "MUL") == 0 and count(sizes, "EQ") == 0 and count(sizes, "CONCAT") == 0, "const expressions are folded")
+
+-- branches on a constant condition are dropped, the other branch stays
+local function branches(x)
+	if DEBUG then x = x + 100 end
+	if false then x = x + 1000 elseif N == 3 then x = x + 1 else x = x + 10000 end
+	while false do x = x + 5 end
+	if true then x = x * 2 else x = x * 3 end
+	return x
+end
+expect(branches(1) == 4, "constant branches")
+expect(count(branches, "ADD") == 1 and count(branches, "MUL") == 1, "dead branches are dropped")
+expect(count(branches, "TEST") == 0 and count(branches, "EQ") == 0, "no test is left")
+
+local function shortcut(x)
+	local a = false and x.field
+	local b = true or x.field
+	local c = DEBUG and x.field
+	return a, b, c
+end
+local a, b, c = shortcut(nil)
+expect(a == false and b == true and c == false, "false and x, true or x")
+
+local k = 0
+repeat k = k + 1 if k == 3 then break end until false
+expect(k == 3, "repeat until false")
+
+-- a global can change at runtime, a branch on it stays
+G_DEBUG = false
+local function global() if G_DEBUG then return 1 end return 2 end
+expect(global() == 2, "global false")
+G_DEBUG = true
+expect(global() == 1, "global changed at runtime")
@@ -0,0 +1,138 @@
+-- coroutines: resume and yield, wrap, status, yields that can not cross a
+-- metamethod, yields from deep recursion and collection of dead threads.
+-- nthreads() tells how many threads the collector still keeps
+
+-- values pass both ways through resume and yield
+local co = coroutine.create(function(a, b)
+	local c = coroutine.yield(a + b, a * b)
+	local d, e = coroutine.yield(c * 2)
+	return d .. e, "end"
+end)
+expect(coroutine.status(co) == "suspended", "a new coroutine is suspended")
+local ok, s, m = coroutine.resume(co, 3, 4)
+expect(ok == true and s == 7 and m == 12, "resume passes arguments, yield passes results")
+local ok, x = coroutine.resume(co, 10)
+expect(ok == true and x == 20, "resume passes values to yield")
+local ok, r1, r2 = coroutine.resume(co, "a", "b")
+expect(ok == true and r1 == "ab" and r2 == "end", "the return values finish the resume")
+expect(coroutine.status(co) == "dead", "a finished coroutine is dead")
+local ok, msg = coroutine.resume(co)
+expect(ok == false and msg ~= nil, "a dead coroutine can not be resumed")
+
+-- status from inside and from another coroutine
+local function peek(th, seen)
+	seen[2] = coroutine.status(th)
+	coroutine.yield()
+end
+local seen = {}
+local outer = coroutine.create(function(self, seen)
+	seen[1] = coroutine.status(self)
+	local inner = coroutine.create(peek)
+	coroutine.resume(inner, self, seen)
+	seen[3] = coroutine.status(inner)
+	coroutine.yield()
+end)
+coroutine.resume(outer, outer, seen)
+expect(seen[1] == "running", "a coroutine sees itself running")
+expect(seen[2] == "normal", "a coroutine that resumed another one is normal")
+expect(seen[3] == "suspended", "a coroutine that yielded is suspended")
+expect(coroutine.status(outer) == "suspended", "outer is suspended after its yield")
+local th, ismain = coroutine.running()
+expect(ismain == true and coroutine.isyieldable() == false, "the main thread can not yield")
+
+-- wrap
+local acc = coroutine.wrap(function(x)
+	while true do
+		x = x + coroutine.yield(x)
+	end
+end)
+expect(acc(1) == 1 and acc(2) == 3 and acc(10) == 13, "wrap keeps state between calls")
+
+local function range(n)
+	return coroutine.wrap(function()
+		for i = 1, n do
+			coroutine.yield(i, i * i)
+		end
+	end)
+end
+local sum, sq = 0, 0
+for i, ii in range(10) do
+	sum = sum + i
+	sq = sq + ii
+end
+expect(sum == 55 and sq == 385, "wrap works as a generic for iterator")
+
+local bad = coroutine.wrap(function() local z = nil; z() end)
+local runner = coroutine.create(function() bad() end)
+local ok, msg = coroutine.resume(runner)
+expect(ok == false and msg ~= nil, "wrap propagates errors to its caller")
+
+-- an error inside a coroutine kills it
+local e = coroutine.create(function() local t = nil; return t.x end)
+local ok, msg = coroutine.resume(e)
+expect(ok == false and msg ~= nil and coroutine.status(e) == "dead", "an error makes the coroutine dead")
+
+-- a metamethod runs in a C call boundary, yielding from it is an error
+local mt = { __add = function(a, b) coroutine.yield(1); return 3 end }
+local ca = coroutine.create(function() local t = setmetatable({}, mt); return t + 1 end)
+local ok, msg = coroutine.resume(ca)
+expect(ok == false and msg ~= nil, "a yield across a metamethod errors out")
+expect(coroutine.status(ca) == "dead", "the coroutine that yielded across a metamethod is dead")
+local mi = { __index = function(t, k) return coroutine.yield(k) end }
+local ci = coroutine.create(function() local t = setmetatable({}, mi); return t.key end)
+local ok, msg = coroutine.resume(ci)
+expect(ok == false and msg ~= nil, "a yield across __index errors out")
+
+-- yield from the bottom of a deep recursion, the coroutine stack grows and
+-- is kept across a collection
+local function deep(n)
+	if n == 0 then
+		return coroutine.yield("bottom")
+	end
+	return 1 + deep(n - 1)
+end
+local d = coroutine.create(function(n) return deep(n) end)
+local ok, v = coroutine.resume(d, 5000)
+expect(ok == true and v == "bottom", "yield from a deep recursion")
+collectgarbage()
+local ok, v = coroutine.resume(d, 1)
+expect(ok == true and v == 5001, "resume unwinds the deep recursion")
+expect(coroutine.status(d) == "dead", "the deep coroutine finished")
+
+-- dead threads and threads dropped while suspended are collected, the
+-- ones still referenced survive
+local function gen(i)
+	return coroutine.create(function(x)
+		local t = { x, i }
+		coroutine.yield(t[1])
+		return t[2]
+	end)
+end
+collectgarbage()
+local base = nthreads()
+local keep = {}
+local total = 0
+for i = 1, 2000 do
+	local c = gen(i)
+	local ok, v = coroutine.resume(c, i)
+	total = total + v
+	if i % 2 == 0 then
+		coroutine.resume(c)
+	end
+	if i % 100 == 0 then
+		keep[#keep + 1] = c
+	end
+end
+expect(total == 2001000, "every coroutine ran")
+expect(nthreads() > base + 20, "the coroutines are still around before a collection")
+collectgarbage()
+expect(nthreads() == base + 20, "only the referenced coroutines survive a collection")
+local alive = 0
+for i = 1, #keep do
+	expect(coroutine.status(keep[i]) == "dead", "kept coroutines ran to the end")
+	alive = alive + 1
+end
+expect(alive == 20, "kept coroutines are reachable")
+keep = nil
+collectgarbage()
+expect(nthreads() == base, "dropped coroutines are collected")
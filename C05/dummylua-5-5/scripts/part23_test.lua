@@ -0,0 +1,43 @@
+-- lua to lua calls do not recurse into luaV_execute, so the depth is only
+-- bounded by the lua stack and not by the C stack or LUA_MAXCALLS (200)
+
+local function sum(n)
+	if n == 0 then
+		return 0
+	end
+	return n + sum(n - 1)
+end
+expect(sum(199) == 19900, "below the old call limit")
+expect(sum(1000) == 500500, "above the old call limit")
+expect(sum(100000) == 5000050000, "100000 frames deep")
+
+local iseven
+local function isodd(n)
+	if n == 0 then
+		return false
+	end
+	return iseven(n - 1) == true
+end
+iseven = function(n)
+	if n == 0 then
+		return true
+	end
+	return isodd(n - 1) == true
+end
+expect(iseven(20000) == true and isodd(20001) == true, "mutual recursion")
+
+-- results of calls used inside expressions and argument lists
+local function add(a, b) return a + b end
+local function two() return 1, 2 end
+expect(add(sum(3), sum(4)) == 16, "calls as arguments")
+expect(add(two()) == 3, "a call expanding into the arguments")
+local t = {two(), two()}
+expect(t[1] == 1 and t[2] == 1 and t[3] == 2, "calls in a constructor")
+
+-- a runaway recursion is an error that can be caught, and the stack still works after it
+local function forever(n)
+	return 1 + forever(n + 1)
+end
+local ok, msg = try(forever, 1)
+expect(ok == false and msg ~= nil, "a runaway recursion raises an error")
+expect(sum(10000) == 50005000, "deep calls work again after the overflow")
@@ -0,0 +1,55 @@
+-- proper tail calls, 'return f(args)' reuses the frame of the caller, so any
+-- number of them runs in the same CallInfo depth. cidepth() counts the
+-- CallInfos in use, its own included
+
+local function loop(n)
+	if n == 0 then
+		return cidepth()
+	end
+	return loop(n - 1)
+end
+local d = loop(1)
+expect(loop(1000) == d, "1000 tail calls take no extra CallInfo")
+expect(loop(1000000) == d, "a million tail calls take no extra CallInfo")
+
+local function nottail(n)
+	if n == 0 then
+		return cidepth()
+	end
+	return (nottail(n - 1))
+end
+expect(nottail(10) == nottail(0) + 10, "a call in parentheses is not a tail call")
+
+local pong
+local function ping(n, acc)
+	if n == 0 then
+		return acc
+	end
+	return pong(n - 1, acc + 1)
+end
+pong = function(n, acc)
+	return ping(n, acc)
+end
+expect(ping(500000, 0) == 500000, "mutual tail recursion")
+
+-- the callee gets its own arguments, with missing ones nil and extra ones dropped
+local function three(a, b, c)
+	return c == nil and a + b
+end
+local function wrap(x)
+	return three(x, x, nil, x)
+end
+local function short(x)
+	return three(x, 1)
+end
+expect(wrap(2) == 4 and short(5) == 6, "arguments of a tail call")
+
+-- all the results of the tail called function are returned
+local function two() return 1, 2 end
+local function tailtwo() return two() end
+local a, b = tailtwo()
+expect(a == 1 and b == 2, "a tail call returns every result")
+
+-- a tail call to a c function
+local function depth() return cidepth() end
+expect(depth() == d, "a tail call to a c function replaces the frame")
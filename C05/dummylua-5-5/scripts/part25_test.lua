@@ -0,0 +1,66 @@
+-- vararg functions, '...' and select. The extra arguments stay on the stack
+-- below the frame of the callee
+
+local function count(...)
+	return select('#', ...)
+end
+expect(count() == 0, "no extra arguments")
+expect(count(nil) == 1, "a nil argument counts")
+expect(count(1, nil, 3, nil) == 4, "trailing nils count")
+
+local function pick(n, ...)
+	return select(n, ...)
+end
+local a, b = pick(2, "x", "y", "z")
+expect(a == "y" and b == "z", "select(n, ...) returns the tail")
+local a, b = pick(-1, "x", "y", "z")
+expect(a == "z" and b == nil, "a negative index counts from the end")
+expect(pick(4, "x", "y", "z") == nil, "an index past the end gives nothing")
+local ok = try(pick, 0, "x")
+expect(ok == false, "select(0, ...) is an error")
+
+-- fewer arguments than fixed parameters, the missing ones are nil and there are no extras
+local function fixed(a, b, c, ...)
+	return a, b, c, select('#', ...)
+end
+local a, b, c, n = fixed(1)
+expect(a == 1 and b == nil and c == nil and n == 0, "missing parameters are nil")
+local a, b, c, n = fixed(1, 2, 3, 4, 5)
+expect(a == 1 and c == 3 and n == 2, "the extra arguments after the fixed ones")
+
+local function many(p1, p2, p3, p4, p5, p6, p7, p8, p9, p10, p11, p12, p13, p14, p15, p16,
+	p17, p18, p19, p20, p21, p22, p23, p24, p25, p26, p27, p28, p29, p30, ...)
+	local l1, l2, l3, l4, l5, l6, l7, l8 = 1, 2, 3, 4, 5, 6, 7, 8
+	return p30 == nil and select('#', ...) == 0 and l8 == 8
+end
+expect(many() == true, "a frame with many nil filled parameters")
+expect(many(1, 2, 3) == true, "a frame with some of them passed")
+
+-- '...' as a value: adjusted to one value or expanded as the last expression
+local function first(...)
+	local x = ...
+	return x
+end
+expect(first(7, 8) == 7 and first() == nil, "'...' adjusted to one value")
+
+local function pack(...)
+	return {...}
+end
+local t = pack(1, 2, 3)
+expect(t[1] == 1 and t[3] == 3 and t[4] == nil, "'...' in a constructor")
+local t = pack()
+expect(t[1] == nil, "an empty '...' in a constructor")
+
+local function pass(...)
+	return count(...), count(..., 10), count(10, ...)
+end
+local n1, n2, n3 = pass(1, 2, 3)
+expect(n1 == 3 and n2 == 2 and n3 == 4, "'...' in an argument list")
+
+local function deep(n, ...)
+	if n == 0 then
+		return select('#', ...)
+	end
+	return deep(n - 1, n, ...)
+end
+expect(deep(100) == 100, "a growing vararg list")
@@ -0,0 +1,81 @@
+-- numeric for loops. With an integer start and step the trip count is worked
+-- out once in OP_FORPREP, so loops at the ends of the integer range run the
+-- right number of times and never overflow the control variable. p26_test.c
+-- sets maxinteger and mininteger
+local maxi = maxinteger
+local mini = mininteger
+
+local function count(a, b, c)
+	local n = 0
+	local last = nil
+	for i = a, b, c do
+		n = n + 1
+		last = i
+	end
+	return n, last
+end
+
+local n, last = count(1, 10, 1)
+expect(n == 10 and last == 10, "a plain loop")
+local n = count(10, 1, 1)
+expect(n == 0, "an empty loop")
+local n, last = count(10, 1, -1)
+expect(n == 10 and last == 1, "a negative step")
+local n, last = count(1, 10, 3)
+expect(n == 4 and last == 10, "a step that lands on the limit")
+local n, last = count(1, 11, 3)
+expect(n == 4 and last == 10, "a step that passes the limit")
+local n, last = count(-5, -20, -4)
+expect(n == 4 and last == -17, "a negative step that passes the limit")
+
+-- at the ends of the integer range
+local n, last = count(9223372036854775805, maxi, 1)
+expect(n == 3 and last == maxi, "up to maxinteger")
+local n, last = count(0, mini, mini)
+expect(n == 2 and last == mini, "down to mininteger")
+local n, last = count(mini, mini, mini)
+expect(n == 1 and last == mini, "one iteration at mininteger")
+local n, last = count(9223372036854775797, maxi, 4)
+expect(n == 3 and last == 9223372036854775805, "a step past maxinteger stops")
+local n, last = count(mini, 0, maxi)
+expect(n == 2 and last == -1, "a huge step from mininteger")
+local n, last = count(0, maxi, maxi)
+expect(n == 2 and last == maxi, "a step of maxinteger")
+local n, last = count(maxi, mini, mini)
+expect(n == 2 and last == -1, "a step of mininteger")
+local n = count(maxi, 9223372036854775806, 1)
+expect(n == 0, "no iteration past maxinteger")
+
+-- float limits are cut to integers, the control variable stays an integer
+local n, last = count(1, 3.5, 1)
+expect(n == 3 and last == 3, "a float limit")
+local n, last = count(3, 0.5, -1)
+expect(n == 3 and last == 1, "a float limit with a negative step")
+local huge = 100000000000000000000.0
+local n, last = count(9223372036854775806, huge, 1)
+expect(n == 2 and last == maxi, "a limit beyond the integer range")
+local n = count(1, -huge, 1)
+expect(n == 0, "a limit below the integer range")
+
+-- a float start or step makes a float loop
+local n, last = count(0, 1, 0.25)
+expect(n == 5 and last == 1.0, "a float step")
+local n, last = count(1, 0, -0.5)
+expect(n == 3 and last == 0.0, "a negative float step")
+local n, last = count(0.5, 3, 1)
+expect(n == 3 and last == 2.5, "a float start")
+
+-- a zero step is an error
+local ok = try(count, 1, 10, 0)
+expect(ok == false, "an integer step of zero")
+local ok = try(count, 1, 10, 0.0)
+expect(ok == false, "a float step of zero")
+
+-- nested loops and a body that does not touch the control variable
+local total = 0
+for i = 1, 100 do
+	for j = i, 1, -1 do
+		total = total + 1
+	end
+end
+expect(total == 5050, "nested loops")
@@ -0,0 +1,59 @@
+-- integer and float arithmetic. Integer operands give integer results that
+-- wrap around, only '/' and '^' always give floats. mtype(x) tells the
+-- subtype, p27_test.c sets maxinteger and mininteger
+local maxi = maxinteger
+local mini = mininteger
+
+local function isint(x, v) return mtype(x) == "integer" and x == v end
+local function isflt(x, v) return mtype(x) == "float" and x == v end
+
+-- results stay integers
+local a, b = 6, 4
+expect(isint(a + b, 10) and isint(a - b, 2) and isint(a * b, 24), "+, - and * of integers")
+expect(isint(-a, -6), "unary minus of an integer")
+expect(isflt(a / b, 1.5) and isflt(8 / b, 2.0), "'/' is always a float")
+expect(isflt(a + 0.5, 6.5) and isflt(b * 1.0, 4.0), "a float operand gives a float")
+
+-- wrap around
+local one = 1
+expect(isint(maxi + one, mini), "maxinteger + 1 wraps to mininteger")
+expect(isint(mini - one, maxi), "mininteger - 1 wraps to maxinteger")
+expect(isint(maxi * 2, -2), "maxinteger * 2")
+expect(isint(-mini, mini), "-mininteger is mininteger")
+expect(mini < maxi and mini + maxi == -1, "comparisons at the ends of the range")
+
+-- floor division and modulo with negative operands
+local function idiv(x, y) return x // y end
+local function mod(x, y) return x % y end
+expect(isint(idiv(7, 2), 3) and isint(idiv(-7, 2), -4), "// rounds towards minus infinity")
+expect(isint(idiv(7, -2), -4) and isint(idiv(-7, -2), 3), "// with a negative divisor")
+expect(isint(mod(7, 3), 1) and isint(mod(-7, 3), 2), "% takes the sign of the divisor")
+expect(isint(mod(7, -3), -2) and isint(mod(-7, -3), -1), "% with a negative divisor")
+expect(isint(idiv(mini, -1), mini) and isint(mod(mini, -1), 0), "mininteger // -1 and % -1")
+expect(isflt(idiv(7.0, 2), 3.0) and isflt(idiv(-7, 2.0), -4.0), "// of floats")
+expect(isflt(mod(-7.5, 2), 0.5) and isflt(mod(7.5, -2), -0.5), "% of floats")
+expect(isint(-7 // 2, -4) and isint(-7 % 3, 2), "folded constants")
+
+local ok = try(idiv, 1, 0)
+expect(ok == false, "integer // 0 is an error")
+local ok = try(mod, 1, 0)
+expect(ok == false, "integer % 0 is an error")
+
+-- integers above 2^53 keep every bit
+local big = 9007199254740993
+expect(isint(big, 9007199254740993), "2^53 + 1 is an integer")
+expect(big ~= 9007199254740992 and big > 9007199254740992, "2^53 + 1 is not 2^53")
+expect(isint(big - 1, 9007199254740992) and isint(big + 1, 9007199254740994), "arithmetic above 2^53")
+expect(isint(big * 1, big) and isint(big // 1, big), "no float round trip")
+
+-- integers and floats compare by value
+expect(one == 1.0 and one < 1.5 and 2.0 > one, "mixed comparisons")
+
+-- an integral float key is the same key as the integer
+local t = {}
+t[2] = "int"
+expect(t[2.0] == "int", "t[2.0] is t[2]")
+t[3.0] = "flt"
+expect(t[3] == "flt", "t[3] is t[3.0]")
+t[1.5] = "half"
+expect(t[1.5] == "half" and t[1] == nil and t[2] == "int", "a fractional key")
@@ -0,0 +1,79 @@
+-- the inline caches of constant short string keys. Each loop below runs one
+-- instruction many times, so its cache is filled first and then has to notice
+-- that the table, the slot or the metatable behind it changed
+
+local function get(t) return t.x end
+local function set(t, v) t.x = v end
+
+-- a key deleted and then added again
+local t = {x = 1, y = 2}
+expect(get(t) == 1 and get(t) == 1, "a cached field")
+t.x = nil
+expect(get(t) == nil, "a deleted field reads nil through the cache")
+t.x = 3
+expect(get(t) == 3, "the field added again")
+set(t, nil)
+set(t, 4)
+expect(get(t) == 4 and t.y == 2, "deleted and added through a cached store")
+
+-- the node array is reallocated while the cache points into the old one
+local t = {x = 1}
+expect(get(t) == 1, "before the resize")
+local k = "k"
+for i = 1, 100 do
+	k = k .. "a"
+	t[k] = i
+end
+expect(get(t) == 1 and t[k] == 100, "after the resize")
+t.x = nil
+k = "k"
+for i = 1, 100 do
+	k = k .. "a"
+	t[k] = nil
+end
+t.x = 5
+expect(get(t) == 5, "after deleting everything else")
+
+-- one site that sees different tables with the key in different slots
+local a = {x = "a"}
+local b = {p = 1, q = 2, x = "b"}
+local c = {}
+local n = 0
+for i = 1, 30 do
+	if get(a) == "a" and get(b) == "b" and get(c) == nil then
+		n = n + 1
+	end
+end
+expect(n == 30, "a site shared by tables of different shapes")
+
+-- a field that is missing from the table comes from __index, and the
+-- metatable is swapped in the middle of the loop
+local mt1 = {__index = {x = "one"}}
+local mt2 = {__index = {x = "two"}}
+local obj = setmetatable({}, mt1)
+local seen1, seen2 = 0, 0
+for i = 1, 20 do
+	if i == 11 then
+		setmetatable(obj, mt2)
+	end
+	local v = get(obj)
+	if v == "one" then seen1 = seen1 + 1 end
+	if v == "two" then seen2 = seen2 + 1 end
+end
+expect(seen1 == 10 and seen2 == 10, "setmetatable in the middle of a loop")
+obj.x = "own"
+expect(get(obj) == "own", "an own field hides __index")
+obj.x = nil
+expect(get(obj) == "two", "__index again once the field is gone")
+
+-- method calls through the cache of OP_SELF
+local A = {id = function(self) return 1 end}
+local B = {id = function(self) return 2 end}
+local objs = {setmetatable({}, {__index = A}), setmetatable({}, {__index = B}), A}
+local s = 0
+for i = 1, 3 do
+	s = s * 10 + objs[i]:id()
+end
+expect(s == 121, "OP_SELF on different receivers")
+A.id = function(self) return 3 end
+expect(objs[1]:id() == 3, "a method replaced after a cached call")
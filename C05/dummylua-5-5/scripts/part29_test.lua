@@ -0,0 +1,53 @@
+-- the cached _ENV slots of OP_GETTABUP and OP_SETTABUP. A site keeps the node
+-- of the global table it resolved to, so deleting a global, adding it again
+-- and growing the global table under it must all be seen
+
+local function readg() return counter end
+local function writeg(v) counter = v end
+
+counter = 1
+expect(readg() == 1 and readg() == 1, "a cached global")
+counter = nil
+expect(readg() == nil, "a deleted global reads nil")
+counter = 2
+expect(readg() == 2, "the global defined again")
+writeg(nil)
+expect(readg() == nil, "deleted through a cached store")
+writeg(3)
+expect(readg() == 3 and counter == 3, "defined again through a cached store")
+
+-- grow the global table, its node array moves while the sites point into it
+local k = "g"
+for i = 1, 200 do
+	k = k .. "x"
+	_ENV[k] = i
+end
+expect(readg() == 3 and _ENV[k] == 200, "globals after the global table grew")
+writeg(4)
+expect(counter == 4 and readg() == 4, "a cached store after the global table grew")
+
+k = "g"
+for i = 1, 200 do
+	k = k .. "x"
+	_ENV[k] = nil
+end
+expect(readg() == 4, "globals after the others were deleted")
+
+-- a global read in a loop while another function changes it
+local function bump() counter = counter + 1 end
+counter = 0
+local sum = 0
+for i = 1, 10 do
+	bump()
+	sum = sum + readg()
+end
+expect(sum == 55, "a global changed between cached reads")
+
+-- a builtin replaced at run time
+local function show(x) return tostring(x) end
+local oldtostring = tostring
+expect(show(1) ~= "fake", "a builtin")
+tostring = function() return "fake" end
+expect(show(1) == "fake", "a replaced builtin")
+tostring = oldtostring
+expect(show(1) ~= "fake", "the builtin put back")
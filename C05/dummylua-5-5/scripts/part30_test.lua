@@ -0,0 +1,59 @@
+-- metamethod absence flags. A lookup that finds no __index or __newindex in a
+-- metatable marks it as absent, so anything that adds the field later has
+-- to clear the mark
+
+local mt = {}
+local obj = setmetatable({}, mt)
+expect(obj.x == nil and obj.x == nil, "no __index yet")
+mt.__index = {x = 1}
+expect(obj.x == 1, "__index added after a lookup found it absent")
+
+local stored = 0
+obj.y = 2
+expect(obj.y == 2, "a plain store without __newindex")
+mt.__newindex = function(t, k, v) stored = stored + v end
+obj.z = 3
+expect(stored == 3 and obj.z == nil, "__newindex added after a store found it absent")
+obj.y = 4
+expect(stored == 3 and obj.y == 4, "an existing field does not call __newindex")
+
+-- the field is removed, then filled again in the slot it left
+local mt = {__index = {v = "first"}}
+local obj = setmetatable({}, mt)
+expect(obj.v == "first", "a metatable with __index")
+mt.__index = nil
+expect(obj.v == nil and obj.v == nil, "__index removed")
+mt.__index = {v = "second"}
+expect(obj.v == "second", "__index stored again into its old slot")
+
+-- the store goes through a function and a loop, so it hits the inline caches
+local function setindex(m, t) m.__index = t end
+local mts = {{}, {}, {}}
+local n = 0
+for i = 1, 3 do
+	local o = setmetatable({}, mts[i])
+	if o.w == nil then
+		setindex(mts[i], {w = i})
+		if o.w == i then
+			n = n + 1
+		end
+	end
+end
+expect(n == 3, "__index set through a cached store")
+
+-- a metatable shared by several objects
+local shared = {}
+local a = setmetatable({}, shared)
+local b = setmetatable({}, shared)
+expect(a.q == nil and b.q == nil, "no __index on the shared metatable")
+shared.__index = function(t, k) return k end
+expect(a.q == "q" and b.r == "r", "a function __index added later")
+
+-- other fields of the metatable do not hide a later __index
+local mt = {}
+local obj = setmetatable({}, mt)
+expect(obj.m == nil, "empty metatable")
+mt.other = 1
+expect(obj.m == nil, "an unrelated field")
+mt.__index = {m = "m"}
+expect(obj.m == "m", "__index after an unrelated field")
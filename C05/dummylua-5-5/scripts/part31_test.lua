@@ -0,0 +1,58 @@
+-- the __index chain cache. A key found through a chain of __index tables is
+-- remembered for the metatable of the receiver, and any write into a table of
+-- the chain or any setmetatable has to drop it
+
+local Base = {kind = "base", f = 1}
+local Mid = setmetatable({}, {__index = Base})
+local Leaf = {__index = Mid}
+local obj = setmetatable({}, Leaf)
+
+local function kind(o) return o.kind end
+local function f(o) return o.f end
+
+expect(kind(obj) == "base" and kind(obj) == "base", "a key found two levels up")
+expect(f(obj) == 1, "another key of the same chain")
+
+-- a store into the middle of the chain after the lookup was cached
+Mid.kind = "mid"
+expect(kind(obj) == "mid", "a store into the middle table hides the cached one")
+Mid.kind = nil
+expect(kind(obj) == "base", "the key deleted from the middle table")
+
+-- a store into the last table of the chain
+Base.f = 2
+expect(f(obj) == 2, "a store into the table the key came from")
+
+-- a store into the receiver itself
+obj.f = 3
+expect(f(obj) == 3, "an own field")
+obj.f = nil
+expect(f(obj) == 2, "the own field deleted")
+
+-- the chain is changed by setmetatable
+local Other = {kind = "other"}
+setmetatable(Mid, {__index = Other})
+expect(kind(obj) == "other" and f(obj) == nil, "setmetatable in the middle of the chain")
+setmetatable(Mid, {__index = Base})
+expect(kind(obj) == "base", "the first chain again")
+
+-- a loop reading through the chain while the middle table changes
+local n = 0
+for i = 1, 20 do
+	if i == 11 then
+		Mid.f = 10
+	end
+	n = n + f(obj)
+end
+expect(n == 10 * 2 + 10 * 10, "a store in the middle of a loop")
+Mid.f = nil
+
+-- two receivers with different metatables over the same chain
+local obj2 = setmetatable({}, {__index = Mid})
+expect(f(obj) == 2 and f(obj2) == 2, "two metatables over one chain")
+Base.f = 5
+expect(f(obj) == 5 and f(obj2) == 5, "both see the change")
+
+-- the cache does not keep the chain alive or stale after a collection
+collectgarbage()
+expect(kind(obj) == "base" and f(obj2) == 5, "lookups after a full collection")
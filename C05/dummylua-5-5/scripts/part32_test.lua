@@ -0,0 +1,50 @@
+-- a .. b .. c .. d is one OP_CONCAT over consecutive registers. Strings and
+-- numbers are joined in one allocation, anything else goes to __concat with
+-- its right neighbour, from the right like Lua does
+local a, b, c, d = "a", "b", "c", "d"
+expect(a .. b .. c .. d == "abcd", "four strings")
+expect(a .. "" .. b .. "" == "ab", "empty strings in the chain")
+
+local i, j, f = 1, 23, 2.5
+expect(i .. j == "123", "two integers")
+expect(a .. i .. b .. j == "a1b23", "strings and integers")
+expect(i .. a .. f .. b == "1a2.5b", "an integer and a float")
+expect(-7 .. a == "-7a", "a negative integer")
+expect(a .. j .. j .. j .. j .. j .. j .. j == "a23232323232323", "a long chain")
+
+local s = ""
+for k = 1, 5 do
+	s = s .. k .. ","
+end
+expect(s == "1,2,3,4,5,", "a chain growing in a loop")
+
+-- a long result is not a short string, it still compares by value
+local long = "0123456789012345678901234567890123456789"
+expect(long .. long .. i == "01234567890123456789012345678901234567890123456789012345678901234567890123456789" .. "1",
+	"a long string built from a chain")
+
+-- __concat in the middle of the chain
+local mt = {}
+local obj = setmetatable({}, mt)
+mt.__concat = function(l, r)
+	if l == obj then
+		return "<" .. r
+	end
+	return l .. ">"
+end
+expect(a .. obj .. b .. c == "a<bc", "__concat in the middle takes the joined right part")
+expect(obj .. a == "<a", "__concat on the left")
+expect(a .. b .. obj == "ab>", "__concat on the right")
+expect(i .. obj .. j == "1<23", "__concat between numbers")
+
+local calls = 0
+mt.__concat = function(l, r)
+	calls = calls + 1
+	return "x"
+end
+expect(a .. obj .. b .. obj .. c == "ax" and calls == 2, "two objects in one chain")
+
+-- a chain without __concat is an error
+local plain = {}
+local ok = try(function() return a .. plain .. b end)
+expect(ok == false, "a table without __concat")
@@ -0,0 +1,79 @@
+-- #t is a border: t[#t] is not nil and t[#t + 1] is nil, or 0 when t[1] is
+-- nil. With holes any border will do, so the checks below only test that
+-- the result is one
+local function isborder(t, n)
+	if n == 0 then
+		return t[1] == nil
+	end
+	return t[n] ~= nil and t[n + 1] == nil
+end
+
+local t = {}
+expect(#t == 0, "an empty table")
+local t = {1, 2, 3}
+expect(#t == 3, "a full array")
+local t = {1, 2, 3, nil}
+expect(#t == 3, "a trailing nil")
+local t = {nil, nil, 3}
+expect(isborder(t, #t), "holes at the start")
+local t = {1, nil, 3, nil, 5, nil, nil, 8}
+expect(isborder(t, #t), "holes in the middle")
+
+-- elements past the array part live in the hash part
+local t = {}
+t[1] = 1
+t[2] = 2
+t[3] = 3
+t[5] = 5
+expect(isborder(t, #t), "a hole between the array and the hash part")
+local t = {1, 2}
+t[4] = 4
+t[3] = 3
+expect(#t == 4, "the border continues into the hash part")
+local t = {x = 1, y = 2}
+expect(#t == 0, "only hash entries")
+t[1] = 1
+expect(#t == 1, "one integer key in the hash part")
+local t = {}
+for i = 100, 1, -1 do
+	t[i] = i
+end
+expect(#t == 100, "a sequence filled from the end")
+
+-- the array part is full and so is the start of the hash part
+local t = {1, 2, 3, 4}
+for i = 5, 40 do
+	t[i] = i
+end
+t.name = "n"
+expect(#t == 40, "a sequence with a string key")
+t[40] = nil
+expect(#t == 39, "the last element removed")
+
+-- push and pop at the end, the cached border follows
+local s = {}
+for i = 1, 50 do
+	s[#s + 1] = i
+end
+expect(#s == 50 and s[50] == 50, "pushes at the border")
+for i = 1, 20 do
+	s[#s] = nil
+end
+expect(#s == 30 and s[30] == 30 and s[31] == nil, "pops at the border")
+s[#s + 1] = "x"
+expect(#s == 31 and s[31] == "x", "a push after the pops")
+for i = 1, 31 do
+	s[#s] = nil
+end
+expect(#s == 0, "popped down to empty")
+
+-- a hint that went stale through a store away from the border
+local h = {1, 2, 3, 4, 5, 6, 7, 8}
+expect(#h == 8, "the first length")
+h[3] = nil
+expect(isborder(h, #h), "a hole below the cached border")
+h[8] = nil
+h[7] = nil
+expect(isborder(h, #h), "the cached border removed")
+h[3] = 3
+expect(#h == 6, "the hole filled")
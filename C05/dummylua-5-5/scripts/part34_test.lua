@@ -0,0 +1,34 @@
+-- table constructors, the items are stored by OP_SETLIST in batches of
+-- LFIELD_PER_FLUSH. big(...) is a chunk from p34_test.c returning a literal
+-- of 26000 items followed by its varargs, more batches than OP_SETLIST's C
+-- holds, so the batch number goes into an OP_EXTRAARG
+
+local function three() return 7, 8, 9 end
+
+local t = {1, 2, 3}
+expect(#t == 3 and t[3] == 3, "a short list")
+local t = {three()}
+expect(#t == 3 and t[1] == 7 and t[3] == 9, "a call expands at the end")
+local t = {three(), 4}
+expect(#t == 2 and t[1] == 7 and t[2] == 4, "a call in the middle keeps one value")
+local t = {1, 2, x = 3, 4}
+expect(#t == 3 and t[3] == 4 and t.x == 3, "named fields do not take a slot")
+
+local t = {
+	1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20,
+	21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,
+	41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, three(),
+}
+expect(#t == 54 and t[50] == 50 and t[51] == 51 and t[52] == 7 and t[54] == 9, "a second batch and a call")
+
+local t = big()
+expect(#t == 26000, "a literal longer than the C argument of OP_SETLIST")
+local ok = true
+for i = 1, 26000 do
+	if t[i] ~= i then ok = false end
+end
+expect(ok, "every item of the long literal is in place")
+expect(t[25550] == 25550 and t[25551] == 25551 and t[26001] == nil, "the items around the C limit")
+
+local t = big(26001, 26002)
+expect(#t == 26002 and t[26001] == 26001 and t[26002] == 26002, "varargs after the long literal")
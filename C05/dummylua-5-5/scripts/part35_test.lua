@@ -0,0 +1,36 @@
+-- the collector only steps at the opcodes that allocate, a call is not a
+-- safepoint. gcinfo() returns the collector state and the bytes in use
+
+local function add(a, b) return a + b end
+local function twice(a) return add(a, a) end
+local function loop(n)
+	local s = 0
+	for i = 1, n do
+		s = s + twice(i)
+	end
+	return s
+end
+
+-- the first runs may compile the loop, only the last one is measured
+loop(1000)
+loop(1000)
+collectgarbage()
+local state, mem = gcinfo()
+local s = loop(100000)
+local state2, mem2 = gcinfo()
+expect(s == 10000100000, "the loop result")
+expect(state2 == state and mem2 == mem, "calls alone neither allocate nor step the collector")
+
+-- calls that allocate still get their garbage collected
+local function make(i) return {i, i, i} end
+local function churn(n)
+	local last
+	for i = 1, n do
+		last = make(i)
+	end
+	return last
+end
+local t = churn(200000)
+local _, mem3 = gcinfo()
+expect(t[1] == 200000, "the last table")
+expect(mem3 < mem + 4000000, "tables made in calls are collected")
@@ -0,0 +1,44 @@
+-- stack growth. With LUA_USE_MMAPSTACK the stack grows in place inside its
+-- reservation, otherwise it is reallocated and every pointer into it, open
+-- upvalues included, is moved along
+
+local function depth(n)
+	if n == 0 then
+		return 0
+	end
+	local a, b, c = n, n, n
+	return 1 + depth(n - 1) + a - b + c - n
+end
+expect(depth(10) == 10, "a shallow recursion")
+expect(depth(150000) == 150000, "a recursion that grows the stack many times")
+
+-- open upvalues of a frame below the growth
+local function grow(n, f)
+	if n == 0 then
+		return f()
+	end
+	local r = grow(n - 1, f)
+	return r
+end
+local function outer()
+	local x = 42
+	local function get() return x end
+	local function set() x = x + 1 end
+	local r = grow(50000, get)
+	grow(50000, set)
+	return r, x, get()
+end
+local r, x, y = outer()
+expect(r == 42 and x == 43 and y == 43, "open upvalues across stack growth")
+
+-- an overflow is an error that can be caught, and the stack keeps working
+local function forever(n)
+	local a, b, c, d = n, n, n, n
+	return forever(n + 1) + a + b + c + d
+end
+local ok, msg = try(forever, 1)
+expect(ok == false and msg ~= nil, "the overflow is an error")
+expect(depth(150000) == 150000, "deep recursion after the overflow")
+local ok = try(forever, 1)
+expect(ok == false, "a second overflow")
+expect(depth(1000) == 1000, "and the stack still works")
@@ -0,0 +1,52 @@
+-- the collector shrinks a stack and its CallInfo list that a deep recursion
+-- left much larger than what is in use. stackinfo() returns the stack size
+-- in slots and the number of CallInfos
+
+local peak, peakci
+local function depth(n)
+	if n == 0 then
+		peak, peakci = stackinfo()
+		return 0
+	end
+	local a, b = n, n
+	return 1 + depth(n - 1) + a - b
+end
+
+collectgarbage()
+local size0, nci0 = stackinfo()
+expect(depth(100000) == 100000, "a deep recursion")
+local size1, nci1 = stackinfo()
+expect(peak > size0 and peakci > nci0, "the recursion grew the stack and the CallInfos")
+collectgarbage()
+local size2, nci2 = stackinfo()
+expect(size2 < peak and nci2 < peakci, "a collection shrinks them")
+expect(size2 < size0 * 4 and nci2 < nci0 + 1000, "back to about the size in use")
+
+-- recursion works again after the shrink, and shrinks again
+expect(depth(100000) == 100000, "a deep recursion after the shrink")
+collectgarbage()
+expect(depth(50000) == 50000, "and again")
+collectgarbage()
+local size3, nci3 = stackinfo()
+expect(size3 < peak and nci3 < peakci, "shrunk a second time")
+
+-- a collection in the middle of a recursion keeps the frames in use
+local function deepgc(n)
+	if n == 0 then
+		collectgarbage()
+		return 0
+	end
+	local a = n
+	return deepgc(n - 1) + a - n + 1
+end
+expect(depth(100000) == 100000, "grow first")
+expect(deepgc(1000) == 1000, "a collection inside a recursion")
+expect(deepgc(20000) == 20000, "a collection inside a deeper recursion")
+
+-- a stack that was already shrunk is left alone
+depth(1000)
+collectgarbage()
+local s1, c1 = stackinfo()
+collectgarbage()
+local s2, c2 = stackinfo()
+expect(s1 == s2 and c1 == c2, "a second collection does not resize again")
@@ -0,0 +1,14 @@
+# cmake -DINTERP=<dummylua> -DAOT=<aottest> -P aotdiff.cmake, runs the
+# interpreter and the translation of part18_test.lua and compares their output
+execute_process(COMMAND ${INTERP} p18 OUTPUT_VARIABLE expected RESULT_VARIABLE interp_result)
+execute_process(COMMAND ${AOT} OUTPUT_VARIABLE actual RESULT_VARIABLE aot_result)
+
+IF (NOT interp_result EQUAL 0)
+	message(FATAL_ERROR "the interpreter failed:\n${expected}")
+ENDIF()
+IF (NOT aot_result EQUAL 0)
+	message(FATAL_ERROR "the aot build failed:\n${actual}")
+ENDIF()
+IF (NOT expected STREQUAL actual)
+	message(FATAL_ERROR "the aot build prints\n${actual}\nthe interpreter prints\n${expected}")
+ENDIF()
@@ -0,0 +1,59 @@
+#include "luatest.h"
+#include "../common/luastring.h"
+
+static int nfailed = 0;
+
+static int lexpect(struct lua_State* L) {
+	TValue* o = index2addr(L, 1);
+	if (lua_gettop(L) < 1 || ttisnil(o) || (ttisboolean(o) && !o->value_.b)) {
+		const char* msg = lua_gettop(L) > 1 ? lua_tostring(L, 2) : NULL;
+		nfailed++;
+		printf("FAILED: %s\n", msg ? msg : "?");
+	}
+	return 0;
+}
+
+// try(f, ...), calls f in protected mode, it returns true and the results of f,
+// or false and the error message
+static int ltry(struct lua_State* L) {
+	if (luaL_pcall(L, lua_gettop(L) - 1, LUA_MULRET) != LUA_OK) {
+		lua_pushboolean(L, 0);
+		lua_pushvalue(L, -2);
+		return 2;
+	}
+
+	TValue ok;
+	setbvalue(&ok, 1);
+	lua_insert(L, 1, &ok);
+	return lua_gettop(L);
+}
+
+int luatest_call(struct lua_State* L, const char* name) {
+	nfailed = 0;
+	lua_pushglobaltable(L);
+	lua_pushcfunction(L, lexpect);
+	lua_setfield(L, -2, "expect");
+	lua_pushcfunction(L, ltry);
+	lua_setfield(L, -2, "try");
+	lua_pop(L);
+
+	if (luaL_pcall(L, 0, 0) != LUA_OK) {
+		nfailed++;
+		if (novariant(L->top - 1) == LUA_TSTRING) {
+			printf("error: %s\n", getstr(gco2ts(gcvalue(L->top - 1))));
+		}
+		lua_pop(L);
+	}
+
+	printf("%s: %s\n", name, nfailed == 0 ? "ok" : "FAILED");
+	return nfailed;
+}
+
+int luatest_dofile(struct lua_State* L, const char* filename) {
+	if (luaL_loadfile(L, filename) != LUA_OK) {
+		printf("failure to load file %s\n", filename);
+		printf("%s: FAILED\n", filename);
+		return 1;
+	}
+	return luatest_call(L, filename);
+}
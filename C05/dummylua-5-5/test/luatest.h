@@ -0,0 +1,15 @@
+#ifndef _luatest_h_
+#define _luatest_h_
+
+#include "../clib/luaaux.h"
+
+// run a test script with the globals 'expect(cond, msg)' and 'try(f, ...)'
+// registered, it returns the number of failed expectations, an error raised by
+// the script counts as one
+int luatest_dofile(struct lua_State* L, const char* filename);
+
+// the same for a chunk that is already loaded onto the top of the stack, the
+// name only shows up in the report
+int luatest_call(struct lua_State* L, const char* name);
+
+#endif
@@ -0,0 +1,12 @@
+#include "p14_test.h"
+#include "luatest.h"
+
+int p14_test_main() {
+	struct lua_State* L = luaL_newstate();
+	luaL_openlibs(L);
+
+	int nfailed = luatest_dofile(L, "../scripts/part14_test.lua");
+
+	lua_close(L);
+	return nfailed;
+}
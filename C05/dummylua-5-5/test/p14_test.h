@@ -0,0 +1,8 @@
+#ifndef _p14_test_h_
+#define _p14_test_h_
+
+#include "../clib/luaaux.h"
+
+int p14_test_main();
+
+#endif
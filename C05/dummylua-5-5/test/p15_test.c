@@ -0,0 +1,59 @@
+#include "p15_test.h"
+#include "luatest.h"
+#include "../vm/luagc.h"
+#include "../vm/luavm.h"
+#include "../vm/luaopcodes.h"
+#include <stdlib.h>
+
+static int count_quickened(Proto* p) {
+	int n = 0;
+	for (int i = 0; i < p->sizecode; i++) {
+		if (luaP_genericop(GET_OPCODE(p->code[i])) != GET_OPCODE(p->code[i])) {
+			n++;
+		}
+	}
+	for (int i = 0; i < p->sizep; i++) {
+		if (p->p[i]) {
+			n += count_quickened(p->p[i]);
+		}
+	}
+	return n;
+}
+
+static int run(int quickening) {
+	const char* filename = "../scripts/part15_test.lua";
+	struct lua_State* L = luaL_newstate();
+	luaL_openlibs(L);
+	luaV_setquicken(L, quickening);
+
+	int nfailed = 0;
+	if (luaL_loadfile(L, filename) == LUA_OK) {
+		Proto* p = gco2lclosure(gcvalue(L->top - 1))->p;
+		lua_pushvalue(L, -1);
+		nfailed = luatest_call(L, filename);
+
+		// the chunk is still on the stack, so its code can be looked at after the run
+		int nquickened = count_quickened(p);
+		if (quickening && getenv("LUA_DUMPCODE")) {
+			luaV_dumpcode(p);
+		}
+#if defined(LUA_NOQUICKEN)
+		quickening = 0;
+#endif
+		if ((nquickened > 0) != (quickening != 0)) {
+			printf("FAILED: %d quickened instructions with quickening %s\n", nquickened, quickening ? "on" : "off");
+			nfailed++;
+		}
+	}
+	else {
+		printf("failure to load file %s\n", filename);
+		nfailed++;
+	}
+
+	lua_close(L);
+	return nfailed;
+}
+
+int p15_test_main() {
+	return run(1) + run(0);
+}
@@ -0,0 +1,8 @@
+#ifndef _p15_test_h_
+#define _p15_test_h_
+
+#include "../clib/luaaux.h"
+
+int p15_test_main();
+
+#endif
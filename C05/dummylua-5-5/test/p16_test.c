@@ -0,0 +1,40 @@
+#include "p16_test.h"
+#include "luatest.h"
+#include "../vm/luagc.h"
+#include "../vm/luajit.h"
+
+// compiled(f), true if the lua function f has native code
+static int lcompiled(struct lua_State* L) {
+	TValue* o = index2addr(L, 1);
+	lua_pushboolean(L, o->tt_ == LUA_TLCL && gco2lclosure(gcvalue(o))->p->jit != NULL);
+	return 1;
+}
+
+static int lsetjitmode(struct lua_State* L) {
+	int isnum = 0;
+	luaJ_setmode(L, (int)lua_tointegerx(L, 1, &isnum));
+	return 0;
+}
+
+static int run(int mode) {
+	struct lua_State* L = luaL_newstate();
+	luaL_openlibs(L);
+	luaJ_setmode(L, mode);
+
+	lua_pushglobaltable(L);
+	lua_pushcfunction(L, lcompiled);
+	lua_setfield(L, -2, "compiled");
+	lua_pushcfunction(L, lsetjitmode);
+	lua_setfield(L, -2, "setjitmode");
+	lua_pushboolean(L, LUA_USE_JIT && mode == LUAJ_METHOD);
+	lua_setfield(L, -2, "JIT");
+	lua_pop(L);
+
+	int nfailed = luatest_dofile(L, "../scripts/part16_test.lua");
+	lua_close(L);
+	return nfailed;
+}
+
+int p16_test_main() {
+	return run(LUAJ_METHOD) + run(LUAJ_OFF);
+}
@@ -0,0 +1,8 @@
+#ifndef _p16_test_h_
+#define _p16_test_h_
+
+#include "../clib/luaaux.h"
+
+int p16_test_main();
+
+#endif
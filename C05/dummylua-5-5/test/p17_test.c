@@ -0,0 +1,44 @@
+#include "p17_test.h"
+#include "luatest.h"
+#include "../vm/luajit.h"
+
+static void setcounter(struct lua_State* L, const char* name, lua_Integer v) {
+	lua_pushinteger(L, v);
+	lua_setfield(L, -2, name);
+}
+
+// tracestats(), the counters of the tracing jit in a table
+static int ltracestats(struct lua_State* L) {
+	JitStats st;
+	luaJ_stats(L, &st);
+	lua_createtable(L);
+	setcounter(L, "traces", st.ntraces);
+	setcounter(L, "cached", st.ncached);
+	setcounter(L, "recorded", (lua_Integer)st.nrecorded);
+	setcounter(L, "aborts", (lua_Integer)st.naborts);
+	setcounter(L, "flushed", (lua_Integer)st.nflushed);
+	setcounter(L, "blacklisted", (lua_Integer)st.nblacklisted);
+	setcounter(L, "entries", (lua_Integer)st.entries);
+	setcounter(L, "sideexits", (lua_Integer)st.sideexits);
+	setcounter(L, "headmisses", (lua_Integer)st.headmisses);
+	return 1;
+}
+
+int p17_test_main() {
+	struct lua_State* L = luaL_newstate();
+	luaL_openlibs(L);
+	luaJ_setmode(L, LUAJ_TRACE);
+
+	lua_pushglobaltable(L);
+	lua_pushcfunction(L, ltracestats);
+	lua_setfield(L, -2, "tracestats");
+	lua_pushboolean(L, LUA_USE_JIT);
+	lua_setfield(L, -2, "JIT");
+	lua_pop(L);
+
+	int nfailed = luatest_dofile(L, "../scripts/part17_test.lua");
+	luaJ_dumptraces(L);
+
+	lua_close(L);
+	return nfailed;
+}
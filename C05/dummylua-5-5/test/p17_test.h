@@ -0,0 +1,8 @@
+#ifndef _p17_test_h_
+#define _p17_test_h_
+
+#include "../clib/luaaux.h"
+
+int p17_test_main();
+
+#endif
@@ -0,0 +1,16 @@
+#include "luatest.h"
+
+// runs part18_test.lua translated into c by luatoc, it has to print exactly
+// what 'dummylua p18' prints, see aotdiff.cmake
+int luaopen_part18(struct lua_State* L);
+
+int main(int argc, char** argv) {
+	struct lua_State* L = luaL_newstate();
+	luaL_openlibs(L);
+
+	luaL_pushcfunction(L, luaopen_part18);
+	int nfailed = luatest_call(L, "../scripts/part18_test.lua");
+
+	lua_close(L);
+	return nfailed == 0 ? 0 : 1;
+}
@@ -0,0 +1,13 @@
+#include "p18_test.h"
+#include "luatest.h"
+
+// the interpreter half of the aot test, test/p18_aot.c runs the translation
+int p18_test_main() {
+	struct lua_State* L = luaL_newstate();
+	luaL_openlibs(L);
+
+	int nfailed = luatest_dofile(L, "../scripts/part18_test.lua");
+
+	lua_close(L);
+	return nfailed;
+}
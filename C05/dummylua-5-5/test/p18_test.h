@@ -0,0 +1,8 @@
+#ifndef _p18_test_h_
+#define _p18_test_h_
+
+#include "../clib/luaaux.h"
+
+int p18_test_main();
+
+#endif
@@ -0,0 +1,38 @@
+#include "p19_test.h"
+#include "luatest.h"
+#include "../vm/luagc.h"
+#include <string.h>
+#include <stdlib.h>
+
+// line(), the line of the call in the lua function that makes it
+static int lline(struct lua_State* L) {
+	struct CallInfo* ci = L->ci->previous;
+	Proto* p = gco2lclosure(gcvalue(ci->func))->p;
+	lua_pushinteger(L, p->line[ci->l.savedpc - p->code - 1]);
+	return 1;
+}
+
+// errline(msg), the line the innermost frame of a runtime error reports
+static int lerrline(struct lua_State* L) {
+	const char* msg = lua_tostring(L, 1);
+	const char* at = msg ? strstr(msg, "line:") : NULL;
+	lua_pushinteger(L, at ? atoi(at + 5) : -1);
+	return 1;
+}
+
+int p19_test_main() {
+	struct lua_State* L = luaL_newstate();
+	luaL_openlibs(L);
+
+	lua_pushglobaltable(L);
+	lua_pushcfunction(L, lline);
+	lua_setfield(L, -2, "line");
+	lua_pushcfunction(L, lerrline);
+	lua_setfield(L, -2, "errline");
+	lua_pop(L);
+
+	int nfailed = luatest_dofile(L, "../scripts/part19_test.lua");
+
+	lua_close(L);
+	return nfailed;
+}
@@ -0,0 +1,8 @@
+#ifndef _p19_test_h_
+#define _p19_test_h_
+
+#include "../clib/luaaux.h"
+
+int p19_test_main();
+
+#endif
@@ -0,0 +1,42 @@
+#include "p20_test.h"
+#include "luatest.h"
+#include "../vm/luagc.h"
+#include "../vm/luaopcodes.h"
+#include "../compiler/luacode.h"
+
+// ncalls(f), the number of OP_CALL and OP_TAILCALL left in the lua function f
+static int lncalls(struct lua_State* L) {
+	Proto* p = gco2lclosure(gcvalue(index2addr(L, 1)))->p;
+	int n = 0;
+	for (int pc = 0; pc < p->sizecode; pc++) {
+		int op = GET_OPCODE(p->code[pc]);
+		if (op == OP_CALL || op == OP_TAILCALL) {
+			n++;
+		}
+	}
+	lua_pushinteger(L, n);
+	return 1;
+}
+
+// the inlining happens when the script is compiled, so it is switched
+// before luaL_loadfile
+static int run(int inlining) {
+	struct lua_State* L = luaL_newstate();
+	luaL_openlibs(L);
+	luaK_setinline(L, inlining);
+
+	lua_pushglobaltable(L);
+	lua_pushcfunction(L, lncalls);
+	lua_setfield(L, -2, "ncalls");
+	lua_pushboolean(L, inlining);
+	lua_setfield(L, -2, "INLINE");
+	lua_pop(L);
+
+	int nfailed = luatest_dofile(L, "../scripts/part20_test.lua");
+	lua_close(L);
+	return nfailed;
+}
+
+int p20_test_main() {
+	return run(1) + run(0);
+}
@@ -0,0 +1,8 @@
+#ifndef _p20_test_h_
+#define _p20_test_h_
+
+#include "../clib/luaaux.h"
+
+int p20_test_main();
+
+#endif
@@ -0,0 +1,51 @@
+#include "p21_test.h"
+#include "luatest.h"
+#include "../vm/luagc.h"
+#include "../vm/luaopcodes.h"
+#include <string.h>
+
+static const struct {
+	const char* name;
+	int op;
+} opcodes[] = {
+	{ "EQ", OP_EQ }, { "LT", OP_LT }, { "LE", OP_LE }, { "NOT", OP_NOT }, { "CONCAT", OP_CONCAT },
+	{ "JUMP", OP_JUMP }, { "TEST", OP_TEST }, { "TESTSET", OP_TESTSET }, { "GETUPVAL", OP_GETUPVAL },
+	{ "LOADK", OP_LOADK }, { "ADD", OP_ADD }, { "MUL", OP_MUL }, { "CALL", OP_CALL },
+};
+
+// count(f, name), how many instructions of f have the opcode name, quickened
+// ones count as their generic opcode
+static int lcount(struct lua_State* L) {
+	Proto* p = gco2lclosure(gcvalue(index2addr(L, 1)))->p;
+	const char* name = lua_tostring(L, 2);
+	int op = -1;
+	for (int j = 0; name && j < (int)(sizeof(opcodes) / sizeof(opcodes[0])); j++) {
+		if (strcmp(name, opcodes[j].name) == 0) {
+			op = opcodes[j].op;
+		}
+	}
+
+	int n = 0;
+	for (int pc = 0; pc < p->sizecode; pc++) {
+		if (luaP_genericop(GET_OPCODE(p->code[pc])) == op) {
+			n++;
+		}
+	}
+	lua_pushinteger(L, op < 0 ? -1 : n);
+	return 1;
+}
+
+int p21_test_main() {
+	struct lua_State* L = luaL_newstate();
+	luaL_openlibs(L);
+
+	lua_pushglobaltable(L);
+	lua_pushcfunction(L, lcount);
+	lua_setfield(L, -2, "count");
+	lua_pop(L);
+
+	int nfailed = luatest_dofile(L, "../scripts/part21_test.lua");
+
+	lua_close(L);
+	return nfailed;
+}
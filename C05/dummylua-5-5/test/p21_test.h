@@ -0,0 +1,8 @@
+#ifndef _p21_test_h_
+#define _p21_test_h_
+
+#include "../clib/luaaux.h"
+
+int p21_test_main();
+
+#endif
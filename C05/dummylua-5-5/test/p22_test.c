@@ -0,0 +1,30 @@
+#include "p22_test.h"
+#include "luatest.h"
+#include "../common/luastate.h"
+
+// nthreads(), how many coroutines the collector still keeps in allgc
+static int lnthreads(struct lua_State* L) {
+	int n = 0;
+	for (struct GCObject* o = G(L)->allgc; o; o = o->next) {
+		if (o->tt_ == LUA_TTHREAD) {
+			n++;
+		}
+	}
+	lua_pushinteger(L, n);
+	return 1;
+}
+
+int p22_test_main() {
+	struct lua_State* L = luaL_newstate();
+	luaL_openlibs(L);
+
+	lua_pushglobaltable(L);
+	lua_pushcfunction(L, lnthreads);
+	lua_setfield(L, -2, "nthreads");
+	lua_pop(L);
+
+	int nfailed = luatest_dofile(L, "../scripts/part22_test.lua");
+
+	lua_close(L);
+	return nfailed;
+}
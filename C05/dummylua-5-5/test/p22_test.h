@@ -0,0 +1,8 @@
+#ifndef _p22_test_h_
+#define _p22_test_h_
+
+#include "../clib/luaaux.h"
+
+int p22_test_main();
+
+#endif
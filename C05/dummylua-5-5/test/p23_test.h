@@ -0,0 +1,8 @@
+#ifndef _p23_test_h_
+#define _p23_test_h_
+
+#include "../clib/luaaux.h"
+
+int p23_test_main();
+
+#endif
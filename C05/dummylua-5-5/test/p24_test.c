@@ -0,0 +1,27 @@
+#include "p24_test.h"
+#include "luatest.h"
+
+// cidepth(), the number of CallInfos above base_ci, cidepth's own included
+static int lcidepth(struct lua_State* L) {
+	int n = 0;
+	for (struct CallInfo* ci = L->ci; ci != &L->base_ci; ci = ci->previous) {
+		n++;
+	}
+	lua_pushinteger(L, n);
+	return 1;
+}
+
+int p24_test_main() {
+	struct lua_State* L = luaL_newstate();
+	luaL_openlibs(L);
+
+	lua_pushglobaltable(L);
+	lua_pushcfunction(L, lcidepth);
+	lua_setfield(L, -2, "cidepth");
+	lua_pop(L);
+
+	int nfailed = luatest_dofile(L, "../scripts/part24_test.lua");
+
+	lua_close(L);
+	return nfailed;
+}
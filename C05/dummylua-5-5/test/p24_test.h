@@ -0,0 +1,8 @@
+#ifndef _p24_test_h_
+#define _p24_test_h_
+
+#include "../clib/luaaux.h"
+
+int p24_test_main();
+
+#endif
@@ -0,0 +1,8 @@
+#ifndef _p25_test_h_
+#define _p25_test_h_
+
+#include "../clib/luaaux.h"
+
+int p25_test_main();
+
+#endif
@@ -0,0 +1,19 @@
+#include "p26_test.h"
+#include "luatest.h"
+
+int p26_test_main() {
+	struct lua_State* L = luaL_newstate();
+	luaL_openlibs(L);
+
+	lua_pushglobaltable(L);
+	lua_pushinteger(L, LUA_MAXINTEGER);
+	lua_setfield(L, -2, "maxinteger");
+	lua_pushinteger(L, LUA_MININTEGER);
+	lua_setfield(L, -2, "mininteger");
+	lua_pop(L);
+
+	int nfailed = luatest_dofile(L, "../scripts/part26_test.lua");
+
+	lua_close(L);
+	return nfailed;
+}
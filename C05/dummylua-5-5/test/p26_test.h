@@ -0,0 +1,8 @@
+#ifndef _p26_test_h_
+#define _p26_test_h_
+
+#include "../clib/luaaux.h"
+
+int p26_test_main();
+
+#endif
@@ -0,0 +1,36 @@
+#include "p27_test.h"
+#include "luatest.h"
+
+// mtype(x), "integer" or "float" for a number and nil for anything else
+static int lmtype(struct lua_State* L) {
+	TValue* o = index2addr(L, 1);
+	if (ttisinteger(o)) {
+		lua_pushstring(L, "integer");
+	}
+	else if (ttisfloat(o)) {
+		lua_pushstring(L, "float");
+	}
+	else {
+		lua_pushnil(L);
+	}
+	return 1;
+}
+
+int p27_test_main() {
+	struct lua_State* L = luaL_newstate();
+	luaL_openlibs(L);
+
+	lua_pushglobaltable(L);
+	lua_pushcfunction(L, lmtype);
+	lua_setfield(L, -2, "mtype");
+	lua_pushinteger(L, LUA_MAXINTEGER);
+	lua_setfield(L, -2, "maxinteger");
+	lua_pushinteger(L, LUA_MININTEGER);
+	lua_setfield(L, -2, "mininteger");
+	lua_pop(L);
+
+	int nfailed = luatest_dofile(L, "../scripts/part27_test.lua");
+
+	lua_close(L);
+	return nfailed;
+}
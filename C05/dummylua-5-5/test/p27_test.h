@@ -0,0 +1,8 @@
+#ifndef _p27_test_h_
+#define _p27_test_h_
+
+#include "../clib/luaaux.h"
+
+int p27_test_main();
+
+#endif
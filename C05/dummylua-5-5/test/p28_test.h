@@ -0,0 +1,8 @@
+#ifndef _p28_test_h_
+#define _p28_test_h_
+
+#include "../clib/luaaux.h"
+
+int p28_test_main();
+
+#endif
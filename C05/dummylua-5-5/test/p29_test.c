@@ -0,0 +1,12 @@
+#include "p29_test.h"
+#include "luatest.h"
+
+int p29_test_main() {
+	struct lua_State* L = luaL_newstate();
+	luaL_openlibs(L);
+
+	int nfailed = luatest_dofile(L, "../scripts/part29_test.lua");
+
+	lua_close(L);
+	return nfailed;
+}
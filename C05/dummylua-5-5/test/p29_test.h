@@ -0,0 +1,8 @@
+#ifndef _p29_test_h_
+#define _p29_test_h_
+
+#include "../clib/luaaux.h"
+
+int p29_test_main();
+
+#endif
@@ -0,0 +1,8 @@
+#ifndef _p30_test_h_
+#define _p30_test_h_
+
+#include "../clib/luaaux.h"
+
+int p30_test_main();
+
+#endif
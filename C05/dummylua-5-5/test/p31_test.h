@@ -0,0 +1,8 @@
+#ifndef _p31_test_h_
+#define _p31_test_h_
+
+#include "../clib/luaaux.h"
+
+int p31_test_main();
+
+#endif
@@ -0,0 +1,8 @@
+#ifndef _p32_test_h_
+#define _p32_test_h_
+
+#include "../clib/luaaux.h"
+
+int p32_test_main();
+
+#endif
@@ -0,0 +1,12 @@
+#include "p33_test.h"
+#include "luatest.h"
+
+int p33_test_main() {
+	struct lua_State* L = luaL_newstate();
+	luaL_openlibs(L);
+
+	int nfailed = luatest_dofile(L, "../scripts/part33_test.lua");
+
+	lua_close(L);
+	return nfailed;
+}
@@ -0,0 +1,8 @@
+#ifndef _p33_test_h_
+#define _p33_test_h_
+
+#include "../clib/luaaux.h"
+
+int p33_test_main();
+
+#endif
@@ -0,0 +1,47 @@
+#include "p34_test.h"
+#include "luatest.h"
+#include <stdio.h>
+
+#define BIGFILE "part34_big.lua"
+#define NBIG 26000 // more than MAXARG_C batches of LFIELD_PER_FLUSH
+
+// a chunk returning a table constructor with NBIG items followed by its
+// varargs, it is too long to check in, so it is written here and loaded as
+// the global 'big'
+static int loadbig(struct lua_State* L) {
+	FILE* f = fopen(BIGFILE, "w");
+	if (f == NULL) {
+		return 0;
+	}
+	fprintf(f, "return {");
+	for (int i = 1; i <= NBIG; i++) {
+		fprintf(f, "%d, ", i);
+	}
+	fprintf(f, "...}\n");
+	fclose(f);
+
+	int ok = luaL_loadfile(L, BIGFILE) == LUA_OK;
+	remove(BIGFILE);
+	return ok;
+}
+
+int p34_test_main() {
+	struct lua_State* L = luaL_newstate();
+	luaL_openlibs(L);
+
+	if (!loadbig(L)) {
+		printf("p34_test: can not load %s\n", BIGFILE);
+		lua_close(L);
+		return 1;
+	}
+	lua_pushglobaltable(L);
+	lua_pushvalue(L, -2);
+	lua_setfield(L, -2, "big");
+	lua_pop(L);
+	lua_pop(L);
+
+	int nfailed = luatest_dofile(L, "../scripts/part34_test.lua");
+
+	lua_close(L);
+	return nfailed;
+}
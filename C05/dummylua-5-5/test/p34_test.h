@@ -0,0 +1,8 @@
+#ifndef _p34_test_h_
+#define _p34_test_h_
+
+#include "../clib/luaaux.h"
+
+int p34_test_main();
+
+#endif
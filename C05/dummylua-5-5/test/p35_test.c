@@ -0,0 +1,26 @@
+#include "p35_test.h"
+#include "luatest.h"
+#include "../common/luastate.h"
+
+// gcinfo(), the collector state and the number of bytes in use
+static int lgcinfo(struct lua_State* L) {
+	struct global_State* g = G(L);
+	lua_pushinteger(L, g->gcstate);
+	lua_pushinteger(L, (lua_Integer)(g->totalbytes + g->GCdebt));
+	return 2;
+}
+
+int p35_test_main() {
+	struct lua_State* L = luaL_newstate();
+	luaL_openlibs(L);
+
+	lua_pushglobaltable(L);
+	lua_pushcfunction(L, lgcinfo);
+	lua_setfield(L, -2, "gcinfo");
+	lua_pop(L);
+
+	int nfailed = luatest_dofile(L, "../scripts/part35_test.lua");
+
+	lua_close(L);
+	return nfailed;
+}
@@ -0,0 +1,8 @@
+#ifndef _p35_test_h_
+#define _p35_test_h_
+
+#include "../clib/luaaux.h"
+
+int p35_test_main();
+
+#endif
@@ -0,0 +1,8 @@
+#ifndef _p36_test_h_
+#define _p36_test_h_
+
+#include "../clib/luaaux.h"
+
+int p36_test_main();
+
+#endif
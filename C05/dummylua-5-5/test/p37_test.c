@@ -0,0 +1,25 @@
+#include "p37_test.h"
+#include "luatest.h"
+#include "../common/luastate.h"
+
+// stackinfo(), the stack size in slots and the number of CallInfos allocated
+static int lstackinfo(struct lua_State* L) {
+	lua_pushinteger(L, L->stack_size);
+	lua_pushinteger(L, L->nci);
+	return 2;
+}
+
+int p37_test_main() {
+	struct lua_State* L = luaL_newstate();
+	luaL_openlibs(L);
+
+	lua_pushglobaltable(L);
+	lua_pushcfunction(L, lstackinfo);
+	lua_setfield(L, -2, "stackinfo");
+	lua_pop(L);
+
+	int nfailed = luatest_dofile(L, "../scripts/part37_test.lua");
+
+	lua_close(L);
+	return nfailed;
+}
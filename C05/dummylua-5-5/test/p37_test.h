@@ -0,0 +1,8 @@
+#ifndef _p37_test_h_
+#define _p37_test_h_
+
+#include "../clib/luaaux.h"
+
+int p37_test_main();
+
+#endif
@@ -0,0 +1,125 @@
+/* Copyright (c) 2018 Manistein,https://manistein.github.io/blog/  
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.*/
+
+#include "luaaot.h"
+#include "../common/luamem.h"
+#include "../common/luastate.h"
+#include <string.h>
+
+// copy what luatoc generated into p, the way close_func leaves a parsed
+// Proto. Every object is reachable from the closure on the stack before the
+// next one is created
+static void loadproto(struct lua_State* L, Proto* p, const AOTProto* ap, struct TString* source) {
+	p->source = source;
+	p->nparam = ap->nparam;
+	p->is_vararg = ap->is_vararg;
+	p->maxstacksize = ap->maxstacksize;
+	p->aot = ap->f;
+	p->hotcount = 0; // the method jit leaves it alone, it is compiled already
+
+	p->code = luaM_realloc(L, NULL, 0, sizeof(Instruction) * ap->sizecode);
+	p->sizecode = ap->sizecode;
+	memcpy(p->code, ap->code, sizeof(Instruction) * ap->sizecode);
+	p->line = luaM_realloc(L, NULL, 0, sizeof(int) * ap->sizecode);
+	p->sizeline = ap->sizecode;
+	memcpy(p->line, ap->line, sizeof(int) * ap->sizecode);
+	luaF_initcache(L, p);
+
+	p->k = luaM_realloc(L, NULL, 0, sizeof(TValue) * ap->sizek);
+	p->sizek = ap->sizek;
+	for (int i = 0; i < ap->sizek; i++) {
+		setnilvalue(&p->k[i]);
+	}
+	for (int i = 0; i < ap->sizek; i++) {
+		const AOTConst* c = &ap->k[i];
+		switch (c->tt) {
+		case LUA_NUMINT: setivalue(&p->k[i], c->i); break;
+		case LUA_NUMFLT: setfltvalue(&p->k[i], c->n); break;
+		case LUA_TBOOLEAN: setbvalue(&p->k[i], c->i != 0); break;
+		case LUA_SHRSTR: case LUA_LNGSTR: {
+			struct TString* ts = luaS_newlstr(L, c->s, cast(unsigned int, c->len));
+			setgco(&p->k[i], obj2gco(ts));
+		} break;
+		default: break;
+		}
+	}
+
+	p->upvalues = luaM_realloc(L, NULL, 0, sizeof(Upvaldesc) * ap->sizeupvalues);
+	p->sizeupvalues = ap->sizeupvalues;
+	for (int i = 0; i < ap->sizeupvalues; i++) {
+		p->upvalues[i].in_stack = ap->upvalues[i].in_stack;
+		p->upvalues[i].idx = ap->upvalues[i].idx;
+		p->upvalues[i].name = NULL;
+	}
+	for (int i = 0; i < ap->sizeupvalues; i++) {
+		const char* name = ap->upvalues[i].name;
+		if (name) {
+			p->upvalues[i].name = luaS_newlstr(L, name, cast(unsigned int, strlen(name)));
+		}
+	}
+
+	p->locvars = luaM_realloc(L, NULL, 0, sizeof(LocVar) * ap->sizelocvar);
+	p->sizelocvar = ap->sizelocvar;
+	for (int i = 0; i < ap->sizelocvar; i++) {
+		p->locvars[i].varname = NULL;
+		p->locvars[i].startpc = 0;
+		p->locvars[i].endpc = 0;
+	}
+	for (int i = 0; i < ap->sizelocvar; i++) {
+		const char* name = ap->locvars[i];
+		if (name) {
+			p->locvars[i].varname = luaS_newlstr(L, name, cast(unsigned int, strlen(name)));
+		}
+	}
+
+	p->p = luaM_realloc(L, NULL, 0, sizeof(Proto*) * ap->sizep);
+	p->sizep = ap->sizep;
+	for (int i = 0; i < ap->sizep; i++) {
+		p->p[i] = NULL;
+	}
+	for (int i = 0; i < ap->sizep; i++) {
+		if (ap->p[i]) {
+			p->p[i] = luaF_newproto(L);
+			loadproto(L, p->p[i], ap->p[i], source);
+		}
+	}
+}
+
+void luaA_load(struct lua_State* L, const AOTProto* main, const char* source) {
+	LClosure* cl = luaF_newLclosure(L, main->sizeupvalues);
+	setlclvalue(L->top, cl);
+	increase_top(L);
+
+	cl->p = luaF_newproto(L);
+	loadproto(L, cl->p, main, luaS_newlstr(L, source, cast(unsigned int, strlen(source))));
+	luaF_initupvals(L, cl);
+
+	// _ENV, like luaL_loadfile
+	if (cl->nupvalues > 0) {
+		struct Table* t = gco2tbl(gcvalue(&G(L)->l_registry));
+		cl->upvals[0]->v = &t->array[LUA_GLOBALTBLIDX];
+	}
+}
+
+int luaA_open(struct lua_State* L, const AOTProto* main, const char* source) {
+	luaA_load(L, main, source);
+	luaD_callnoyield(L, L->top - 1, 1);
+	return 1;
+}
@@ -0,0 +1,442 @@
+/* Copyright (c) 2018 Manistein,https://manistein.github.io/blog/
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.*/
+
+#ifndef luaaot_h
+#define luaaot_h
+
+#include "luavm.h"
+#include "luado.h"
+#include "luafunc.h"
+#include "luagc.h"
+#include "luaopcodes.h"
+#include "../common/luadebug.h"
+#include "../common/luastring.h"
+#include "../common/luatm.h"
+
+// luatoc translates a lua file into c ahead of time. Every Proto becomes a
+// lua_AOTFunction whose instructions are the aot_OP_* macros below, with the
+// operands as literals, so aot_RK(x) and the like are folded by the c compiler,
+// and the jumps are gotos. Fast paths are inlined, slow paths call the same
+// functions as luaV_execute. A call of a lua function, OP_TAILCALL and
+// OP_RETURN are left to luaV_execute, which enters the function again at the
+// instruction after the call (see newframe). The bytecode and the constants
+// are kept as static data and turned into Protos by luaA_load, nothing is
+// parsed at runtime.
+//
+// A generated function starts with aot_prologue() and a switch from pc to
+// the labels where it can be entered, which are the first instruction and
+// the instructions after OP_CALL and OP_TFORCALL
+
+typedef struct AOTConst {
+	int tt;
+	lua_Integer i;      // integers and booleans
+	lua_Number n;
+	const char* s;
+	size_t len;
+} AOTConst;
+
+typedef struct AOTUpval {
+	int in_stack;
+	int idx;
+	const char* name;
+} AOTUpval;
+
+typedef struct AOTProto {
+	lua_AOTFunction f;
+	const Instruction* code;
+	const int* line;
+	int sizecode;
+	const AOTConst* k;
+	int sizek;
+	const AOTUpval* upvalues;
+	int sizeupvalues;
+	const char* const* locvars; // only the names, nothing reads the pc range
+	int sizelocvar;
+	const struct AOTProto* const* p;
+	int sizep;
+	int nparam;
+	int is_vararg;
+	int maxstacksize;
+} AOTProto;
+
+// push a closure of the main function of a compiled file, like luaL_loadfile
+void luaA_load(struct lua_State* L, const AOTProto* main, const char* source);
+
+// load the file and run its main function, returns its result. luatoc makes
+// this the luaopen_ function of the file, for package.preload or require
+int luaA_open(struct lua_State* L, const AOTProto* main, const char* source);
+
+#define aot_prologue() \
+	LClosure* cl = gco2lclosure(gcvalue(ci->func)); \
+	TValue* k = cl->p->k; \
+	const Instruction* code = cl->p->code; \
+	StkId base = ci->l.base; \
+	(void)k; (void)base
+
+#define aot_R(x) (base + (x))
+#define aot_K(x) (k + (x))
+#define aot_RK(x) (ISK(x) ? aot_K((x) - BITRK) : aot_R(x))
+#define aot_U(x) (cl->upvals[x])
+
+// like savepc and Protect of luaV_execute, pos is the instruction being executed
+#define aot_savepc(pos) (ci->l.savedpc = code + (pos) + 1)
+#define aot_protect(pos, x) { aot_savepc(pos); x; base = ci->l.base; }
+#define aot_checkgc(pos) luaC_condgc({ aot_savepc(pos); L->top = ci->top; }, L, base = ci->l.base)
+
+// the interpreter executes instruction pos
+#define aot_interpret(pos) return code + (pos)
+
+// the values are written in place, without the setters of luastate.c
+#define aot_setobj(t, v) { TValue* t_ = (t); const TValue* v_ = (v); t_->value_ = v_->value_; t_->tt_ = v_->tt_; }
+#define aot_setivalue(o, x) { TValue* o_ = (o); o_->value_.i = (x); o_->tt_ = LUA_NUMINT; }
+#define aot_setfltvalue(o, x) { TValue* o_ = (o); o_->value_.n = (x); o_->tt_ = LUA_NUMFLT; }
+#define aot_setbvalue(o, x) { TValue* o_ = (o); o_->value_.b = (x); o_->tt_ = LUA_TBOOLEAN; }
+
+#define aot_intop(op, v1, v2) l_castU2S(l_castS2U(v1) op l_castS2U(v2))
+#define aot_tonumber(o, pn) (ttisfloat(o) ? (*(pn) = (o)->value_.n, 1) : luaV_tonumber(L, o, pn))
+
+#define aot_gettablecached(pos, t, key, v) { \
+	const TValue* slot = luaH_getshrstrcached(L, hvalue(t), tsvalue(key), &cl->p->cache[pos]); \
+	if (!ttisnil(slot)) { aot_setobj(v, slot); } \
+	else aot_protect(pos, luaV_finishget(L, t, key, v, cast(TValue*, slot))); }
+
+#define aot_settablecached(pos, t, key, v) { \
+	TValue* slot = cast(TValue*, luaH_getshrstrcached(L, hvalue(t), tsvalue(key), &cl->p->cache[pos])); \
+	if (!ttisnil(slot)) { aot_setobj(slot, v); luaH_chainwrite(L, hvalue(t)); luaC_barrierback(L, hvalue(t), slot); } \
+	else aot_protect(pos, luaV_finishset(L, t, key, v, slot)); }
+
+#define aot_arith(pos, a, b, c, op, event) { \
+	TValue o; \
+	aot_setobj(&o, aot_RK(b)); \
+	aot_savepc(pos); \
+	if (!luaO_arith(L, op, &o, aot_RK(c))) { \
+		aot_protect(pos, luaT_trycallbinTM(L, &o, aot_RK(c), event)); \
+		aot_setobj(&o, L->top - 1); \
+		L->top--; \
+	} \
+	aot_setobj(aot_R(a), &o); }
+
+#define aot_arithfast(pos, a, b, c, iop, fop, op, event) { \
+	TValue* rb = aot_RK(b); \
+	TValue* rc = aot_RK(c); \
+	lua_Number nb, nc; \
+	if (ttisinteger(rb) && ttisinteger(rc)) { \
+		aot_setivalue(aot_R(a), aot_intop(iop, rb->value_.i, rc->value_.i)); \
+	} \
+	else if (aot_tonumber(rb, &nb) && aot_tonumber(rc, &nc)) { \
+		aot_setfltvalue(aot_R(a), nb fop nc); \
+	} \
+	else aot_arith(pos, a, b, c, op, event); }
+
+#define aot_order(pos, a, b, c, cmp, event, skip) { \
+	TValue* rb = aot_RK(b); \
+	TValue* rc = aot_RK(c); \
+	lua_Number nb, nc; \
+	int res; \
+	if (ttisinteger(rb) && ttisinteger(rc)) { \
+		res = (rb->value_.i cmp rc->value_.i); \
+	} \
+	else if (!aot_tonumber(rb, &nb) || !aot_tonumber(rc, &nc)) { \
+		aot_protect(pos, luaT_trycallbinTM(L, rb, rc, event)); \
+		res = !l_false(L->top - 1); \
+		L->top--; \
+	} \
+	else { \
+		res = (nb cmp nc); \
+	} \
+	if (res != (a)) goto skip; }
+
+#define aot_OP_MOVE(pos, a, b) aot_setobj(aot_R(a), aot_R(b))
+#define aot_OP_LOADK(pos, a, bx) aot_setobj(aot_R(a), aot_K(bx))
+
+#define aot_OP_GETUPVAL(pos, a, b) { \
+	if (!aot_U(b)) { \
+		aot_savepc(pos); \
+		luaG_runerror(L, "%s", "op_getupval:upval is not exist"); \
+	} \
+	aot_setobj(aot_R(a), aot_U(b)->v); }
+
+#define aot_OP_CALL(pos, a, b, c) { \
+	if ((b) > 0) L->top = aot_R(a) + (b); \
+	aot_savepc(pos); \
+	if (!luaD_precall(L, aot_R(a), (c) - 1)) return NULL; \
+	if ((c) > 0) L->top = ci->top; \
+	base = ci->l.base; }
+
+#define aot_OP_GETTABUP(pos, a, b, c) { \
+	TValue* upval = aot_U(b)->v; \
+	if (ttistable(upval) && ISK(c) && ttisshrstr(aot_RK(c))) aot_gettablecached(pos, upval, aot_RK(c), aot_R(a)) \
+	else aot_protect(pos, luaV_gettable(L, upval, aot_RK(c), aot_R(a))); }
+
+#define aot_OP_GETTABLE(pos, a, b, c) { \
+	TValue* t = aot_R(b); \
+	if (!ttistable(t)) { \
+		aot_savepc(pos); \
+		luaG_runerror(L, "RB is not index to a table; OP_GETTABLE, RA(%d) RB(%d) RC(%d)\n", a, b, c); \
+	} \
+	if (ISK(c) && ttisshrstr(aot_RK(c))) aot_gettablecached(pos, t, aot_RK(c), aot_R(a)) \
+	else if (ttisinteger(aot_RK(c))) { \
+		const TValue* slot = luaH_getint(L, hvalue(t), aot_RK(c)->value_.i); \
+		if (!ttisnil(slot)) { aot_setobj(aot_R(a), slot); } \
+		else aot_protect(pos, luaV_finishget(L, t, aot_RK(c), aot_R(a), cast(TValue*, slot))); \
+	} \
+	else aot_protect(pos, luaV_gettable(L, t, aot_RK(c), aot_R(a))); }
+
+#define aot_OP_SELF(pos, a, b, c) { \
+	TValue* t = aot_R(b); \
+	if (!ttistable(t)) { \
+		aot_savepc(pos); \
+		luaG_runerror(L, "OP_SELF, RA(%d) RB(%d) RC(%d); RB is not index to a table\n", a, b, c); \
+	} \
+	aot_setobj(aot_R(a) + 1, t); \
+	if (ISK(c) && ttisshrstr(aot_RK(c))) aot_gettablecached(pos, t, aot_RK(c), aot_R(a)) \
+	else aot_protect(pos, luaV_gettable(L, t, aot_RK(c), aot_R(a))); }
+
+#define aot_OP_TEST(pos, a, c, skip) { if (l_false(aot_R(a)) == (c)) goto skip; }
+
+#define aot_OP_TESTSET(pos, a, b, c, skip) { \
+	if (l_false(aot_R(b)) == (c)) goto skip; \
+	aot_setobj(aot_R(a), aot_R(b)); \
+	aot_checkgc(pos); }
+
+#define aot_OP_JUMP(pos, target) goto target
+
+#define aot_OP_UNM(pos, a, b) { \
+	TValue* rb = aot_R(b); \
+	if (ttisinteger(rb)) { \
+		aot_setivalue(aot_R(a), aot_intop(-, 0, rb->value_.i)); \
+	} \
+	else if (ttisfloat(rb)) { \
+		aot_setfltvalue(aot_R(a), -rb->value_.n); \
+	} \
+	else { \
+		TValue o; \
+		aot_setobj(&o, rb); \
+		if (!luaO_arith(L, LUA_OPT_UMN, &o, rb)) { \
+			aot_savepc(pos); \
+			luaG_runerror(L, "%s", "op_unm: rb's type is incorrect"); \
+		} \
+		aot_setobj(aot_R(a), &o); \
+	} }
+
+#define aot_OP_LEN(pos, a, b) { \
+	TValue* rb = aot_R(b); \
+	if (ttistable(rb)) { \
+		aot_setivalue(aot_R(a), luaH_getn(L, gco2tbl(gcvalue(rb)))); \
+	} \
+	else if (ttisshrstr(rb) || ttislngstr(rb)) { \
+		struct TString* ts = gco2ts(gcvalue(rb)); \
+		aot_setivalue(aot_R(a), ttisshrstr(rb) ? ts->shrlen : ts->u.lnglen); \
+	} \
+	else { \
+		aot_savepc(pos); \
+		luaG_runerror(L, "%s", "op_len: rb's type is incorrect"); \
+	} }
+
+#define aot_OP_BNOT(pos, a, b) { \
+	TValue o; \
+	aot_setobj(&o, aot_R(b)); \
+	if (!luaO_arith(L, LUA_OPT_BNOT, &o, aot_R(b))) { \
+		aot_savepc(pos); \
+		luaG_runerror(L, "%s", "op_bnot: rb's type is incorrect"); \
+	} \
+	aot_setobj(aot_R(a), &o); }
+
+#define aot_OP_NOT(pos, a, b) { int res = l_false(aot_R(b)); aot_setbvalue(aot_R(a), res); }
+
+#define aot_OP_ADD(pos, a, b, c) aot_arithfast(pos, a, b, c, +, +, LUA_OPT_ADD, TM_ADD)
+#define aot_OP_SUB(pos, a, b, c) aot_arithfast(pos, a, b, c, -, -, LUA_OPT_SUB, TM_SUB)
+#define aot_OP_MUL(pos, a, b, c) aot_arithfast(pos, a, b, c, *, *, LUA_OPT_MUL, TM_MUL)
+
+#define aot_OP_DIV(pos, a, b, c) { \
+	lua_Number nb, nc; \
+	if (aot_tonumber(aot_RK(b), &nb) && aot_tonumber(aot_RK(c), &nc)) { \
+		aot_setfltvalue(aot_R(a), nb / nc); \
+	} \
+	else aot_arith(pos, a, b, c, LUA_OPT_DIV, TM_DIV); }
+
+#define aot_intdiv(pos, a, b, c, f, op, event) { \
+	if (ttisinteger(aot_RK(b)) && ttisinteger(aot_RK(c))) { \
+		lua_Integer r; \
+		aot_protect(pos, r = f(L, aot_RK(b)->value_.i, aot_RK(c)->value_.i)); \
+		aot_setivalue(aot_R(a), r); \
+	} \
+	else aot_arith(pos, a, b, c, op, event); }
+
+#define aot_OP_IDIV(pos, a, b, c) aot_intdiv(pos, a, b, c, luaV_div, LUA_OPT_IDIV, TM_IDIV)
+#define aot_OP_MOD(pos, a, b, c) aot_intdiv(pos, a, b, c, luaV_mod, LUA_OPT_MOD, TM_MOD)
+#define aot_OP_POW(pos, a, b, c) aot_arith(pos, a, b, c, LUA_OPT_POW, TM_POW)
+#define aot_OP_BAND(pos, a, b, c) aot_arith(pos, a, b, c, LUA_OPT_BAND, TM_BAND)
+#define aot_OP_BOR(pos, a, b, c) aot_arith(pos, a, b, c, LUA_OPT_BOR, TM_BOR)
+#define aot_OP_BXOR(pos, a, b, c) aot_arith(pos, a, b, c, LUA_OPT_BXOR, TM_XOR)
+#define aot_OP_SHL(pos, a, b, c) aot_arith(pos, a, b, c, LUA_OPT_SHL, TM_SHL)
+#define aot_OP_SHR(pos, a, b, c) aot_arith(pos, a, b, c, LUA_OPT_SHR, TM_SHR)
+
+#define aot_OP_CONCAT(pos, a, b, c) { \
+	aot_protect(pos, luaV_concat(L, aot_R(b), (c) - (b) + 1)); \
+	aot_setobj(aot_R(a), aot_R(b)); }
+
+#define aot_OP_EQ(pos, a, b, c, skip) { \
+	TValue* rb = aot_RK(b); \
+	TValue* rc = aot_RK(c); \
+	int res; \
+	if (ttisinteger(rb) && ttisinteger(rc)) { \
+		res = (rb->value_.i == rc->value_.i); \
+	} \
+	else aot_protect(pos, res = luaV_eqobject(L, rb, rc)); \
+	if (res != (a)) goto skip; }
+
+#define aot_OP_LT(pos, a, b, c, skip) aot_order(pos, a, b, c, <, TM_LT, skip)
+#define aot_OP_LE(pos, a, b, c, skip) aot_order(pos, a, b, c, <=, TM_LE, skip)
+
+#define aot_OP_LOADBOOL(pos, a, b) aot_setbvalue(aot_R(a), b)
+
+#define aot_OP_LOADNIL(pos, a, b) { \
+	for (int j = 0; j <= (b); j++) { \
+		aot_R(a)[j].tt_ = LUA_TNIL; \
+	} }
+
+#define aot_OP_SETUPVAL(pos, a, b) aot_setobj(aot_U(b)->v, aot_R(a))
+
+#define aot_OP_SETTABUP(pos, a, b, c) { \
+	TValue* upval = aot_U(a)->v; \
+	if (!ttistable(upval)) { \
+		aot_savepc(pos); \
+		luaG_runerror(L, "%s", "op_settabup: upval is not table"); \
+	} \
+	struct Table* t = gco2tbl(gcvalue(upval)); \
+	TValue* v; \
+	if (ISK(b) && ttisshrstr(aot_RK(b))) { \
+		v = cast(TValue*, luaH_getshrstrcached(L, t, tsvalue(aot_RK(b)), &cl->p->cache[pos])); \
+		if (v == luaO_nilobject) { \
+			v = luaH_newkey(L, t, aot_RK(b)); \
+		} \
+		else if (ttisnil(v)) { \
+			invalidateTMcache(t); \
+		} \
+	} \
+	else { \
+		v = luaH_set(L, t, aot_RK(b)); \
+	} \
+	luaH_chainwrite(L, t); \
+	aot_setobj(v, aot_RK(c)); \
+	luaC_barrierback(L, t, v); }
+
+#define aot_OP_NEWTABLE(pos, a, b, c) { \
+	struct Table* t = luaH_new(L); \
+	if ((b) != 0 || (c) != 0) luaH_resize(L, t, luaO_fb2int(b), luaO_fb2int(c)); \
+	aot_R(a)->value_.gc = obj2gco(t); \
+	aot_R(a)->tt_ = LUA_TTABLE; \
+	aot_checkgc(pos); }
+
+#define aot_OP_SETLIST(pos, a, b, c) { \
+	if (!ttistable(aot_R(a))) { \
+		aot_savepc(pos); \
+		luaG_runerror(L, "%s", "op_setlist: ra is not table type"); \
+	} \
+	struct Table* t = gco2tbl(gcvalue(aot_R(a))); \
+	int count = (b); \
+	if (count == 0) { \
+		count = cast(int, L->top - aot_R(a)) - 1; \
+		L->top = ci->top; \
+	} \
+	luaH_setlist(L, t, ((c) - 1) * LFIELD_PER_FLUSH, aot_R(a) + 1, count); }
+
+// luatoc already folded it into the OP_SETLIST before it
+#define aot_OP_EXTRAARG(pos)
+
+#define aot_OP_SETTABLE(pos, a, b, c) { \
+	if (!ttistable(aot_R(a))) { \
+		aot_savepc(pos); \
+		luaG_runerror(L, "%s", "op_settable: ra is not table type"); \
+	} \
+	if (ISK(b) && ttisshrstr(aot_RK(b))) aot_settablecached(pos, aot_R(a), aot_RK(b), aot_RK(c)) \
+	else aot_protect(pos, luaV_settable(L, aot_R(a), aot_RK(b), aot_RK(c))); }
+
+// skip is the instruction after the OP_FORLOOP of the loop
+#define aot_OP_FORPREP(pos, a, skip) { \
+	aot_savepc(pos); \
+	if (luaV_forprep(L, aot_R(a))) goto skip; }
+
+#define aot_OP_FORLOOP(pos, a, loop) { \
+	StkId ra = aot_R(a); \
+	if (ttisinteger(ra + 2)) { \
+		lua_Unsigned count = l_castS2U((ra + 1)->value_.i); \
+		if (count > 0) { \
+			lua_Integer idx = l_castU2S(l_castS2U(ra->value_.i) + l_castS2U((ra + 2)->value_.i)); \
+			(ra + 1)->value_.i = l_castU2S(count - 1); \
+			ra->value_.i = idx; \
+			aot_setivalue(ra + 3, idx); \
+			goto loop; \
+		} \
+	} \
+	else { \
+		lua_Number fstep = (ra + 2)->value_.n; \
+		lua_Number idx = ra->value_.n + fstep; \
+		lua_Number flimit = (ra + 1)->value_.n; \
+		if (fstep > 0 ? idx <= flimit : flimit <= idx) { \
+			ra->value_.n = idx; \
+			aot_setfltvalue(ra + 3, idx); \
+			goto loop; \
+		} \
+	} }
+
+#define aot_OP_TFORCALL(pos, a, c) { \
+	StkId cb = aot_R(a) + 3; \
+	aot_setobj(cb, aot_R(a)); \
+	aot_setobj(cb + 1, aot_R(a) + 1); \
+	aot_setobj(cb + 2, aot_R(a) + 2); \
+	L->top = cb + 3; \
+	aot_savepc(pos); \
+	if (!luaD_precall(L, cb, 2)) return NULL; \
+	L->top = ci->top; \
+	base = ci->l.base; }
+
+#define aot_OP_TFORLOOP(pos, a, loop) { \
+	if (!ttisnil(aot_R(a) + 1)) { \
+		aot_setobj(aot_R(a), aot_R(a) + 1); \
+		goto loop; \
+	} }
+
+#define aot_OP_CLOSURE(pos, a, bx) { \
+	luaV_pushclosure(L, cl, cl->p->p[bx], aot_R(a)); \
+	aot_checkgc(pos); }
+
+// the extra arguments stay right below base, see adjust_varargs
+#define aot_OP_VARARG(pos, a, b) { \
+	int want = (b) - 1; \
+	int have = cast(int, base - ci->func) - cl->p->nparam - 1; \
+	if (have < 0) { \
+		have = 0; \
+	} \
+	if (want < 0) { \
+		want = have; \
+		aot_protect(pos, luaD_checkstack(L, have)); \
+		L->top = aot_R(a) + have; \
+	} \
+	int j; \
+	for (j = 0; j < want && j < have; j++) { \
+		aot_setobj(aot_R(a) + j, base - have + j); \
+	} \
+	for (; j < want; j++) { \
+		aot_R(a)[j].tt_ = LUA_TNIL; \
+	} }
+
+#endif
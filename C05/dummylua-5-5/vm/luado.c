@@ -27,8 +27,15 @@ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
 #include "luagc.h"
 #include "luafunc.h"
 #include "luavm.h"
+#include "luaopcodes.h"
+#include "luajit.h"
 #include "../common/luadebug.h"
 
+#if LUA_USE_MMAPSTACK
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
 #define LUA_TRY(L, c, a) if (_setjmp((c)->b) == 0) { a } 
 
 #ifdef _WINDOWS_PLATFORM_ 
@@ -48,16 +55,128 @@ void seterrobj(struct lua_State* L, int error, StkId oldtop) {
 	L->top = oldtop + 1;
 }
 
+// no gc step here, calls stay free of collector work. The vm steps the
+// collector after the instructions that create objects, see checkGC in luavm.c
 void luaD_checkstack(struct lua_State* L, int need) {
-	luaC_checkgc(L);
     if (L->top + need > L->stack_last) {
         luaD_growstack(L, need);
     }
 }
 
+// the stack has moved, every pointer into it has to follow
+static void correctstack(struct lua_State* L, TValue* old_stack) {
+    L->top = restorestack(L, cast(int, L->top - old_stack));
+
+    struct CallInfo* ci;
+    ci = &L->base_ci;
+    while(ci) {
+        int func_diff = cast(int, ci->func - old_stack);
+        int top_diff = cast(int, ci->top - old_stack);
+		int luabase_diff = cast(int, ci->l.base - old_stack);
+        ci->func = restorestack(L, func_diff);
+        ci->top = restorestack(L, top_diff);
+		ci->l.base = restorestack(L, luabase_diff);
+
+        ci = ci->next;
+    }
+
+    // open upvalues point into the old stack too
+    for (UpVal* uv = L->openupval; uv != NULL; uv = uv->u.open.next) {
+        uv->v = restorestack(L, cast(int, uv->v - old_stack));
+    }
+}
+
+#if LUA_USE_MMAPSTACK
+// bytes of whole pages holding n slots
+static size_t stackbytes(int n) {
+    size_t pagesize = (size_t)sysconf(_SC_PAGESIZE);
+    return (n * sizeof(TValue) + pagesize - 1) & ~(pagesize - 1);
+}
+
+// the largest stack (see luaD_growstack) and a guard page after it. Pages past
+// the committed part stay inaccessible, so running off the end faults
+// instead of overwriting other memory
+#define stackreserve() (stackbytes(LUA_MAXSTACK + LUA_ERRORSTACK) + (size_t)sysconf(_SC_PAGESIZE))
+
+// coroutines can be many and are mostly shallow, reserving that much for each
+// of them would use up the address space, so only the main thread does
+#define mapstack(L) ((L) == G(L)->mainthread)
+#endif
+
+#if LUA_USE_MMAPSTACK
+// commit or give back the pages between old_size and size slots, the stack
+// itself never moves
+static void remapstack(struct lua_State* L, int old_size, int size) {
+    if (L->stack == NULL) {
+        void* p = mmap(NULL, stackreserve(), PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (p == MAP_FAILED) {
+            luaD_throw(L, LUA_ERRMEM);
+        }
+        L->stack = cast(TValue*, p);
+        old_size = 0;
+    }
+
+    size_t old_bytes = stackbytes(old_size);
+    size_t new_bytes = stackbytes(size);
+    char* p = cast(char*, L->stack);
+    if (new_bytes > old_bytes) {
+        if (mprotect(p + old_bytes, new_bytes - old_bytes, PROT_READ | PROT_WRITE) != 0) {
+            luaD_throw(L, LUA_ERRMEM);
+        }
+    }
+    else if (new_bytes < old_bytes) {
+        // give the pages back, they are committed again when touched
+        madvise(p + new_bytes, old_bytes - new_bytes, MADV_DONTNEED);
+        mprotect(p + new_bytes, old_bytes - new_bytes, PROT_NONE);
+    }
+    G(L)->GCdebt += cast(l_mem, new_bytes) - cast(l_mem, old_bytes);
+}
+#endif
+
+void luaD_reallocstack(struct lua_State* L, int size) {
+    TValue* old_stack = L->stack;
+    int old_size = L->stack_size;
+
+#if LUA_USE_MMAPSTACK
+    if (mapstack(L)) {
+        remapstack(L, old_size, size);
+    }
+    else
+#endif
+    L->stack = luaM_realloc(L, L->stack, old_size * sizeof(TValue), size * sizeof(TValue));
+
+    for (int i = old_size; i < size; i++) {
+        setnilvalue(L->stack + i);
+    }
+    L->stack_size = size;
+    L->stack_last = L->stack + size - LUA_EXTRASTACK;
+
+    if (old_stack != NULL && L->stack != old_stack) {
+        correctstack(L, old_stack);
+    }
+}
+
+void luaD_freestack(struct lua_State* L) {
+    if (L->stack == NULL) {
+        return;
+    }
+
+#if LUA_USE_MMAPSTACK
+    if (mapstack(L)) {
+        G(L)->GCdebt -= cast(l_mem, stackbytes(L->stack_size));
+        munmap(L->stack, stackreserve());
+    }
+    else
+#endif
+    luaM_free(L, L->stack, L->stack_size * sizeof(TValue));
+    L->stack = L->stack_last = L->top = NULL;
+    L->stack_size = 0;
+}
+
 void luaD_growstack(struct lua_State* L, int size) {
     if (L->stack_size > LUA_MAXSTACK) {
-		luaG_runerror(L, "stack size is too big %d", L->stack_size);
+        // overflowed again while already running on the error reserve
+        luaD_throw(L, LUA_ERRERR);
     }
 
     int stack_size = L->stack_size * 2;
@@ -66,28 +185,71 @@ void luaD_growstack(struct lua_State* L, int size) {
         stack_size = need_size;
     }
     
-    if (stack_size > LUA_MAXSTACK) {
+    int overflow = 0;
+    if (need_size > LUA_MAXSTACK) {
+        // grow into the error reserve so the error message and traceback have room
         stack_size = LUA_MAXSTACK + LUA_ERRORSTACK;
-    } 
+        overflow = 1;
+    }
+    else if (stack_size > LUA_MAXSTACK) {
+        stack_size = LUA_MAXSTACK;
+    }
 
-    TValue* old_stack = L->stack;
-    L->stack = luaM_realloc(L, L->stack, L->stack_size, stack_size * sizeof(TValue));
-    L->stack_size = stack_size;
-    L->stack_last = L->stack + stack_size - LUA_EXTRASTACK;
-    int top_diff = cast(int, L->top - old_stack);
-    L->top = restorestack(L, top_diff);
+    luaD_reallocstack(L, stack_size);
 
-    struct CallInfo* ci;
-    ci = &L->base_ci;
-    while(ci) {
-        int func_diff = cast(int, ci->func - old_stack);
-        int top_diff = cast(int, ci->top - old_stack);
-		int luabase_diff = cast(int, ci->l.base - old_stack);
-        ci->func = restorestack(L, func_diff);
-        ci->top = restorestack(L, top_diff);
-		ci->l.base = restorestack(L, luabase_diff);
+    if (overflow) {
+        luaG_runerror(L, "stack overflow");
+    }
+}
 
-        ci = ci->next;
+// release what a past deep recursion left behind: CallInfo blocks past the one
+// of the current frame and the one after it, and the part of the stack far
+// above anything in use. The stack is only shrunk when it is more than twice
+// the size it needs, so a program that keeps recursing to a similar depth does
+// not go back and forth
+void luaD_shrinkstack(struct lua_State* L) {
+    int depth = 0;
+    for (struct CallInfo* ci = L->ci; ci != &L->base_ci; ci = ci->previous) {
+        depth++;
+    }
+
+    int keep = ((depth + CI_BLOCKSIZE - 1) / CI_BLOCKSIZE + 1) * CI_BLOCKSIZE;
+    if (L->nci > keep) {
+        struct CallInfo* last = &L->base_ci;
+        for (int i = 0; i < keep; i++) {
+            last = last->next;
+        }
+
+        struct CallInfo* ci = last->next;
+        last->next = NULL;
+        while (ci) {
+            struct CallInfo* block = ci;
+            ci = block[CI_BLOCKSIZE - 1].next;
+            luaM_free(L, block, CI_BLOCKSIZE * sizeof(struct CallInfo));
+            L->nci -= CI_BLOCKSIZE;
+        }
+    }
+
+    // running on the error reserve, leave it to the error handling
+    if (L->stack_size > LUA_MAXSTACK) {
+        return;
+    }
+
+    StkId lim = L->top;
+    for (struct CallInfo* ci = L->ci; ci != NULL; ci = ci->previous) {
+        if (lim < ci->top) {
+            lim = ci->top;
+        }
+    }
+
+    int inuse = cast(int, lim - L->stack) + 1;
+    int goodsize = inuse + inuse / 8 + 2 * LUA_EXTRASTACK;
+    if (goodsize < LUA_STACKSIZE) {
+        goodsize = LUA_STACKSIZE;
+    }
+
+    if (goodsize * 2 < L->stack_size) {
+        luaD_reallocstack(L, goodsize);
     }
 }
 
@@ -107,6 +269,7 @@ void luaD_throw(struct lua_State* L, int error) {
 
 int luaD_rawrunprotected(struct lua_State* L, Pfunc f, void* ud) {
     int old_ncalls = L->ncalls;
+    int old_nny = L->nny;
     struct lua_longjmp lj;
     lj.previous = L->errorjmp;
     lj.status = LUA_OK;
@@ -120,6 +283,7 @@ int luaD_rawrunprotected(struct lua_State* L, Pfunc f, void* ud) {
 
     L->errorjmp = lj.previous;
     L->ncalls = old_ncalls;
+    L->nny = old_nny;
     return lj.status;
 }
 
@@ -130,13 +294,15 @@ static struct CallInfo* next_ci(struct lua_State* L, StkId func, int nresult) {
         ci = L->ci->next;
     }
     else {
-        ci = luaM_realloc(L, NULL, 0, sizeof(struct CallInfo));
-        ci->next = NULL;
-        L->nci++;
+        ci = luaM_newvector(L, CI_BLOCKSIZE, struct CallInfo);
+        for (int i = 0; i < CI_BLOCKSIZE; i++) {
+            ci[i].previous = i == 0 ? L->ci : &ci[i - 1];
+            ci[i].next = i + 1 < CI_BLOCKSIZE ? &ci[i + 1] : NULL;
+        }
+        L->ci->next = ci;
+        L->nci += CI_BLOCKSIZE;
     }
     
-    ci->previous = L->ci;
-    L->ci->next = ci;
     ci->nresult = nresult;
     ci->callstatus = LUA_OK;
     ci->func = func;
@@ -149,6 +315,24 @@ static struct CallInfo* next_ci(struct lua_State* L, StkId func, int nresult) {
 // prepare for function call. 
 // if we call a c function, just directly call it
 // if we call a lua function, just prepare for call it
+// the fixed parameters are moved above the actual arguments and the new base
+// starts right after them, so the extra arguments stay in place below base
+static StkId adjust_varargs(struct lua_State* L, Proto* p, int actual) {
+	int nfixargs = p->nparam;
+	if (actual < nfixargs) {
+		actual = nfixargs; // missing ones are already nil filled
+	}
+
+	StkId fixed = L->top - actual;
+	StkId base = L->top;
+	for (int i = 0; i < nfixargs; i++) {
+		setobj(L->top++, fixed + i);
+		setnilvalue(fixed + i);
+	}
+
+	return base;
+}
+
 int luaD_precall(struct lua_State* L, StkId func, int nresult) {
 	lua_CFunction f;
 	ptrdiff_t func_diff;
@@ -179,19 +363,26 @@ int luaD_precall(struct lua_State* L, StkId func, int nresult) {
 			int fsize = cl->p->maxstacksize;
 
 			func_diff = savestack(L, func);
-			luaD_checkstack(L, fsize);
+			// a vararg callee gets its missing parameters nil filled, then the fixed
+			// ones are copied above the arguments and the frame starts after them
+			luaD_checkstack(L, cl->p->is_vararg ? fsize + 2 * cl->p->nparam : fsize);
 			func = restorestack(L, func_diff);
 			int n = L->top - func - 1;
+			StkId base = func + 1;
 			for (int i = n; i < cl->p->nparam; i++) {
 				setnilvalue(L->top++);
 			}
+			if (cl->p->is_vararg) {
+				base = adjust_varargs(L, cl->p, n);
+			}
 
 			next_ci(L, func, nresult);
 			L->ci->func = func;
-			L->ci->l.base = func + 1;
+			L->ci->l.base = base;
 			L->top = L->ci->top = L->ci->l.base + fsize;
 			L->ci->l.savedpc = cl->p->code;
 			L->ci->callstatus |= CIST_LUA;
+			luaJ_hot(L, cl->p);
 		} break;
 		default: {
 			luaG_runerror(L, "%s", "attempt to call a unsupport value.");
@@ -201,69 +392,43 @@ int luaD_precall(struct lua_State* L, StkId func, int nresult) {
     return 0;
 }
 
+// move the results down to where the function was. The slots they come from
+// are left as they are, the collector clears everything above top in the
+// atomic phase (see traverse_thread), so stale values there are harmless
 int luaD_poscall(struct lua_State* L, StkId first_result, int nresult) {
     StkId func = L->ci->func;
     int nwant = L->ci->nresult;
 
     switch(nwant) {
-        case 0: {
-            L->top = L->ci->func;
-        } break;
+        case 0: break;
         case 1: {
             if (nresult == 0) {
-				setnilvalue(first_result);
+                setnilvalue(func);
+            }
+            else {
+                setobj(func, first_result);
             }
-            setobj(func, first_result);
-			setnilvalue(first_result);
-
-            L->top = func + nwant;
         } break;
         case LUA_MULRET: {
-            int i;
-            for (i = 0; i < nresult; i++) {
-                StkId current = first_result + i;
-                setobj(func + i, current);
-				setnilvalue(current);
+            for (int i = 0; i < nresult; i++) {
+                setobj(func + i, first_result + i);
             }
-            L->top = func + nresult;
+            nwant = nresult;
         } break;
         default: {
-            if (nwant > nresult) {
-                int i;
-                for (i = 0; i < nwant; i++) {
-                    if (i < nresult) {
-                        StkId current = first_result + i;
-                        setobj(func + i, current);
-						setnilvalue(current);
-                    }
-                    else {
-                        StkId stack = func + i;
-						setnilvalue(stack);
-                    }
-                }
-                L->top = func + nwant;
+            int i;
+            int n = nwant < nresult ? nwant : nresult;
+            for (i = 0; i < n; i++) {
+                setobj(func + i, first_result + i);
+            }
+            for (; i < nwant; i++) {
+                setnilvalue(func + i);
             }
-            else {
-                int i;
-                for (i = 0; i < nresult; i++) {
-                    if (i < nwant) {
-                        StkId current = first_result + i;
-                        setobj(func + i, current);
-						setnilvalue(current);
-                    }
-                    else {
-                        StkId stack = func + i;
-						setnilvalue(stack);
-                    }
-                }
-                L->top = func + nresult;
-            } 
         } break;
     }
 
-    struct CallInfo* ci = L->ci;
-    L->ci = ci->previous;
-    
+    L->top = func + nwant;
+    L->ci = L->ci->previous;
     return LUA_OK;
 }
 
@@ -305,6 +470,102 @@ int luaD_pcall(struct lua_State* L, Pfunc f, void* ud, ptrdiff_t oldtop, ptrdiff
     return status;
 }
 
+// finish the lua frames a yield has interrupted. Each one runs in a fresh
+// luaV_execute, from the instruction after the call that led to the yield
+static void unroll(struct lua_State* L) {
+    while (L->ci != &L->base_ci) {
+        struct CallInfo* ci = L->ci;
+        lua_assert(ci->callstatus & CIST_LUA);
+
+        // what OP_CALL and OP_TFORCALL do once a c function has returned
+        Instruction i = *(ci->l.savedpc - 1);
+        if ((GET_OPCODE(i) == OP_CALL && GET_ARG_C(i) > 0) || GET_OPCODE(i) == OP_TFORCALL) {
+            L->top = ci->top;
+        }
+        luaV_execute(L);
+    }
+}
+
+static int resume(struct lua_State* L, void* ud) {
+    int n = *(cast(int*, ud));
+    StkId first_arg = L->top - n;
+    struct CallInfo* ci = L->ci;
+
+    if (L->status == LUA_OK) { // start the body
+        if (!luaD_precall(L, first_arg - 1, LUA_MULRET)) {
+            luaV_execute(L);
+        }
+    }
+    else { // the c function that yielded returns what was passed to resume
+        L->status = LUA_OK;
+        ci->func = restorestack(L, L->yieldfunc);
+        luaD_poscall(L, first_arg, n);
+        unroll(L);
+    }
+    return LUA_OK;
+}
+
+static int resume_error(struct lua_State* L, const char* msg, int nargs) {
+    L->top -= nargs;
+    lua_pushstring(L, msg);
+    return LUA_ERRRUN;
+}
+
+// L returns LUA_YIELD with the yielded values on its stack, LUA_OK with the
+// results of its body once it has finished, or an error code with the error
+// on its top, and then it is dead
+int lua_resume(struct lua_State* L, struct lua_State* from, int nargs) {
+    if (L->status == LUA_OK) {
+        if (L->ci != &L->base_ci) {
+            return resume_error(L, "cannot resume non-suspended coroutine", nargs);
+        }
+        if (L->top - (L->ci->func + 1) == nargs) { // no function to run
+            return resume_error(L, "cannot resume dead coroutine", nargs);
+        }
+    }
+    else if (L->status != LUA_YIELD) {
+        return resume_error(L, "cannot resume dead coroutine", nargs);
+    }
+
+    L->ncalls = from ? from->ncalls + 1 : 1;
+    if (L->ncalls >= LUA_MAXCALLS) {
+        return resume_error(L, "C stack overflow", nargs);
+    }
+
+    L->nny = 0;
+    int status = luaD_rawrunprotected(L, resume, &nargs);
+    if (status != LUA_OK && status != LUA_YIELD) {
+        L->status = status;
+        L->ci->top = L->top;
+    }
+    L->nny = 1;
+
+    return status;
+}
+
+// a yield unwinds the c stack back to lua_resume, so it can only pass through
+// lua frames. A c function calling lua (luaD_callnoyield, metamethods called
+// from c) is a boundary it can not cross
+int lua_yield(struct lua_State* L, int nresults) {
+    struct CallInfo* ci = L->ci;
+    if (L->nny > 0) {
+        if (L != G(L)->mainthread) {
+            luaG_runerror(L, "%s", "attempt to yield across a C-call boundary");
+        }
+        else {
+            luaG_runerror(L, "%s", "attempt to yield from outside a coroutine");
+        }
+    }
+
+    // the yielded values become the only ones of the frame until it is resumed
+    L->status = LUA_YIELD;
+    L->yieldfunc = savestack(L, ci->func);
+    ci->func = L->top - nresults - 1;
+    luaD_throw(L, LUA_YIELD);
+
+    return 0;
+}
+
 // skip utf-8 BOM
 static int skipBOM(LoadF* lf) {
 	const char* bom = "\xEF\xBB\xBF";
@@ -391,7 +652,7 @@ int luaD_protectedparser(struct lua_State* L, Zio* z, const char* filename) {
 		return LUA_ERRERR;
 	}
 
-	luaM_free(L, p.dyd.actvar.arr, p.dyd.actvar.size * sizeof(short));
+	luaM_free(L, p.dyd.actvar.arr, p.dyd.actvar.size * sizeof(Vardesc));
 	luaM_free(L, p.buffer.buffer, p.buffer.size * sizeof(char));
 	return LUA_OK;
 }
@@ -24,14 +24,29 @@ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
 #include "../common/luastate.h"
 #include "../compiler/luazio.h"
 
+// linux only: the stack of the main thread reserves address space for its
+// largest size up front and commits pages as it grows, so it never moves. It is built with
+// -DLUA_USE_MMAPSTACK=1 (cmake -DLUA_USE_MMAPSTACK=ON)
+#if defined(LUA_USE_MMAPSTACK) && LUA_USE_MMAPSTACK && defined(__linux__)
+#undef LUA_USE_MMAPSTACK
+#define LUA_USE_MMAPSTACK 1
+#else
+#undef LUA_USE_MMAPSTACK
+#define LUA_USE_MMAPSTACK 0
+#endif
+
 #define CIST_LUA 1
 #define CIST_FRESH (1 << 1)
+#define CIST_TAIL (1 << 2)  // the frame was reused by a tail call
 
 typedef int (*Pfunc)(struct lua_State* L, void* ud);
 
 void seterrobj(struct lua_State* L, int error, StkId oldtop);
 void luaD_checkstack(struct lua_State* L, int need);
 void luaD_growstack(struct lua_State* L, int size);
+void luaD_reallocstack(struct lua_State* L, int size); // the first call allocates the stack, L->stack must be NULL
+void luaD_freestack(struct lua_State* L);
+void luaD_shrinkstack(struct lua_State* L); // called by the collector in the atomic phase
 void luaD_throw(struct lua_State* L, int error);
 
 int luaD_rawrunprotected(struct lua_State* L, Pfunc f, void* ud);
@@ -1,5 +1,6 @@
 #include "luafunc.h"
 #include "luagc.h"
+#include "luajit.h"
 #include "../common/luamem.h"
 #include "../common/luastate.h"
 #include "../common/luaobject.h"
@@ -21,6 +22,15 @@ Proto* luaF_newproto(struct lua_State* L) {
 	f->sizeupvalues = 0;
 	f->source = NULL;
 	f->maxstacksize = 0;
+	f->cache = NULL;
+	f->sizecache = 0;
+	f->jit = NULL;
+	f->hotcount = LUAJ_HOTCOUNT;
+	f->loops = NULL;
+	f->sizeloops = 0;
+	f->ndeopt = 0;
+	f->noquicken = 0;
+	f->aot = NULL;
 	f->line = NULL;
 	f->sizecode = 0;
 	f->sizeline = 0;
@@ -53,6 +63,12 @@ void luaF_freeproto(struct lua_State* L, Proto* f) {
 		luaM_free(L, f->line, sizeof(int) * f->sizeline);
 	}
 
+	if (f->cache) {
+		luaM_free(L, f->cache, sizeof(ICache) * f->sizecache);
+	}
+
+	luaJ_free(L, f);
+
 	luaM_free(L, f, sizeof(Proto));
 }
 
@@ -64,9 +80,20 @@ lu_mem luaF_sizeproto(struct lua_State* L, Proto* f) {
 	sz += sizeof(Proto*) * f->sizep;
 	sz += sizeof(Upvaldesc) * f->sizeupvalues;
 	sz += sizeof(int) * f->sizeline;
+	sz += sizeof(ICache) * f->sizecache;
 	return sz;
 }
 
+void luaF_initcache(struct lua_State* L, Proto* f) {
+	lua_assert(f->cache == NULL);
+	f->cache = luaM_realloc(L, NULL, 0, sizeof(ICache) * f->sizecode);
+	f->sizecache = f->sizecode;
+	for (int i = 0; i < f->sizecache; i++) {
+		f->cache[i].node = NULL;
+		f->cache[i].slot = 0;
+	}
+}
+
 LClosure* luaF_newLclosure(struct lua_State* L, int nup) {
 	struct GCObject* gco = luaC_newobj(L, LUA_TLCL, sizeofLClosure(nup));
 	LClosure* cl = gco2lclosure(gco);
@@ -140,9 +167,15 @@ UpVal* luaF_findupval(struct lua_State* L, LClosure* cl, int upval_index) {
 
 	UpVal* new_upval = luaM_realloc(L, NULL, 0, sizeof(UpVal));
 	new_upval->u.open.next = openval;
+	new_upval->u.open.touched = 1;
 	new_upval->refcount = 1;
 	new_upval->v = level;
 
+	if (!isintwups(L)) { // the collector has to find the open upvalues of L, see remarkupvals
+		L->twups = G(L)->twups;
+		G(L)->twups = L;
+	}
+
 	if (prev)
 		prev->u.open.next = new_upval;
 	else
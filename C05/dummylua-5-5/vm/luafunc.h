@@ -26,6 +26,7 @@ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
 #define sizeofLClosure(n) (sizeof(LClosure) + sizeof(UpVal*) * (max((n) - 1, 0)))
 #define sizeofCClosure(n) (sizeof(CClosure) + sizeof(TValue) * (max((n) - 1, 0)))
 #define upisopen(up) (up->v != &up->u.value)
+#define isintwups(L) (L->twups != L)
 
 struct UpVal {
 	TValue* v;  // point to stack or its own value (when open)
@@ -42,6 +43,7 @@ struct UpVal {
 Proto* luaF_newproto(struct lua_State* L);
 void luaF_freeproto(struct lua_State* L, Proto* f);
 lu_mem luaF_sizeproto(struct lua_State* L, Proto* f);
+void luaF_initcache(struct lua_State* L, Proto* f); // one empty inline cache per instruction
 
 LClosure* luaF_newLclosure(struct lua_State* L, int nup);
 void luaF_freeLclosure(struct lua_State* L, LClosure* cl);
@@ -128,6 +128,15 @@ static lu_mem traverse_thread(struct lua_State* L, struct lua_State* th) {
         markvalue(L, o);
     }
 
+    // the dead part of the stack may still hold values of frames that have
+    // returned, clear it before sweeping so nothing refers to freed objects
+    if (G(L)->gcstate == GCSinsideatomic) {
+        for (; o < th->stack + th->stack_size; o++) {
+            setnilvalue(o);
+        }
+        luaD_shrinkstack(th);
+    }
+
     return sizeof(struct lua_State) + sizeof(TValue) * th->stack_size + sizeof(struct CallInfo) * th->nci;
 }
 
@@ -306,12 +315,17 @@ static lu_mem traverse_proto(struct lua_State* L, struct Proto* p) {
 static lu_mem traverse_lclosure(struct lua_State* L, struct LClosure* cl) {
 	markobject(L, cl->p);
 
-	for (int i = 1; i < cl->nupvalues; i++) {
+	for (int i = 0; i < cl->nupvalues; i++) {
 		UpVal* up = cl->upvals[i];
 		if (!up)
 			continue;
 
-		if (!upisopen(up)) {
+		// an open upvalue is marked with the stack of its thread, or by
+		// remarkupvals when the thread is not reachable any more
+		if (upisopen(up) && G(L)->gcstate != GCSinsideatomic) {
+			up->u.open.touched = 1;
+		}
+		else {
 			markvalue(L, up->v);
 		}
 	}
@@ -320,8 +334,11 @@ static lu_mem traverse_lclosure(struct lua_State* L, struct LClosure* cl) {
 }
 
 static lu_mem traverse_cclosure(struct lua_State* L, struct CClosure* cc) {
-	// TODO process upvalues
-	return sizeof(struct CClosure);
+	for (int i = 0; i < cc->nupvalues; i++) {
+		markvalue(L, &cc->upvalues[i]);
+	}
+
+	return sizeofCClosure(cc->nupvalues);
 }
 
 static void propagatemark(struct lua_State* L) {
@@ -337,10 +354,10 @@ static void propagatemark(struct lua_State* L) {
         case LUA_TTHREAD:{
             struct lua_State* th = gco2th(gco);
             g->gray = th->gclist;
-			if (g->mainthread == th) {
-				black2gray(gco);
-				linkgclist(th, g->grayagain);
-			}
+			// a stack is written without barriers, every thread is traversed
+			// again in the atomic phase
+			black2gray(gco);
+			linkgclist(th, g->grayagain);
             size = traverse_thread(L, th);
         } break;
         case LUA_TTABLE:{
@@ -530,6 +547,30 @@ static void converge_ephemeron(struct lua_State* L) {
 	} while (changed);
 }
 
+// a thread that was not reached is not traversed, but closures that are
+// alive may still use its open upvalues. Their values are marked here, and
+// threads that were not reached or have no open upvalues leave the list
+static void remarkupvals(struct lua_State* L) {
+    struct global_State* g = G(L);
+    struct lua_State** p = &g->twups;
+    struct lua_State* th;
+    while ((th = *p) != NULL) {
+        if (!iswhite(th) && th->openupval != NULL) {
+            p = &th->twups;
+        }
+        else {
+            *p = th->twups;
+            th->twups = th;
+            for (UpVal* uv = th->openupval; uv != NULL; uv = uv->u.open.next) {
+                if (uv->u.open.touched) {
+                    markvalue(L, uv->v);
+                    uv->u.open.touched = 0;
+                }
+            }
+        }
+    }
+}
+
 static void atomic(struct lua_State* L) {
     struct global_State* g = G(L);
     g->gray = g->grayagain;
@@ -537,6 +578,8 @@ static void atomic(struct lua_State* L) {
 
     g->gcstate = GCSinsideatomic;
 	markmt(L);
+    propagateall(L);
+    remarkupvals(L);
     propagateall(L);
 
 	converge_ephemeron(L);
@@ -563,6 +606,7 @@ static void atomic(struct lua_State* L) {
     g->currentwhite = cast(lu_byte, otherwhite(g));
 
     luaS_clearcache(L);
+	g->chainepoch++; // weak tables in a cached __index chain may have lost fields
 }
 
 static lu_mem freeobj(struct lua_State* L, struct GCObject* gco) {
@@ -587,7 +631,10 @@ static lu_mem freeobj(struct lua_State* L, struct GCObject* gco) {
             return sz;
         } break;
 		case LUA_TTHREAD: {
-			// TODO
+			struct lua_State* th = gco2th(gco);
+			lu_mem sz = sizeof(struct lua_State) + sizeof(TValue) * th->stack_size + sizeof(struct CallInfo) * th->nci;
+			luaE_freethread(L, th);
+			return sz;
 		} break;
 		case LUA_TLCL: {
 			struct LClosure* cl = gco2lclosure(gco);
@@ -840,6 +887,12 @@ void luaC_checkfinalizer(struct lua_State* L, int idx) {
 }
 
 void luaC_fullgc(struct lua_State* L) {
+	// a cycle in progress may have marked objects that became garbage
+	// afterwards, finish it and then run a whole new one
+	while (G(L)->gcstate != GCSpause) {
+		singlestep(L);
+	}
+
 	do {
 		singlestep(L);
 	} while (G(L)->gcstate != GCSpause);
@@ -0,0 +1,1509 @@
+/* Copyright (c) 2018 Manistein,https://manistein.github.io/blog/  
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.*/
+
+#include "luajit.h"
+#include "luaopcodes.h"
+#include "../common/luamem.h"
+#include "../common/luastring.h"
+
+#if LUA_USE_JIT
+#include <sys/mman.h>
+#include <stdio.h>
+#include <string.h>
+
+// The baseline jit translates every instruction of a Proto into a fixed
+// template. Templates inline the fast path of MOVE/LOADK/LOADBOOL/LOADNIL,
+// arithmetic, comparisons, tests, jumps, integer array accesses and the
+// numeric for loop. Everything else, and every fast path whose type guard
+// fails, leaves the native code and hands the instruction back to
+// luaV_execute. The native code never calls into the vm, so it can neither
+// raise an error, reallocate the stack nor run the collector.
+
+typedef const Instruction* (*JitFunction)(struct lua_State* L, StkId base, TValue* k, void* entry);
+
+struct JitCode {
+	unsigned char* mcode;   // executable memory, starts with the prologue
+	size_t size;
+	unsigned int* pcoffset; // offset of the native code of every instruction
+	int sizepc;
+};
+
+// rbx holds base and r12 holds k in the generated code, rax, rcx, rdx and
+// xmm0-xmm3 are scratch registers
+enum { RAX = 0, RCX = 1, RDX = 2, RBX = 3, R12 = 12 };
+
+// x86 condition codes, cc ^ 1 is the negation of cc
+enum { CC_B = 0x2, CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5, CC_BE = 0x6, CC_A = 0x7, CC_L = 0xC, CC_GE = 0xD, CC_LE = 0xE, CC_G = 0xF };
+
+#define NOLABEL ((size_t)-1)
+#define VALUE_OFFSET cast(int, offsetof(TValue, value_))
+#define TT_OFFSET cast(int, offsetof(TValue, tt_))
+
+typedef struct Fixup {
+	size_t at;   // position of a rel32 operand
+	int label;
+} Fixup;
+
+typedef struct ExitStub {
+	int label;
+	int pc;
+} ExitStub;
+
+typedef struct JitState {
+	struct lua_State* L;
+	Proto* p;
+	unsigned char* buf;
+	size_t n;
+	size_t size;
+	size_t* labels;     // labels 0 .. sizecode are the instructions
+	int nlabels;
+	int sizelabels;
+	Fixup* fixups;
+	int nfixups;
+	int sizefixups;
+	ExitStub* exits;
+	int nexits;
+	int sizeexits;
+	int epilogue;
+} JitState;
+
+// a TValue in the stack frame or in k
+typedef struct Slot {
+	int base;
+	int disp;
+} Slot;
+
+#define growarray(J, ptr, n, size, t) \
+	if ((n) >= (size)) { \
+		int newsize_ = (size) > 0 ? (size) * 2 : 64; \
+		(ptr) = (t*)luaM_realloc((J)->L, (ptr), sizeof(t) * (size), sizeof(t) * newsize_); \
+		(size) = newsize_; \
+	}
+
+static void emit1(JitState* J, int b) {
+	if (J->n >= J->size) {
+		size_t newsize = J->size > 0 ? J->size * 2 : 1024;
+		J->buf = (unsigned char*)luaM_realloc(J->L, J->buf, J->size, newsize);
+		J->size = newsize;
+	}
+	J->buf[J->n++] = cast(unsigned char, b);
+}
+
+static void emit4(JitState* J, unsigned int v) {
+	for (int i = 0; i < 4; i++) {
+		emit1(J, (v >> (i * 8)) & 0xFF);
+	}
+}
+
+static void emit8(JitState* J, unsigned long long v) {
+	for (int i = 0; i < 8; i++) {
+		emit1(J, (v >> (i * 8)) & 0xFF);
+	}
+}
+
+static void emitn(JitState* J, const unsigned char* b, int n) {
+	for (int i = 0; i < n; i++) {
+		emit1(J, b[i]);
+	}
+}
+
+#define EMIT(J, ...) { static const unsigned char b_[] = { __VA_ARGS__ }; emitn(J, b_, sizeof(b_)); }
+
+static int newlabel(JitState* J) {
+	growarray(J, J->labels, J->nlabels, J->sizelabels, size_t);
+	J->labels[J->nlabels] = NOLABEL;
+	return J->nlabels++;
+}
+
+static void bindlabel(JitState* J, int label) {
+	J->labels[label] = J->n;
+}
+
+static void rel32(JitState* J, int label) {
+	growarray(J, J->fixups, J->nfixups, J->sizefixups, Fixup);
+	J->fixups[J->nfixups].at = J->n;
+	J->fixups[J->nfixups].label = label;
+	J->nfixups++;
+	emit4(J, 0);
+}
+
+static void jmp(JitState* J, int label) {
+	emit1(J, 0xE9);
+	rel32(J, label);
+}
+
+static void jcc(JitState* J, int cc, int label) {
+	emit1(J, 0x0F);
+	emit1(J, 0x80 | cc);
+	rel32(J, label);
+}
+
+// a label that leaves the native code at pc, the stubs are emitted after the
+// last instruction so that the fast paths fall through to the next instruction
+static int exitlabel(JitState* J, int pc) {
+	growarray(J, J->exits, J->nexits, J->sizeexits, ExitStub);
+	J->exits[J->nexits].label = newlabel(J);
+	J->exits[J->nexits].pc = pc;
+	return J->exits[J->nexits++].label;
+}
+
+static void exitat(JitState* J, int pc) {
+	EMIT(J, 0x48, 0xB8);    // mov rax, &code[pc]
+	emit8(J, cast(unsigned long long, cast(size_t, &J->p->code[pc])));
+	jmp(J, J->epilogue);
+}
+
+static void rex(JitState* J, int w, int reg, int base) {
+	int b = 0x40 | (w << 3) | ((reg & 8) >> 1) | ((base & 8) >> 3);
+	if (b != 0x40) {
+		emit1(J, b);
+	}
+}
+
+// ModRM and SIB of [base + disp32]
+static void modrm(JitState* J, int reg, int base, int disp) {
+	emit1(J, 0x80 | ((reg & 7) << 3) | (base & 7));
+	if ((base & 7) == 4) {
+		emit1(J, 0x24);
+	}
+	emit4(J, cast(unsigned int, disp));
+}
+
+static Slot slot_at(int base, int disp) {
+	Slot s;
+	s.base = base;
+	s.disp = disp;
+	return s;
+}
+
+static Slot reg_slot(int r) {
+	return slot_at(RBX, r * cast(int, sizeof(TValue)));
+}
+
+static Slot rk_slot(int r) {
+	return ISK(r) ? slot_at(R12, (r - BITRK) * cast(int, sizeof(TValue))) : reg_slot(r);
+}
+
+// mov reg, qword [s + off]
+static void load(JitState* J, int reg, Slot s, int off) {
+	rex(J, 1, reg, s.base);
+	emit1(J, 0x8B);
+	modrm(J, reg, s.base, s.disp + off);
+}
+
+// mov qword [s + off], reg
+static void store(JitState* J, Slot s, int off, int reg) {
+	rex(J, 1, reg, s.base);
+	emit1(J, 0x89);
+	modrm(J, reg, s.base, s.disp + off);
+}
+
+// cmp dword [s.tt_], tag
+static void cmptag(JitState* J, Slot s, int tag) {
+	rex(J, 0, 0, s.base);
+	emit1(J, 0x83);
+	modrm(J, 7, s.base, s.disp + TT_OFFSET);
+	emit1(J, tag);
+}
+
+// mov dword [s.tt_], tag
+static void settag(JitState* J, Slot s, int tag) {
+	rex(J, 0, 0, s.base);
+	emit1(J, 0xC7);
+	modrm(J, 0, s.base, s.disp + TT_OFFSET);
+	emit4(J, cast(unsigned int, tag));
+}
+
+// mov qword [s.value_], imm32
+static void setvalue(JitState* J, Slot s, int v) {
+	rex(J, 1, 0, s.base);
+	emit1(J, 0xC7);
+	modrm(J, 0, s.base, s.disp + VALUE_OFFSET);
+	emit4(J, cast(unsigned int, v));
+}
+
+// movsd xmm, [s.value_]
+static void loadsd(JitState* J, int xmm, Slot s) {
+	emit1(J, 0xF2);
+	rex(J, 0, xmm, s.base);
+	EMIT(J, 0x0F, 0x10);
+	modrm(J, xmm, s.base, s.disp + VALUE_OFFSET);
+}
+
+// movsd [s.value_], xmm
+static void storesd(JitState* J, Slot s, int xmm) {
+	emit1(J, 0xF2);
+	rex(J, 0, xmm, s.base);
+	EMIT(J, 0x0F, 0x11);
+	modrm(J, xmm, s.base, s.disp + VALUE_OFFSET);
+}
+
+// cvtsi2sd xmm, qword [s.value_]
+static void loadcvt(JitState* J, int xmm, Slot s) {
+	emit1(J, 0xF2);
+	rex(J, 1, xmm, s.base);
+	EMIT(J, 0x0F, 0x2A);
+	modrm(J, xmm, s.base, s.disp + VALUE_OFFSET);
+}
+
+// setobj(dst, src), rcx is the only register it uses
+static void copy(JitState* J, Slot dst, Slot src) {
+	load(J, RCX, src, VALUE_OFFSET);
+	store(J, dst, VALUE_OFFSET, RCX);
+	load(J, RCX, src, TT_OFFSET);
+	store(J, dst, TT_OFFSET, RCX);
+}
+
+// xmm = tonumber(s), leaves at exitl for anything but numbers
+static void tonumber(JitState* J, int xmm, Slot s, int exitl) {
+	int isint = newlabel(J);
+	int done = newlabel(J);
+	cmptag(J, s, LUA_NUMFLT);
+	jcc(J, CC_NE, isint);
+	loadsd(J, xmm, s);
+	jmp(J, done);
+	bindlabel(J, isint);
+	cmptag(J, s, LUA_NUMINT);
+	jcc(J, CC_NE, exitl);
+	loadcvt(J, xmm, s);
+	bindlabel(J, done);
+}
+
+// goes to falsyl if l_false(s), to truthyl otherwise
+static void testfalse(JitState* J, Slot s, int falsyl, int truthyl) {
+	rex(J, 0, RAX, s.base);
+	emit1(J, 0x8B);                            // mov eax, [s.tt_]
+	modrm(J, RAX, s.base, s.disp + TT_OFFSET);
+	EMIT(J, 0x83, 0xF8, LUA_TNIL);             // cmp eax, LUA_TNIL
+	jcc(J, CC_E, falsyl);
+	EMIT(J, 0x83, 0xF8, LUA_TBOOLEAN);         // cmp eax, LUA_TBOOLEAN
+	jcc(J, CC_NE, truthyl);
+	rex(J, 0, 0, s.base);
+	emit1(J, 0x83);                            // cmp dword [s.value_], 0
+	modrm(J, 7, s.base, s.disp + VALUE_OFFSET);
+	emit1(J, 0);
+	jcc(J, CC_E, falsyl);
+	jmp(J, truthyl);
+}
+
+// rax = &t->array[key - 1] for the table t and the integer key, which must be
+// inside the array part and hold a value that is not nil. a store also leaves
+// tables of a cached __index chain to the interpreter (see luaH_chainwrite)
+static void arrayref(JitState* J, Slot t, Slot key, int forstore, int exitl) {
+	load(J, RAX, t, VALUE_OFFSET);
+	if (forstore) {
+		emit1(J, 0x80);                        // cmp byte [rax + inchain], 0
+		modrm(J, 7, RAX, cast(int, offsetof(struct Table, inchain)));
+		emit1(J, 0);
+		jcc(J, CC_NE, exitl);
+	}
+	load(J, RCX, key, VALUE_OFFSET);
+	EMIT(J, 0x48, 0x83, 0xE9, 0x01);           // sub rcx, 1
+	emit1(J, 0x8B);                            // mov edx, [rax + arraysize]
+	modrm(J, RDX, RAX, cast(int, offsetof(struct Table, arraysize)));
+	EMIT(J, 0x48, 0x39, 0xD1);                 // cmp rcx, rdx
+	jcc(J, CC_AE, exitl);
+	load(J, RAX, slot_at(RAX, cast(int, offsetof(struct Table, array))), 0);
+	EMIT(J, 0x48, 0xC1, 0xE1, 0x04);           // shl rcx, 4
+	EMIT(J, 0x48, 0x01, 0xC8);                 // add rax, rcx
+	cmptag(J, slot_at(RAX, 0), LUA_TNIL);
+	jcc(J, CC_E, exitl);
+}
+
+// arrayref after checking that t is a table and key an integer
+static void arrayslot(JitState* J, Slot t, Slot key, int forstore, int exitl) {
+	cmptag(J, t, LUA_TTABLE);
+	jcc(J, CC_NE, exitl);
+	cmptag(J, key, LUA_NUMINT);
+	jcc(J, CC_NE, exitl);
+	arrayref(J, t, key, forstore, exitl);
+}
+
+static void op_arith(JitState* J, int op, Instruction i, int exitl) {
+	Slot ra = reg_slot(GET_ARG_A(i));
+	Slot rb = rk_slot(GET_ARG_B(i));
+	Slot rc = rk_slot(GET_ARG_C(i));
+	int flt = newlabel(J);
+	int done = newlabel(J);
+
+	if (op != OP_DIV) { // integer x integer stays an integer
+		cmptag(J, rb, LUA_NUMINT);
+		jcc(J, CC_NE, flt);
+		cmptag(J, rc, LUA_NUMINT);
+		jcc(J, CC_NE, flt);
+		load(J, RAX, rb, VALUE_OFFSET);
+		load(J, RCX, rc, VALUE_OFFSET);
+		switch (op) {
+		case OP_ADD: EMIT(J, 0x48, 0x01, 0xC8); break;       // add rax, rcx
+		case OP_SUB: EMIT(J, 0x48, 0x29, 0xC8); break;       // sub rax, rcx
+		default: EMIT(J, 0x48, 0x0F, 0xAF, 0xC1); break;     // imul rax, rcx
+		}
+		store(J, ra, VALUE_OFFSET, RAX);
+		settag(J, ra, LUA_NUMINT);
+		jmp(J, done);
+	}
+
+	bindlabel(J, flt);
+	tonumber(J, 0, rb, exitl);
+	tonumber(J, 1, rc, exitl);
+	switch (op) {
+	case OP_ADD: EMIT(J, 0xF2, 0x0F, 0x58, 0xC1); break;    // addsd xmm0, xmm1
+	case OP_SUB: EMIT(J, 0xF2, 0x0F, 0x5C, 0xC1); break;    // subsd xmm0, xmm1
+	case OP_MUL: EMIT(J, 0xF2, 0x0F, 0x59, 0xC1); break;    // mulsd xmm0, xmm1
+	default: EMIT(J, 0xF2, 0x0F, 0x5E, 0xC1); break;        // divsd xmm0, xmm1
+	}
+	storesd(J, ra, 0);
+	settag(J, ra, LUA_NUMFLT);
+	bindlabel(J, done);
+}
+
+// EQ/LT/LE are followed by a jump: if the result differs from A the jump is skipped
+static void op_order(JitState* J, int op, Instruction i, int pc, int exitl) {
+	Slot rb = rk_slot(GET_ARG_B(i));
+	Slot rc = rk_slot(GET_ARG_C(i));
+	int a = GET_ARG_A(i);
+	int flt = newlabel(J);
+	int cc = op == OP_LT ? CC_L : (op == OP_LE ? CC_LE : CC_E);
+
+	cmptag(J, rb, LUA_NUMINT);
+	jcc(J, CC_NE, flt);
+	cmptag(J, rc, LUA_NUMINT);
+	jcc(J, CC_NE, flt);
+	load(J, RAX, rb, VALUE_OFFSET);
+	load(J, RCX, rc, VALUE_OFFSET);
+	EMIT(J, 0x48, 0x39, 0xC8);                 // cmp rax, rcx
+	jcc(J, a ? cc ^ 1 : cc, pc + 2);
+	jmp(J, pc + 1);
+
+	bindlabel(J, flt);
+	if (op == OP_EQ) {
+		jmp(J, exitl);
+		return;
+	}
+	// compare rc with rb, so that an unordered result (nan) is false for both
+	tonumber(J, 0, rb, exitl);
+	tonumber(J, 1, rc, exitl);
+	EMIT(J, 0x66, 0x0F, 0x2E, 0xC8);           // ucomisd xmm1, xmm0
+	cc = op == OP_LT ? CC_A : CC_AE;
+	jcc(J, a ? cc ^ 1 : cc, pc + 2);
+	jmp(J, pc + 1);
+}
+
+static void op_forloop(JitState* J, Instruction i, int pc) {
+	Slot idx = reg_slot(GET_ARG_A(i));
+	Slot limit = reg_slot(GET_ARG_A(i) + 1);
+	Slot step = reg_slot(GET_ARG_A(i) + 2);
+	Slot var = reg_slot(GET_ARG_A(i) + 3);
+	int target = pc + 1 + GET_ARG_sBx(i);
+	int flt = newlabel(J);
+	int pos = newlabel(J);
+	int cont = newlabel(J);
+
+	// integer loop, limit holds the remaining trip count, see OP_FORPREP
+	cmptag(J, step, LUA_NUMINT);
+	jcc(J, CC_NE, flt);
+	load(J, RAX, limit, VALUE_OFFSET);
+	EMIT(J, 0x48, 0x85, 0xC0);                 // test rax, rax
+	jcc(J, CC_E, pc + 1);
+	EMIT(J, 0x48, 0x83, 0xE8, 0x01);           // sub rax, 1
+	store(J, limit, VALUE_OFFSET, RAX);
+	load(J, RAX, idx, VALUE_OFFSET);
+	load(J, RCX, step, VALUE_OFFSET);
+	EMIT(J, 0x48, 0x01, 0xC8);                 // add rax, rcx
+	store(J, idx, VALUE_OFFSET, RAX);
+	store(J, var, VALUE_OFFSET, RAX);
+	settag(J, var, LUA_NUMINT);
+	jmp(J, target);
+
+	bindlabel(J, flt);
+	loadsd(J, 0, idx);
+	loadsd(J, 2, step);
+	EMIT(J, 0xF2, 0x0F, 0x58, 0xC2);           // addsd xmm0, xmm2
+	loadsd(J, 1, limit);
+	EMIT(J, 0x66, 0x0F, 0x57, 0xDB);           // xorpd xmm3, xmm3
+	EMIT(J, 0x66, 0x0F, 0x2E, 0xD3);           // ucomisd xmm2, xmm3
+	jcc(J, CC_A, pos);
+	EMIT(J, 0x66, 0x0F, 0x2E, 0xC1);           // ucomisd xmm0, xmm1
+	jcc(J, CC_AE, cont);
+	jmp(J, pc + 1);
+	bindlabel(J, pos);
+	EMIT(J, 0x66, 0x0F, 0x2E, 0xC8);           // ucomisd xmm1, xmm0
+	jcc(J, CC_AE, cont);
+	jmp(J, pc + 1);
+	bindlabel(J, cont);
+	storesd(J, idx, 0);
+	storesd(J, var, 0);
+	settag(J, var, LUA_NUMFLT);
+	jmp(J, target);
+}
+
+// return 0 if the instruction has no template
+static int translate(JitState* J, Instruction i, int pc) {
+	int op = luaP_genericop(GET_OPCODE(i));
+
+	// every instruction that may skip the next one needs pc + 2 to exist
+	int sizecode = J->p->sizecode;
+	Slot ra = reg_slot(GET_ARG_A(i));
+	switch (op) {
+	case OP_MOVE: {
+		copy(J, ra, reg_slot(GET_ARG_B(i)));
+	} break;
+	case OP_LOADK: {
+		copy(J, ra, slot_at(R12, GET_ARG_Bx(i) * cast(int, sizeof(TValue))));
+	} break;
+	case OP_LOADBOOL: {
+		if (GET_ARG_C(i) && pc + 2 > sizecode) return 0;
+		setvalue(J, ra, GET_ARG_B(i));
+		settag(J, ra, LUA_TBOOLEAN);
+		if (GET_ARG_C(i)) {
+			jmp(J, pc + 2);
+		}
+	} break;
+	case OP_LOADNIL: {
+		for (int j = 0; j <= cast(int, GET_ARG_B(i)); j++) {
+			settag(J, reg_slot(GET_ARG_A(i) + j), LUA_TNIL);
+		}
+	} break;
+	case OP_JUMP: {
+		int target = pc + 1 + GET_ARG_sBx(i);
+		if (target < 0 || target > sizecode) return 0;
+		jmp(J, target);
+	} break;
+	case OP_TEST: {
+		if (pc + 2 > sizecode) return 0;
+		int c = GET_ARG_C(i);
+		testfalse(J, ra, c ? pc + 2 : pc + 1, c ? pc + 1 : pc + 2);
+	} break;
+	case OP_TESTSET: {
+		if (pc + 2 > sizecode) return 0;
+		int c = GET_ARG_C(i);
+		int set = newlabel(J);
+		testfalse(J, reg_slot(GET_ARG_B(i)), c ? pc + 2 : set, c ? set : pc + 2);
+		bindlabel(J, set);
+		copy(J, ra, reg_slot(GET_ARG_B(i)));
+	} break;
+	case OP_NOT: {
+		int f = newlabel(J);
+		int t = newlabel(J);
+		int done = newlabel(J);
+		testfalse(J, reg_slot(GET_ARG_B(i)), f, t);
+		bindlabel(J, f);
+		setvalue(J, ra, 1);
+		jmp(J, done);
+		bindlabel(J, t);
+		setvalue(J, ra, 0);
+		bindlabel(J, done);
+		settag(J, ra, LUA_TBOOLEAN);
+	} break;
+	case OP_UNM: {
+		Slot rb = reg_slot(GET_ARG_B(i));
+		int flt = newlabel(J);
+		int done = newlabel(J);
+		int exitl = exitlabel(J, pc);
+		load(J, RAX, rb, VALUE_OFFSET);
+		cmptag(J, rb, LUA_NUMINT);
+		jcc(J, CC_NE, flt);
+		EMIT(J, 0x48, 0xF7, 0xD8);             // neg rax
+		store(J, ra, VALUE_OFFSET, RAX);
+		settag(J, ra, LUA_NUMINT);
+		jmp(J, done);
+		bindlabel(J, flt);
+		cmptag(J, rb, LUA_NUMFLT);
+		jcc(J, CC_NE, exitl);
+		EMIT(J, 0x48, 0x0F, 0xBA, 0xF8, 0x3F); // btc rax, 63
+		store(J, ra, VALUE_OFFSET, RAX);
+		settag(J, ra, LUA_NUMFLT);
+		bindlabel(J, done);
+	} break;
+	case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV: {
+		op_arith(J, op, i, exitlabel(J, pc));
+	} break;
+	case OP_EQ: case OP_LT: case OP_LE: {
+		if (pc + 2 > sizecode) return 0;
+		op_order(J, op, i, pc, exitlabel(J, pc));
+	} break;
+	case OP_GETTABLE: {
+		arrayslot(J, reg_slot(GET_ARG_B(i)), rk_slot(GET_ARG_C(i)), 0, exitlabel(J, pc));
+		copy(J, ra, slot_at(RAX, 0));
+	} break;
+	case OP_SETTABLE: {
+		// only numbers, which need no write barrier
+		Slot v = rk_slot(GET_ARG_C(i));
+		int exitl = exitlabel(J, pc);
+		int isnum = newlabel(J);
+		rex(J, 0, RDX, v.base);
+		emit1(J, 0x8B);                        // mov edx, [v.tt_]
+		modrm(J, RDX, v.base, v.disp + TT_OFFSET);
+		EMIT(J, 0x83, 0xFA, LUA_NUMINT);       // cmp edx, LUA_NUMINT
+		jcc(J, CC_E, isnum);
+		EMIT(J, 0x83, 0xFA, LUA_NUMFLT);       // cmp edx, LUA_NUMFLT
+		jcc(J, CC_NE, exitl);
+		bindlabel(J, isnum);
+		arrayslot(J, ra, rk_slot(GET_ARG_B(i)), 1, exitl);
+		copy(J, slot_at(RAX, 0), v);
+	} break;
+	case OP_FORLOOP: {
+		int target = pc + 1 + GET_ARG_sBx(i);
+		if (target < 0 || target > sizecode || pc + 1 > sizecode) return 0;
+		op_forloop(J, i, pc);
+	} break;
+	default: return 0;
+	}
+	return 1;
+}
+
+static void freestate(JitState* J) {
+	luaM_free(J->L, J->buf, J->size);
+	luaM_free(J->L, J->labels, sizeof(size_t) * J->sizelabels);
+	luaM_free(J->L, J->fixups, sizeof(Fixup) * J->sizefixups);
+	luaM_free(J->L, J->exits, sizeof(ExitStub) * J->sizeexits);
+}
+
+// entry(L, base, k, ...), keeps base in rbx and k in r12
+static void prologue(JitState* J) {
+	EMIT(J, 0x53);                             // push rbx
+	EMIT(J, 0x41, 0x54);                       // push r12
+	EMIT(J, 0x48, 0x89, 0xF3);                 // mov rbx, rsi
+	EMIT(J, 0x49, 0x89, 0xD4);                 // mov r12, rdx
+}
+
+// emit the exit stubs and the epilogue, resolve the jumps and move the code
+// into executable memory, returns NULL if that fails
+static unsigned char* link(JitState* J) {
+	for (int e = 0; e < J->nexits; e++) {
+		bindlabel(J, J->exits[e].label);
+		exitat(J, J->exits[e].pc);
+	}
+
+	bindlabel(J, J->epilogue);
+	EMIT(J, 0x41, 0x5C);                       // pop r12
+	EMIT(J, 0x5B);                             // pop rbx
+	EMIT(J, 0xC3);                             // ret
+
+	for (int f = 0; f < J->nfixups; f++) {
+		size_t at = J->fixups[f].at;
+		int rel = cast(int, cast(long long, J->labels[J->fixups[f].label]) - cast(long long, at + 4));
+		memcpy(J->buf + at, &rel, sizeof(rel));
+	}
+
+	unsigned char* mcode = mmap(NULL, J->n, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (mcode == MAP_FAILED) {
+		return NULL;
+	}
+	memcpy(mcode, J->buf, J->n);
+	if (mprotect(mcode, J->n, PROT_READ | PROT_EXEC) != 0) {
+		munmap(mcode, J->n);
+		return NULL;
+	}
+	return mcode;
+}
+
+void luaJ_compile(struct lua_State* L, Proto* p) {
+	if (p->jit || p->sizecode <= 0) {
+		return;
+	}
+
+	JitState J;
+	memset(&J, 0, sizeof(J));
+	J.L = L;
+	J.p = p;
+	for (int pc = 0; pc <= p->sizecode; pc++) {
+		newlabel(&J);
+	}
+	J.epilogue = newlabel(&J);
+
+	// entry(L, base, k, address of the first instruction to run)
+	prologue(&J);
+	EMIT(&J, 0xFF, 0xE1);                      // jmp rcx
+
+	for (int pc = 0; pc < p->sizecode; pc++) {
+		bindlabel(&J, pc);
+		if (!translate(&J, p->code[pc], pc)) {
+			exitat(&J, pc);
+		}
+	}
+	bindlabel(&J, p->sizecode);
+	exitat(&J, p->sizecode - 1);
+
+	unsigned char* mcode = link(&J);
+	if (mcode == NULL) {
+		freestate(&J);
+		return;
+	}
+
+	struct JitCode* jc = luaM_realloc(L, NULL, 0, sizeof(struct JitCode));
+	jc->mcode = mcode;
+	jc->size = J.n;
+	jc->sizepc = p->sizecode;
+	jc->pcoffset = luaM_realloc(L, NULL, 0, sizeof(unsigned int) * p->sizecode);
+	for (int pc = 0; pc < p->sizecode; pc++) {
+		jc->pcoffset[pc] = cast(unsigned int, J.labels[pc]);
+	}
+	p->jit = jc;
+	freestate(&J);
+}
+
+const Instruction* luaJ_execute(struct lua_State* L, Proto* p, StkId base, const Instruction* pc) {
+	struct JitCode* jc = p->jit;
+	JitFunction f = (JitFunction)(void*)jc->mcode;
+	return f(L, base, p->k, jc->mcode + jc->pcoffset[pc - p->code]);
+}
+
+// The tracing jit counts the iterations of every loop back edge (OP_FORLOOP,
+// OP_TFORLOOP and a backward OP_JUMP). Once a back edge is hot the recorder
+// sees each instruction, together with the types of its operands, before the
+// interpreter runs it, until the path comes back to the back edge. The trace
+// is that path compiled for the recorded types: a branch that goes the other
+// way or a value of another type is a guard that leaves the trace. Registers
+// the loop reads before writing them are checked once when the trace is
+// entered, and a register whose type is known is neither checked nor retagged
+// again, so a loop whose types stay stable runs its iterations without type
+// checks. A trace never leaves the frame of its loop and writes every result
+// back to the stack, the CallInfo and base it was entered with are still
+// valid at an exit and the interpreter only needs the pc to resume at.
+// The trace of a generic for ends at the OP_TFORCALL of its loop: the trace
+// hands the call of the iterator to the interpreter, which comes back to the
+// OP_TFORLOOP and enters the trace again.
+// Recordings that leave the frame or meet an instruction without a template
+// are aborted, a loop that aborts LUAJ_MAXABORT times is blacklisted.
+
+typedef struct TraceIns {
+	Instruction i;
+	int pc;
+	int next;           // pc of the instruction that ran after it
+	lu_byte ta, tb, tc; // observed tags of the operands
+	lu_byte tres;       // tag of R(A) after it ran
+} TraceIns;
+
+typedef struct Trace {
+	struct Trace* prev;
+	struct Trace* next;
+	Proto* p;
+	int anchor;         // pc of the back edge
+	int tail;           // pc a completed iteration hands back, the anchor or the OP_TFORCALL of a generic for
+	int id;
+	int nins;
+	int nguards;        // guards checked once at the trace entry
+	unsigned char* mcode;
+	size_t size;
+	unsigned long entries;
+	unsigned long sideexits;
+	unsigned long headmisses; // entries whose registers no longer had the recorded types
+} Trace;
+
+struct JitLoop {
+	Trace* trace;
+	int hot;
+	int aborts;
+};
+
+enum { ABORT_NYI, ABORT_FRAME, ABORT_LENGTH, ABORT_TYPES, ABORT_TOTAL };
+
+static const char* abortnames[ABORT_TOTAL] = {
+	"instruction without template", "left the loop frame", "trace too long", "operand types",
+};
+
+struct TraceState {
+	Proto* p;           // the loop being recorded, NULL when the recorder is idle
+	StkId base;
+	int anchor;
+	int nins;
+	TraceIns ins[LUAJ_MAXTRACE];
+	Trace* traces;      // the trace cache, every trace of every loop
+	int ntraces;
+	unsigned long nrecorded;
+	unsigned long naborts[ABORT_TOTAL];
+	unsigned long nblacklisted;
+	unsigned long nflushed;
+};
+
+#define TRACE_MAXREGS (MAXARG_A + 4)
+#define isnumtag(t) ((t) == LUA_NUMINT || (t) == LUA_NUMFLT)
+#define tagof(o) cast(lu_byte, (o)->tt_)
+
+typedef struct TraceBuilder {
+	JitState J;
+	struct TraceState* ts;
+	Trace* tr;
+	int pass;           // the first pass only collects the entry guards
+	int fail;           // abort reason, -1 as long as the trace compiles
+	int known[TRACE_MAXREGS];   // tag the register holds at this point of the trace, -1 if unknown
+	lu_byte written[TRACE_MAXREGS];
+	int nguards;
+	struct { int reg; int tag; } guards[TRACE_MAXREGS];
+} TraceBuilder;
+
+// register r has to hold tag, exits to pc otherwise
+static void need(TraceBuilder* T, int r, int tag, int pc) {
+	if (T->known[r] == tag) {
+		return;
+	}
+	if (T->known[r] >= 0) { // the recorded types contradict each other
+		T->fail = ABORT_TYPES;
+		return;
+	}
+	if (T->pass == 0 && !T->written[r]) {
+		T->guards[T->nguards].reg = r;
+		T->guards[T->nguards].tag = tag;
+		T->nguards++;
+	}
+	else {
+		cmptag(&T->J, reg_slot(r), tag);
+		jcc(&T->J, CC_NE, exitlabel(&T->J, pc));
+	}
+	T->known[r] = tag;
+}
+
+static int operand(TraceBuilder* T, int rk, int observed, int pc) {
+	if (ISK(rk)) {
+		return T->ts->p->k[rk - BITRK].tt_;
+	}
+	need(T, rk, observed, pc);
+	return observed;
+}
+
+static void settype(TraceBuilder* T, int r, int tag) {
+	if (T->known[r] != tag) {
+		settag(&T->J, reg_slot(r), tag);
+		T->known[r] = tag;
+	}
+	T->written[r] = 1;
+}
+
+// R(r) = src, tag is the type of src or -1
+static void move(TraceBuilder* T, int r, Slot src, int tag) {
+	JitState* J = &T->J;
+	load(J, RCX, src, VALUE_OFFSET);
+	store(J, reg_slot(r), VALUE_OFFSET, RCX);
+	if (tag >= 0) {
+		settype(T, r, tag);
+	}
+	else {
+		load(J, RCX, src, TT_OFFSET);
+		store(J, reg_slot(r), TT_OFFSET, RCX);
+		T->known[r] = -1;
+		T->written[r] = 1;
+	}
+}
+
+static void loadnum(JitState* J, int xmm, Slot s, int tag) {
+	if (tag == LUA_NUMFLT) {
+		loadsd(J, xmm, s);
+	}
+	else {
+		loadcvt(J, xmm, s);
+	}
+}
+
+// 1 if the recorded path skipped the instruction after ti
+static int skipped(TraceBuilder* T, const TraceIns* ti) {
+	if (ti->next == ti->pc + 2) {
+		return 1;
+	}
+	if (ti->next != ti->pc + 1) {
+		T->fail = ABORT_NYI;
+	}
+	return 0;
+}
+
+// testing R(r) skips the next instruction if it is falsy and falsyskips is set,
+// or if it is truthy and falsyskips is not, the test has to go the recorded way
+static void guardtest(TraceBuilder* T, int r, int falsyskips, int skip, int pc) {
+	JitState* J = &T->J;
+	int tag = T->known[r];
+	if (tag >= 0 && tag != LUA_TBOOLEAN) {
+		int falsy = tag == LUA_TNIL;
+		if ((falsy ? falsyskips : !falsyskips) != skip) {
+			T->fail = ABORT_TYPES;
+		}
+		return;
+	}
+	int cont = newlabel(J);
+	int exitl = exitlabel(J, pc);
+	int falsyok = falsyskips == skip;
+	testfalse(J, reg_slot(r), falsyok ? cont : exitl, falsyok ? exitl : cont);
+	bindlabel(J, cont);
+}
+
+static void trace_order(TraceBuilder* T, int op, const TraceIns* ti) {
+	JitState* J = &T->J;
+	Instruction i = ti->i;
+	int pc = ti->pc;
+	int res = skipped(T, ti) ? !GET_ARG_A(i) : GET_ARG_A(i); // what the comparison yielded
+	int tb = operand(T, GET_ARG_B(i), ti->tb, pc);
+	int tc = operand(T, GET_ARG_C(i), ti->tc, pc);
+	Slot rb = rk_slot(GET_ARG_B(i));
+	Slot rc = rk_slot(GET_ARG_C(i));
+
+	if (isnumtag(tb) && isnumtag(tc)) {
+		if (tb == LUA_NUMINT && tc == LUA_NUMINT) {
+			int cc = op == OP_LT ? CC_L : (op == OP_LE ? CC_LE : CC_E);
+			load(J, RAX, rb, VALUE_OFFSET);
+			load(J, RCX, rc, VALUE_OFFSET);
+			EMIT(J, 0x48, 0x39, 0xC8);         // cmp rax, rcx
+			jcc(J, res ? cc ^ 1 : cc, exitlabel(J, pc));
+		}
+		else if (op == OP_EQ) {
+			T->fail = ABORT_TYPES;
+		}
+		else {
+			int cc = op == OP_LT ? CC_A : CC_AE;
+			loadnum(J, 0, rb, tb);
+			loadnum(J, 1, rc, tc);
+			EMIT(J, 0x66, 0x0F, 0x2E, 0xC8);   // ucomisd xmm1, xmm0
+			jcc(J, res ? cc ^ 1 : cc, exitlabel(J, pc));
+		}
+	}
+	else if (op != OP_EQ) {
+		T->fail = ABORT_TYPES;
+	}
+	else if (tb == LUA_SHRSTR && tc == LUA_SHRSTR) { // short strings are interned
+		load(J, RAX, rb, VALUE_OFFSET);
+		load(J, RCX, rc, VALUE_OFFSET);
+		EMIT(J, 0x48, 0x39, 0xC8);             // cmp rax, rcx
+		jcc(J, res ? CC_NE : CC_E, exitlabel(J, pc));
+	}
+	else if (tb != tc || tb == LUA_TNIL) { // values of different types are never equal
+		if ((tb == tc) != res) {
+			T->fail = ABORT_TYPES;
+		}
+	}
+	else {
+		T->fail = ABORT_TYPES;
+	}
+}
+
+static void trace_forloop(TraceBuilder* T, const TraceIns* ti) {
+	JitState* J = &T->J;
+	Instruction i = ti->i;
+	int pc = ti->pc;
+	int a = GET_ARG_A(i);
+	int t = ti->tc;
+	int cont = ti->next == pc + 1 + GET_ARG_sBx(i);
+	if (!isnumtag(t) || (!cont && ti->next != pc + 1)) {
+		T->fail = ABORT_TYPES;
+		return;
+	}
+	need(T, a, t, pc);
+	need(T, a + 1, t, pc);
+	need(T, a + 2, t, pc);
+
+	Slot idx = reg_slot(a);
+	Slot limit = reg_slot(a + 1);
+	Slot step = reg_slot(a + 2);
+	Slot var = reg_slot(a + 3);
+	int exitl = exitlabel(J, pc);
+	if (t == LUA_NUMINT) {
+		load(J, RAX, limit, VALUE_OFFSET);
+		EMIT(J, 0x48, 0x85, 0xC0);             // test rax, rax
+		jcc(J, cont ? CC_E : CC_NE, exitl);
+		if (cont) {
+			EMIT(J, 0x48, 0x83, 0xE8, 0x01);   // sub rax, 1
+			store(J, limit, VALUE_OFFSET, RAX);
+			load(J, RAX, idx, VALUE_OFFSET);
+			load(J, RCX, step, VALUE_OFFSET);
+			EMIT(J, 0x48, 0x01, 0xC8);         // add rax, rcx
+			store(J, idx, VALUE_OFFSET, RAX);
+			store(J, var, VALUE_OFFSET, RAX);
+			settype(T, a + 3, LUA_NUMINT);
+		}
+		return;
+	}
+
+	int yes = cont ? newlabel(J) : exitl;
+	int no = cont ? exitl : newlabel(J);
+	int pos = newlabel(J);
+	loadsd(J, 0, idx);
+	loadsd(J, 2, step);
+	EMIT(J, 0xF2, 0x0F, 0x58, 0xC2);           // addsd xmm0, xmm2
+	loadsd(J, 1, limit);
+	EMIT(J, 0x66, 0x0F, 0x57, 0xDB);           // xorpd xmm3, xmm3
+	EMIT(J, 0x66, 0x0F, 0x2E, 0xD3);           // ucomisd xmm2, xmm3
+	jcc(J, CC_A, pos);
+	EMIT(J, 0x66, 0x0F, 0x2E, 0xC1);           // ucomisd xmm0, xmm1
+	jcc(J, CC_AE, yes);
+	jmp(J, no);
+	bindlabel(J, pos);
+	EMIT(J, 0x66, 0x0F, 0x2E, 0xC8);           // ucomisd xmm1, xmm0
+	jcc(J, CC_AE, yes);
+	jmp(J, no);
+	bindlabel(J, cont ? yes : no);
+	if (cont) {
+		storesd(J, idx, 0);
+		storesd(J, var, 0);
+		settype(T, a + 3, LUA_NUMFLT);
+	}
+}
+
+static void traceins(TraceBuilder* T, const TraceIns* ti) {
+	JitState* J = &T->J;
+	Instruction i = ti->i;
+	int op = luaP_genericop(GET_OPCODE(i));
+	int pc = ti->pc;
+	int a = GET_ARG_A(i);
+	Slot ra = reg_slot(a);
+	switch (op) {
+	case OP_MOVE: {
+		move(T, a, reg_slot(GET_ARG_B(i)), T->known[GET_ARG_B(i)]);
+	} break;
+	case OP_LOADK: {
+		int bx = GET_ARG_Bx(i);
+		move(T, a, slot_at(R12, bx * cast(int, sizeof(TValue))), T->ts->p->k[bx].tt_);
+	} break;
+	case OP_LOADBOOL: {
+		setvalue(J, ra, GET_ARG_B(i));
+		settype(T, a, LUA_TBOOLEAN);
+	} break;
+	case OP_LOADNIL: {
+		for (int j = 0; j <= cast(int, GET_ARG_B(i)); j++) {
+			settype(T, a + j, LUA_TNIL);
+		}
+	} break;
+	case OP_JUMP: break; // the trace is the path itself
+	case OP_NOT: {
+		int b = GET_ARG_B(i);
+		int tb = T->known[b];
+		if (tb >= 0 && tb != LUA_TBOOLEAN) {
+			setvalue(J, ra, tb == LUA_TNIL);
+		}
+		else {
+			int f = newlabel(J);
+			int t = newlabel(J);
+			int done = newlabel(J);
+			testfalse(J, reg_slot(b), f, t);
+			bindlabel(J, f);
+			setvalue(J, ra, 1);
+			jmp(J, done);
+			bindlabel(J, t);
+			setvalue(J, ra, 0);
+			bindlabel(J, done);
+		}
+		settype(T, a, LUA_TBOOLEAN);
+	} break;
+	case OP_TEST: {
+		guardtest(T, a, GET_ARG_C(i) != 0, skipped(T, ti), pc);
+	} break;
+	case OP_TESTSET: {
+		int b = GET_ARG_B(i);
+		int skip = skipped(T, ti);
+		guardtest(T, b, GET_ARG_C(i) != 0, skip, pc);
+		if (!skip) {
+			move(T, a, reg_slot(b), T->known[b]);
+		}
+	} break;
+	case OP_UNM: {
+		int tb = operand(T, GET_ARG_B(i), ti->tb, pc);
+		if (!isnumtag(tb)) {
+			T->fail = ABORT_TYPES;
+			break;
+		}
+		load(J, RAX, reg_slot(GET_ARG_B(i)), VALUE_OFFSET);
+		if (tb == LUA_NUMINT) {
+			EMIT(J, 0x48, 0xF7, 0xD8);             // neg rax
+		}
+		else {
+			EMIT(J, 0x48, 0x0F, 0xBA, 0xF8, 0x3F); // btc rax, 63
+		}
+		store(J, ra, VALUE_OFFSET, RAX);
+		settype(T, a, tb);
+	} break;
+	case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV: {
+		int tb = operand(T, GET_ARG_B(i), ti->tb, pc);
+		int tc = operand(T, GET_ARG_C(i), ti->tc, pc);
+		Slot rb = rk_slot(GET_ARG_B(i));
+		Slot rc = rk_slot(GET_ARG_C(i));
+		if (!isnumtag(tb) || !isnumtag(tc)) {
+			T->fail = ABORT_TYPES;
+			break;
+		}
+		if (op != OP_DIV && tb == LUA_NUMINT && tc == LUA_NUMINT) {
+			load(J, RAX, rb, VALUE_OFFSET);
+			load(J, RCX, rc, VALUE_OFFSET);
+			switch (op) {
+			case OP_ADD: EMIT(J, 0x48, 0x01, 0xC8); break;       // add rax, rcx
+			case OP_SUB: EMIT(J, 0x48, 0x29, 0xC8); break;       // sub rax, rcx
+			default: EMIT(J, 0x48, 0x0F, 0xAF, 0xC1); break;     // imul rax, rcx
+			}
+			store(J, ra, VALUE_OFFSET, RAX);
+			settype(T, a, LUA_NUMINT);
+			break;
+		}
+		loadnum(J, 0, rb, tb);
+		loadnum(J, 1, rc, tc);
+		switch (op) {
+		case OP_ADD: EMIT(J, 0xF2, 0x0F, 0x58, 0xC1); break;    // addsd xmm0, xmm1
+		case OP_SUB: EMIT(J, 0xF2, 0x0F, 0x5C, 0xC1); break;    // subsd xmm0, xmm1
+		case OP_MUL: EMIT(J, 0xF2, 0x0F, 0x59, 0xC1); break;    // mulsd xmm0, xmm1
+		default: EMIT(J, 0xF2, 0x0F, 0x5E, 0xC1); break;        // divsd xmm0, xmm1
+		}
+		storesd(J, ra, 0);
+		settype(T, a, LUA_NUMFLT);
+	} break;
+	case OP_EQ: case OP_LT: case OP_LE: {
+		trace_order(T, op, ti);
+	} break;
+	case OP_GETTABLE: {
+		int tb = operand(T, GET_ARG_B(i), ti->tb, pc);
+		int tc = operand(T, GET_ARG_C(i), ti->tc, pc);
+		if (tb != LUA_TTABLE || tc != LUA_NUMINT || ti->tres == LUA_TNIL) {
+			T->fail = ABORT_TYPES;
+			break;
+		}
+		int exitl = exitlabel(J, pc);
+		arrayref(J, reg_slot(GET_ARG_B(i)), rk_slot(GET_ARG_C(i)), 0, exitl);
+		cmptag(J, slot_at(RAX, 0), ti->tres);  // the element keeps its recorded type
+		jcc(J, CC_NE, exitl);
+		move(T, a, slot_at(RAX, 0), ti->tres);
+	} break;
+	case OP_SETTABLE: {
+		int ta = operand(T, a, ti->ta, pc);
+		int tb = operand(T, GET_ARG_B(i), ti->tb, pc);
+		int tc = operand(T, GET_ARG_C(i), ti->tc, pc);
+		if (ta != LUA_TTABLE || tb != LUA_NUMINT || !isnumtag(tc)) { // numbers need no write barrier
+			T->fail = ABORT_TYPES;
+			break;
+		}
+		Slot v = rk_slot(GET_ARG_C(i));
+		arrayref(J, ra, rk_slot(GET_ARG_B(i)), 1, exitlabel(J, pc));
+		load(J, RCX, v, VALUE_OFFSET);
+		store(J, slot_at(RAX, 0), VALUE_OFFSET, RCX);
+		settag(J, slot_at(RAX, 0), tc);
+	} break;
+	case OP_FORLOOP: {
+		trace_forloop(T, ti);
+	} break;
+	case OP_TFORCALL: {
+		exitat(J, pc);  // the last instruction of the trace, see recordins
+	} break;
+	case OP_TFORLOOP: {
+		int cont = ti->next == pc + 1 + GET_ARG_sBx(i);
+		need(T, a + 1, ti->tb, pc);
+		if (cont != (ti->tb != LUA_TNIL)) {
+			T->fail = ABORT_TYPES;
+		}
+		else if (cont) {
+			move(T, a, reg_slot(a + 1), ti->tb);
+		}
+	} break;
+	default: T->fail = ABORT_NYI; break;
+	}
+}
+
+// the first pass finds the registers read before they are written, the second
+// one checks them once at the head of the trace and compiles the loop body with
+// their types known. the body jumps back behind those checks if it leaves the
+// registers with the same types
+static void emittrace(TraceBuilder* T) {
+	JitState* J = &T->J;
+	struct TraceState* ts = T->ts;
+	J->n = 0;
+	J->nlabels = 0;
+	J->nfixups = 0;
+	J->nexits = 0;
+	T->fail = -1;
+	for (int r = 0; r < TRACE_MAXREGS; r++) {
+		T->known[r] = -1;
+		T->written[r] = 0;
+	}
+	if (T->pass == 0) {
+		T->nguards = 0;
+	}
+
+	J->epilogue = newlabel(J);
+	int head = newlabel(J);
+	int loop = newlabel(J);
+	prologue(J);
+	int miss = newlabel(J);
+	bindlabel(J, head);
+	if (T->pass > 0) {
+		for (int g = 0; g < T->nguards; g++) {
+			cmptag(J, reg_slot(T->guards[g].reg), T->guards[g].tag);
+			jcc(J, CC_NE, miss);
+			T->known[T->guards[g].reg] = T->guards[g].tag;
+		}
+	}
+	bindlabel(J, loop);
+	for (int n = 0; n < ts->nins && T->fail < 0; n++) {
+		traceins(T, &ts->ins[n]);
+	}
+
+	int stable = 1;
+	for (int g = 0; g < T->nguards; g++) {
+		if (T->known[T->guards[g].reg] != T->guards[g].tag) {
+			stable = 0;
+		}
+	}
+	jmp(J, stable ? loop : head);
+
+	bindlabel(J, miss);
+	EMIT(J, 0x48, 0xB8);                       // mov rax, &tr->headmisses
+	emit8(J, cast(unsigned long long, cast(size_t, &T->tr->headmisses)));
+	EMIT(J, 0x48, 0x83, 0x00, 0x01);           // add qword [rax], 1
+	exitat(J, ts->anchor);
+}
+
+static void stoprecording(struct lua_State* L, int reason) {
+	struct TraceState* ts = G(L)->tracestate;
+	G(L)->recording = 0;
+	if (reason >= 0) {
+		struct JitLoop* lp = &ts->p->loops[ts->anchor];
+		ts->naborts[reason]++;
+		if (++lp->aborts >= LUAJ_MAXABORT) {
+			ts->nblacklisted++;
+		}
+		lp->hot = LUAJ_HOTLOOP;
+	}
+	ts->p = NULL;
+}
+
+static void compiletrace(struct lua_State* L, struct TraceState* ts) {
+	TraceBuilder* T = luaM_realloc(L, NULL, 0, sizeof(TraceBuilder));
+	memset(T, 0, sizeof(TraceBuilder));
+	T->J.L = L;
+	T->J.p = ts->p;
+	T->ts = ts;
+	T->tr = luaM_realloc(L, NULL, 0, sizeof(Trace));
+	T->fail = -1;
+	for (T->pass = 0; T->pass < 2 && T->fail < 0; T->pass++) {
+		emittrace(T);
+	}
+
+	Trace* tr = T->tr;
+	unsigned char* mcode = T->fail < 0 ? link(&T->J) : NULL;
+	if (mcode == NULL) {
+		luaM_free(L, tr, sizeof(Trace));
+		stoprecording(L, T->fail < 0 ? ABORT_NYI : T->fail);
+	}
+	else {
+		tr->p = ts->p;
+		tr->anchor = ts->anchor;
+		tr->tail = GET_OPCODE(ts->ins[ts->nins - 1].i) == OP_TFORCALL ? ts->ins[ts->nins - 1].pc : ts->anchor;
+		tr->id = ++ts->ntraces;
+		tr->nins = ts->nins;
+		tr->nguards = T->nguards;
+		tr->mcode = mcode;
+		tr->size = T->J.n;
+		tr->entries = 0;
+		tr->sideexits = 0;
+		tr->headmisses = 0;
+		tr->prev = NULL;
+		tr->next = ts->traces;
+		if (ts->traces) {
+			ts->traces->prev = tr;
+		}
+		ts->traces = tr;
+		ts->p->loops[ts->anchor].trace = tr;
+		stoprecording(L, -1);
+	}
+	freestate(&T->J);
+	luaM_free(L, T, sizeof(TraceBuilder));
+}
+
+static void recordins(struct lua_State* L, struct TraceState* ts, StkId base, int pc) {
+	if (ts->nins >= LUAJ_MAXTRACE) {
+		stoprecording(L, ABORT_LENGTH);
+		return;
+	}
+
+	Instruction i = ts->p->code[pc];
+	TValue* k = ts->p->k;
+	TraceIns* ti = &ts->ins[ts->nins];
+	ti->i = i;
+	ti->pc = pc;
+	ti->next = -1;
+	ti->ta = tagof(base + GET_ARG_A(i));
+	ti->tb = ti->tc = ti->tres = LUA_TNIL;
+	switch (luaP_genericop(GET_OPCODE(i))) {
+	case OP_MOVE: case OP_UNM: case OP_NOT: case OP_TESTSET: {
+		ti->tb = tagof(base + GET_ARG_B(i));
+	} break;
+	case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV:
+	case OP_EQ: case OP_LT: case OP_LE: case OP_GETTABLE: case OP_SETTABLE: {
+		int b = GET_ARG_B(i);
+		int c = GET_ARG_C(i);
+		ti->tb = tagof(ISK(b) ? k + (b - BITRK) : base + b);
+		ti->tc = tagof(ISK(c) ? k + (c - BITRK) : base + c);
+	} break;
+	case OP_FORLOOP: {
+		ti->tc = tagof(base + GET_ARG_A(i) + 2);
+	} break;
+	case OP_TFORLOOP: {
+		ti->tb = tagof(base + GET_ARG_A(i) + 1);
+	} break;
+	case OP_TFORCALL: {
+		// the call of the loop's own iterator completes an iteration, the one
+		// of a generic for nested in the loop does not
+		if (pc + 1 != ts->anchor) {
+			stoprecording(L, ABORT_NYI);
+			return;
+		}
+		ts->nins++;
+		compiletrace(L, ts);
+	} return;
+	case OP_LOADK: case OP_LOADBOOL: case OP_LOADNIL: case OP_JUMP: case OP_TEST: break;
+	default: {
+		stoprecording(L, ABORT_NYI);
+		return;
+	}
+	}
+	ts->nins++;
+}
+
+void luaJ_setmode(struct lua_State* L, int mode) {
+	G(L)->jitmode = cast(lu_byte, mode);
+	if (mode != LUAJ_TRACE && G(L)->recording) {
+		stoprecording(L, -1);
+	}
+}
+
+static void freetrace(struct lua_State* L, struct TraceState* ts, Trace* tr) {
+	if (tr->prev) {
+		tr->prev->next = tr->next;
+	}
+	else {
+		ts->traces = tr->next;
+	}
+	if (tr->next) {
+		tr->next->prev = tr->prev;
+	}
+	tr->p->loops[tr->anchor].trace = NULL;
+	munmap(tr->mcode, tr->size);
+	luaM_free(L, tr, sizeof(Trace));
+}
+
+static void flushtrace(struct lua_State* L, struct JitLoop* lp, int blacklist) {
+	struct TraceState* ts = G(L)->tracestate;
+	freetrace(L, ts, lp->trace);
+	ts->nflushed++;
+	if (blacklist || ++lp->aborts >= LUAJ_MAXABORT) {
+		lp->aborts = LUAJ_MAXABORT;
+		ts->nblacklisted++;
+	}
+	else {
+		lp->hot = LUAJ_HOTLOOP;
+	}
+}
+
+static const Instruction* runtrace(struct lua_State* L, struct JitLoop* lp, StkId base) {
+	Trace* tr = lp->trace;
+	JitFunction f = (JitFunction)(void*)tr->mcode;
+	const Instruction* pc = f(L, base, tr->p->k, NULL);
+	tr->entries++;
+	if (pc != tr->p->code + tr->tail && pc != tr->p->code + tr->anchor) {
+		tr->sideexits++;
+	}
+
+	// a trace that hardly ever completes an iteration is slower than the
+	// interpreter, it is flushed and its loop blacklisted. a loop whose
+	// registers changed their types is recorded again with the new ones
+	if (tr->entries >= LUAJ_HOTLOOP && tr->sideexits * 4 > tr->entries * 3) {
+		flushtrace(L, lp, 1);
+	}
+	else if (tr->headmisses >= LUAJ_HOTLOOP / 4 && tr->headmisses * 2 > tr->entries) {
+		flushtrace(L, lp, 0);
+	}
+	return pc;
+}
+
+const Instruction* luaJ_loop(struct lua_State* L, Proto* p, StkId base, const Instruction* pc) {
+	struct global_State* g = G(L);
+	if (p->loops == NULL) {
+		p->loops = luaM_realloc(L, NULL, 0, sizeof(struct JitLoop) * p->sizecode);
+		p->sizeloops = p->sizecode;
+		for (int j = 0; j < p->sizeloops; j++) {
+			p->loops[j].trace = NULL;
+			p->loops[j].hot = LUAJ_HOTLOOP;
+			p->loops[j].aborts = 0;
+		}
+	}
+
+	struct JitLoop* lp = &p->loops[pc - p->code];
+	if (lp->trace) {
+		return runtrace(L, lp, base);
+	}
+	if (g->recording || lp->aborts >= LUAJ_MAXABORT || --lp->hot > 0) {
+		return pc;
+	}
+
+	if (g->tracestate == NULL) {
+		g->tracestate = luaM_realloc(L, NULL, 0, sizeof(struct TraceState));
+		memset(g->tracestate, 0, sizeof(struct TraceState));
+	}
+	struct TraceState* ts = g->tracestate;
+	ts->p = p;
+	ts->base = base;
+	ts->anchor = cast(int, pc - p->code);
+	ts->nins = 0;
+	ts->nrecorded++;
+	g->recording = 1;
+	recordins(L, ts, base, ts->anchor);
+	return pc;
+}
+
+void luaJ_record(struct lua_State* L, Proto* p, StkId base, const Instruction* pc) {
+	struct TraceState* ts = G(L)->tracestate;
+	if (p != ts->p || base != ts->base) { // a call, a return or a metamethod
+		stoprecording(L, ABORT_FRAME);
+		return;
+	}
+
+	int at = cast(int, pc - p->code);
+	TraceIns* last = &ts->ins[ts->nins - 1];
+	last->next = at;
+	last->tres = tagof(base + GET_ARG_A(last->i));
+	if (at == ts->anchor) {
+		compiletrace(L, ts);
+	}
+	else {
+		recordins(L, ts, base, at);
+	}
+}
+
+void luaJ_dumptraces(struct lua_State* L) {
+	struct TraceState* ts = G(L)->tracestate;
+	if (ts == NULL) {
+		printf("no loop got hot\n");
+		return;
+	}
+
+	printf("%d traces, %lu recordings, %lu traces flushed, %lu loops blacklisted\n", ts->ntraces, ts->nrecorded,
+		ts->nflushed, ts->nblacklisted);
+	for (Trace* tr = ts->traces; tr; tr = tr->next) {
+		Proto* p = tr->p;
+		printf("trace %d <%s:%d> loop at pc %d, %d instructions, %d entry guards, %d bytes, %lu entries, %lu side exits, %lu type misses\n",
+			tr->id, p->source ? getstr(p->source) : "?", tr->anchor < p->sizeline ? p->line[tr->anchor] : 0,
+			tr->anchor, tr->nins, tr->nguards, cast(int, tr->size), tr->entries, tr->sideexits, tr->headmisses);
+	}
+	for (int r = 0; r < ABORT_TOTAL; r++) {
+		if (ts->naborts[r] > 0) {
+			printf("aborted: %s %lu\n", abortnames[r], ts->naborts[r]);
+		}
+	}
+}
+
+void luaJ_stats(struct lua_State* L, JitStats* st) {
+	struct TraceState* ts = G(L)->tracestate;
+	memset(st, 0, sizeof(JitStats));
+	if (ts == NULL) {
+		return;
+	}
+
+	st->ntraces = ts->ntraces;
+	st->nrecorded = ts->nrecorded;
+	st->nflushed = ts->nflushed;
+	st->nblacklisted = ts->nblacklisted;
+	for (int r = 0; r < ABORT_TOTAL; r++) {
+		st->naborts += ts->naborts[r];
+	}
+	for (Trace* tr = ts->traces; tr; tr = tr->next) {
+		st->ncached++;
+		st->entries += tr->entries;
+		st->sideexits += tr->sideexits;
+		st->headmisses += tr->headmisses;
+	}
+}
+
+void luaJ_close(struct lua_State* L) {
+	struct TraceState* ts = G(L)->tracestate;
+	if (ts) {
+		lua_assert(ts->traces == NULL);
+		luaM_free(L, ts, sizeof(struct TraceState));
+		G(L)->tracestate = NULL;
+	}
+}
+
+void luaJ_free(struct lua_State* L, Proto* p) {
+	struct JitCode* jc = p->jit;
+	if (jc) {
+		munmap(jc->mcode, jc->size);
+		luaM_free(L, jc->pcoffset, sizeof(unsigned int) * jc->sizepc);
+		luaM_free(L, jc, sizeof(struct JitCode));
+		p->jit = NULL;
+	}
+
+	struct TraceState* ts = G(L)->tracestate;
+	if (ts && ts->p == p) {
+		stoprecording(L, -1);
+	}
+	if (p->loops) {
+		for (int j = 0; j < p->sizeloops; j++) {
+			if (p->loops[j].trace) {
+				freetrace(L, ts, p->loops[j].trace);
+			}
+		}
+		luaM_free(L, p->loops, sizeof(struct JitLoop) * p->sizeloops);
+		p->loops = NULL;
+		p->sizeloops = 0;
+	}
+}
+
+#else
+#include <string.h>
+
+void luaJ_setmode(struct lua_State* L, int mode) {
+	(void)L;
+	(void)mode;
+}
+
+void luaJ_compile(struct lua_State* L, Proto* p) {
+	(void)L;
+	(void)p;
+}
+
+const Instruction* luaJ_execute(struct lua_State* L, Proto* p, StkId base, const Instruction* pc) {
+	(void)L;
+	(void)p;
+	(void)base;
+	return pc;
+}
+
+const Instruction* luaJ_loop(struct lua_State* L, Proto* p, StkId base, const Instruction* pc) {
+	(void)L;
+	(void)p;
+	(void)base;
+	return pc;
+}
+
+void luaJ_record(struct lua_State* L, Proto* p, StkId base, const Instruction* pc) {
+	(void)L;
+	(void)p;
+	(void)base;
+	(void)pc;
+}
+
+void luaJ_dumptraces(struct lua_State* L) {
+	(void)L;
+}
+
+void luaJ_stats(struct lua_State* L, JitStats* st) {
+	(void)L;
+	memset(st, 0, sizeof(JitStats));
+}
+
+void luaJ_free(struct lua_State* L, Proto* p) {
+	(void)L;
+	(void)p;
+}
+
+void luaJ_close(struct lua_State* L) {
+	(void)L;
+}
+
+#endif
@@ -0,0 +1,105 @@
+/* Copyright (c) 2018 Manistein,https://manistein.github.io/blog/  
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.*/
+
+#ifndef luajit_h
+#define luajit_h
+
+#include "../common/luastate.h"
+
+// the baseline jit emits x86-64 System V code and relies on lua_Number being
+// a double, it is built with -DLUA_USE_JIT=1 (cmake -DLUA_USE_JIT=ON)
+#if defined(LUA_USE_JIT) && LUA_USE_JIT && defined(__x86_64__) && defined(__linux__) && defined(LLONG_MAX)
+#undef LUA_USE_JIT
+#define LUA_USE_JIT 1
+#else
+#undef LUA_USE_JIT
+#define LUA_USE_JIT 0
+#endif
+
+// jit modes, a tracing jit leaves whole functions to the interpreter and only
+// compiles the paths that hot loops actually take
+#define LUAJ_OFF 0
+#define LUAJ_METHOD 1
+#define LUAJ_TRACE 2
+
+// calls plus loop back edges before a function gets compiled
+#define LUAJ_HOTCOUNT 64
+
+// iterations of a loop before it gets recorded, failed recordings before it is
+// blacklisted, and the longest trace the recorder accepts
+#define LUAJ_HOTLOOP 56
+#define LUAJ_MAXABORT 4
+#define LUAJ_MAXTRACE 256
+
+#if LUA_USE_JIT
+#define luaJ_hot(L, p) { if (G(L)->jitmode == LUAJ_METHOD && (p)->hotcount > 0 && --(p)->hotcount == 0) luaJ_compile(L, p); }
+#define luaJ_canrun(L, p) ((p)->jit != NULL && G(L)->jitmode == LUAJ_METHOD)
+#define luaJ_tracing(L) (G(L)->jitmode == LUAJ_TRACE)
+#define luaJ_recording(L) (G(L)->recording)
+#else
+#define luaJ_hot(L, p) ((void)0)
+#define luaJ_canrun(L, p) 0
+#define luaJ_tracing(L) 0
+#define luaJ_recording(L) 0
+#endif
+
+// switch between LUAJ_OFF, LUAJ_METHOD and LUAJ_TRACE at runtime, code that is
+// already compiled is kept
+void luaJ_setmode(struct lua_State* L, int mode);
+
+// translate p into native code, p->jit stays NULL if that is not possible
+void luaJ_compile(struct lua_State* L, Proto* p);
+
+// run the native code of p from pc until it reaches an instruction it does not
+// handle, and return that instruction, which the interpreter executes next
+const Instruction* luaJ_execute(struct lua_State* L, Proto* p, StkId base, const Instruction* pc);
+
+// called by a loop back edge at pc before it executes: runs the trace of the
+// loop, or counts the iteration and starts recording once the loop is hot.
+// returns where the interpreter continues, pc itself if it has to execute the
+// back edge
+const Instruction* luaJ_loop(struct lua_State* L, Proto* p, StkId base, const Instruction* pc);
+
+// shows the instruction at pc to the recorder before the interpreter executes it
+void luaJ_record(struct lua_State* L, Proto* p, StkId base, const Instruction* pc);
+
+// print the trace cache and the recorder counters
+void luaJ_dumptraces(struct lua_State* L);
+
+// the counters luaJ_dumptraces prints, entries, sideexits and headmisses are
+// summed over the traces in the cache. all zero as long as no loop got hot
+typedef struct JitStats {
+	int ntraces;                // traces compiled so far, flushed ones included
+	int ncached;                // traces in the cache
+	unsigned long nrecorded;
+	unsigned long naborts;      // aborted recordings, for any reason
+	unsigned long nflushed;
+	unsigned long nblacklisted;
+	unsigned long entries;
+	unsigned long sideexits;
+	unsigned long headmisses;
+} JitStats;
+
+void luaJ_stats(struct lua_State* L, JitStats* st);
+
+void luaJ_free(struct lua_State* L, Proto* p);
+void luaJ_close(struct lua_State* L);
+
+#endif
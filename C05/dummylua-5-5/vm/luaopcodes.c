@@ -15,6 +15,7 @@ const lu_byte luaP_opmodes[NUM_OPCODES] = {
     ,opmode(0, 1, OpArgK, OpArgN, iABx) // OP_LOADK
     ,opmode(0, 1, OpArgU, OpArgN, iABC) // OP_GETUPVAL
     ,opmode(0, 1, OpArgU, OpArgU, iABC) // OP_CALL
+    ,opmode(0, 1, OpArgU, OpArgU, iABC) // OP_TAILCALL
     ,opmode(0, 0, OpArgU, OpArgU, iABC) // OP_RETURN
 	,opmode(0, 1, OpArgU, OpArgU, iABC) // OP_GETTABUP
 	,opmode(0, 1, OpArgU, OpArgU, iABC) // OP_GETTABLE
@@ -51,4 +52,31 @@ const lu_byte luaP_opmodes[NUM_OPCODES] = {
 	,opmode(0, 1, OpArgR, OpArgR, iABC) // OP_SETTABLE
 	,opmode(0, 1, OpArgU, OpArgU, iAsBx)// OP_FORPREP
 	,opmode(1, 1, OpArgU, OpArgU, iAsBx)// OP_FORLOOP
-};
\ No newline at end of file
+	,opmode(0, 0, OpArgN, OpArgU, iABC) // OP_TFORCALL
+	,opmode(0, 1, OpArgR, OpArgN, iAsBx)// OP_TFORLOOP
+	,opmode(0, 1, OpArgU, OpArgN, iABx) // OP_CLOSURE
+	,opmode(0, 1, OpArgU, OpArgN, iABC) // OP_VARARG
+	,opmode(0, 0, OpArgU, OpArgU, iABx) // OP_EXTRAARG
+	,opmode(0, 1, OpArgR, OpArgR, iABC) // OP_ADD_II
+	,opmode(0, 1, OpArgR, OpArgR, iABC) // OP_ADD_FF
+	,opmode(0, 1, OpArgR, OpArgR, iABC) // OP_SUB_II
+	,opmode(0, 1, OpArgR, OpArgR, iABC) // OP_SUB_FF
+	,opmode(0, 1, OpArgR, OpArgR, iABC) // OP_MUL_II
+	,opmode(0, 1, OpArgR, OpArgR, iABC) // OP_MUL_FF
+	,opmode(1, 0, OpArgR, OpArgR, iABC) // OP_LT_II
+	,opmode(1, 0, OpArgR, OpArgR, iABC) // OP_LE_II
+	,opmode(0, 1, OpArgU, OpArgU, iABC) // OP_GETTABLE_INT
+	,opmode(0, 1, OpArgU, OpArgU, iABC) // OP_GETTABLE_SHRSTR
+};
+
+int luaP_genericop(int op) {
+	switch (op) {
+	case OP_ADD_II: case OP_ADD_FF: return OP_ADD;
+	case OP_SUB_II: case OP_SUB_FF: return OP_SUB;
+	case OP_MUL_II: case OP_MUL_FF: return OP_MUL;
+	case OP_LT_II: return OP_LT;
+	case OP_LE_II: return OP_LE;
+	case OP_GETTABLE_INT: case OP_GETTABLE_SHRSTR: return OP_GETTABLE;
+	default: return op;
+	}
+}
\ No newline at end of file
@@ -48,7 +48,7 @@ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
 #define GET_ARG_B(i) ((i & 0xFF800000) >> POS_B)
 #define GET_ARG_C(i) ((i & 0x7FC000) >> POS_C)
 #define GET_ARG_Bx(i) ((i & 0xFFFFC000) >> (SIZE_A + SIZE_OP))
-#define GET_ARG_sBx(i) (GET_ARG_Bx(i) - LUA_IBIAS)
+#define GET_ARG_sBx(i) (cast(int, GET_ARG_Bx(i)) - LUA_IBIAS)
 
 #define MAXARG_A ((1 << SIZE_A) - 1)
 #define MAXARG_B ((1 << SIZE_B) - 1)
@@ -69,6 +69,9 @@ enum OpCode {
 					// it means that the function parameters range from A+1 to the top of stack
 					// C represents the number of return, if C is 1, there is no value return, else if C is greater than 1, then it has C - 1 return values, or if C is 0
 					// the return values range from A to the top of stack
+	OP_TAILCALL,    // A, B, C; return R[A](R[A + 1], ... , R[A + B - 1])
+					// same operands as OP_CALL, but the callee reuses the frame of the current function,
+					// so it is always followed by OP_RETURN A 0
 	OP_RETURN,      // A, B; return R[A], ... R[A + B - 2]
 					// return the values to the calling function, B represent the number of results. if B is 1, that means no value return, if B is greater than 1, it means 
 					// there are B - 1 values return. And finally, if B is 0, the set of values range from R[A] to the top of stack, are return to the calling function
@@ -98,7 +101,7 @@ enum OpCode {
 	OP_BXOR,		// A B C   R(A) := RK(B) ~ RK(C)
 	OP_SHL,			// A B C   R(A) := RK(B) << RK(C)
 	OP_SHR,			// A B C   R(A) := RK(B) >> RK(C)
-	OP_CONCAT,		// A B C   R(A) := R(B).. ... ..R(C)
+	OP_CONCAT,		// A B C   R(A) := R(B).. ... ..R(C), R(B) to R(C) are clobbered
 
 	OP_EQ,			// A B C   if ((RK(B) == RK(C)) ~= A) then pc++
 	OP_LT,			// A B C   if ((RK(B) <  RK(C)) ~= A) then pc++
@@ -111,6 +114,7 @@ enum OpCode {
 	OP_SETTABUP,    // A B C   UpValue[A][RK(B)] := RK(C)
 	OP_NEWTABLE,    // A B C   R(A) := {} (size = B,C)
 	OP_SETLIST,     // A B C   R(A)[(C-1)*FPF+i] := R(A+i), 1 <= i <= B
+					//         if C is 0, the real C is the Bx of the OP_EXTRAARG that follows
 	OP_SETTABLE,    // A B C   R(A)[RK(B)] = RK(C)
 
 	OP_FORPREP,     // A sBx   FORPREP A sBx R(A) -= R(A+2); PC += sBx
@@ -121,6 +125,23 @@ enum OpCode {
 	OP_TFORCALL,    // A C	R(A+3), ... ,R(A+2+C) := R(A)(R(A+1), R(A+2));
 	OP_TFORLOOP,    // A sBx	if R(A+1) ~= nil then { R(A)=R(A+1); pc += sBx }
 	OP_CLOSURE,     // A Bx	R(A) := closure(KPROTO[Bx])
+	OP_VARARG,      // A B	R(A), R(A+1), ..., R(A+B-2) = vararg
+					// if B is 0, all the extra arguments are loaded and the top of stack is set after the last one
+	OP_EXTRAARG,    // Bx      extra (larger) argument for the previous opcode
+
+	// quickened variants, the compiler never emits them. luaV_execute rewrites a generic
+	// instruction into one of these once it has seen the operand types, and rewrites it
+	// back when a type guard fails. Operands are the same as the generic instruction's
+	OP_ADD_II,      // OP_ADD, both operands are integers
+	OP_ADD_FF,      // OP_ADD, both operands are floats
+	OP_SUB_II,      // OP_SUB, both operands are integers
+	OP_SUB_FF,      // OP_SUB, both operands are floats
+	OP_MUL_II,      // OP_MUL, both operands are integers
+	OP_MUL_FF,      // OP_MUL, both operands are floats
+	OP_LT_II,       // OP_LT, both operands are integers
+	OP_LE_II,       // OP_LE, both operands are integers
+	OP_GETTABLE_INT,    // OP_GETTABLE, R(B) is a table and RK(C) is an integer
+	OP_GETTABLE_SHRSTR, // OP_GETTABLE, R(B) is a table and RK(C) is a constant short string
 	NUM_OPCODES,
 };
 
@@ -148,4 +169,6 @@ enum OpArgMask {
 	OpArgK,     // argument is used, and it's value is in constant table, the index is in instruction
 };
 
-extern const lu_byte luaP_opmodes[NUM_OPCODES];
\ No newline at end of file
+extern const lu_byte luaP_opmodes[NUM_OPCODES];
+
+int luaP_genericop(int op); // the opcode a quickened opcode was specialized from
\ No newline at end of file
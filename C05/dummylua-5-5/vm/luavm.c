@@ -24,13 +24,31 @@ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
 #include "luagc.h"
 #include "luaopcodes.h"
 #include "luafunc.h"
+#include "luajit.h"
 #include "../common/luaobject.h"
 #include "../common/luadebug.h"
 
 #define MAXLOOP 2000
 
+#define indexcache(g, mt, ts) (&(g)->indexcache[(point2uint(mt) ^ (ts)->hash) & (INDEXCACHE_SIZE - 1)])
+
 // if slot is null, then it means that t is not a table
+// a short string key that is found through a chain of __index tables is
+// remembered per (metatable of t, key). Only hits are cached: the key and the
+// value are then fields of a chain table, so they stay alive until that table
+// is written, which changes the epoch
 void luaV_finishget(struct lua_State* L, TValue* t, const StkId key, StkId val, TValue* slot) {
+	global_State* g = G(L);
+	IndexCache* c = NULL;
+	if (slot != NULL && hvalue(t)->metatable && ttisshrstr(key)) {
+		c = indexcache(g, hvalue(t)->metatable, tsvalue(key));
+		if (c->epoch == g->chainepoch && c->mt == hvalue(t)->metatable && c->key == tsvalue(key)) {
+			setobj(val, &c->value);
+			return;
+		}
+	}
+
+	struct Table* mt = c ? hvalue(t)->metatable : NULL;
 	TValue* tm;
 	for (int i = 0; i < MAXLOOP; i++) {
 		if (slot == NULL) { // t is not a table
@@ -46,8 +64,8 @@ void luaV_finishget(struct lua_State* L, TValue* t, const StkId key, StkId val,
 				return;
 			}
 
-			tm = (TValue*)luaH_getstr(L, hvalue(t)->metatable, G(L)->tmnames[TM_INDEX]);
-			if (ttisnil(tm)) {
+			tm = fasttm(L, hvalue(t)->metatable, TM_INDEX);
+			if (tm == NULL) {
 				setnilvalue(val);
 				return;
 			}
@@ -58,9 +76,25 @@ void luaV_finishget(struct lua_State* L, TValue* t, const StkId key, StkId val,
 			return;
 		}
 
+		if (c) {
+			if (ttistable(tm)) {
+				hvalue(t)->metatable->inchain = 1;
+				hvalue(tm)->inchain = 1;
+			}
+			else {
+				c = NULL;
+			}
+		}
+
 		t = tm;
 		if (luaV_fastget(L, t, key, luaH_get, slot)) {
 			setobj(val, (StkId)slot);
+			if (c) {
+				c->mt = mt;
+				c->key = tsvalue(key);
+				setobj(&c->value, val);
+				c->epoch = g->chainepoch;
+			}
 			return;
 		}
 	}
@@ -79,11 +113,15 @@ void luaV_finishset(struct lua_State* L, TValue* t, const TValue* key, StkId val
 		}
 		else {
 			lua_assert(ttisnil(slot));
-			tm = luaT_gettmbyobj(L, t, TM_NEWINDEX);
+			tm = fasttm(L, hvalue(t)->metatable, TM_NEWINDEX);
 			if (tm == NULL) {
 				if (slot == luaO_nilobject) {
 					slot = luaH_newkey(L, hvalue(t), key);
 				}
+				else {
+					invalidateTMcache(hvalue(t));
+					luaH_chainwrite(L, hvalue(t));
+				}
 
 				setobj(slot, val);
 				luaC_barrierback(L, hvalue(t), slot);
@@ -153,721 +191,973 @@ int luaV_eqobject(struct lua_State* L, const TValue* a, const TValue* b) {
 	return ret;
 }
 
-// implement of instructions
-static void newframe(struct lua_State* L);
-static void op_move(struct lua_State* L, LClosure* cl, StkId ra, Instruction i) {
-	int reg_b = GET_ARG_B(i);
-	StkId o = L->ci->l.base + reg_b;
-	setobj(ra, o);
-}
-
-static void op_loadk(struct lua_State* L, LClosure* cl, StkId ra, Instruction i) {
-	int bx = GET_ARG_Bx(i);
-	setobj(ra, &cl->p->k[bx]);
-}
-
-static void op_getupval(struct lua_State* L, LClosure* cl, StkId ra, Instruction i) {
-	UpVal* upval = cl->upvals[GET_ARG_B(i)];
-	if (upval) {
-		setobj(ra, upval->v);
+int luaV_tonumber(struct lua_State* L, const TValue* v, lua_Number* n) {
+	int result = 0;
+	if (ttisinteger(v)) {
+		*n = (lua_Number)v->value_.i;
+		result = 1;
 	}
-	else {
-		luaG_runerror(L, "%s", "op_getupval:upval is not exist");
+	else if (ttisfloat(v)) {
+		*n = v->value_.n;
+		result = 1;
 	}
+	return result;
 }
 
-static void op_gettabup(struct lua_State* L, LClosure* cl, StkId ra, Instruction i) {
-	int b = GET_ARG_B(i);
-	TValue* upval = cl->upvals[b]->v;
-	int arg_c = GET_ARG_C(i);
-	if (ISK(arg_c)) {
-		int index = arg_c - MAININDEXRK - 1;
-		TValue* key = &cl->p->k[index];
-		luaV_gettable(L, upval, key, ra);
+int luaV_tointeger(struct lua_State* L, const TValue* v, lua_Integer* i) {
+	int result = 0;
+	if (ttisinteger(v)) {
+		*i = v->value_.i;
+		result = 1;
 	}
-	else {
-		TValue* value = L->ci->l.base + arg_c;
-		setobj(ra, value);
+	else if (ttisfloat(v)) {
+		*i = (lua_Integer)v->value_.n;
+		result = 1;
 	}
+	return result;
 }
 
-static void op_call(struct lua_State* L, LClosure* cl, StkId ra, Instruction i) {
-	int narg = GET_ARG_B(i);
-	int nresult = GET_ARG_C(i) - 1;
-	if (narg > 0) {
-		L->top = ra + narg;
-	}
-
-	if (luaD_precall(L, ra, nresult)) { // c function
-		L->top = L->ci->top;
-	}
-	else {
-		newframe(L);
+// floor division, rounds towards minus infinity
+lua_Integer luaV_div(struct lua_State* L, lua_Integer m, lua_Integer n) {
+	if (l_castS2U(n) + 1u <= 1u) { // n is 0 or -1
+		if (n == 0) {
+			luaG_runerror(L, "%s", "attempt to perform 'n//0'");
+		}
+		return l_castU2S(0u - l_castS2U(m)); // avoids overflow of LUA_MININTEGER / -1
 	}
-}
 
-static void op_return(struct lua_State* L, LClosure* cl, StkId ra, Instruction i) {
-	luaF_close(L, cl);
-
-	int b = GET_ARG_B(i);
-	luaD_poscall(L, ra, b ? (b - 1) : (int)(L->top - ra));
-	if (L->ci->callstatus & CIST_LUA) {
-		//if (b) {
-		//	L->top = L->ci->top;
-		//}
-		lua_assert(GET_OPCODE(*(L->ci->savedpc - 1)) == OP_CALL);
+	lua_Integer q = m / n;
+	if ((m ^ n) < 0 && m % n != 0) {
+		q -= 1;
 	}
+	return q;
 }
 
-static void op_gettable(struct lua_State* L, LClosure* cl, StkId ra, Instruction i) {
-	int b = GET_ARG_B(i);
-	int c = GET_ARG_C(i);
-	TValue* vt = L->ci->l.base + b;
-	if (!ttistable(vt)) {
-		luaG_runerror(L, "RB is not index to a table; OP_GETTABLE, RA(%d) RB(%d) RC(%d)\n", ra - L->ci->l.base, b, c);
+// the result takes the sign of the divisor
+lua_Integer luaV_mod(struct lua_State* L, lua_Integer m, lua_Integer n) {
+	if (l_castS2U(n) + 1u <= 1u) { // n is 0 or -1
+		if (n == 0) {
+			luaG_runerror(L, "%s", "attempt to perform 'n%0'");
+		}
+		return 0;
 	}
 
-	if (ISK(c)) {
-		int k = c - MAININDEXRK - 1;
-		luaV_gettable(L, vt, (const TValue*)&cl->p->k[k], ra);
-	}
-	else {
-		luaV_gettable(L, vt, (const TValue*)(L->ci->l.base + c), ra);
+	lua_Integer r = m % n;
+	if (r != 0 && (r ^ n) < 0) {
+		r += n;
 	}
+	return r;
 }
 
-static void op_self(struct lua_State* L, LClosure* cl, StkId ra, Instruction i) {
-	int b = GET_ARG_B(i);
-	int c = GET_ARG_C(i);
+#define NBITS cast(int, sizeof(lua_Integer) * CHAR_BIT)
 
-	TValue* vt = L->ci->l.base + b;
-	if (!ttistable(vt)) {
-		luaG_runerror(L, "OP_SELF, RA(%d) RB(%d) RC(%d); RB is not index to a table\n", ra - L->ci->l.base, b, c);
-	}
-	struct Table* t = gco2tbl(gcvalue(vt));
-
-	StkId ra1 = ra + 1;
-	setobj(ra1, vt);
-	if (ISK(c)) {
-		int idx = c - MAININDEXRK - 1;
-		luaV_gettable(L, vt, &cl->p->k[idx], ra);
+// logical shift, a negative y shifts to the right
+lua_Integer luaV_shiftl(lua_Integer x, lua_Integer y) {
+	if (y < 0) {
+		if (y <= -NBITS) return 0;
+		return l_castU2S(l_castS2U(x) >> l_castS2U(-y));
 	}
 	else {
-		luaV_gettable(L, vt, L->ci->l.base + c, ra);
+		if (y >= NBITS) return 0;
+		return l_castU2S(l_castS2U(x) << l_castS2U(y));
 	}
 }
 
-static void op_test(struct lua_State* L, LClosure* cl, StkId ra, Instruction i) {
-	int c = GET_ARG_C(i);
-
-	int cond = 0;
-	switch (ra->tt_) {
-	case LUA_TNIL: cond = 0; break;
-	case LUA_TBOOLEAN: cond = ra->value_.b; break;
-	default: cond = 1; break;
-	}
-
-	if (!(cond == c)) {
-		L->ci->l.savedpc++;
-	}
+#define tostringable(o) (novariant(o) == LUA_TSTRING || novariant(o) == LUA_TNUMBER)
+
+// Joins the total values from first on and leaves the result in first, the
+// slots after it are scratch. Like lua it works from the right end: the
+// longest run of strings and numbers there becomes one string in a single
+// allocation, numbers are converted in place, and any other value goes to
+// __concat together with its right neighbour.
+void luaV_concat(struct lua_State* L, StkId first, int total) {
+	ptrdiff_t pos = savestack(L, first);
+	do {
+		StkId top = restorestack(L, pos) + total; // past the last value
+		int n = 2;
+		if (!tostringable(top - 2) || !tostringable(top - 1)) {
+			luaT_trycallbinTM(L, top - 2, top - 1, TM_CONCAT);
+			top = restorestack(L, pos) + total; // the metamethod may move the stack
+			setobj(top - 2, L->top - 1);
+			L->top--;
+		}
+		else {
+			for (n = 0; n < total && tostringable(top - n - 1); n++) {
+				if (novariant(top - n - 1) == LUA_TNUMBER) {
+					luaO_tostr(L, top - n - 1);
+				}
+			}
+			setgco(top - n, obj2gco(luaO_strjoin(L, top - n, n)));
+		}
+		total -= n - 1;
+	} while (total > 1);
 }
 
-static void op_testset(struct lua_State* L, LClosure* cl, StkId ra, Instruction i) {
-	int b = GET_ARG_B(i);
-	int c = GET_ARG_C(i);
-
-	StkId rb = L->ci->l.base + b;
-	int cond = 0;
-	switch (rb->tt_) {
-	case LUA_TNIL: cond = 0; break;
-	case LUA_TBOOLEAN: cond = rb->value_.b; break;
-	default: cond = 1; break;
-	}
-
-	if (cond == c) {
-		setobj(ra, rb);
+// Converts the limit of an integer for loop to an integer. A float limit is
+// floored (or ceiled for a negative step) and clipped to the integer range.
+// Returns 1 if the loop must not run at all.
+static int forlimit(struct lua_State* L, lua_Integer init, const TValue* lim, lua_Integer* p, lua_Integer step) {
+	if (ttisinteger(lim)) {
+		*p = lim->value_.i;
 	}
 	else {
-		L->ci->l.savedpc++;
-	}
-}
+		lua_Number flim;
+		if (!luaV_tonumber(L, lim, &flim)) {
+			luaG_runerror(L, "%s", "op_forprep:limit must be a number");
+		}
 
-static void op_jump(struct lua_State* L, LClosure* cl, StkId ra, Instruction i) {
-	int sbx = GET_ARG_Bx(i);
-	sbx -= LUA_IBIAS;
-	L->ci->l.savedpc += sbx;
-}
+		if (flim != flim) { // NaN
+			return 1;
+		}
 
-static void op_unm(struct lua_State* L, LClosure* cl, StkId ra, Instruction i) {
-	int b = GET_ARG_B(i);
-	StkId rb = L->ci->l.base + b;
-	TValue o;
-	setobj(&o, rb);
-	if (!luaO_arith(L, LUA_OPT_UMN, &o, rb)) {
-		luaG_runerror(L, "%s", "op_unm: rb's type is incorrect");
+		flim = step < 0 ? ceil(flim) : floor(flim);
+		if (flim >= -(lua_Number)LUA_MININTEGER) {
+			*p = LUA_MAXINTEGER;
+		}
+		else if (flim < (lua_Number)LUA_MININTEGER) {
+			*p = LUA_MININTEGER;
+		}
+		else {
+			*p = (lua_Integer)flim;
+		}
 	}
-	setobj(ra, &o);
-}
 
-static void op_len(struct lua_State* L, LClosure* cl, StkId ra, Instruction i) {
-	int b = GET_ARG_B(i);
-	StkId rb = L->ci->l.base + b;
-	if (ttistable(rb)) {
-		struct Table* t = gco2tbl(gcvalue(rb));
-		setivalue(ra, t->arraysize);
-	}
-	else if (ttisshrstr(rb) || ttislngstr(rb)) {
-		struct TString* ts = gco2ts(gcvalue(rb));
-		int len = ttisshrstr(rb) ? ts->shrlen : ts->u.lnglen;
-		setivalue(ra, len);
-	}
-	else {
-		luaG_runerror(L, "%s", "op_len: rb's type is incorrect");
-	}
+	return step > 0 ? init > *p : init < *p;
 }
 
-static void op_bnot(struct lua_State* L, LClosure* cl, StkId ra, Instruction i) {
-	StkId rb = L->ci->l.base + GET_ARG_B(i);
-	TValue o;
-	if (!luaO_arith(L, LUA_OPT_BNOT, &o, rb)) {
-		luaG_runerror(L, "%s", "op_len: rb's type is incorrect");
-	}
-	setobj(ra, &o);
-}
+// OP_FORPREP: converts the loop values in place, see the comments in
+// OP_FORLOOP for the layout of an integer loop. Returns 1 if the loop must
+// not run at all. The caller saves pc, the errors report its line
+int luaV_forprep(struct lua_State* L, StkId ra) {
+	StkId init = ra;
+	StkId limit = ra + 1;
+	StkId step = ra + 2;
+	if (ttisinteger(init) && ttisinteger(step)) {
+		lua_Integer iinit = init->value_.i;
+		lua_Integer istep = step->value_.i;
+		lua_Integer ilimit;
+		if (istep == 0) {
+			luaG_runerror(L, "%s", "op_forprep:step is zero");
+		}
 
-static void op_not(struct lua_State* L, LClosure* cl, StkId ra, Instruction i) {
-	StkId rb = L->ci->l.base + GET_ARG_B(i);
-	switch (novariant(rb)) {
-	case LUA_TNUMBER: {
-		float v = ttisfloat(rb) ? (float)rb->value_.n : (float)rb->value_.i;
-		setivalue(ra, !((int)v));
-	} break;
-	case LUA_TBOOLEAN: {
-		setbvalue(ra, !rb->value_.b);
-	} break;
-	case LUA_TLCF: {
-		setivalue(ra, !((lua_Integer)rb->value_.f));
-	} break;
-	case LUA_TLIGHTUSERDATA: {
-		setivalue(ra, !((lua_Integer)rb->value_.p));
-	} break;
-	default: {
-		setivalue(ra, !((lua_Integer)gcvalue(rb)));
-	} break;
-	}
-}
+		if (forlimit(L, iinit, limit, &ilimit, istep)) {
+			return 1;
+		}
 
-static void binop(struct lua_State* L, LClosure* cl, StkId ra, Instruction i, int op, TMS event) {
-	int b = GET_ARG_B(i);
-	int c = GET_ARG_C(i);
-	StkId rb, rc;
-	if (ISK(b)) {
-		rb = &cl->p->k[b - MAININDEXRK - 1];
-	}
-	else {
-		rb = L->ci->l.base + b;
+		// the limit slot keeps the number of remaining iterations
+		lua_Unsigned count;
+		if (istep > 0) {
+			count = l_castS2U(ilimit) - l_castS2U(iinit);
+			if (istep != 1) {
+				count /= l_castS2U(istep);
+			}
+		}
+		else {
+			count = l_castS2U(iinit) - l_castS2U(ilimit);
+			count /= l_castS2U(-(istep + 1)) + 1u; // avoids negating LUA_MININTEGER
+		}
+		setivalue(limit, l_castU2S(count));
+		setivalue(ra + 3, iinit);
+		return 0;
 	}
 
-	if (ISK(c)) {
-		rc = &cl->p->k[c - MAININDEXRK - 1];
-	}
-	else {
-		rc = L->ci->l.base + c;
+	lua_Number finit, flimit, fstep;
+	if (!luaV_tonumber(L, init, &finit) || !luaV_tonumber(L, limit, &flimit) || !luaV_tonumber(L, step, &fstep)) {
+		luaG_runerror(L, "%s", "op_forprep:'for' values must be numbers");
 	}
 
-	TValue o;
-	setobj(&o, rb);
-	if (!luaO_arith(L, op, &o, rc)) {
-		luaT_trycallbinTM(L, &o, rc, event);
-		setobj(&o, L->top - 1);
-		L->top--;
+	if (fstep == 0) {
+		luaG_runerror(L, "%s", "op_forprep:step is zero");
 	}
-	setobj(ra, &o);
-}
-
-static void op_add(struct lua_State* L, LClosure* cl, StkId ra, Instruction i) {
-	binop(L, cl, ra, i, LUA_OPT_ADD, TM_ADD);
-}
-
-static void op_sub(struct lua_State* L, LClosure* cl, StkId ra, Instruction i) {
-	binop(L, cl, ra, i, LUA_OPT_SUB, TM_SUB);
-}
 
-static void op_mul(struct lua_State* L, LClosure* cl, StkId ra, Instruction i) {
-	binop(L, cl, ra, i, LUA_OPT_MUL, TM_MUL);
-}
-
-static void op_div(struct lua_State* L, LClosure* cl, StkId ra, Instruction i) {
-	binop(L, cl, ra, i, LUA_OPT_DIV, TM_DIV);
-}
-
-static void op_idiv(struct lua_State* L, LClosure* cl, StkId ra, Instruction i) {
-	binop(L, cl, ra, i, LUA_OPT_IDIV, TM_IDIV);
-}
-
-static void op_mod(struct lua_State* L, LClosure* cl, StkId ra, Instruction i) {
-	binop(L, cl, ra, i, LUA_OPT_MOD, TM_MOD);
-}
-
-static void op_pow(struct lua_State* L, LClosure* cl, StkId ra, Instruction i) {
-	binop(L, cl, ra, i, LUA_OPT_POW, TM_POW);
-}
-
-static void op_band(struct lua_State* L, LClosure* cl, StkId ra, Instruction i) {
-	binop(L, cl, ra, i, LUA_OPT_BAND, TM_BAND);
-}
-
-static void op_bor(struct lua_State* L, LClosure* cl, StkId ra, Instruction i) {
-	binop(L, cl, ra, i, LUA_OPT_BOR, TM_BOR);
-}
-
-static void op_bxor(struct lua_State* L, LClosure* cl, StkId ra, Instruction i) {
-	binop(L, cl, ra, i, LUA_OPT_BXOR, TM_XOR);
-}
-
-static void op_shl(struct lua_State* L, LClosure* cl, StkId ra, Instruction i) {
-	binop(L, cl, ra, i, LUA_OPT_SHL, TM_SHL);
-}
-
-static void op_shr(struct lua_State* L, LClosure* cl, StkId ra, Instruction i) {
-	binop(L, cl, ra, i, LUA_OPT_SHR, TM_SHR);
-}
-
-static void op_concat(struct lua_State* L, LClosure* cl, StkId ra, Instruction i) {
-	int b = GET_ARG_B(i);
-	int c = GET_ARG_C(i);
-
-	StkId base = L->ci->l.base;
-	StkId arg_b = base + b;
-	StkId arg_c = base + c;
-	if (!luaO_concat(L, arg_b, arg_c, ra)) {
-		luaT_trycallbinTM(L, arg_b, arg_c, TM_CONCAT);
-		setobj(ra, L->top - 1);
-		L->top--;
+	if (fstep > 0 ? flimit < finit : finit < flimit) {
+		return 1;
 	}
-}
 
-static void op_eq(struct lua_State* L, LClosure* cl, StkId ra, Instruction i) {
-	StkId rb = RK(L, cl, GET_ARG_B(i));
-	StkId rc = RK(L, cl, GET_ARG_C(i));
-
-	if (luaV_eqobject(L, rb, rc) != GET_ARG_A(i))
-		L->ci->l.savedpc++;
+	setfltvalue(init, finit);
+	setfltvalue(limit, flimit);
+	setfltvalue(step, fstep);
+	setfltvalue(ra + 3, finit);
+	return 0;
 }
 
-static void op_lt(struct lua_State* L, LClosure* cl, StkId ra, Instruction i) {
-	StkId rb = RK(L, cl, GET_ARG_B(i));
-	StkId rc = RK(L, cl, GET_ARG_C(i));
-	lua_Number nb, nc;
-	if (!luaV_tonumber(L, rb, &nb) || !luaV_tonumber(L, rc, &nc)) {
-		luaT_trycallbinTM(L, rb, rc, TM_LT);
-
-		TValue o;
-		setobj(&o, L->top - 1);
-		L->top--;
-		
-		int v = !l_false(&o);
-		if (v != GET_ARG_A(i)) {
-			L->ci->l.savedpc++;
-		}
-	}
-	else {
-		if ((nb < nc) != GET_ARG_A(i)) {
-			L->ci->l.savedpc++;
-		}
-	}
-}
-
-static void op_le(struct lua_State* L, LClosure* cl, StkId ra, Instruction i) {
-	StkId rb = RK(L, cl, GET_ARG_B(i));
-	StkId rc = RK(L, cl, GET_ARG_C(i));
-	lua_Number nb, nc;
-	if (!luaV_tonumber(L, rb, &nb) || !luaV_tonumber(L, rc, &nc)) {
-		luaT_trycallbinTM(L, rb, rc, TM_LE);
+// OP_CLOSURE: R(A) = a closure of p, whose upvalues are the locals or the
+// upvalues of the running closure cl
+void luaV_pushclosure(struct lua_State* L, LClosure* cl, Proto* p, StkId ra) {
+	LClosure* new_cl = luaF_newLclosure(L, p->sizeupvalues);
+	new_cl->p = p;
+	setgco(ra, obj2gco(new_cl));
 
-		TValue o;
-		setobj(&o, L->top - 1);
-		L->top--;
+	new_cl->upvals[0] = cl->upvals[0];
+	for (int j = 1; j < p->sizeupvalues; j++) {
+		Upvaldesc* up = &p->upvalues[j];
+		if (!up->name) {
+			continue;
+		}
 
-		int v = !l_false(&o);
-		if (v != GET_ARG_A(i)) {
-			L->ci->l.savedpc++;
+		if (up->in_stack) {
+			new_cl->upvals[j] = luaF_findupval(L, cl, up->idx);
 		}
-	}
-	else {
-		if ((nb <= nc) != GET_ARG_A(i)) {
-			L->ci->l.savedpc++;
+		else {
+			new_cl->upvals[j] = cl->upvals[j];
 		}
 	}
 }
 
-static void op_loadbool(struct lua_State* L, LClosure* cl, StkId ra, Instruction i) {
-	setbvalue(ra, GET_ARG_B(i));
-	if (GET_ARG_C(i))
-		L->ci->l.savedpc++;
-}
-
-static void op_loadnil(struct lua_State* L, LClosure* cl, StkId ra, Instruction i) {
-	int a = GET_ARG_A(i);
-	int b = GET_ARG_B(i);
-	for (int i = a; i <= (a+b); i++)
-		setnilvalue(L->ci->l.base + i);
-}
-
-static void op_setupval(struct lua_State* L, LClosure* cl, StkId ra, Instruction i) {
-	setobj(cl->upvals[GET_ARG_B(i)]->v, ra);
-}
-
-static void op_settabup(struct lua_State* L, LClosure* cl, StkId ra, Instruction i) {
-	TValue* upval = cl->upvals[GET_ARG_A(i)]->v;
-	if (!ttistable(upval)) {
-		luaG_runerror(L, "%s", "op_settabup: upval is not table");
-	}
-	struct Table* t = gco2tbl(gcvalue(upval));
-	TValue* v = luaH_set(L, t, RK(L, cl, GET_ARG_B(i)));
-	setobj(v, RK(L, cl, GET_ARG_C(i)));
-}
-
-static void op_newtable(struct lua_State* L, LClosure* cl, StkId ra, Instruction i) {
-	struct Table* t = luaH_new(L);
-	luaH_resize(L, t, GET_ARG_B(i), GET_ARG_C(i));
-	ra->value_.gc = obj2gco(t);
-	ra->tt_ = LUA_TTABLE;
+// The interpreter is one function: cl, k, base and pc live in locals, and
+// every handler is inlined into the dispatch loop below. With GCC/Clang the
+// dispatch uses computed goto (one indirect jump at the end of each handler),
+// other compilers fall back to a plain switch.
+#if defined(__GNUC__) && !defined(LUA_NOJUMPTABLE)
+#define LUA_USE_JUMPTABLE 1
+#else
+#define LUA_USE_JUMPTABLE 0
+#endif
+
+#define RA(i) (base + GET_ARG_A(i))
+#define RB(i) (base + GET_ARG_B(i))
+#define RC(i) (base + GET_ARG_C(i))
+#define RKB(i) (ISK(GET_ARG_B(i)) ? k + (GET_ARG_B(i) - BITRK) : base + GET_ARG_B(i))
+#define RKC(i) (ISK(GET_ARG_C(i)) ? k + (GET_ARG_C(i) - BITRK) : base + GET_ARG_C(i))
+
+// pc only lives in a local, it must be written back before anything that can
+// raise an error (line info) or re-enter the vm
+#define savepc(ci) ((ci)->l.savedpc = pc)
+#define updatebase(ci) (base = (ci)->l.base)
+
+// any call may reallocate the stack, so base has to be reloaded after it
+#define Protect(x) { savepc(ci); x; updatebase(ci); }
+
+// gc safepoint, used after OP_NEWTABLE, OP_CONCAT and OP_CLOSURE. The whole
+// frame stays below top so that every register is marked
+#define checkGC(L) luaC_condgc({ savepc(ci); L->top = ci->top; }, L, updatebase(ci))
+
+#define dojump(i) (pc += cast(int, GET_ARG_sBx(i)))
+#if LUA_USE_JIT
+// while the tracing jit records a loop it sees every instruction before it runs
+#define vmfetch() { i = *(pc++); ra = RA(i); if (luaJ_recording(L)) luaJ_record(L, cl->p, base, pc - 1); }
+#else
+#define vmfetch() { i = *(pc++); ra = RA(i); }
+#endif
+
+// a hot back edge runs the trace of its loop, the trace hands back the
+// instruction to continue at, which is the back edge itself when the
+// interpreter has to execute it
+#define traceloop() { \
+	if (luaJ_tracing(L)) { \
+		const Instruction* npc_ = luaJ_loop(L, cl->p, base, pc - 1); \
+		if (npc_ != pc - 1) { pc = npc_; vmbreak; } \
+	} \
 }
 
-static void op_setlist(struct lua_State* L, LClosure* cl, StkId ra, Instruction i) {
-	if (!ttistable(ra)) {
-		luaG_runerror(L, "%s", "op_setlist: ra is not table type");
-	}
-
-	struct Table* t = gco2tbl(gcvalue(ra));
-	int b = GET_ARG_B(i);
-	int c = GET_ARG_C(i);
-
-	int count = 0;
-	if (b == 0) {
-		count = L->top - ra - 1;
-	}
-	else {
-		count = b;
-	}
-
-	int base = (c - 1) * LFIELD_PER_FLUSH;
-	for (int i = 1; i <= count; i++) {
-		luaH_setint(L, t, base + i, ra + i);
+#if LUA_USE_JUMPTABLE
+#define vmdispatch(o) goto *disptab[o];
+#define vmcase(l) L_##l:
+#define vmbreak vmfetch(); vmdispatch(GET_OPCODE(i));
+#else
+#define vmdispatch(o) switch(o)
+#define vmcase(l) case l:
+#define vmbreak break
+#endif
+
+// integer operations wrap around like lua 5.3
+#define intop(op, v1, v2) l_castU2S(l_castS2U(v1) op l_castS2U(v2))
+
+// the fast paths write the results in place, without the setters of luastate.c
+#define chgivalue(o, x) { TValue* io_ = (o); io_->value_.i = (x); io_->tt_ = LUA_NUMINT; }
+#define chgfltvalue(o, x) { TValue* io_ = (o); io_->value_.n = (x); io_->tt_ = LUA_NUMFLT; }
+
+// quickening: a generic instruction that sees the common operand types rewrites
+// itself into a specialized opcode, and the specialized opcode rewrites itself
+// back (and executes again as the generic one) as soon as its guard fails.
+// A function whose instructions keep flipping stops being specialized.
+// luaV_setquicken switches it at runtime, LUA_NOQUICKEN compiles it out
+#if !defined(LUA_NOQUICKEN)
+#define LUA_USE_QUICKEN 1
+#else
+#define LUA_USE_QUICKEN 0
+#endif
+
+#define MAXDEOPT 64
+
+#if LUA_USE_QUICKEN
+#define quicken(op) { if (G(L)->quickening && !cl->p->noquicken) SET_OPCODE(*cast(Instruction*, pc - 1), op); }
+#else
+#define quicken(op) ((void)0)
+#endif
+
+// pc - 1 is the instruction being executed, so pc-- makes vmbreak fetch it again
+#define deopt(op) { luaV_deopt(cl->p, pc - 1, op); pc--; }
+
+static void luaV_deopt(Proto* p, const Instruction* pc, int op) {
+	SET_OPCODE(*cast(Instruction*, pc), op);
+	if (++p->ndeopt >= MAXDEOPT) {
+		p->noquicken = 1;
 	}
 }
 
-static void op_settable(struct lua_State* L, LClosure* cl, StkId ra, Instruction i) {
-	TValue* tv = L->ci->l.base + GET_ARG_A(i);
-	if (tv->tt_ != LUA_TTABLE) {
-		luaG_runerror(L, "%s", "op_settable: ra is not table type");
-	}
+// the inline cache of the instruction being executed
+#define icache() (&cl->p->cache[pc - 1 - cl->p->code])
+
+// t[key] and t[key] = v for a table t and a constant short string key, a cache
+// hit is a compare and a load, everything else goes the way of luaV_gettable
+// and luaV_settable
+#define gettablecached(t, key, v) { \
+	const TValue* slot = luaH_getshrstrcached(L, hvalue(t), tsvalue(key), icache()); \
+	if (!ttisnil(slot)) { setobj(v, cast(TValue*, slot)); } \
+	else Protect(luaV_finishget(L, t, key, v, cast(TValue*, slot))); }
+
+#define settablecached(t, key, v) { \
+	TValue* slot = cast(TValue*, luaH_getshrstrcached(L, hvalue(t), tsvalue(key), icache())); \
+	if (!ttisnil(slot)) { setobj(slot, v); luaH_chainwrite(L, hvalue(t)); luaC_barrierback(L, hvalue(t), slot); } \
+	else Protect(luaV_finishset(L, t, key, v, slot)); }
+
+#define tonumber(o, pn) (ttisfloat(o) ? (*(pn) = (o)->value_.n, 1) : luaV_tonumber(L, o, pn))
+
+// '+', '-' and '*': integer x integer stays an integer, a float operand turns it
+// into a float operation, anything else goes to luaO_arith and the metamethods
+#define op_arithfast(L, iop, fop, op, event, iquick, fquick) { \
+	TValue* rb = RKB(i); \
+	TValue* rc = RKC(i); \
+	lua_Number nb, nc; \
+	if (ttisinteger(rb) && ttisinteger(rc)) { \
+		chgivalue(ra, intop(iop, rb->value_.i, rc->value_.i)); \
+		quicken(iquick); \
+	} \
+	else if (tonumber(rb, &nb) && tonumber(rc, &nc)) { \
+		if (ttisfloat(rb) && ttisfloat(rc)) quicken(fquick); \
+		chgfltvalue(ra, nb fop nc); \
+	} \
+	else op_arith(L, op, event); }
+
+// the quickened forms of op_arithfast, generic is the opcode to fall back to
+#define op_arith_ii(iop, generic) { \
+	TValue* rb = RKB(i); \
+	TValue* rc = RKC(i); \
+	if (ttisinteger(rb) && ttisinteger(rc)) { \
+		chgivalue(ra, intop(iop, rb->value_.i, rc->value_.i)); \
+	} \
+	else deopt(generic); }
+
+#define op_arith_ff(fop, generic) { \
+	TValue* rb = RKB(i); \
+	TValue* rc = RKC(i); \
+	if (ttisfloat(rb) && ttisfloat(rc)) { \
+		chgfltvalue(ra, rb->value_.n fop rc->value_.n); \
+	} \
+	else deopt(generic); }
+
+#define op_arith(L, op, event) { \
+	TValue* rb = RKB(i); \
+	TValue* rc = RKC(i); \
+	TValue o; \
+	setobj(&o, rb); \
+	savepc(ci); \
+	if (!luaO_arith(L, op, &o, rc)) { \
+		Protect(luaT_trycallbinTM(L, &o, rc, event)); \
+		setobj(&o, L->top - 1); \
+		L->top--; \
+	} \
+	setobj(RA(i), &o); }
+
+#define op_order(L, cmp, event, iquick) { \
+	TValue* rb = RKB(i); \
+	TValue* rc = RKC(i); \
+	lua_Number nb, nc; \
+	int res; \
+	if (ttisinteger(rb) && ttisinteger(rc)) { \
+		res = (rb->value_.i cmp rc->value_.i); \
+		quicken(iquick); \
+	} \
+	else if (!tonumber(rb, &nb) || !tonumber(rc, &nc)) { \
+		Protect(luaT_trycallbinTM(L, rb, rc, event)); \
+		res = !l_false(L->top - 1); \
+		L->top--; \
+	} \
+	else { \
+		res = (nb cmp nc); \
+	} \
+	if (res != GET_ARG_A(i)) pc++; }
+
+#define op_order_ii(cmp, generic) { \
+	TValue* rb = RKB(i); \
+	TValue* rc = RKC(i); \
+	if (ttisinteger(rb) && ttisinteger(rc)) { \
+		if ((rb->value_.i cmp rc->value_.i) != GET_ARG_A(i)) pc++; \
+	} \
+	else deopt(generic); }
 
-	struct Table* t = gco2tbl(gcvalue(tv));
-	StkId rb, rc;
-	int b = GET_ARG_B(i);
-	int c = GET_ARG_C(i);
-	if (ISK(b)) {
-		rb = &cl->p->k[b - MAININDEXRK - 1];
-	}
-	else {
-		rb = L->ci->l.base + b;
+void luaV_execute(struct lua_State* L) {
+	struct CallInfo* ci = L->ci;
+	LClosure* cl;
+	TValue* k;
+	StkId base;
+	const Instruction* pc;
+	Instruction i;
+	StkId ra;
+
+#if LUA_USE_JUMPTABLE
+	// must follow the order of enum OpCode
+	static const void* const disptab[NUM_OPCODES] = {
+		&&L_OP_MOVE, &&L_OP_LOADK, &&L_OP_GETUPVAL, &&L_OP_CALL, &&L_OP_TAILCALL,
+		&&L_OP_RETURN, &&L_OP_GETTABUP, &&L_OP_GETTABLE, &&L_OP_SELF, &&L_OP_TEST,
+		&&L_OP_TESTSET, &&L_OP_JUMP, &&L_OP_UNM, &&L_OP_LEN, &&L_OP_BNOT,
+		&&L_OP_NOT, &&L_OP_ADD, &&L_OP_SUB, &&L_OP_MUL, &&L_OP_DIV,
+		&&L_OP_IDIV, &&L_OP_MOD, &&L_OP_POW, &&L_OP_BAND, &&L_OP_BOR,
+		&&L_OP_BXOR, &&L_OP_SHL, &&L_OP_SHR, &&L_OP_CONCAT, &&L_OP_EQ,
+		&&L_OP_LT, &&L_OP_LE, &&L_OP_LOADBOOL, &&L_OP_LOADNIL, &&L_OP_SETUPVAL,
+		&&L_OP_SETTABUP, &&L_OP_NEWTABLE, &&L_OP_SETLIST, &&L_OP_SETTABLE, &&L_OP_FORPREP,
+		&&L_OP_FORLOOP, &&L_OP_TFORCALL, &&L_OP_TFORLOOP, &&L_OP_CLOSURE,
+		&&L_OP_VARARG, &&L_OP_EXTRAARG, &&L_OP_ADD_II, &&L_OP_ADD_FF, &&L_OP_SUB_II, &&L_OP_SUB_FF,
+		&&L_OP_MUL_II, &&L_OP_MUL_FF, &&L_OP_LT_II, &&L_OP_LE_II, &&L_OP_GETTABLE_INT,
+		&&L_OP_GETTABLE_SHRSTR,
+	};
+#endif
+
+	ci->callstatus |= CIST_FRESH;
+
+	// every lua to lua call and return jumps back here with the new ci
+newframe:
+	lua_assert(ci == L->ci);
+	cl = gco2lclosure(gcvalue(ci->func));
+	k = cl->p->k;
+	base = ci->l.base;
+	pc = ci->l.savedpc;
+
+	// a function compiled ahead of time runs as c code, which hands back the
+	// instruction the interpreter has to execute, or NULL once it has set up
+	// the frame of a lua function it calls
+	if (cl->p->aot) {
+		pc = cl->p->aot(L, ci, pc);
+		if (pc == NULL) {
+			ci = L->ci;
+			goto newframe;
+		}
+		updatebase(ci);
 	}
 
-	if (ISK(c)) {
-		rc = &cl->p->k[c - MAININDEXRK - 1];
-	}
-	else {
-		rc = L->ci->l.base + c;
+	// a call enters the native code of a compiled function right away, the
+	// interpreter takes over at the first instruction it does not handle
+	if (luaJ_canrun(L, cl->p) && pc == cl->p->code) {
+		pc = luaJ_execute(L, cl->p, base, pc);
 	}
 
-	luaV_settable(L, tv, rb, rc);
-}
-
-static void op_forprep(struct lua_State* L, LClosure* cl, StkId ra, Instruction i) {
-	StkId step_ptr = ra + 2;
-	if (!ttisinteger(step_ptr) && !ttisfloat(step_ptr)) {
-		luaG_runerror(L, "%s", "op_forprep:step type error");
-	}
-	
-	int arith_ret = luaO_arith(L, LUA_OPT_SUB, ra, step_ptr);
-	if (!arith_ret) {
-		luaG_runerror(L, "%s", "op_forprep:arith error");
-	}
+	// debug_print(L);
 
-	int sbx = GET_ARG_sBx(i);
-	L->ci->l.savedpc += sbx;
-}
+	for (;;) {
+		vmfetch();
+		vmdispatch(GET_OPCODE(i)) {
+			vmcase(OP_MOVE) {
+				setobj(ra, RB(i));
+			} vmbreak;
+			vmcase(OP_LOADK) {
+				setobj(ra, k + GET_ARG_Bx(i));
+			} vmbreak;
+			vmcase(OP_GETUPVAL) {
+				UpVal* upval = cl->upvals[GET_ARG_B(i)];
+				if (!upval) {
+					savepc(ci);
+					luaG_runerror(L, "%s", "op_getupval:upval is not exist");
+				}
+				setobj(ra, upval->v);
+			} vmbreak;
+			vmcase(OP_CALL) {
+				int narg = GET_ARG_B(i);
+				int nresult = GET_ARG_C(i) - 1;
+				if (narg > 0) {
+					L->top = ra + narg;
+				}
 
-static void op_forloop(struct lua_State* L, LClosure* cl, StkId ra, Instruction i) {
-	StkId limit = ra + 1;
-	StkId step_ptr = ra + 2;
-	StkId local_var = ra + 3;
+				savepc(ci);
+				if (luaD_precall(L, ra, nresult)) { // c function
+					if (nresult >= 0) {
+						L->top = ci->top;
+					}
+					updatebase(ci);
+				}
+				else { // lua function, run it in this loop instead of recursing
+					ci = L->ci;
+					goto newframe;
+				}
+			} vmbreak;
+			vmcase(OP_TAILCALL) {
+				int narg = GET_ARG_B(i);
+				if (narg > 0) {
+					L->top = ra + narg;
+				}
 
-	lua_assert(ttisinteger(limit) || ttisfloat(limit));
-	lua_assert(ttisinteger(step_ptr) || ttisfloat(step_ptr));
+				// the current frame is about to be reused, close its upvalues first.
+				// only closures of the nested functions can capture locals
+				if (cl->p->sizep > 0) {
+					luaF_close(L, cl);
+				}
 
-	int arith_ret = luaO_arith(L, LUA_OPT_ADD, ra, step_ptr);
-	if (!arith_ret) {
-		luaG_runerror(L, "%s", "op_forloop:arith error");
-	}
+				savepc(ci);
+				if (luaD_precall(L, ra, LUA_MULRET)) { // c function, the following OP_RETURN passes its results on
+					updatebase(ci);
+				}
+				else {
+					// move the callee and its fixed arguments down into the current frame
+					struct CallInfo* nci = L->ci;
+					StkId nfunc = nci->func;
+					StkId ofunc = ci->func;
+					StkId lim = nci->l.base + gco2lclosure(gcvalue(nfunc))->p->nparam;
+					for (int aux = 0; nfunc + aux < lim; aux++) {
+						setobj(ofunc + aux, nfunc + aux);
+					}
+
+					ci->l.base = ofunc + (nci->l.base - nfunc);
+					ci->top = L->top = ofunc + (L->top - nfunc);
+					ci->l.savedpc = nci->l.savedpc;
+					ci->callstatus |= CIST_TAIL;
+					L->ci = ci;
+					goto newframe;
+				}
+			} vmbreak;
+			vmcase(OP_RETURN) {
+				if (cl->p->sizep > 0) {
+					luaF_close(L, cl);
+				}
 
-	lua_Number v1, v2, v3;
-	luaV_tonumber(L, ra, &v1);
-	luaV_tonumber(L, limit, &v2);
-	luaV_tonumber(L, step_ptr, &v3);
-	int sbx = GET_ARG_sBx(i);
+				int b = GET_ARG_B(i);
+				int nwant = ci->nresult;
+				luaD_poscall(L, ra, b ? (b - 1) : (int)(L->top - ra));
 
-	if (v3 >= 0) {
-		if (v1 <= v2) {
-			L->ci->l.savedpc += sbx;
-			setobj(local_var, ra);
-		}
-	}
-	else {
-		if (v1 >= v2) {
-			L->ci->l.savedpc += sbx;
-			setobj(local_var, ra);
-		}
-	}
-}
+				// this frame was called from c (luaD_call), so give control back
+				if (ci->callstatus & CIST_FRESH) {
+					return;
+				}
 
-static void op_tforcall(struct lua_State* L, LClosure* cl, StkId ra, Instruction i) {
-	StkId temp_ra3 = ra + 3;
-	StkId temp_ra4 = ra + 4;
-	StkId temp_ra5 = ra + 5;
+				// back to the calling lua function
+				ci = L->ci;
+				if (nwant != LUA_MULRET) {
+					L->top = ci->top;
+				}
+				lua_assert(GET_OPCODE(*(ci->l.savedpc - 1)) == OP_CALL || GET_OPCODE(*(ci->l.savedpc - 1)) == OP_TFORCALL);
+				goto newframe;
+			}
+			vmcase(OP_GETTABUP) {
+				// globals: _ENV.name goes through the inline cache, which is
+				// invalidated by itself when _G is resized
+				TValue* upval = cl->upvals[GET_ARG_B(i)]->v;
+				TValue* rc = RKC(i);
+				if (ttistable(upval) && ttisshrstr(rc) && ISK(GET_ARG_C(i))) {
+					gettablecached(upval, rc, ra);
+				}
+				else Protect(luaV_gettable(L, upval, rc, ra));
+			} vmbreak;
+			vmcase(OP_GETTABLE) {
+				TValue* vt = RB(i);
+				if (!ttistable(vt)) {
+					savepc(ci);
+					luaG_runerror(L, "RB is not index to a table; OP_GETTABLE, RA(%d) RB(%d) RC(%d)\n", GET_ARG_A(i), GET_ARG_B(i), GET_ARG_C(i));
+				}
+				TValue* rc = RKC(i);
+				if (ttisshrstr(rc) && ISK(GET_ARG_C(i))) {
+					quicken(OP_GETTABLE_SHRSTR);
+					gettablecached(vt, rc, ra);
+				}
+				else {
+					if (ttisinteger(rc)) {
+						quicken(OP_GETTABLE_INT);
+					}
+					Protect(luaV_gettable(L, vt, rc, ra));
+				}
+			} vmbreak;
+			vmcase(OP_SELF) {
+				TValue* vt = RB(i);
+				if (!ttistable(vt)) {
+					savepc(ci);
+					luaG_runerror(L, "OP_SELF, RA(%d) RB(%d) RC(%d); RB is not index to a table\n", GET_ARG_A(i), GET_ARG_B(i), GET_ARG_C(i));
+				}
+				setobj(ra + 1, vt);
+				TValue* rc = RKC(i);
+				if (ttisshrstr(rc) && ISK(GET_ARG_C(i))) {
+					gettablecached(vt, rc, ra);
+				}
+				else Protect(luaV_gettable(L, vt, rc, ra));
+			} vmbreak;
+			vmcase(OP_TEST) {
+				if (l_false(ra) == GET_ARG_C(i)) {
+					pc++;
+				}
+			} vmbreak;
+			vmcase(OP_TESTSET) {
+				StkId rb = RB(i);
+				if (l_false(rb) != GET_ARG_C(i)) {
+					setobj(ra, rb);
+				}
+				else {
+					pc++;
+				}
+			} vmbreak;
+			vmcase(OP_JUMP) {
+				if (GET_ARG_sBx(i) < 0) traceloop();
+				dojump(i);
+				if (GET_ARG_sBx(i) < 0) { // loop back edge
+					if (luaJ_canrun(L, cl->p)) {
+						pc = luaJ_execute(L, cl->p, base, pc);
+					}
+					else luaJ_hot(L, cl->p);
+				}
+			} vmbreak;
+			vmcase(OP_UNM) {
+				TValue* rb = RB(i);
+				if (ttisinteger(rb)) {
+					chgivalue(ra, intop(-, 0, rb->value_.i));
+					vmbreak;
+				}
+				else if (ttisfloat(rb)) {
+					chgfltvalue(ra, -rb->value_.n);
+					vmbreak;
+				}
 
-	setobj(temp_ra3, ra);
-	setobj(temp_ra4, ra + 1);
-	setobj(temp_ra5, ra + 2);
-	L->top = ra + 6;
+				TValue o;
+				setobj(&o, RB(i));
+				if (!luaO_arith(L, LUA_OPT_UMN, &o, RB(i))) {
+					savepc(ci);
+					luaG_runerror(L, "%s", "op_unm: rb's type is incorrect");
+				}
+				setobj(ra, &o);
+			} vmbreak;
+			vmcase(OP_LEN) {
+				StkId rb = RB(i);
+				if (ttistable(rb)) {
+					struct Table* t = gco2tbl(gcvalue(rb));
+					setivalue(ra, luaH_getn(L, t));
+				}
+				else if (ttisshrstr(rb) || ttislngstr(rb)) {
+					struct TString* ts = gco2ts(gcvalue(rb));
+					int len = ttisshrstr(rb) ? ts->shrlen : ts->u.lnglen;
+					setivalue(ra, len);
+				}
+				else {
+					savepc(ci);
+					luaG_runerror(L, "%s", "op_len: rb's type is incorrect");
+				}
+			} vmbreak;
+			vmcase(OP_BNOT) {
+				TValue o;
+				setobj(&o, RB(i));
+				if (!luaO_arith(L, LUA_OPT_BNOT, &o, RB(i))) {
+					savepc(ci);
+					luaG_runerror(L, "%s", "op_bnot: rb's type is incorrect");
+				}
+				setobj(ra, &o);
+			} vmbreak;
+			vmcase(OP_NOT) {
+				StkId rb = RB(i);
+				setbvalue(ra, l_false(rb));
+			} vmbreak;
+			vmcase(OP_ADD) {
+				op_arithfast(L, +, +, LUA_OPT_ADD, TM_ADD, OP_ADD_II, OP_ADD_FF);
+			} vmbreak;
+			vmcase(OP_SUB) {
+				op_arithfast(L, -, -, LUA_OPT_SUB, TM_SUB, OP_SUB_II, OP_SUB_FF);
+			} vmbreak;
+			vmcase(OP_MUL) {
+				op_arithfast(L, *, *, LUA_OPT_MUL, TM_MUL, OP_MUL_II, OP_MUL_FF);
+			} vmbreak;
+			vmcase(OP_DIV) {
+				TValue* rb = RKB(i);
+				TValue* rc = RKC(i);
+				lua_Number nb, nc;
+				if (tonumber(rb, &nb) && tonumber(rc, &nc)) {
+					chgfltvalue(ra, nb / nc);
+				}
+				else op_arith(L, LUA_OPT_DIV, TM_DIV);
+			} vmbreak;
+			vmcase(OP_IDIV) {
+				TValue* rb = RKB(i);
+				TValue* rc = RKC(i);
+				if (ttisinteger(rb) && ttisinteger(rc)) {
+					lua_Integer r;
+					Protect(r = luaV_div(L, rb->value_.i, rc->value_.i));
+					chgivalue(ra, r);
+				}
+				else op_arith(L, LUA_OPT_IDIV, TM_IDIV);
+			} vmbreak;
+			vmcase(OP_MOD) {
+				TValue* rb = RKB(i);
+				TValue* rc = RKC(i);
+				if (ttisinteger(rb) && ttisinteger(rc)) {
+					lua_Integer r;
+					Protect(r = luaV_mod(L, rb->value_.i, rc->value_.i));
+					chgivalue(ra, r);
+				}
+				else op_arith(L, LUA_OPT_MOD, TM_MOD);
+			} vmbreak;
+			vmcase(OP_POW) {
+				op_arith(L, LUA_OPT_POW, TM_POW);
+			} vmbreak;
+			vmcase(OP_BAND) {
+				op_arith(L, LUA_OPT_BAND, TM_BAND);
+			} vmbreak;
+			vmcase(OP_BOR) {
+				op_arith(L, LUA_OPT_BOR, TM_BOR);
+			} vmbreak;
+			vmcase(OP_BXOR) {
+				op_arith(L, LUA_OPT_BXOR, TM_XOR);
+			} vmbreak;
+			vmcase(OP_SHL) {
+				op_arith(L, LUA_OPT_SHL, TM_SHL);
+			} vmbreak;
+			vmcase(OP_SHR) {
+				op_arith(L, LUA_OPT_SHR, TM_SHR);
+			} vmbreak;
+			vmcase(OP_CONCAT) {
+				int b = GET_ARG_B(i);
+				Protect(luaV_concat(L, base + b, GET_ARG_C(i) - b + 1));
+				setobj(RA(i), base + b);
+				checkGC(L);
+			} vmbreak;
+			vmcase(OP_EQ) {
+				TValue* rb = RKB(i);
+				TValue* rc = RKC(i);
+				int res;
+				if (ttisinteger(rb) && ttisinteger(rc)) {
+					res = (rb->value_.i == rc->value_.i);
+				}
+				else {
+					Protect(res = luaV_eqobject(L, rb, rc));
+				}
+				if (res != GET_ARG_A(i)) {
+					pc++;
+				}
+			} vmbreak;
+			vmcase(OP_LT) {
+				op_order(L, <, TM_LT, OP_LT_II);
+			} vmbreak;
+			vmcase(OP_LE) {
+				op_order(L, <=, TM_LE, OP_LE_II);
+			} vmbreak;
+			vmcase(OP_LOADBOOL) {
+				setbvalue(ra, GET_ARG_B(i));
+				if (GET_ARG_C(i)) {
+					pc++;
+				}
+			} vmbreak;
+			vmcase(OP_LOADNIL) {
+				int b = GET_ARG_B(i);
+				do {
+					setnilvalue(ra++);
+				} while (b--);
+			} vmbreak;
+			vmcase(OP_SETUPVAL) {
+				setobj(cl->upvals[GET_ARG_B(i)]->v, ra);
+			} vmbreak;
+			vmcase(OP_SETTABUP) {
+				TValue* upval = cl->upvals[GET_ARG_A(i)]->v;
+				if (!ttistable(upval)) {
+					savepc(ci);
+					luaG_runerror(L, "%s", "op_settabup: upval is not table");
+				}
+				struct Table* t = gco2tbl(gcvalue(upval));
+				TValue* rb = RKB(i);
+				TValue* v;
+				if (ttisshrstr(rb) && ISK(GET_ARG_B(i))) {
+					v = cast(TValue*, luaH_getshrstrcached(L, t, tsvalue(rb), icache()));
+					if (v == luaO_nilobject) {
+						v = luaH_newkey(L, t, rb);
+					}
+					else if (ttisnil(v)) {
+						invalidateTMcache(t);
+					}
+				}
+				else {
+					v = luaH_set(L, t, rb);
+				}
+				luaH_chainwrite(L, t);
+				setobj(v, RKC(i));
+				luaC_barrierback(L, t, v);
+			} vmbreak;
+			vmcase(OP_NEWTABLE) {
+				struct Table* t = luaH_new(L);
+				int b = GET_ARG_B(i);
+				int c = GET_ARG_C(i);
+				if (b != 0 || c != 0) {
+					luaH_resize(L, t, luaO_fb2int(b), luaO_fb2int(c));
+				}
+				ra->value_.gc = obj2gco(t);
+				ra->tt_ = LUA_TTABLE;
+				checkGC(L);
+			} vmbreak;
+			vmcase(OP_SETLIST) {
+				if (!ttistable(ra)) {
+					savepc(ci);
+					luaG_runerror(L, "%s", "op_setlist: ra is not table type");
+				}
 
-	if (luaD_precall(L, temp_ra3, 2)) { // is c call?
-		L->top = L->ci->top;
-	}
-	else {
-		newframe(L);
-	}
-}
+				struct Table* t = gco2tbl(gcvalue(ra));
+				int n = GET_ARG_B(i);
+				if (n == 0) {
+					n = cast(int, L->top - ra) - 1;
+					L->top = ci->top;
+				}
 
-static void op_tforloop(struct lua_State* L, LClosure* cl, StkId ra, Instruction i) {
-	int sbx = GET_ARG_sBx(i);
-	if (!ttisnil((ra + 1))) {
-		setobj(ra, ra + 1);
-		L->ci->l.savedpc += sbx;
-	}
-}
+				int c = GET_ARG_C(i);
+				if (c == 0) {
+					c = GET_ARG_Bx(*pc++);
+				}
 
-static void op_closure(struct lua_State* L, LClosure* cl, StkId ra, Instruction i) {
-	Proto* proto = cl->p->p[GET_ARG_Bx(i)];
-	LClosure* new_cl = luaF_newLclosure(L, proto->sizeupvalues);
-	new_cl->p = proto;
-	setgco(ra, obj2gco(new_cl));
+				unsigned int first = (c - 1) * LFIELD_PER_FLUSH;
+				luaH_setlist(L, t, first, ra + 1, n);
+			} vmbreak;
+			vmcase(OP_SETTABLE) {
+				if (!ttistable(ra)) {
+					savepc(ci);
+					luaG_runerror(L, "%s", "op_settable: ra is not table type");
+				}
+				TValue* rb = RKB(i);
+				if (ttisshrstr(rb) && ISK(GET_ARG_B(i))) {
+					settablecached(ra, rb, RKC(i));
+				}
+				else Protect(luaV_settable(L, ra, rb, RKC(i)));
+			} vmbreak;
+			vmcase(OP_FORPREP) {
+				// on entry the loop either falls through into its body or
+				// jumps over the OP_FORLOOP that closes it
+				savepc(ci);
+				if (luaV_forprep(L, ra)) {
+					dojump(i);
+					pc++;
+				}
+			} vmbreak;
+			vmcase(OP_FORLOOP) {
+				if (luaJ_canrun(L, cl->p)) { // native code always handles OP_FORLOOP itself
+					pc = luaJ_execute(L, cl->p, base, pc - 1);
+					vmbreak;
+				}
+				luaJ_hot(L, cl->p);
+				traceloop();
+
+				if (ttisinteger(ra + 2)) { // integer loop, count down the precomputed trip count
+					lua_Unsigned count = l_castS2U((ra + 1)->value_.i);
+					if (count > 0) {
+						lua_Integer idx = l_castU2S(l_castS2U(ra->value_.i) + l_castS2U((ra + 2)->value_.i));
+						(ra + 1)->value_.i = l_castU2S(count - 1);
+						ra->value_.i = idx;
+						setivalue(ra + 3, idx);
+						dojump(i);
+					}
+				}
+				else {
+					lua_Number fstep = (ra + 2)->value_.n;
+					lua_Number idx = ra->value_.n + fstep;
+					lua_Number flimit = (ra + 1)->value_.n;
+					if (fstep > 0 ? idx <= flimit : flimit <= idx) {
+						ra->value_.n = idx;
+						setfltvalue(ra + 3, idx);
+						dojump(i);
+					}
+				}
+			} vmbreak;
+			vmcase(OP_TFORCALL) {
+				StkId cb = ra + 3;
+				setobj(cb, ra);
+				setobj(cb + 1, ra + 1);
+				setobj(cb + 2, ra + 2);
+				L->top = cb + 3;
+
+				savepc(ci);
+				if (luaD_precall(L, cb, 2)) { // is c call?
+					L->top = ci->top;
+					updatebase(ci);
+				}
+				else {
+					ci = L->ci;
+					goto newframe;
+				}
+			} vmbreak;
+			vmcase(OP_TFORLOOP) {
+				traceloop();
+				if (!ttisnil(ra + 1)) {
+					setobj(ra, ra + 1);
+					dojump(i);
+				}
+			} vmbreak;
+			vmcase(OP_CLOSURE) {
+				luaV_pushclosure(L, cl, cl->p->p[GET_ARG_Bx(i)], ra);
+				checkGC(L);
+			} vmbreak;
+			vmcase(OP_VARARG) {
+				// the extra arguments stay right below base, see adjust_varargs
+				int b = GET_ARG_B(i) - 1;
+				int n = cast(int, base - ci->func) - cl->p->nparam - 1;
+				if (n < 0) {
+					n = 0;
+				}
 
-	new_cl->upvals[0] = cl->upvals[0];
-	for (int i = 1; i < proto->sizeupvalues; i ++) {
-		Upvaldesc* up = &proto->upvalues[i];
-		if (!up->name) {
-			continue;
-		}
+				if (b < 0) { // load all of them
+					b = n;
+					Protect(luaD_checkstack(L, n));
+					ra = RA(i);
+					L->top = ra + n;
+				}
 
-		if (up->in_stack) {
-			UpVal* found = luaF_findupval(L, cl, up->idx);
-			new_cl->upvals[i] = found;
-		}
-		else {
-			new_cl->upvals[i] = cl->upvals[i];
+				int j;
+				for (j = 0; j < b && j < n; j++) {
+					setobj(ra + j, base - n + j);
+				}
+				for (; j < b; j++) {
+					setnilvalue(ra + j);
+				}
+			} vmbreak;
+			vmcase(OP_EXTRAARG) {
+				// always skipped by the instruction that owns it
+				lua_assert(0);
+			} vmbreak;
+			vmcase(OP_ADD_II) {
+				op_arith_ii(+, OP_ADD);
+			} vmbreak;
+			vmcase(OP_ADD_FF) {
+				op_arith_ff(+, OP_ADD);
+			} vmbreak;
+			vmcase(OP_SUB_II) {
+				op_arith_ii(-, OP_SUB);
+			} vmbreak;
+			vmcase(OP_SUB_FF) {
+				op_arith_ff(-, OP_SUB);
+			} vmbreak;
+			vmcase(OP_MUL_II) {
+				op_arith_ii(*, OP_MUL);
+			} vmbreak;
+			vmcase(OP_MUL_FF) {
+				op_arith_ff(*, OP_MUL);
+			} vmbreak;
+			vmcase(OP_LT_II) {
+				op_order_ii(<, OP_LT);
+			} vmbreak;
+			vmcase(OP_LE_II) {
+				op_order_ii(<=, OP_LE);
+			} vmbreak;
+			vmcase(OP_GETTABLE_INT) {
+				TValue* vt = RB(i);
+				TValue* rc = RKC(i);
+				if (ttistable(vt) && ttisinteger(rc)) {
+					const TValue* slot = luaH_getint(L, hvalue(vt), rc->value_.i);
+					if (!ttisnil(slot)) {
+						setobj(ra, cast(TValue*, slot));
+					}
+					else {
+						Protect(luaV_finishget(L, vt, rc, ra, cast(TValue*, slot)));
+					}
+				}
+				else deopt(OP_GETTABLE);
+			} vmbreak;
+			vmcase(OP_GETTABLE_SHRSTR) {
+				// only quickened for constant keys, so RKC(i) is always the same short string
+				TValue* vt = RB(i);
+				if (ttistable(vt)) {
+					TValue* rc = RKC(i);
+					gettablecached(vt, rc, ra);
+				}
+				else deopt(OP_GETTABLE);
+			} vmbreak;
 		}
 	}
 }
 
-int luaV_tonumber(struct lua_State* L, const TValue* v, lua_Number* n) {
-	int result = 0;
-	if (ttisinteger(v)) {
-		*n = (lua_Number)v->value_.i;
-		result = 1;
-	}
-	else if (ttisfloat(v)) {
-		*n = v->value_.n;
-		result = 1;
-	}
-	return result;
-}
-
-int luaV_tointeger(struct lua_State* L, const TValue* v, lua_Integer* i) {
-	int result = 0;
-	if (ttisinteger(v)) {
-		*i = v->value_.i;
-		result = 1;
-	}
-	else if (ttisfloat(v)) {
-		*i = (lua_Integer)v->value_.n;
-		result = 1;
-	}
-	return result;
-}
-
-void luaV_execute(struct lua_State* L) {
-	L->ci->callstatus |= CIST_FRESH;
-	newframe(L);
-}
-
-static Instruction vmfetch(struct lua_State* L) {
-	Instruction i = *(L->ci->l.savedpc++);
-	return i;
-}
-
-static StkId vmdecode(struct lua_State* L, Instruction i) {
-	StkId ra = L->ci->l.base + GET_ARG_A(i);
-	return ra;
-}
-
-static void print_Instruction(int idx, Instruction i);
-static bool vmexecute(struct lua_State* L, StkId ra, Instruction i) {
-	bool is_loop = true;
-	struct GCObject* gco = gcvalue(L->ci->func);
-	LClosure* cl = gco2lclosure(gco);
-
-	// print_Instruction(0, i);
-
-	switch (GET_OPCODE(i)) {
-	case OP_MOVE: {
-		op_move(L, cl, ra, i);
-	} break;
-	case OP_GETUPVAL: {
-		op_getupval(L, cl, ra, i);
-	} break;
-	case OP_GETTABLE: {
-		op_gettable(L, cl, ra, i);
-	} break;
-	case OP_GETTABUP: {
-		op_gettabup(L, cl, ra, i);
-	} break;
-	case OP_LOADK: {
-		op_loadk(L, cl, ra, i);
-	} break;
-	case OP_CALL: {
-		op_call(L, cl, ra, i);
-	} break;
-	case OP_SELF: {
-		op_self(L, cl, ra, i);
-	} break;
-	case OP_TEST: {
-		op_test(L, cl, ra, i);
-	} break;
-	case OP_TESTSET: {
-		op_testset(L, cl, ra, i);
-	} break;
-	case OP_JUMP: {
-		op_jump(L, cl, ra, i);
-	} break;
-	case OP_UNM: {
-		op_unm(L, cl, ra, i);
-	} break;
-	case OP_LEN: {
-		op_len(L, cl, ra, i);
-	} break;
-	case OP_BNOT: {
-		op_bnot(L, cl, ra, i);
-	} break;
-	case OP_NOT: {
-		op_not(L, cl, ra, i);
-	} break;
-	case OP_ADD: {
-		op_add(L, cl, ra, i);
-	} break;
-	case OP_SUB: {
-		op_sub(L, cl, ra, i);
-	} break;
-	case OP_MUL: {
-		op_mul(L, cl, ra, i);
-	} break;
-	case OP_DIV: {
-		op_div(L, cl, ra, i);
-	} break;
-	case OP_IDIV: {
-		op_idiv(L, cl, ra, i);
-	} break;
-	case OP_MOD: {
-		op_mod(L, cl, ra, i);
-	} break;
-	case OP_POW: {
-		op_pow(L, cl, ra, i);
-	} break;
-	case OP_BAND: {
-		op_band(L, cl, ra, i);
-	} break;
-	case OP_BOR: {
-		op_bor(L, cl, ra, i);
-	} break;
-	case OP_BXOR: {
-		op_bxor(L, cl, ra, i);
-	} break;
-	case OP_SHL: {
-		op_shl(L, cl, ra, i);
-	} break;
-	case OP_SHR: {
-		op_shr(L, cl, ra, i);
-	} break;
-	case OP_CONCAT: {
-		op_concat(L, cl, ra, i);
-	} break;
-	case OP_EQ: {
-		op_eq(L, cl, ra, i);
-	} break;
-	case OP_LT: {
-		op_lt(L, cl, ra, i);
-	} break;
-	case OP_LE: {
-		op_le(L, cl, ra, i);
-	} break;
-	case OP_LOADBOOL: {
-		op_loadbool(L, cl, ra, i);
-	} break;
-	case OP_LOADNIL: {
-		op_loadnil(L, cl, ra, i);
-	} break;
-	case OP_SETUPVAL: {
-		op_setupval(L, cl, ra, i);
-	} break;
-	case OP_SETTABUP: {
-		op_settabup(L, cl, ra, i);
-	} break;
-	case OP_NEWTABLE: {
-		op_newtable(L, cl, ra, i);
-	} break;
-	case OP_SETLIST: {
-		op_setlist(L, cl, ra, i);
-	} break;
-	case OP_SETTABLE: {
-		op_settable(L, cl, ra, i);
-	} break;
-	case OP_FORPREP: {
-		op_forprep(L, cl, ra, i);
-	} break;
-	case OP_FORLOOP: {
-		op_forloop(L, cl, ra, i);
-	} break;
-	case OP_TFORCALL: {
-		op_tforcall(L, cl, ra, i);
-	} break;
-	case OP_TFORLOOP: {
-		op_tforloop(L, cl, ra, i);
-	} break;
-	case OP_CLOSURE: {
-		op_closure(L, cl, ra, i);
-	} break;
-	case OP_RETURN: {
-		op_return(L, cl, ra, i);
-		is_loop = false;
-	} break;
-	default:break;
-	}
-
-	return is_loop;
-}
-
 static void print_TValue(const TValue* v) {
 	switch (v->tt_)
 	{
@@ -894,6 +1184,7 @@ static char* code2name[] = {
 	"OP_LOADK",
 	"OP_GETUPVAL",
 	"OP_CALL",
+	"OP_TAILCALL",
 	"OP_RETURN",
 	"OP_GETTABUP",
 	"OP_GETTABLE",
@@ -932,13 +1223,29 @@ static char* code2name[] = {
 	"OP_FORLOOP",
 	"OP_TFORCALL",
 	"OP_TFORLOOP",
-	"OP_CLOSURE"
+	"OP_CLOSURE",
+	"OP_VARARG",
+	"OP_EXTRAARG",
+	"OP_ADD_II",
+	"OP_ADD_FF",
+	"OP_SUB_II",
+	"OP_SUB_FF",
+	"OP_MUL_II",
+	"OP_MUL_FF",
+	"OP_LT_II",
+	"OP_LE_II",
+	"OP_GETTABLE_INT",
+	"OP_GETTABLE_SHRSTR",
 };
 
 static void print_Instruction(int idx, Instruction i) {
 	switch (luaP_opmodes[GET_OPCODE(i)] & 0x03) {
 	case iABC: {
-		printf("[%d] opcode(%s) ra(%d) rb(%d) rc(%d) \n", idx, code2name[GET_OPCODE(i)], GET_ARG_A(i), GET_ARG_B(i), GET_ARG_C(i));
+		printf("[%d] opcode(%s) ra(%d) rb(%d) rc(%d) ", idx, code2name[GET_OPCODE(i)], GET_ARG_A(i), GET_ARG_B(i), GET_ARG_C(i));
+		if (luaP_genericop(GET_OPCODE(i)) != GET_OPCODE(i)) {
+			printf("quickened from %s", code2name[luaP_genericop(GET_OPCODE(i))]);
+		}
+		printf("\n");
 	} break;
 	case iABx: {
 		printf("[%d] opcode(%s) ra(%d) bx(%d) \n", idx, code2name[GET_OPCODE(i)], GET_ARG_A(i), GET_ARG_Bx(i));
@@ -970,15 +1277,23 @@ static void debug_print(struct lua_State* L) {
 	printf("\n");
 }
 
-static void newframe(struct lua_State* L) {
-	// debug_print(L);
+void luaV_setquicken(struct lua_State* L, int enable) {
+	G(L)->quickening = cast(lu_byte, enable ? 1 : 0);
+}
 
-	int count = 0;
-	bool is_loop = true;
-	while (is_loop) {
-		Instruction i = vmfetch(L);
-		StkId ra = vmdecode(L, i);
-		is_loop = vmexecute(L, ra, i);
-		count++;
+// print the code of p and of every nested function as it is now, so the
+// quickened instructions show up next to the generic ones
+void luaV_dumpcode(Proto* p) {
+	printf("function <%s:%d> %d instructions, %d deopts%s\n", p->source ? getstr(p->source) : "?",
+		p->sizeline > 0 ? p->line[0] : 0, p->sizecode, p->ndeopt, p->noquicken ? " (not quickened)" : "");
+	for (int i = 0; i < p->sizecode; i++) {
+		print_Instruction(i, p->code[i]);
 	}
-}
\ No newline at end of file
+	printf("\n");
+
+	for (int i = 0; i < p->sizep; i++) {
+		if (p->p[i]) {
+			luaV_dumpcode(p->p[i]);
+		}
+	}
+}
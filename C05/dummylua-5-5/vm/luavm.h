@@ -36,7 +36,7 @@ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
     (!ttistable(t) ? (slot = NULL, 0) : \
      (slot = cast(TValue*, get(L, hvalue(t), k)), \
         (ttisnil(slot) ? (0) : \
-            (setobj(slot, v), \
+            (setobj(slot, v), luaH_chainwrite(L, hvalue(t)), \
             luaC_barrierback(L, hvalue(t), slot), 1))))
 
 #define luaV_settable(L, t, k, v) { TValue* slot = NULL; \
@@ -47,9 +47,29 @@ void luaV_finishget(struct lua_State* L, TValue* t, const StkId key, StkId val,
 void luaV_finishset(struct lua_State* L, TValue* t, const TValue* key, StkId val, TValue* slot);
 int luaV_eqobject(struct lua_State* L, const TValue* a, const TValue* b);
 
+// the n values from first on joined into first, see OP_CONCAT
+void luaV_concat(struct lua_State* L, StkId first, int total);
+
 int luaV_tonumber(struct lua_State* L, const TValue* v, lua_Number* n);
 int luaV_tointeger(struct lua_State* L, const TValue* v, lua_Integer* i);
 
+// integer floor division, modulo and shift with lua semantics
+lua_Integer luaV_div(struct lua_State* L, lua_Integer m, lua_Integer n);
+lua_Integer luaV_mod(struct lua_State* L, lua_Integer m, lua_Integer n);
+lua_Integer luaV_shiftl(lua_Integer x, lua_Integer y);
+
+// the parts of OP_FORPREP and OP_CLOSURE that code compiled ahead of time
+// shares with the interpreter, see luaaot.h
+int luaV_forprep(struct lua_State* L, StkId ra);
+void luaV_pushclosure(struct lua_State* L, LClosure* cl, Proto* p, StkId ra);
+
 void luaV_execute(struct lua_State* L);
 
+// quickening is on by default, turn it off to run the generic opcodes only, the
+// instructions that are already specialized go back when their guard fails
+void luaV_setquicken(struct lua_State* L, int enable);
+
+// print the current (possibly quickened) bytecode of p and its nested functions
+void luaV_dumpcode(Proto* p);
+
 #endif